@@ -0,0 +1,647 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <atomic>
+#include <new>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <benchmark/benchmark.h>
+#include "camera.h"
+#include "image.h"
+#include "image_proc.h"
+
+///////////////////////////////////////////////////////////////////////
+// Micro-benchmarks for the Image codecs and pixel operations.
+//
+// Every benchmark reports:
+//      bytes_per_second - raw RGB bytes encoded/decoded/compared
+//      frames/s         - whole images processed per second
+//      allocs/iter      - calls to operator new per iteration
+//
+// Run with --benchmark_out=result.json --benchmark_out_format=json (or
+// build the image_bench_json target) and diff two reports with
+// benchmark's tools/compare.py to catch codec regressions.
+///////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+// Allocation counting
+// NOTE:
+//      The global operator new is replaced for this executable only so
+//      that each benchmark can report how many heap allocations a single
+//      iteration performs. libjpeg/libpng use malloc directly, so only
+//      allocations made by the Image class itself are counted.
+//
+//      Every form of new and delete is replaced, so any pair matches.
+//      They go through out of line helpers: with malloc()/free() inlined
+//      GCC pairs a new expression with free() and warns
+//      (-Wmismatched-new-delete).
+///////////////////////////////////////////////////////////////////////
+static std::atomic<uint64_t> g_allocCount{0};
+
+__attribute__((noinline)) static void* counted_alloc(std::size_t size, std::size_t align)
+{
+    g_allocCount.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    if (align <= alignof(std::max_align_t)) return std::malloc(size);
+    void* p = nullptr;
+    return posix_memalign(&p, align, size) == 0 ? p : nullptr;
+}
+
+__attribute__((noinline)) static void counted_free(void* p)
+{
+    std::free(p);
+}
+
+void* operator new(std::size_t size)
+{
+    if (void* p = counted_alloc(size, 0)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t align)
+{
+    if (void* p = counted_alloc(size, static_cast<std::size_t>(align))) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+void* operator new[](std::size_t size, std::align_val_t align) { return operator new(size, align); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size, 0); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size, 0); }
+void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return counted_alloc(size, static_cast<std::size_t>(align));
+}
+void* operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return counted_alloc(size, static_cast<std::size_t>(align));
+}
+
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete[](void* p) noexcept { counted_free(p); }
+void operator delete(void* p, std::size_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::size_t) noexcept { counted_free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { counted_free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { counted_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { counted_free(p); }
+
+///////////////////////////////////////////////////////////////////////
+// Helpers
+///////////////////////////////////////////////////////////////////////
+
+// Fill an image with a gradient plus a little noise, so the codecs have
+// realistic work to do (flat images compress unrealistically well)
+static void fill_test_pattern(Image& image, int width, int height)
+{
+    uint32_t seed = 0x12345678u;
+    for (int y = 0; y < height; y++)
+    {
+        uint8_t* row = image.m_data + 3 * width * y;
+        for (int x = 0; x < width; x++)
+        {
+            seed = seed * 1664525u + 1013904223u;   // LCG noise
+            uint8_t noise = (seed >> 24) & 0x0F;
+            row[3 * x + 0] = static_cast<uint8_t>((x * 255) / width + noise);
+            row[3 * x + 1] = static_cast<uint8_t>((y * 255) / height + noise);
+            row[3 * x + 2] = static_cast<uint8_t>(((x + y) * 127) / (width + height) + noise);
+        }
+    }
+}
+
+// Temporary file path that is unique per benchmark
+static std::string temp_path(const std::string& name)
+{
+    return (std::filesystem::temp_directory_path() / ("image_bench_" + name)).string();
+}
+
+// Attach the standard counters to a finished benchmark
+static void report(benchmark::State& state, int width, int height, uint64_t allocs)
+{
+    const int64_t frameBytes = static_cast<int64_t>(width) * height * 3;
+    state.SetBytesProcessed(state.iterations() * frameBytes);
+    state.counters["frames"] = benchmark::Counter(
+        static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+    state.counters["allocs/iter"] = benchmark::Counter(
+        static_cast<double>(allocs), benchmark::Counter::kAvgIterations);
+}
+
+///////////////////////////////////////////////////////////////////////
+// JPEG
+// Args: width, height, quality
+///////////////////////////////////////////////////////////////////////
+static void BM_SaveJPEG(benchmark::State& state)
+{
+    const int width = static_cast<int>(state.range(0));
+    const int height = static_cast<int>(state.range(1));
+    const int quality = static_cast<int>(state.range(2));
+    const std::string path = temp_path("save_" + std::to_string(width) + "_" +
+        std::to_string(quality) + ".jpg");
+
+    Image image(width, height);
+    fill_test_pattern(image, width, height);
+
+    uint64_t allocs = g_allocCount.load();
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(image.SaveJPEG(path, quality));
+    }
+    allocs = g_allocCount.load() - allocs;
+
+    report(state, width, height, allocs);
+    state.counters["file_bytes"] = static_cast<double>(std::filesystem::file_size(path));
+    std::filesystem::remove(path);
+}
+
+static void BM_OpenJPEG(benchmark::State& state)
+{
+    const int width = static_cast<int>(state.range(0));
+    const int height = static_cast<int>(state.range(1));
+    const int quality = static_cast<int>(state.range(2));
+    const std::string path = temp_path("open_" + std::to_string(width) + "_" +
+        std::to_string(quality) + ".jpg");
+
+    Image source(width, height);
+    fill_test_pattern(source, width, height);
+    if (!source.SaveJPEG(path, quality))
+    {
+        state.SkipWithError("Failed to prepare JPEG");
+        return;
+    }
+
+    uint64_t allocs = g_allocCount.load();
+    for (auto _ : state)
+    {
+        Image loaded;
+        benchmark::DoNotOptimize(loaded.OpenJPEG(path));
+    }
+    allocs = g_allocCount.load() - allocs;
+
+    report(state, width, height, allocs);
+    std::filesystem::remove(path);
+}
+
+///////////////////////////////////////////////////////////////////////
+// PNG
+// Args: width, height
+///////////////////////////////////////////////////////////////////////
+static void BM_SavePNG(benchmark::State& state)
+{
+    const int width = static_cast<int>(state.range(0));
+    const int height = static_cast<int>(state.range(1));
+    const std::string path = temp_path("save_" + std::to_string(width) + ".png");
+
+    Image image(width, height);
+    fill_test_pattern(image, width, height);
+
+    uint64_t allocs = g_allocCount.load();
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(image.SavePNG(path));
+    }
+    allocs = g_allocCount.load() - allocs;
+
+    report(state, width, height, allocs);
+    state.counters["file_bytes"] = static_cast<double>(std::filesystem::file_size(path));
+    std::filesystem::remove(path);
+}
+
+static void BM_OpenPNG(benchmark::State& state)
+{
+    const int width = static_cast<int>(state.range(0));
+    const int height = static_cast<int>(state.range(1));
+    const std::string path = temp_path("open_" + std::to_string(width) + ".png");
+
+    Image source(width, height);
+    fill_test_pattern(source, width, height);
+    if (!source.SavePNG(path))
+    {
+        state.SkipWithError("Failed to prepare PNG");
+        return;
+    }
+
+    uint64_t allocs = g_allocCount.load();
+    for (auto _ : state)
+    {
+        Image loaded;
+        benchmark::DoNotOptimize(loaded.OpenPNG(path));
+    }
+    allocs = g_allocCount.load() - allocs;
+
+    report(state, width, height, allocs);
+    std::filesystem::remove(path);
+}
+
+///////////////////////////////////////////////////////////////////////
+// In-memory codecs through the registry, lossless QOI against PNG/JPEG
+// Args: width, height, format (ImageFormat)
+///////////////////////////////////////////////////////////////////////
+static void BM_Encode(benchmark::State& state)
+{
+    const int width = static_cast<int>(state.range(0));
+    const int height = static_cast<int>(state.range(1));
+    const ImageFormat format = static_cast<ImageFormat>(state.range(2));
+    state.SetLabel(Image::FormatName(format));
+
+    Image image(width, height);
+    fill_test_pattern(image, width, height);
+    std::vector<uint8_t> encoded;
+
+    uint64_t allocs = g_allocCount.load();
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(image.Encode(encoded, format, 90));
+    }
+    allocs = g_allocCount.load() - allocs;
+
+    report(state, width, height, allocs);
+    state.counters["encoded_bytes"] = static_cast<double>(encoded.size());
+}
+
+static void BM_Decode(benchmark::State& state)
+{
+    const int width = static_cast<int>(state.range(0));
+    const int height = static_cast<int>(state.range(1));
+    const ImageFormat format = static_cast<ImageFormat>(state.range(2));
+    state.SetLabel(Image::FormatName(format));
+
+    Image source(width, height);
+    fill_test_pattern(source, width, height);
+    std::vector<uint8_t> encoded;
+    if (!source.Encode(encoded, format, 90))
+    {
+        state.SkipWithError("Failed to prepare image");
+        return;
+    }
+
+    Image decoded;
+    uint64_t allocs = g_allocCount.load();
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(decoded.Decode(encoded.data(), encoded.size()));
+    }
+    allocs = g_allocCount.load() - allocs;
+
+    report(state, width, height, allocs);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Reduced scale JPEG decode (scaled in the IDCT), what a consumer that
+// only needs a thumbnail pays for an MJPEG frame. Uses a camera-like
+// frame: with the heavy noise of fill_test_pattern() Huffman decoding
+// dominates and hides the IDCT savings.
+// Args: width, height, scale (1, 2, 4, 8)
+///////////////////////////////////////////////////////////////////////
+static void BM_DecodeJPEGScaled(benchmark::State& state)
+{
+    const int width = static_cast<int>(state.range(0));
+    const int height = static_cast<int>(state.range(1));
+    const int scale = static_cast<int>(state.range(2));
+
+    Image source;
+    SyntheticCamera camera(width, height, 0.0, 4);
+    camera.Render(source, 5);
+    std::vector<uint8_t> encoded;
+    if (!source.EncodeJPEG(encoded, 80))
+    {
+        state.SkipWithError("Failed to prepare image");
+        return;
+    }
+
+    Image decoded;
+    uint64_t allocs = g_allocCount.load();
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(decoded.DecodeJPEG(encoded.data(), encoded.size(), scale));
+    }
+    allocs = g_allocCount.load() - allocs;
+
+    report(state, width, height, allocs);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Rotating a JPEG 90 degrees: in the DCT domain vs decode, turn the
+// pixels and encode again
+///////////////////////////////////////////////////////////////////////
+static void BM_RotateJPEG(benchmark::State& state)
+{
+    const int width = static_cast<int>(state.range(0));
+    const int height = static_cast<int>(state.range(1));
+    const bool lossless = state.range(2) != 0;
+
+    Image source;
+    SyntheticCamera camera(width, height, 0.0, 4);
+    camera.Render(source, 5);
+    std::vector<uint8_t> encoded;
+    if (!source.EncodeJPEG(encoded, 80))
+    {
+        state.SkipWithError("Failed to prepare image");
+        return;
+    }
+
+    JPEGTransform transform;
+    transform.type = JPEGTransformType::Rotate90;
+    std::vector<uint8_t> out;
+    Image decoded, rotated(height, width);
+    uint64_t allocs = g_allocCount.load();
+    for (auto _ : state)
+    {
+        if (lossless)
+        {
+            benchmark::DoNotOptimize(Image::TransformJPEG(encoded.data(), encoded.size(), out, transform));
+            continue;
+        }
+        decoded.DecodeJPEG(encoded.data(), encoded.size());
+        for (int y = 0; y < width; y++)
+        {
+            for (int x = 0; x < height; x++)
+            {
+                const uint8_t* p = decoded.m_data + (static_cast<size_t>(height - 1 - x) * width + y) * 3;
+                uint8_t* q = rotated.m_data + (static_cast<size_t>(y) * height + x) * 3;
+                q[0] = p[0];
+                q[1] = p[1];
+                q[2] = p[2];
+            }
+        }
+        benchmark::DoNotOptimize(rotated.EncodeJPEG(out, 80));
+    }
+    allocs = g_allocCount.load() - allocs;
+
+    report(state, width, height, allocs);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Downsampling one frame for three consumers (half size, quarter size
+// and a 320 wide thumbnail), each resizing the full frame itself against
+// all of them sharing the frame's pyramid.
+// Args: w, h, 0 = independent resizes, 1 = shared pyramid
+///////////////////////////////////////////////////////////////////////
+static void BM_FramePyramid(benchmark::State& state)
+{
+    const int width = static_cast<int>(state.range(0));
+    const int height = static_cast<int>(state.range(1));
+    const bool shared = state.range(2) != 0;
+    const int sizes[][2] = {{width / 2, height / 2}, {width / 4, height / 4}, {320, 320 * height / width}};
+
+    Image frame;
+    SyntheticCamera camera(width, height, 0.0, 4);
+    camera.Render(frame, 5);
+    Image scratch[3];
+    uint64_t allocs = 0;
+    for (auto _ : state)
+    {
+        frame.Touch();      // A new frame: nothing cached
+        const uint64_t before = g_allocCount.load();
+        for (int i = 0; i < 3; i++)
+        {
+            if (shared)
+                benchmark::DoNotOptimize(PyramidScaled(frame, sizes[i][0], sizes[i][1], scratch[i]));
+            else
+                benchmark::DoNotOptimize(ResizeImage(frame, scratch[i], sizes[i][0], sizes[i][1]));
+        }
+        allocs += g_allocCount.load() - before;
+    }
+
+    report(state, width, height, allocs);
+}
+
+static void BM_IntegralImage(benchmark::State& state)
+{
+    const int width = static_cast<int>(state.range(0));
+    const int height = static_cast<int>(state.range(1));
+
+    Image frame;
+    SyntheticCamera camera(width, height, 0.0, 4);
+    camera.Render(frame, 5);
+    uint64_t allocs = g_allocCount.load();
+    for (auto _ : state)
+    {
+        frame.Touch();
+        benchmark::DoNotOptimize(LumaIntegral(frame));
+    }
+    allocs = g_allocCount.load() - allocs;
+
+    report(state, width, height, allocs);
+}
+
+///////////////////////////////////////////////////////////////////////
+// SaveFile / OpenFile dispatch
+// The same small image is saved directly and through the generic
+// interface, so the difference between the two is the dispatch cost.
+// Args: 0 = direct call, 1 = generic interface
+///////////////////////////////////////////////////////////////////////
+static const int kDispatchSize = 16;
+
+static void BM_SaveDispatch(benchmark::State& state)
+{
+    const bool generic = state.range(0) != 0;
+    const std::string path = temp_path("dispatch_save.png");
+
+    Image image(kDispatchSize, kDispatchSize);
+    fill_test_pattern(image, kDispatchSize, kDispatchSize);
+
+    uint64_t allocs = g_allocCount.load();
+    for (auto _ : state)
+    {
+        if (generic)
+            benchmark::DoNotOptimize(image.SaveFile(path));
+        else
+            benchmark::DoNotOptimize(image.SavePNG(path));
+    }
+    allocs = g_allocCount.load() - allocs;
+
+    report(state, kDispatchSize, kDispatchSize, allocs);
+    std::filesystem::remove(path);
+}
+
+static void BM_OpenDispatch(benchmark::State& state)
+{
+    const bool generic = state.range(0) != 0;
+    const std::string path = temp_path("dispatch_open.png");
+
+    Image source(kDispatchSize, kDispatchSize);
+    fill_test_pattern(source, kDispatchSize, kDispatchSize);
+    if (!source.SavePNG(path))
+    {
+        state.SkipWithError("Failed to prepare PNG");
+        return;
+    }
+
+    uint64_t allocs = g_allocCount.load();
+    for (auto _ : state)
+    {
+        Image loaded;
+        if (generic)
+            benchmark::DoNotOptimize(loaded.OpenFile(path));
+        else
+            benchmark::DoNotOptimize(loaded.OpenPNG(path));
+    }
+    allocs = g_allocCount.load() - allocs;
+
+    report(state, kDispatchSize, kDispatchSize, allocs);
+    std::filesystem::remove(path);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Comparison
+// Args: width, height
+///////////////////////////////////////////////////////////////////////
+static void BM_OperatorEquals(benchmark::State& state)
+{
+    const int width = static_cast<int>(state.range(0));
+    const int height = static_cast<int>(state.range(1));
+
+    Image a(width, height);
+    Image b(width, height);
+    fill_test_pattern(a, width, height);
+    fill_test_pattern(b, width, height);  // Identical, so the whole buffer is scanned
+
+    uint64_t allocs = g_allocCount.load();
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(a == b);
+    }
+    allocs = g_allocCount.load() - allocs;
+
+    report(state, width, height, allocs);
+}
+
+static void BM_Compare(benchmark::State& state)
+{
+    const int width = static_cast<int>(state.range(0));
+    const int height = static_cast<int>(state.range(1));
+
+    Image a(width, height);
+    Image b(width, height);
+    fill_test_pattern(a, width, height);
+    fill_test_pattern(b, width, height);
+    b.m_data[0] ^= 0xFF;  // One mismatch so the error path is exercised
+
+    uint64_t allocs = g_allocCount.load();
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(a.compare(b, 0.01));
+    }
+    allocs = g_allocCount.load() - allocs;
+
+    report(state, width, height, allocs);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Pixel getters / setters
+// NOTE:
+//      The accessors take uint8_t coordinates, so a full 256x256 sweep
+//      is the largest region they can address.
+///////////////////////////////////////////////////////////////////////
+static const int kPixelSize = 256;
+
+static void BM_GetPixel(benchmark::State& state)
+{
+    Image image(kPixelSize, kPixelSize);
+    fill_test_pattern(image, kPixelSize, kPixelSize);
+
+    uint64_t allocs = g_allocCount.load();
+    for (auto _ : state)
+    {
+        uint32_t sum = 0;
+        for (int y = 0; y < kPixelSize; y++)
+        {
+            for (int x = 0; x < kPixelSize; x++)
+            {
+                sum += image.GetPixelRed(x, y);
+                sum += image.GetPixelGreen(x, y);
+                sum += image.GetPixelBlue(x, y);
+            }
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    allocs = g_allocCount.load() - allocs;
+
+    report(state, kPixelSize, kPixelSize, allocs);
+}
+
+static void BM_SetPixel(benchmark::State& state)
+{
+    Image image(kPixelSize, kPixelSize);
+
+    uint64_t allocs = g_allocCount.load();
+    for (auto _ : state)
+    {
+        for (int y = 0; y < kPixelSize; y++)
+        {
+            for (int x = 0; x < kPixelSize; x++)
+            {
+                image.SetPixelRed(x, y, static_cast<uint8_t>(x));
+                image.SetPixelGreen(x, y, static_cast<uint8_t>(y));
+                image.SetPixelBlue(x, y, static_cast<uint8_t>(x ^ y));
+            }
+        }
+        benchmark::ClobberMemory();
+    }
+    allocs = g_allocCount.load() - allocs;
+
+    report(state, kPixelSize, kPixelSize, allocs);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Registration
+///////////////////////////////////////////////////////////////////////
+static void JPEGArgs(benchmark::internal::Benchmark* b)
+{
+    const int resolutions[][2] = {{320, 240}, {640, 480}, {1280, 720}, {1920, 1080}};
+    const int qualities[] = {50, 75, 90, 100};
+    for (const auto& res : resolutions)
+        for (int q : qualities)
+            b->Args({res[0], res[1], q});
+    b->ArgNames({"w", "h", "q"});
+    b->Unit(benchmark::kMillisecond);
+}
+
+static void ResolutionArgs(benchmark::internal::Benchmark* b)
+{
+    const int resolutions[][2] = {{320, 240}, {640, 480}, {1280, 720}, {1920, 1080}};
+    for (const auto& res : resolutions)
+        b->Args({res[0], res[1]});
+    b->ArgNames({"w", "h"});
+}
+
+static void CodecArgs(benchmark::internal::Benchmark* b)
+{
+    const int resolutions[][2] = {{640, 480}, {1920, 1080}};
+    const ImageFormat formats[] = {ImageFormat::PNG, ImageFormat::JPEG, ImageFormat::QOI};
+    for (const auto& res : resolutions)
+        for (ImageFormat format : formats)
+            b->Args({res[0], res[1], static_cast<int>(format)});
+    b->ArgNames({"w", "h", "fmt"});
+    b->Unit(benchmark::kMillisecond);
+}
+
+BENCHMARK(BM_SaveJPEG)->Apply(JPEGArgs);
+BENCHMARK(BM_OpenJPEG)->Apply(JPEGArgs);
+BENCHMARK(BM_SavePNG)->Apply(ResolutionArgs)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_OpenPNG)->Apply(ResolutionArgs)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Encode)->Apply(CodecArgs);
+BENCHMARK(BM_Decode)->Apply(CodecArgs);
+BENCHMARK(BM_DecodeJPEGScaled)->ArgNames({"w", "h", "scale"})
+    ->Args({1920, 1080, 1})->Args({1920, 1080, 2})->Args({1920, 1080, 4})->Args({1920, 1080, 8})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_RotateJPEG)->ArgNames({"w", "h", "lossless"})
+    ->Args({1920, 1080, 0})->Args({1920, 1080, 1})->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_FramePyramid)->ArgNames({"w", "h", "shared"})
+    ->Args({1280, 720, 0})->Args({1280, 720, 1})->Args({1920, 1080, 0})->Args({1920, 1080, 1})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_IntegralImage)->Apply(ResolutionArgs)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SaveDispatch)->ArgName("generic")->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_OpenDispatch)->ArgName("generic")->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_OperatorEquals)->Apply(ResolutionArgs)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Compare)->Apply(ResolutionArgs)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_GetPixel)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_SetPixel)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,140 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "inference.h"
+
+///////////////////////////////////////////////////////////////////////
+// Float32 vs int8 CPU inference.
+//
+// A small detector backbone (224x224 input, strided 3x3 convolutions and
+// 1x1 mixing layers) with random weights: the speed does not depend on
+// the values, and the int8 benchmarks also report how far their output
+// is from the float path (rms_rel_error, top1_agree) on the same images.
+///////////////////////////////////////////////////////////////////////
+
+static uint32_t next_random(uint32_t& seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return seed >> 8;
+}
+
+static void add_layer(Network& net, uint32_t& seed, int in, int out, int kernel, int stride, bool relu)
+{
+    ConvLayer layer;
+    layer.inChannels = in;
+    layer.outChannels = out;
+    layer.kernel = kernel;
+    layer.stride = stride;
+    layer.pad = kernel / 2;
+    layer.relu = relu;
+    const float range = 2.0f / static_cast<float>(kernel * kernel * in);
+    layer.weights.resize(static_cast<size_t>(out) * kernel * kernel * in);
+    for (float& w : layer.weights)
+    {
+        w = range * ((next_random(seed) % 2001) / 1000.0f - 1.0f);
+    }
+    layer.bias.assign(out, 0.01f);
+    net.AddLayer(layer);
+}
+
+static Network& backbone()
+{
+    static Network net;
+    if (net.layers.empty())
+    {
+        uint32_t seed = 42;
+        add_layer(net, seed, 3, 16, 3, 2, true);       // 112
+        add_layer(net, seed, 16, 32, 3, 2, true);      // 56
+        add_layer(net, seed, 32, 32, 1, 1, true);
+        add_layer(net, seed, 32, 64, 3, 2, true);      // 28
+        add_layer(net, seed, 64, 64, 1, 1, true);
+        add_layer(net, seed, 64, 128, 3, 2, true);     // 14
+        add_layer(net, seed, 128, 16, 1, 1, false);    // Box and class logits
+    }
+    return net;
+}
+
+static const std::vector<Image>& sample_images()
+{
+    static std::vector<Image> images;
+    if (images.empty())
+    {
+        uint32_t seed = 7;
+        for (int n = 0; n < 4; n++)
+        {
+            Image image;
+            image.Resize(224, 224);
+            for (int i = 0; i < 224 * 224 * 3; i++)
+            {
+                image.m_data[i] = static_cast<uint8_t>((i / 3 % 224) + (next_random(seed) & 63));
+            }
+            images.push_back(std::move(image));
+        }
+    }
+    return images;
+}
+
+static void BM_ForwardFloat(benchmark::State& state)
+{
+    Network& net = backbone();
+    const Image& image = sample_images()[0];
+    std::vector<float> output;
+    for (auto _ : state)
+    {
+        net.Forward(image, output);
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.counters["frames/s"] = benchmark::Counter(
+        static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+    state.counters["activation_bytes"] = static_cast<double>(net.ActivationBytes());
+}
+
+// Argument: index into QuantizedNetwork::AvailableKernels()
+static void BM_ForwardInt8(benchmark::State& state)
+{
+    const std::vector<std::string> kernels = QuantizedNetwork::AvailableKernels();
+    if (state.range(0) >= static_cast<int64_t>(kernels.size()))
+    {
+        state.SkipWithError("kernel not available on this CPU");
+        return;
+    }
+    const std::string previous = QuantizedNetwork::SelectedKernel();
+    QuantizedNetwork::SelectKernel(kernels[state.range(0)]);
+
+    Network& net = backbone();
+    std::vector<const Image*> images;
+    for (const Image& image : sample_images())
+    {
+        images.push_back(&image);
+    }
+    QuantizedNetwork quantized;
+    std::string error;
+    bool ok = quantized.Quantize(net, images, error);
+    QuantizedNetwork::SelectKernel(previous);
+    if (!ok)
+    {
+        state.SkipWithError(error.c_str());
+        return;
+    }
+
+    std::vector<uint8_t> output;
+    QuantParams params;
+    for (auto _ : state)
+    {
+        quantized.Forward(*images[0], output, params);
+        benchmark::DoNotOptimize(output.data());
+    }
+
+    QuantizationReport report;
+    CompareQuantized(net, quantized, images, report);
+    state.SetLabel(quantized.KernelName());
+    state.counters["frames/s"] = benchmark::Counter(
+        static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+    state.counters["activation_bytes"] = static_cast<double>(quantized.ActivationBytes());
+    state.counters["rms_rel_error"] = report.signalRms > 0.0 ? report.rmsError / report.signalRms : 0.0;
+    state.counters["top1_agree"] = report.top1Agreement;
+}
+
+BENCHMARK(BM_ForwardFloat)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ForwardInt8)->ArgName("kernel")->DenseRange(0, 4)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,81 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "camera.h"
+#include "remap.h"
+
+///////////////////////////////////////////////////////////////////////
+// Remapping a 1080p frame.
+//
+// Undistortion of a wide angle lens (about 120 degrees across, strong
+// barrel distortion) through the precomputed map, on one thread and on
+// all of them, against the exact rotation and flip fast paths.
+///////////////////////////////////////////////////////////////////////
+
+static const int kWidth = 1920;
+static const int kHeight = 1080;
+
+static CameraCalibration wide_angle()
+{
+    CameraCalibration cal;
+    cal.fx = cal.fy = 560.0;
+    cal.cx = kWidth / 2.0;
+    cal.cy = kHeight / 2.0;
+    cal.k1 = -0.28;
+    cal.k2 = 0.07;
+    cal.p1 = 0.0005;
+    cal.p2 = -0.0003;
+    return cal;
+}
+
+static void report(benchmark::State& state)
+{
+    const double pixels = static_cast<double>(kWidth) * kHeight;
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * pixels * 3));
+    state.counters["frames"] = benchmark::Counter(static_cast<double>(state.iterations()),
+        benchmark::Counter::kIsRate);
+}
+
+static void BM_Undistort(benchmark::State& state)
+{
+    const size_t threads = static_cast<size_t>(state.range(0));
+    Image source, output;
+    SyntheticCamera camera(kWidth, kHeight, 0.0, 4);
+    camera.Render(source, 5);
+
+    Remapper remapper(threads);
+    if (!remapper.SetUndistort(wide_angle(), kWidth, kHeight))
+    {
+        state.SkipWithError("Failed to build the map");
+        return;
+    }
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(remapper.Apply(source, output));
+    }
+    report(state);
+    state.counters["map_mb"] = remapper.MapBytes() / 1048576.0;
+    state.SetLabel(Remapper::KernelName());
+}
+
+static void BM_Orientation(benchmark::State& state)
+{
+    const Orientation orientation = static_cast<Orientation>(state.range(0));
+    Image source, output;
+    SyntheticCamera camera(kWidth, kHeight, 0.0, 4);
+    camera.Render(source, 5);
+
+    Remapper remapper(1);
+    remapper.SetOrientation(orientation, kWidth, kHeight);
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(remapper.Apply(source, output));
+    }
+    report(state);
+}
+
+// threads: 1, 0 = all cores
+BENCHMARK(BM_Undistort)->ArgName("threads")->Arg(1)->Arg(0)->Unit(benchmark::kMillisecond)->UseRealTime();
+// Rotate90, Rotate180, Rotate270, FlipHorizontal, FlipVertical
+BENCHMARK(BM_Orientation)->ArgName("orientation")->DenseRange(0, 4)->Unit(benchmark::kMillisecond);
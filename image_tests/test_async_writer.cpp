@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "async_writer.h"
+#include "json.h"
+#include "pipeline.h"
+
+
+static std::string TempPath(const std::string &name)
+{
+    return testing::TempDir() + "async_writer_" + std::to_string(getpid()) + "_" + name;
+}
+
+static std::vector<uint8_t> ReadFile(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static AsyncWriter::Buffer Pattern(size_t size, uint8_t seed)
+{
+    auto data = std::make_shared<std::vector<uint8_t>>(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        (*data)[i] = static_cast<uint8_t>(i * 7 + seed);
+    }
+    return data;
+}
+
+TEST(AsyncWriterTest, WritesExactFilesOnBothBackends)
+{
+    for (AsyncWriter::Backend backend : {AsyncWriter::Backend::Auto, AsyncWriter::Backend::Threads})
+    {
+        AsyncWriter::Options options;
+        options.backend = backend;
+        AsyncWriter writer(options);
+        SCOPED_TRACE(writer.BackendName());
+
+        // Below, at and past the O_DIRECT block size: padding must not show
+        const size_t sizes[] = {0, 100, 4096, 10001, 1 << 20};
+        std::mutex mutex;
+        std::vector<WriteResult> results;
+        std::vector<std::string> paths;
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+        {
+            paths.push_back(TempPath(std::string(writer.BackendName()) + "_" + std::to_string(i)));
+            ASSERT_TRUE(writer.Write(paths.back(), Pattern(sizes[i], static_cast<uint8_t>(i)),
+                [&](const WriteResult &result)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    results.push_back(result);
+                }));
+        }
+        writer.Flush();
+
+        EXPECT_EQ(results.size(), paths.size());
+        EXPECT_EQ(writer.Written(), paths.size());
+        EXPECT_EQ(writer.Failed(), 0u);
+        EXPECT_EQ(writer.InFlightBytes(), 0u);
+        for (const WriteResult &result : results)
+        {
+            EXPECT_EQ(result.error, 0) << result.path;
+        }
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            EXPECT_EQ(ReadFile(paths[i]), *Pattern(sizes[i], static_cast<uint8_t>(i))) << paths[i];
+            remove(paths[i].c_str());
+        }
+
+        // Errors come back through the callback, not from Write()
+        int error = 0;
+        ASSERT_TRUE(writer.Write("/nonexistent-dir/file", Pattern(10, 0),
+            [&](const WriteResult &result) { error = result.error; }));
+        writer.Flush();
+        EXPECT_NE(error, 0);
+        EXPECT_EQ(writer.Failed(), 1u);
+    }
+}
+
+TEST(AsyncWriterTest, RejectsInsteadOfBlockingOverBudget)
+{
+    AsyncWriter::Options options;
+    options.maxInFlightBytes = 10000;
+    AsyncWriter writer(options);
+
+    // Hold the first write's bytes in its callback until released
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool inCallback = false, release = false;
+    const std::string first = TempPath("budget_first"), second = TempPath("budget_second");
+    ASSERT_TRUE(writer.Write(first, Pattern(6000, 1), [&](const WriteResult &)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        inCallback = true;
+        changed.notify_all();
+        changed.wait(lock, [&] { return release; });
+    }));
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return inCallback; });
+    }
+
+    EXPECT_EQ(writer.InFlightBytes(), 6000u);
+    EXPECT_FALSE(writer.Write(second, Pattern(6000, 2)));
+    EXPECT_FALSE(writer.Write(second, nullptr));
+    EXPECT_TRUE(writer.Write(second, Pattern(4000, 2)));       // Exactly fills it
+    EXPECT_EQ(writer.Rejected(), 1u);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        release = true;
+    }
+    changed.notify_all();
+    writer.Flush();
+
+    EXPECT_EQ(writer.Written(), 2u);
+    EXPECT_EQ(writer.PeakInFlightBytes(), 10000u);
+    EXPECT_EQ(writer.InFlightBytes(), 0u);
+    EXPECT_EQ(ReadFile(second).size(), 4000u);
+    remove(first.c_str());
+    remove(second.c_str());
+}
+
+TEST(AsyncWriterTest, RingFailureFinishesWritesWithoutTheRing)
+{
+    // io_uring_enter() fails once, so waiting out the kernel's writes
+    // works; then for good, so the ring is closed under them
+    for (unsigned failures : {1u, 1000000u})
+    {
+        AsyncWriter::Options options;
+        options.failEnterAt = 3;
+        options.failEnterCount = failures;
+        options.failEnterErrno = ENOMEM;
+        AsyncWriter writer(options);
+        if (std::string(writer.BackendName()) != "io_uring")
+        {
+            GTEST_SKIP() << "no io_uring here";
+        }
+        SCOPED_TRACE(failures);
+
+        std::mutex mutex;
+        std::vector<WriteResult> results;
+        std::vector<std::string> paths;
+        for (int i = 0; i < 24; i++)
+        {
+            paths.push_back(TempPath("ring_failure_" + std::to_string(i)));
+            ASSERT_TRUE(writer.Write(paths.back(), Pattern(100000 + i, static_cast<uint8_t>(i)),
+                [&](const WriteResult &result)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    results.push_back(result);
+                }));
+        }
+        writer.Flush();
+        EXPECT_STREQ(writer.BackendName(), "threads");
+        ASSERT_EQ(results.size(), paths.size());
+
+        // A write either failed with the ring's errno or is intact
+        for (const WriteResult &result : results)
+        {
+            const size_t i = std::find(paths.begin(), paths.end(), result.path) - paths.begin();
+            ASSERT_LT(i, paths.size());
+            if (result.error)
+            {
+                EXPECT_EQ(result.error, ENOMEM) << result.path;
+            }
+            else
+            {
+                EXPECT_EQ(ReadFile(result.path), *Pattern(100000 + i, static_cast<uint8_t>(i))) << result.path;
+            }
+        }
+        if (failures == 1)
+        {
+            EXPECT_EQ(writer.Failed(), 0u);
+        }
+
+        // And the writer goes on without it
+        int error = -1;
+        ASSERT_TRUE(writer.Write(paths[0], Pattern(10, 0), [&](const WriteResult &result) { error = result.error; }));
+        writer.Flush();
+        EXPECT_EQ(error, 0);
+        EXPECT_EQ(ReadFile(paths[0]).size(), 10u);
+        for (const std::string &path : paths)
+        {
+            remove(path.c_str());
+        }
+    }
+}
+
+TEST(AsyncWriterTest, SnapshotNodeSavesFrames)
+{
+    const std::string prefix = TempPath("snap");
+    JsonValue config;
+    std::string error;
+    ASSERT_TRUE(JsonValue::Parse(
+        "{\"nodes\": ["
+        "  {\"name\": \"cam\", \"type\": \"source\", \"width\": 64, \"height\": 48, \"fps\": 0,"
+        "   \"frames\": 3, \"mjpeg\": true},"
+        "  {\"name\": \"snap\", \"type\": \"snapshot\", \"prefix\": \"" + prefix + "\","
+        "   \"events_only\": false}"
+        "],"
+        " \"edges\": [{\"from\": \"cam\", \"to\": \"snap\", \"depth\": 8}]}", config, error)) << error;
+
+    Pipeline pipeline;
+    ASSERT_TRUE(pipeline.Load(config, error)) << error;
+    std::mutex mutex;
+    std::vector<FramePtr> sent;
+    ASSERT_TRUE(pipeline.SetTap("cam", [&](const FramePtr &frame)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sent.push_back(frame);
+    }));
+    pipeline.Start();
+    pipeline.Wait();
+
+    // Finish() flushed: every file is complete once the pipeline is done
+    ASSERT_EQ(sent.size(), 3u);
+    for (const FramePtr &frame : sent)
+    {
+        const std::string path = prefix + "-" + std::to_string(frame->sequence) + ".jpg";
+        EXPECT_EQ(ReadFile(path), *frame->payload) << path;
+        remove(path.c_str());
+    }
+    for (const PipelineNodeStats &s : pipeline.Stats())
+    {
+        EXPECT_EQ(s.errors, 0u) << s.name;
+    }
+}
@@ -0,0 +1,351 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "camera.h"
+#include "image.h"
+
+
+// Camera-like test frame: gradient plus a little sensor noise
+static void RenderFrame(Image &image, int width, int height)
+{
+    SyntheticCamera camera(width, height, 0.0, 4);
+    camera.Render(image, 3);
+}
+
+static std::string TempPath(const std::string &name)
+{
+    return (std::filesystem::temp_directory_path() /
+        ("codec_test_" + std::to_string(::getpid()) + "_" + name)).string();
+}
+
+TEST(CodecTest, QOIRoundTripIsLossless)
+{
+    Image image;
+    RenderFrame(image, 161, 97);    // Odd size, exercises runs at row ends
+
+    std::vector<uint8_t> encoded;
+    ASSERT_TRUE(image.EncodeQOI(encoded));
+    EXPECT_LT(encoded.size(), static_cast<size_t>(image.GetBufferSize()));
+
+    Image decoded;
+    ASSERT_TRUE(decoded.DecodeQOI(encoded.data(), encoded.size()));
+    EXPECT_TRUE(decoded == image);
+
+    // Every truncation is rejected rather than read out of bounds
+    for (size_t size : {size_t(0), size_t(13), encoded.size() / 2, encoded.size() - 9})
+    {
+        EXPECT_FALSE(decoded.DecodeQOI(encoded.data(), size)) << "size " << size;
+    }
+}
+
+TEST(CodecTest, DetectsFormatFromMagicBytes)
+{
+    Image image;
+    RenderFrame(image, 64, 48);
+
+    const ImageFormat formats[] = {ImageFormat::PNG, ImageFormat::JPEG, ImageFormat::QOI};
+    std::vector<uint8_t> encoded;
+    for (ImageFormat format : formats)
+    {
+        ASSERT_TRUE(image.Encode(encoded, format, 90)) << Image::FormatName(format);
+        EXPECT_EQ(Image::DetectFormat(encoded.data(), encoded.size()), format);
+
+        Image decoded;
+        ASSERT_TRUE(decoded.Decode(encoded.data(), encoded.size())) << Image::FormatName(format);
+        EXPECT_TRUE(decoded.compare(image, 0.02)) << Image::FormatName(format);
+        if (format != ImageFormat::JPEG)
+        {
+            EXPECT_TRUE(decoded == image) << Image::FormatName(format);
+        }
+    }
+
+    const uint8_t garbage[] = {'G', 'I', 'F', '8', '9', 'a', 0, 0};
+    EXPECT_EQ(Image::DetectFormat(garbage, sizeof(garbage)), ImageFormat::Unknown);
+    Image decoded;
+    EXPECT_FALSE(decoded.Decode(garbage, sizeof(garbage)));
+}
+
+TEST(CodecTest, FormatFromPathIgnoresCase)
+{
+    EXPECT_EQ(Image::FormatFromPath("a/b/frame.QoI"), ImageFormat::QOI);
+    EXPECT_EQ(Image::FormatFromPath("frame.JPEG"), ImageFormat::JPEG);
+    EXPECT_EQ(Image::FormatFromPath("frame.png"), ImageFormat::PNG);
+    EXPECT_EQ(Image::FormatFromPath("dir.png/frame"), ImageFormat::Unknown);
+    EXPECT_EQ(Image::FormatFromPath("frame"), ImageFormat::Unknown);
+}
+
+TEST(CodecTest, OpenFileUsesContentNotName)
+{
+    Image image;
+    RenderFrame(image, 40, 30);
+
+    const std::string saved = TempPath("frame.QOI");
+    const std::string renamed = TempPath("frame.bin");
+    ASSERT_TRUE(image.SaveFile(saved));
+    std::filesystem::rename(saved, renamed);
+
+    Image loaded;
+    EXPECT_TRUE(loaded.OpenFile(renamed));
+    EXPECT_TRUE(loaded == image);
+
+    // A PNG named .jpg is still read as PNG
+    const std::string misnamed = TempPath("frame.jpg");
+    ASSERT_TRUE(image.SavePNG(misnamed));
+    Image png;
+    EXPECT_TRUE(png.OpenFile(misnamed));
+    EXPECT_TRUE(png == image);
+
+    std::filesystem::remove(renamed);
+    std::filesystem::remove(misnamed);
+}
+
+TEST(CodecTest, CodecsRunConcurrently)
+{
+    // Every thread round-trips its own frames through all three codecs
+    // and feeds the decoders corrupt data, which must fail cleanly
+    const int kThreads = 8;
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++)
+    {
+        threads.emplace_back([&failures, t]
+        {
+            SyntheticCamera camera(96, 64, 0.0, 8);
+            Image image, decoded;
+            std::vector<uint8_t> encoded;
+            const ImageFormat formats[] = {ImageFormat::PNG, ImageFormat::JPEG, ImageFormat::QOI};
+            for (int i = 0; i < 10; i++)
+            {
+                camera.Render(image, t * 100 + i);
+                ImageFormat format = formats[i % 3];
+                if (!image.Encode(encoded, format, 85) ||
+                    !decoded.Decode(encoded.data(), encoded.size()) ||
+                    !decoded.compare(image, 0.02))
+                {
+                    failures++;
+                }
+
+                // Cut the stream short: must return false, not crash or print
+                encoded.resize(encoded.size() / 3);
+                if (decoded.Decode(encoded.data(), encoded.size()) && format != ImageFormat::JPEG)
+                {
+                    failures++;
+                }
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    EXPECT_EQ(failures.load(), 0);
+}
+
+TEST(CodecTest, FailuresReportLastError)
+{
+    Image image;
+    const uint8_t truncated[] = {0xff, 0xd8, 0xff, 0xe0, 0x00};
+    EXPECT_FALSE(image.DecodeJPEG(truncated, sizeof(truncated)));
+    EXPECT_NE(std::string(Image::LastError()).find("JPEG"), std::string::npos);
+
+    EXPECT_FALSE(image.OpenFile(TempPath("missing.png")));
+    EXPECT_NE(std::string(Image::LastError()).find("missing.png"), std::string::npos);
+
+    Image empty;
+    EXPECT_FALSE(empty.SaveJPEG(TempPath("empty.jpg")));
+}
+
+TEST(CodecTest, RejectsImagesTooLargeToAllocate)
+{
+    // A real JPEG with its frame header claiming 65500x65500: 12.9 GB of
+    // RGB, which wraps to a small buffer in 32 bit arithmetic
+    Image image;
+    RenderFrame(image, 64, 48);
+    std::vector<uint8_t> jpeg;
+    ASSERT_TRUE(image.EncodeJPEG(jpeg, 90));
+    size_t sof = 2;
+    while (sof + 9 < jpeg.size() && !(jpeg[sof] == 0xff && jpeg[sof + 1] == 0xc0))
+    {
+        sof += 2 + (jpeg[sof + 2] << 8 | jpeg[sof + 3]);
+    }
+    ASSERT_LT(sof + 9, jpeg.size());
+    jpeg[sof + 5] = jpeg[sof + 7] = 0xff;      // Height, width: 0xffdc = 65500
+    jpeg[sof + 6] = jpeg[sof + 8] = 0xdc;
+
+    int width = 0, height = 0;
+    ASSERT_TRUE(Image::JPEGSize(jpeg.data(), jpeg.size(), width, height));
+    EXPECT_EQ(width, 65500);
+    EXPECT_EQ(height, 65500);
+    Image decoded;
+    EXPECT_FALSE(decoded.DecodeJPEG(jpeg.data(), jpeg.size()));
+
+    EXPECT_FALSE(decoded.Resize(65500, 65500));
+    EXPECT_FALSE(decoded.Resize(-1, 10));
+    EXPECT_FALSE(decoded.Resize(20000, 20001));    // Just over kMaxPixels
+    EXPECT_TRUE(decoded.Resize(64, 48));
+}
+
+TEST(CodecTest, JPEGDecodesAtReducedScale)
+{
+    Image image;
+    RenderFrame(image, 642, 481);
+    std::vector<uint8_t> jpeg;
+    ASSERT_TRUE(image.EncodeJPEG(jpeg, 90));
+
+    int width = 0, height = 0;
+    ASSERT_TRUE(Image::JPEGSize(jpeg.data(), jpeg.size(), width, height));
+    EXPECT_EQ(width, 642);
+    EXPECT_EQ(height, 481);
+    EXPECT_FALSE(Image::JPEGSize(jpeg.data(), 10, width, height));
+
+    EXPECT_EQ(Image::JPEGScaleFor(642, 481, 161, 0), 4);     // 642 / 4 rounds up to 161
+    EXPECT_EQ(Image::JPEGScaleFor(642, 481, 162, 0), 2);
+    EXPECT_EQ(Image::JPEGScaleFor(642, 481, 642, 481), 1);
+    EXPECT_EQ(Image::JPEGScaleFor(642, 481, 1, 1), 8);
+
+    // A 1/4 decode matches a full decode shrunk by 4, near enough
+    Image quarter, full;
+    ASSERT_TRUE(quarter.DecodeJPEG(jpeg.data(), jpeg.size(), 4));
+    EXPECT_EQ(quarter.GetWidth(), 161);
+    EXPECT_EQ(quarter.GetHeight(), 121);
+    ASSERT_TRUE(full.DecodeJPEG(jpeg.data(), jpeg.size()));
+    long diff = 0;
+    for (int y = 0; y < 120; y++)
+    {
+        for (int x = 0; x < 160; x++)
+        {
+            int sum = 0;
+            for (int i = 0; i < 16; i++)
+            {
+                sum += full.m_data[((y * 4 + i / 4) * 642 + x * 4 + i % 4) * 3];
+            }
+            diff += std::abs(quarter.m_data[(y * 161 + x) * 3] - (sum + 8) / 16);
+        }
+    }
+    EXPECT_LT(diff / (120 * 160), 3);
+    EXPECT_FALSE(quarter.DecodeJPEG(jpeg.data(), jpeg.size(), 3));
+}
+
+TEST(CodecTest, JPEGTransformsAreLossless)
+{
+    Image image;
+    RenderFrame(image, 96, 64);     // Whole MCUs, nothing is trimmed
+    std::vector<uint8_t> encoded;
+    ASSERT_TRUE(image.EncodeJPEG(encoded, 90));
+    Image original;
+    ASSERT_TRUE(original.DecodeJPEG(encoded.data(), encoded.size()));
+
+    // Coefficients only move, so undoing a transform gives the same JPEG
+    const JPEGTransformType types[] = {JPEGTransformType::Rotate90, JPEGTransformType::Rotate180,
+        JPEGTransformType::FlipHorizontal, JPEGTransformType::FlipVertical};
+    const int repeats[] = {4, 2, 2, 2};
+    for (size_t t = 0; t < 4; t++)
+    {
+        JPEGTransform transform;
+        transform.type = types[t];
+        std::vector<uint8_t> current = encoded, next;
+        for (int i = 0; i < repeats[t]; i++)
+        {
+            ASSERT_TRUE(Image::TransformJPEG(current.data(), current.size(), next, transform));
+            current.swap(next);
+        }
+        Image back;
+        ASSERT_TRUE(back.DecodeJPEG(current.data(), current.size()));
+        EXPECT_TRUE(back == original) << static_cast<int>(types[t]);
+    }
+
+    // A flip is exact in the pixels too
+    JPEGTransform flip;
+    flip.type = JPEGTransformType::FlipHorizontal;
+    std::vector<uint8_t> flipped;
+    ASSERT_TRUE(Image::TransformJPEG(encoded.data(), encoded.size(), flipped, flip));
+    Image mirrored;
+    ASSERT_TRUE(mirrored.DecodeJPEG(flipped.data(), flipped.size()));
+    for (int x = 0; x < 96; x += 19)
+    {
+        const uint8_t *a = mirrored.m_data + (10 * 96 + x) * 3;
+        const uint8_t *b = original.m_data + (10 * 96 + 95 - x) * 3;
+        EXPECT_EQ(a[0], b[0]);
+        EXPECT_EQ(a[2], b[2]);
+    }
+
+    // A rotation matches rotating the pixels, to within IDCT rounding
+    JPEGTransform rotate;
+    rotate.type = JPEGTransformType::Rotate90;
+    std::vector<uint8_t> rotated;
+    ASSERT_TRUE(Image::TransformJPEG(encoded.data(), encoded.size(), rotated, rotate));
+    Image turned;
+    ASSERT_TRUE(turned.DecodeJPEG(rotated.data(), rotated.size()));
+    EXPECT_EQ(turned.GetWidth(), 64);
+    EXPECT_EQ(turned.GetHeight(), 96);
+    Image expected(64, 96);
+    for (int y = 0; y < 96; y++)
+    {
+        for (int x = 0; x < 64; x++)
+        {
+            memcpy(expected.m_data + (y * 64 + x) * 3, original.m_data + ((63 - x) * 96 + y) * 3, 3);
+        }
+    }
+    EXPECT_TRUE(turned.compare(expected, 1.0));
+}
+
+TEST(CodecTest, JPEGTransformCropsAndTrimsToMCUs)
+{
+    Image image;
+    RenderFrame(image, 100, 75);    // Partial MCUs on the right and bottom
+    std::vector<uint8_t> encoded;
+    ASSERT_TRUE(image.EncodeJPEG(encoded, 90));
+    Image original;
+    ASSERT_TRUE(original.DecodeJPEG(encoded.data(), encoded.size()));
+
+    // The corner snaps to the 8x8 grid, the region grows to keep its end
+    JPEGTransform crop;
+    crop.cropX = 20;
+    crop.cropY = 21;
+    crop.cropWidth = 40;
+    crop.cropHeight = 30;
+    std::vector<uint8_t> cropped;
+    JPEGTransform applied;
+    ASSERT_TRUE(Image::TransformJPEG(encoded.data(), encoded.size(), cropped, crop, &applied));
+    EXPECT_EQ(applied.cropX, 16);
+    EXPECT_EQ(applied.cropY, 16);
+    EXPECT_EQ(applied.cropWidth, 44);
+    EXPECT_EQ(applied.cropHeight, 35);
+    Image part;
+    ASSERT_TRUE(part.DecodeJPEG(cropped.data(), cropped.size()));
+    ASSERT_EQ(part.GetWidth(), 44);
+    for (int y = 0; y < 35; y += 7)
+    {
+        EXPECT_EQ(memcmp(part.m_data + y * 44 * 3, original.m_data + ((16 + y) * 100 + 16) * 3, 44 * 3), 0);
+    }
+
+    // Mirrored axes lose their partial edge MCU, the others keep it
+    JPEGTransform rotate;
+    rotate.type = JPEGTransformType::Rotate180;
+    std::vector<uint8_t> out;
+    int width = 0, height = 0;
+    ASSERT_TRUE(Image::TransformJPEG(encoded.data(), encoded.size(), out, rotate));
+    ASSERT_TRUE(Image::JPEGSize(out.data(), out.size(), width, height));
+    EXPECT_EQ(width, 96);
+    EXPECT_EQ(height, 72);
+    rotate.type = JPEGTransformType::FlipVertical;
+    ASSERT_TRUE(Image::TransformJPEG(encoded.data(), encoded.size(), out, rotate));
+    ASSERT_TRUE(Image::JPEGSize(out.data(), out.size(), width, height));
+    EXPECT_EQ(width, 100);
+    EXPECT_EQ(height, 72);
+
+    // Nothing left, or not a JPEG
+    crop.cropX = 100;
+    EXPECT_FALSE(Image::TransformJPEG(encoded.data(), encoded.size(), out, crop));
+    const uint8_t junk[16] = {0};
+    EXPECT_FALSE(Image::TransformJPEG(junk, sizeof(junk), out, JPEGTransform()));
+    EXPECT_STRNE(Image::LastError(), "");
+}
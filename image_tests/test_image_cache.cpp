@@ -0,0 +1,122 @@
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include "image_proc.h"
+
+
+// Noise, so every 2x2 block has different pixels
+static std::shared_ptr<Image> Noise(int w, int h, uint32_t seed)
+{
+    auto image = std::make_shared<Image>(w, h);
+    for (int i = 0; i < w * h * 3; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        image->m_data[i] = static_cast<uint8_t>(seed >> 24);
+    }
+    return image;
+}
+
+TEST(ImageCacheTest, LevelsAreSharedAndDroppedWithThePixels)
+{
+    // 77 wide: rows end off the SIMD step and the odd column is dropped
+    std::shared_ptr<Image> frame = Noise(77, 45, 1);
+    const uint64_t before = PyramidLevelsBuilt();
+
+    const Image *level1 = PyramidLevel(*frame, 1);
+    ASSERT_NE(level1, nullptr);
+    ASSERT_EQ(level1->GetWidth(), 38);
+    ASSERT_EQ(level1->GetHeight(), 22);
+    for (int y = 0; y < 22; y++)
+    {
+        for (int x = 0; x < 38; x++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                const uint8_t *p = frame->m_data + ((2 * y) * 77 + 2 * x) * 3 + c;
+                const int expected = (p[0] + p[3] + p[77 * 3] + p[77 * 3 + 3] + 2) >> 2;
+                ASSERT_EQ(level1->m_data[(y * 38 + x) * 3 + c], expected) << x << "," << y;
+            }
+        }
+    }
+    EXPECT_EQ(PyramidLevelsBuilt() - before, 1u);
+
+    // A pyramid over the same frame reuses the level and builds only the rest
+    ImagePyramid pyramid;
+    pyramid.Reset(frame);
+    EXPECT_EQ(pyramid.Level(1), level1);
+    EXPECT_NE(pyramid.Level(3), nullptr);
+    EXPECT_EQ(pyramid.LevelsBuilt(), 2u);
+    EXPECT_EQ(PyramidLevel(*frame, 3), pyramid.Level(3));
+    EXPECT_EQ(PyramidLevelsBuilt() - before, 3u);
+
+    Image scratch;
+    EXPECT_EQ(PyramidScaled(*frame, 19, 11, scratch), PyramidLevel(*frame, 2));
+    EXPECT_EQ(PyramidScaled(*frame, 30, 20, scratch), &scratch);
+
+    // Changed pixels start over
+    frame->Touch();
+    EXPECT_EQ(frame->Cache(), nullptr);
+    EXPECT_NE(PyramidLevel(*frame, 1), nullptr);
+    EXPECT_EQ(PyramidLevelsBuilt() - before, 4u);
+    frame->SetPixelRed(0, 0, 1);        // Single pixel writes too
+    EXPECT_EQ(frame->Cache(), nullptr);
+    EXPECT_NE(PyramidLevel(*frame, 1), nullptr);
+    ASSERT_TRUE(frame->Resize(8, 8));
+    EXPECT_EQ(frame->Cache(), nullptr);
+    EXPECT_EQ(PyramidLevel(*frame, 1)->GetWidth(), 4);
+    EXPECT_EQ(PyramidLevel(*frame, 4), nullptr);        // 8x8 stops at 1x1
+}
+
+TEST(ImageCacheTest, IntegralImageSumsLuma)
+{
+    const int w = 41, h = 23;
+    std::shared_ptr<Image> frame = Noise(w, h, 7);
+    const IntegralImage *integral = LumaIntegral(*frame);
+    ASSERT_NE(integral, nullptr);
+    EXPECT_EQ(integral->width, w);
+    EXPECT_EQ(integral->height, h);
+    EXPECT_EQ(LumaIntegral(*frame), integral);
+
+    const int boxes[][4] = {{0, 0, w, h}, {3, 5, 4, 6}, {10, 2, 40, 20}, {7, 7, 7, 9}};
+    for (const int *box : boxes)
+    {
+        uint32_t expected = 0;
+        for (int y = box[1]; y < box[3]; y++)
+        {
+            for (int x = box[0]; x < box[2]; x++)
+            {
+                const uint8_t *p = frame->m_data + (y * w + x) * 3;
+                expected += (77u * p[0] + 150u * p[1] + 29u * p[2]) >> 8;
+            }
+        }
+        EXPECT_EQ(integral->Sum(box[0], box[1], box[2], box[3]), expected);
+    }
+
+    EXPECT_EQ(LumaIntegral(Image()), nullptr);
+}
+
+TEST(ImageCacheTest, ConcurrentUsersBuildEachLevelOnce)
+{
+    std::shared_ptr<Image> frame = Noise(640, 480, 3);
+    const uint64_t before = PyramidLevelsBuilt();
+
+    std::vector<const Image *> seen(8, nullptr);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < seen.size(); t++)
+    {
+        threads.emplace_back([&, t] { seen[t] = PyramidLevel(*frame, 4); });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    for (const Image *level : seen)
+    {
+        EXPECT_EQ(level, seen[0]);
+    }
+    ASSERT_NE(seen[0], nullptr);
+    EXPECT_EQ(seen[0]->GetWidth(), 40);
+    EXPECT_EQ(PyramidLevelsBuilt() - before, 4u);
+}
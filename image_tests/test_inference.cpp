@@ -0,0 +1,137 @@
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "inference.h"
+
+
+static uint32_t NextRandom(uint32_t &seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return seed >> 8;
+}
+
+static ConvLayer RandomLayer(uint32_t &seed, int in, int out, int kernel, int stride, bool relu)
+{
+    ConvLayer layer;
+    layer.inChannels = in;
+    layer.outChannels = out;
+    layer.kernel = kernel;
+    layer.stride = stride;
+    layer.pad = kernel / 2;
+    layer.relu = relu;
+    const float range = 2.0f / std::sqrt(static_cast<float>(kernel * kernel * in));
+    for (int i = 0; i < out * kernel * kernel * in; i++)
+    {
+        layer.weights.push_back(range * ((NextRandom(seed) % 2001) / 1000.0f - 1.0f));
+    }
+    for (int i = 0; i < out; i++)
+    {
+        layer.bias.push_back(0.1f * ((NextRandom(seed) % 2001) / 1000.0f - 1.0f));
+    }
+    return layer;
+}
+
+static Network SmallNetwork()
+{
+    uint32_t seed = 7;
+    Network net;
+    net.inputWidth = 48;
+    net.inputHeight = 32;
+    EXPECT_TRUE(net.AddLayer(RandomLayer(seed, 3, 16, 3, 2, true)));
+    EXPECT_TRUE(net.AddLayer(RandomLayer(seed, 16, 32, 3, 2, true)));
+    EXPECT_TRUE(net.AddLayer(RandomLayer(seed, 32, 32, 1, 1, true)));
+    EXPECT_TRUE(net.AddLayer(RandomLayer(seed, 32, 10, 3, 1, false)));
+    return net;
+}
+
+static Image Pattern(int width, int height, uint32_t seed)
+{
+    Image image;
+    image.Resize(width, height);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            uint8_t *p = image.m_data + (static_cast<size_t>(y) * width + x) * 3;
+            p[0] = static_cast<uint8_t>(x * 255 / width);
+            p[1] = static_cast<uint8_t>(y * 255 / height);
+            p[2] = static_cast<uint8_t>(NextRandom(seed));
+        }
+    }
+    return image;
+}
+
+TEST(InferenceTest, RejectsLayersThatDoNotFit)
+{
+    uint32_t seed = 1;
+    Network net;
+    EXPECT_FALSE(net.AddLayer(RandomLayer(seed, 4, 8, 3, 1, true)));     // Input has 3 channels
+    ConvLayer layer = RandomLayer(seed, 3, 8, 3, 1, true);
+    layer.bias.pop_back();
+    EXPECT_FALSE(net.AddLayer(layer));
+    EXPECT_TRUE(net.AddLayer(RandomLayer(seed, 3, 8, 3, 1, true)));
+    EXPECT_TRUE(net.AddLayer(RandomLayer(seed, 8, 4, 1, 1, false)));
+
+    QuantizedNetwork quantized;
+    std::string error;
+    EXPECT_FALSE(quantized.Quantize(net, std::vector<const Image *>(), error));
+    EXPECT_FALSE(error.empty());
+}
+
+TEST(InferenceTest, Int8MatchesFloatOnEveryKernel)
+{
+    Network net = SmallNetwork();
+    std::vector<Image> images;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        images.push_back(Pattern(64 + 16 * i, 40 + 8 * i, i + 1));
+    }
+    std::vector<const Image *> calibration;
+    for (const Image &image : images)
+    {
+        calibration.push_back(&image);
+    }
+
+    const std::string original = QuantizedNetwork::SelectedKernel();
+    for (const std::string &kernel : QuantizedNetwork::AvailableKernels())
+    {
+        ASSERT_TRUE(QuantizedNetwork::SelectKernel(kernel));
+        QuantizedNetwork quantized;
+        std::string error;
+        ASSERT_TRUE(quantized.Quantize(net, calibration, error)) << error;
+        EXPECT_EQ(kernel, quantized.KernelName());
+
+        QuantizationReport report;
+        ASSERT_TRUE(CompareQuantized(net, quantized, calibration, report));
+        EXPECT_EQ(report.values, 4u * 12 * 8 * 10);
+        EXPECT_LT(report.rmsError, 0.05 * report.signalRms) << kernel;
+        EXPECT_GT(report.top1Agreement, 0.9) << kernel;
+        EXPECT_EQ(net.ActivationBytes(), 4 * quantized.ActivationBytes());
+    }
+    EXPECT_FALSE(QuantizedNetwork::SelectKernel("no-such-kernel"));
+    ASSERT_TRUE(QuantizedNetwork::SelectKernel(original));
+}
+
+TEST(InferenceTest, InputTensorIsTheImage)
+{
+    Network net = SmallNetwork();
+    Image exact = Pattern(net.inputWidth, net.inputHeight, 3);
+    Image larger = Pattern(96, 64, 4);
+
+    QuantizedNetwork quantized;
+    std::string error;
+    ASSERT_TRUE(quantized.Quantize(net, {&exact, &larger}, error)) << error;
+    EXPECT_EQ(quantized.PrepareInput(exact), exact.m_data);     // No copy, no float pass
+    const uint8_t *resized = quantized.PrepareInput(larger);
+    ASSERT_NE(resized, nullptr);
+    EXPECT_NE(resized, larger.m_data);
+
+    std::vector<uint8_t> output;
+    QuantParams params;
+    ASSERT_TRUE(quantized.Forward(exact, output, params));
+    EXPECT_EQ(output.size(), 12u * 8 * 10);
+    EXPECT_GT(params.scale, 0.0f);
+    EXPECT_GT(params.zeroPoint, 0);     // Last layer has no ReLU
+}
@@ -0,0 +1,88 @@
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <gtest/gtest.h>
+#include "image.h"
+#include "image_proc.h"
+#include "motion_gate.h"
+
+
+// Grey corridor with a dark square at (x, y)
+static void RenderScene(Image &image, int squareX, int squareY)
+{
+    image.Resize(320, 240);
+    FillRect(image, 0, 0, 320, 240, Color{120, 120, 120});
+    if (squareX >= 0)
+    {
+        FillRect(image, squareX, squareY, squareX + 40, squareY + 40, Color{20, 20, 20});
+    }
+}
+
+TEST(MotionGateTest, AbsDiffMatchesScalar)
+{
+    std::vector<uint8_t> a(77), b(77), mask(77);
+    size_t expected = 0;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        a[i] = static_cast<uint8_t>(i * 37);
+        b[i] = static_cast<uint8_t>(i * 11 + 5);
+        expected += std::abs(int(a[i]) - int(b[i])) > 30;
+    }
+
+    EXPECT_EQ(AbsDiffThreshold(a.data(), b.data(), mask.data(), a.size(), 30), expected);
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        bool over = std::abs(int(a[i]) - int(b[i])) > 30;
+        EXPECT_EQ(mask[i], over ? 0xff : 0) << i;
+    }
+}
+
+TEST(MotionGateTest, SkipsStaticSceneUpToMaxSkip)
+{
+    MotionGate gate;
+    gate.maxSkip = 5;
+    Image frame;
+    RenderScene(frame, -1, -1);
+
+    MotionResult result;
+    EXPECT_TRUE(gate.Process(frame, result));   // First frame is the background
+    for (int i = 0; i < 5; i++)
+    {
+        EXPECT_FALSE(gate.Process(frame, result)) << i;
+        EXPECT_EQ(result.activity, 0.0);
+    }
+    EXPECT_TRUE(gate.Process(frame, result));   // Refresh after maxSkip
+    EXPECT_TRUE(result.forced);
+    EXPECT_EQ(gate.Frames(), 7u);
+    EXPECT_EQ(gate.Forwarded(), 2u);
+}
+
+TEST(MotionGateTest, ForwardsAndLocalisesMovement)
+{
+    MotionGate gate;
+    Image frame;
+    MotionResult result;
+
+    RenderScene(frame, -1, -1);
+    gate.Process(frame, result);
+
+    RenderScene(frame, 200, 100);
+    ASSERT_TRUE(gate.Process(frame, result));
+    EXPECT_FALSE(result.forced);
+    ASSERT_EQ(result.regions.size(), 1u);
+
+    // The region covers the square, with at most a cell of slack
+    const MotionRegion &region = result.regions[0];
+    EXPECT_LE(region.x, 200);
+    EXPECT_LE(region.y, 100);
+    EXPECT_GE(region.x + region.width, 240);
+    EXPECT_GE(region.y + region.height, 140);
+    EXPECT_LT(region.width, 80);
+    EXPECT_LT(region.height, 80);
+
+    // A second, separate object gives a second region
+    RenderScene(frame, 200, 100);
+    FillRect(frame, 10, 10, 50, 50, Color{250, 250, 250});
+    ASSERT_TRUE(gate.Process(frame, result));
+    EXPECT_EQ(result.regions.size(), 2u);
+}
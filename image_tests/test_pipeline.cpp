@@ -0,0 +1,357 @@
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "json.h"
+#include "pipeline.h"
+#include "shm_transport.h"
+
+
+static JsonValue ParseOrFail(const std::string &text)
+{
+    JsonValue value;
+    std::string error;
+    EXPECT_TRUE(JsonValue::Parse(text, value, error)) << error;
+    return value;
+}
+
+TEST(PipelineTest, ParsesJsonAndReportsErrorPositions)
+{
+    JsonValue doc = ParseOrFail(
+        "{\"name\": \"cam\\u00e9\", \"fps\": -2.5e1, \"on\": true,\n"
+        " \"list\": [1, {\"x\": null}], \"smile\": \"\\ud83d\\ude00\"}");
+    ASSERT_TRUE(doc.IsObject());
+    EXPECT_EQ(doc.GetString("name", ""), "cam\xc3\xa9");
+    EXPECT_DOUBLE_EQ(doc.GetNumber("fps", 0), -25.0);
+    EXPECT_TRUE(doc.GetBool("on", false));
+    EXPECT_EQ(doc.GetString("smile", ""), "\xf0\x9f\x98\x80");
+    ASSERT_TRUE(doc.Find("list") && doc.Find("list")->IsArray());
+    EXPECT_TRUE(doc.Find("list")->array[1].Find("x")->IsNull());
+    EXPECT_EQ(doc.GetNumber("name", 7.0), 7.0);     // Mistyped falls back
+
+    JsonValue bad;
+    std::string error;
+    EXPECT_FALSE(JsonValue::Parse("{\"a\": 1,\n \"b\" 2}", bad, error));
+    EXPECT_NE(error.find("line 2 column 6"), std::string::npos) << error;
+    EXPECT_FALSE(JsonValue::Parse("[01]", bad, error));
+    EXPECT_FALSE(JsonValue::Parse("{} x", bad, error));
+    EXPECT_FALSE(JsonValue::Parse(std::string(100, '['), bad, error));
+}
+
+TEST(PipelineTest, RejectsBadGraphs)
+{
+    const char *configs[] = {
+        "{\"nodes\": [{\"name\": \"a\", \"type\": \"warp\"}]}",
+        "{\"nodes\": [{\"name\": \"a\", \"type\": \"source\"}, {\"name\": \"a\", \"type\": \"encode\"}]}",
+        "{\"nodes\": [{\"name\": \"e\", \"type\": \"encode\"}]}",      // No source
+        "{\"nodes\": [{\"name\": \"s\", \"type\": \"source\"}, {\"name\": \"e\", \"type\": \"encode\"}]}",
+        "{\"nodes\": [{\"name\": \"s\", \"type\": \"source\"}, {\"name\": \"e\", \"type\": \"encode\"},"
+        " {\"name\": \"f\", \"type\": \"encode\"}],"
+        " \"edges\": [{\"from\": \"e\", \"to\": \"f\"}, {\"from\": \"f\", \"to\": \"e\"}]}",    // Cycle
+        "{\"nodes\": [{\"name\": \"s\", \"type\": \"source\"}],"
+        " \"edges\": [{\"from\": \"s\", \"to\": \"s\"}]}",
+        "{\"nodes\": [{\"name\": \"s\", \"type\": \"source\"}, {\"name\": \"i\", \"type\": \"infer\", \"model\": \"yolo\"}],"
+        " \"edges\": [{\"from\": \"s\", \"to\": \"i\"}]}",
+        "{\"nodes\": [{\"name\": \"s\", \"type\": \"source\"}, {\"name\": \"e\", \"type\": \"encode\", \"quality\": 0}],"
+        " \"edges\": [{\"from\": \"s\", \"to\": \"e\"}]}",
+    };
+    for (const char *text : configs)
+    {
+        Pipeline pipeline;
+        std::string error;
+        EXPECT_FALSE(pipeline.Load(ParseOrFail(text), error)) << text;
+        EXPECT_FALSE(error.empty());
+    }
+
+    // Capture time drives the rate limit: 30 fps in, 10 fps out
+    PipelineEdge edge("a", "b", 64, 10.0);
+    int accepted = 0;
+    for (int i = 0; i < 30; i++)
+    {
+        auto frame = std::make_shared<PipelineFrame>();
+        frame->timestampUs = 1000000 + i * 33333ull;
+        accepted += edge.Push(frame);
+    }
+    EXPECT_EQ(accepted, 10);
+    EXPECT_EQ(edge.Limited(), 20u);
+}
+
+TEST(PipelineTest, FanOutSharesOneFrame)
+{
+    JsonValue config = ParseOrFail(
+        "{\"nodes\": ["
+        "  {\"name\": \"cam\", \"type\": \"source\", \"width\": 64, \"height\": 48, \"fps\": 0, \"frames\": 5},"
+        "  {\"name\": \"a\", \"type\": \"encode\", \"format\": \"jpeg\"},"
+        "  {\"name\": \"b\", \"type\": \"encode\", \"format\": \"png\"},"
+        "  {\"name\": \"half\", \"type\": \"resize\", \"width\": 32}"
+        "],"
+        " \"edges\": [{\"from\": \"cam\", \"to\": \"a\", \"depth\": 8}, {\"from\": \"cam\", \"to\": \"b\", \"depth\": 8},"
+        "            {\"from\": \"cam\", \"to\": \"half\", \"depth\": 8}]}");
+
+    Pipeline pipeline;
+    std::string error;
+    ASSERT_TRUE(pipeline.Load(config, error)) << error;
+
+    std::mutex mutex;
+    std::vector<FramePtr> sent, fromA, fromB, fromHalf;
+    auto collect = [&mutex](std::vector<FramePtr> &into)
+    {
+        return [&mutex, &into](const FramePtr &frame)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            into.push_back(frame);
+        };
+    };
+    ASSERT_TRUE(pipeline.SetTap("cam", collect(sent)));
+    ASSERT_TRUE(pipeline.SetTap("a", collect(fromA)));
+    ASSERT_TRUE(pipeline.SetTap("b", collect(fromB)));
+    ASSERT_TRUE(pipeline.SetTap("half", collect(fromHalf)));
+    pipeline.Start();
+    pipeline.Wait();
+    EXPECT_TRUE(pipeline.Finished());
+
+    ASSERT_EQ(sent.size(), 5u);
+    ASSERT_EQ(fromA.size(), 5u);
+    ASSERT_EQ(fromB.size(), 5u);
+    ASSERT_EQ(fromHalf.size(), 5u);
+    for (size_t i = 0; i < sent.size(); i++)
+    {
+        // Both encoders read the very same pixels and pass them on
+        EXPECT_EQ(fromA[i]->image.get(), sent[i]->image.get());
+        EXPECT_EQ(fromB[i]->image.get(), sent[i]->image.get());
+        EXPECT_EQ(fromA[i]->encoding, FrameEncoding::JPEG);
+        EXPECT_EQ(fromB[i]->encoding, FrameEncoding::PNG);
+        EXPECT_EQ(fromA[i]->sequence, sent[i]->sequence);
+        EXPECT_EQ(fromHalf[i]->width, 32u);
+        EXPECT_EQ(fromHalf[i]->height, 24u);
+        EXPECT_FALSE(fromHalf[i]->payload);
+    }
+    for (const PipelineNodeStats &s : pipeline.Stats())
+    {
+        EXPECT_EQ(s.errors, 0u) << s.name;
+        EXPECT_TRUE(s.finished) << s.name;
+    }
+}
+
+TEST(PipelineTest, MjpegPassesThroughAndDecodesOnce)
+{
+    JsonValue config = ParseOrFail(
+        "{\"nodes\": ["
+        "  {\"name\": \"cam\", \"type\": \"source\", \"width\": 640, \"height\": 480, \"fps\": 0,"
+        "   \"frames\": 4, \"mjpeg\": true},"
+        "  {\"name\": \"jpeg\", \"type\": \"encode\", \"format\": \"jpeg\"},"
+        "  {\"name\": \"thumb\", \"type\": \"resize\", \"width\": 160},"
+        "  {\"name\": \"tiny\", \"type\": \"resize\", \"width\": 100}"
+        "],"
+        " \"edges\": [{\"from\": \"cam\", \"to\": \"jpeg\", \"depth\": 8},"
+        "            {\"from\": \"cam\", \"to\": \"thumb\", \"depth\": 8},"
+        "            {\"from\": \"cam\", \"to\": \"tiny\", \"depth\": 8}]}");
+
+    Pipeline pipeline;
+    std::string error;
+    ASSERT_TRUE(pipeline.Load(config, error)) << error;
+
+    std::mutex mutex;
+    std::vector<FramePtr> sent, encoded, thumbs;
+    auto collect = [&mutex](std::vector<FramePtr> &into)
+    {
+        return [&mutex, &into](const FramePtr &frame)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            into.push_back(frame);
+        };
+    };
+    ASSERT_TRUE(pipeline.SetTap("cam", collect(sent)));
+    ASSERT_TRUE(pipeline.SetTap("jpeg", collect(encoded)));
+    ASSERT_TRUE(pipeline.SetTap("thumb", collect(thumbs)));
+    pipeline.Start();
+    pipeline.Wait();
+
+    ASSERT_EQ(sent.size(), 4u);
+    ASSERT_EQ(encoded.size(), 4u);
+    ASSERT_EQ(thumbs.size(), 4u);
+    for (size_t i = 0; i < sent.size(); i++)
+    {
+        // The camera's bytes go on untouched, never decoded for that
+        EXPECT_FALSE(sent[i]->image);
+        EXPECT_EQ(sent[i]->encoding, FrameEncoding::JPEG);
+        EXPECT_EQ(sent[i]->width, 640u);
+        EXPECT_EQ(encoded[i].get(), sent[i].get());
+
+        // Both resizes share one quarter scale decode
+        EXPECT_EQ(sent[i]->decodes, 1);
+        ASSERT_TRUE(sent[i]->decoded);
+        EXPECT_EQ(sent[i]->decoded->GetWidth(), 160);
+        EXPECT_EQ(thumbs[i]->width, 160u);
+        EXPECT_EQ(thumbs[i]->height, 120u);
+    }
+
+    // Asking for more than the cached decode decodes again, at full size
+    ImagePool pool(1);
+    std::shared_ptr<const Image> full = FramePixels(*sent[0], pool);
+    ASSERT_TRUE(full);
+    EXPECT_EQ(full->GetWidth(), 640);
+    EXPECT_EQ(sent[0]->decodes, 2);
+}
+
+TEST(PipelineTest, FirstDecodeServesTheBiggestNeed)
+{
+    // A thumbnail and a bigger consumer race for the frame, the second
+    // behind a node that forwards it untouched
+    struct Case
+    {
+        const char *big;
+        int decodedWidth;
+    };
+    const Case cases[] = {
+        {"{\"name\": \"big\", \"type\": \"convert\", \"to\": \"gray\"}", 640},
+        {"{\"name\": \"big\", \"type\": \"resize\", \"width\": 320}", 320},
+    };
+    for (const Case &test : cases)
+    {
+        SCOPED_TRACE(test.big);
+        JsonValue config = ParseOrFail(std::string(
+            "{\"nodes\": ["
+            "  {\"name\": \"cam\", \"type\": \"source\", \"width\": 640, \"height\": 480, \"fps\": 0,"
+            "   \"frames\": 6, \"mjpeg\": true},"
+            "  {\"name\": \"tiny\", \"type\": \"resize\", \"width\": 100},"
+            "  {\"name\": \"jpeg\", \"type\": \"encode\"},") + test.big +
+            "],"
+            " \"edges\": [{\"from\": \"cam\", \"to\": \"tiny\", \"depth\": 8},"
+            "            {\"from\": \"cam\", \"to\": \"jpeg\", \"depth\": 8},"
+            "            {\"from\": \"jpeg\", \"to\": \"big\", \"depth\": 8}]}");
+
+        Pipeline pipeline;
+        std::string error;
+        ASSERT_TRUE(pipeline.Load(config, error)) << error;
+        std::mutex mutex;
+        std::vector<FramePtr> sent, small;
+        ASSERT_TRUE(pipeline.SetTap("cam", [&](const FramePtr &frame)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            sent.push_back(frame);
+        }));
+        ASSERT_TRUE(pipeline.SetTap("tiny", [&](const FramePtr &frame)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            small.push_back(frame);
+        }));
+        pipeline.Start();
+        pipeline.Wait();
+
+        ASSERT_EQ(sent.size(), 6u);
+        ASSERT_EQ(small.size(), 6u);
+        for (size_t i = 0; i < sent.size(); i++)
+        {
+            EXPECT_EQ(sent[i]->decodes, 1);
+            ASSERT_TRUE(sent[i]->decoded);
+            EXPECT_EQ(sent[i]->decoded->GetWidth(), test.decodedWidth);
+            EXPECT_EQ(small[i]->width, 100u);
+        }
+    }
+}
+
+TEST(PipelineTest, OrientTurnsJpegFramesWithoutPixels)
+{
+    JsonValue config = ParseOrFail(
+        "{\"nodes\": ["
+        "  {\"name\": \"cam\", \"type\": \"source\", \"width\": 64, \"height\": 48, \"fps\": 0,"
+        "   \"frames\": 3, \"mjpeg\": true},"
+        "  {\"name\": \"turn\", \"type\": \"orient\", \"rotate\": 90, \"crop\": [0, 8, 64, 32]}"
+        "],"
+        " \"edges\": [{\"from\": \"cam\", \"to\": \"turn\", \"depth\": 8}]}");
+
+    Pipeline pipeline;
+    std::string error;
+    ASSERT_TRUE(pipeline.Load(config, error)) << error;
+    std::mutex mutex;
+    std::vector<FramePtr> sent, turned;
+    ASSERT_TRUE(pipeline.SetTap("cam", [&](const FramePtr &frame)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sent.push_back(frame);
+    }));
+    ASSERT_TRUE(pipeline.SetTap("turn", [&](const FramePtr &frame)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        turned.push_back(frame);
+    }));
+    pipeline.Start();
+    pipeline.Wait();
+
+    ASSERT_EQ(turned.size(), 3u);
+    for (size_t i = 0; i < turned.size(); i++)
+    {
+        EXPECT_EQ(sent[i]->decodes, 0);         // Nothing was decoded on the way
+        EXPECT_FALSE(turned[i]->image);
+        EXPECT_EQ(turned[i]->width, 32u);
+        EXPECT_EQ(turned[i]->height, 64u);
+        int width = 0, height = 0;
+        ASSERT_TRUE(Image::JPEGSize(turned[i]->payload->data(), turned[i]->payload->size(), width, height));
+        EXPECT_EQ(width, 32);
+        EXPECT_EQ(height, 64);
+    }
+
+    // Bad settings are configuration errors
+    const char *bad[] = {"\"rotate\": 45", "\"rotate\": 90, \"flip\": \"vertical\"",
+        "\"flip\": \"sideways\"", "\"crop\": [1, 2, 3]"};
+    for (const char *settings : bad)
+    {
+        Pipeline other;
+        EXPECT_FALSE(other.Load(ParseOrFail(
+            std::string("{\"nodes\": [{\"name\": \"cam\", \"type\": \"source\"},"
+            " {\"name\": \"o\", \"type\": \"orient\", ") + settings + "}],"
+            " \"edges\": [{\"from\": \"cam\", \"to\": \"o\"}]}"), error)) << settings;
+    }
+}
+
+TEST(PipelineTest, ShmRingFitsFramesBiggerThanTheFirst)
+{
+    FrameBus bus;
+    ImagePool pool;
+    std::atomic<bool> running(true);
+    PipelineContext context{bus, pool, running};
+    const std::string name = "/rtml_test_" + std::to_string(getpid()) + "_publish";
+    std::unique_ptr<PipelineNode> node = PipelineNode::Create("publish");
+    ASSERT_TRUE(node);
+    std::string error;
+    ASSERT_TRUE(node->Configure(ParseOrFail("{\"name\": \"out\", \"shm\": \"" + name + "\"}"),
+        context, error)) << error;
+
+    // A flat first frame encodes tiny, a busy one near the raw size
+    FramePtr out;
+    const size_t sizes[] = {100, 64 * 48 * 3};
+    for (uint64_t i = 0; i < 2; i++)
+    {
+        auto frame = std::make_shared<PipelineFrame>();
+        frame->sequence = i;
+        frame->width = 64;
+        frame->height = 48;
+        frame->encoding = FrameEncoding::JPEG;
+        frame->payload = std::make_shared<std::vector<uint8_t>>(sizes[i], static_cast<uint8_t>(i));
+        ASSERT_TRUE(node->Process(frame, out)) << sizes[i];
+
+        ShmFrameReader reader;
+        ASSERT_TRUE(reader.Open(name));
+        ShmFrame shm;
+        ASSERT_TRUE(reader.Receive(shm, 0));
+        EXPECT_EQ(shm.sequence, i);
+        EXPECT_EQ(shm.payloadSize, sizes[i]);
+    }
+
+    // Or a fixed size from the config
+    PipelineNode::Create("publish").swap(node);
+    ASSERT_TRUE(node->Configure(ParseOrFail("{\"name\": \"out\", \"shm\": \"" + name + "\","
+        " \"shm_max_bytes\": 1000}"), context, error)) << error;
+    std::shared_ptr<PipelineFrame> frame = std::make_shared<PipelineFrame>();
+    frame->width = 640;
+    frame->height = 480;
+    frame->encoding = FrameEncoding::JPEG;
+    frame->payload = std::make_shared<std::vector<uint8_t>>(500, 0);
+    EXPECT_TRUE(node->Process(frame, out));
+    frame->payload = std::make_shared<std::vector<uint8_t>>(5000, 0);
+    EXPECT_FALSE(node->Process(frame, out));
+}
@@ -0,0 +1,180 @@
+#include <cstdint>
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+#include "image.h"
+#include "image_proc.h"
+#include "postprocess.h"
+
+
+static Detection MakeBox(float x, float y, float w, float h, float score, int32_t classId)
+{
+    Detection det;
+    det.x = x;
+    det.y = y;
+    det.width = w;
+    det.height = h;
+    det.score = score;
+    det.classId = classId;
+    return det;
+}
+
+TEST(PostprocessTest, DecodeAppliesThresholdAndLetterbox)
+{
+    // Two already decoded rows (cx, cy, w, h, obj, 2 classes), no sigmoid
+    GridLayout layout;
+    layout.gridWidth = 2;
+    layout.gridHeight = 1;
+    layout.numClasses = 2;
+    layout.applySigmoid = false;
+
+    const float output[] = {
+        60.0f, 50.0f, 20.0f, 40.0f, 0.9f, 0.1f, 0.8f,
+        10.0f, 10.0f, 4.0f, 4.0f, 0.1f, 0.9f, 0.1f,      // Below threshold
+    };
+
+    InputTransform transform;
+    transform.scale = 0.5f;     // 200x200 frame letterboxed into 100x100 + 10px pad
+    transform.padY = 10.0f;
+    transform.frameWidth = 200.0f;
+    transform.frameHeight = 200.0f;
+
+    Postprocessor post;
+    std::vector<Detection> boxes;
+    ASSERT_EQ(post.Decode(output, layout, transform, boxes), 1u);
+    EXPECT_EQ(boxes[0].classId, 1);
+    EXPECT_NEAR(boxes[0].score, 0.72f, 1e-5f);
+    EXPECT_NEAR(boxes[0].x, 100.0f, 1e-4f);
+    EXPECT_NEAR(boxes[0].y, 40.0f, 1e-4f);
+    EXPECT_NEAR(boxes[0].width, 40.0f, 1e-4f);
+    EXPECT_NEAR(boxes[0].height, 80.0f, 1e-4f);
+}
+
+TEST(PostprocessTest, SuppressIsClassAware)
+{
+    std::vector<Detection> boxes = {
+        MakeBox(10, 10, 50, 50, 0.6f, 0),
+        MakeBox(12, 12, 50, 50, 0.9f, 0),   // Suppresses the first
+        MakeBox(11, 11, 50, 50, 0.7f, 1),   // Other class, kept
+        MakeBox(200, 200, 20, 20, 0.3f, 0), // No overlap, kept
+    };
+
+    Postprocessor post;
+    post.Suppress(boxes);
+    ASSERT_EQ(boxes.size(), 3u);
+    EXPECT_FLOAT_EQ(boxes[0].score, 0.9f);  // Input order is preserved
+    EXPECT_EQ(boxes[1].classId, 1);
+    EXPECT_FLOAT_EQ(boxes[2].score, 0.3f);
+
+    // Class agnostic: the class 1 box goes too
+    boxes.push_back(MakeBox(11, 11, 50, 50, 0.7f, 1));
+    post.classAware = false;
+    post.Suppress(boxes);
+    EXPECT_EQ(boxes.size(), 2u);
+
+    // A cap of zero keeps nothing, both ways
+    post.maxDetections = 0;
+    std::vector<Detection> greedy = boxes;
+    post.Suppress(boxes);
+    post.SuppressGreedy(greedy);
+    EXPECT_TRUE(boxes.empty());
+    EXPECT_TRUE(greedy.empty());
+}
+
+TEST(PostprocessTest, SuppressMatchesGreedyOnClusters)
+{
+    // Well separated clusters of jittered boxes: both NMS variants must
+    // keep exactly the best box of each cluster
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> jitter(-2.0f, 2.0f);
+    std::uniform_real_distribution<float> score(0.3f, 1.0f);
+
+    std::vector<Detection> boxes;
+    for (int cluster = 0; cluster < 20; cluster++)
+    {
+        float cx = 100.0f * (cluster % 5);
+        float cy = 100.0f * (cluster / 5);
+        for (int i = 0; i < 7; i++)
+        {
+            boxes.push_back(MakeBox(cx + jitter(rng), cy + jitter(rng), 40, 40, score(rng), cluster % 3));
+        }
+    }
+    std::vector<Detection> greedy = boxes;
+
+    Postprocessor post;
+    post.Suppress(boxes);
+    post.SuppressGreedy(greedy);
+    ASSERT_EQ(boxes.size(), 20u);
+    ASSERT_EQ(greedy.size(), 20u);
+
+    float fastSum = 0.0f, greedySum = 0.0f;
+    for (size_t i = 0; i < boxes.size(); i++)
+    {
+        fastSum += boxes[i].score;
+        greedySum += greedy[i].score;
+    }
+    EXPECT_FLOAT_EQ(fastSum, greedySum);
+
+    // Cap keeps the highest scores
+    post.maxDetections = 5;
+    post.Suppress(boxes);
+    ASSERT_EQ(boxes.size(), 5u);
+    for (const Detection &det : boxes)
+    {
+        EXPECT_GE(det.score, greedy[4].score);
+    }
+}
+
+TEST(PostprocessTest, DrawingClipsToImage)
+{
+    Image image(40, 30);
+    FillRect(image, 0, 0, 40, 30, Color{0, 0, 0});
+
+    DrawRect(image, 5, 5, 15, 15, Color{255, 0, 0}, 2);
+    EXPECT_EQ(image.GetPixelRed(5, 5), 255);
+    EXPECT_EQ(image.GetPixelRed(6, 10), 255);
+    EXPECT_EQ(image.GetPixelRed(10, 10), 0);    // Interior untouched
+    EXPECT_EQ(image.GetPixelRed(15, 15), 0);    // Exclusive bottom right
+
+    // Partly and fully outside the image must not crash
+    DrawRect(image, -1, -1, 100, 100, Color{0, 255, 0}, 3);
+    EXPECT_EQ(image.GetPixelGreen(0, 0), 255);
+    EXPECT_EQ(image.GetPixelGreen(39, 29), 0);  // Bottom edge is off-image
+    FillRect(image, 50, 50, 60, 60, Color{0, 0, 255});
+
+    int width = DrawText(image, 30, 25, "AB 1%", Color{0, 0, 255});
+    EXPECT_EQ(width, 5 * 6);
+
+    std::vector<Detection> boxes = {MakeBox(2, 2, 20, 20, 0.5f, 3)};
+    DrawDetections(image, boxes);
+    Color color = ClassColor(3);
+    EXPECT_EQ(image.GetPixelRed(21, 21), color.r);
+}
+
+TEST(PostprocessTest, ResizeAveragesWhenShrinking)
+{
+    Image image(8, 4);
+    for (int y = 0; y < 4; y++)
+    {
+        for (int x = 0; x < 8; x++)
+        {
+            image.SetPixelRed(x, y, static_cast<uint8_t>(x * 10));
+            image.SetPixelGreen(x, y, 100);
+            image.SetPixelBlue(x, y, static_cast<uint8_t>(y * 50));
+        }
+    }
+
+    Image half;
+    ASSERT_TRUE(ResizeImage(image, half, 4, 2));
+    ASSERT_EQ(half.GetWidth(), 4);
+    ASSERT_EQ(half.GetHeight(), 2);
+    EXPECT_EQ(half.GetPixelRed(1, 0), 25);      // mean of 20 and 30
+    EXPECT_EQ(half.GetPixelGreen(3, 1), 100);
+    EXPECT_EQ(half.GetPixelBlue(0, 1), 125);    // mean of 100 and 150
+
+    Image big;
+    ASSERT_TRUE(ResizeImage(half, big, 16, 8));
+    EXPECT_EQ(big.GetPixelGreen(15, 7), 100);
+    EXPECT_EQ(big.GetPixelRed(0, 0), 5);
+    EXPECT_FALSE(ResizeImage(half, half, 2, 2));
+}
@@ -0,0 +1,167 @@
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include "camera.h"
+#include "image_pool.h"
+#include "publisher.h"
+#include "receiver.h"
+#include "tcp_transport.h"
+#include "thread_pool.h"
+
+
+// Publish count synthetic JPEG frames on topic
+static void publish_frames(Publisher &publisher, int count, int width, int height)
+{
+    SyntheticCamera camera(width, height, 0.0);
+    Image image;
+    FrameMessage frame;
+    frame.encoding = FrameEncoding::JPEG;
+    frame.width = width;
+    frame.height = height;
+
+    for (int i = 1; i <= count; i++)
+    {
+        camera.Capture(image, frame.timestampUs);
+        ASSERT_TRUE(image.EncodeJPEG(frame.payload, 75));
+        frame.sequence = i;
+        publisher.Publish(frame);
+    }
+}
+
+TEST(ReceiverTest, ThreadPoolRunsEveryTask)
+{
+    ThreadPool pool(4);
+    std::atomic<int> sum(0);
+    for (int i = 1; i <= 100; i++)
+    {
+        pool.Submit([&sum, i] { sum += i; });
+    }
+    pool.Wait();
+    EXPECT_EQ(sum.load(), 5050);
+}
+
+TEST(ReceiverTest, ThreadPoolStealsNestedTasks)
+{
+    // Every task spawns children on its own worker's deque; idle workers
+    // have to steal them for the pool to drain
+    ThreadPool pool(4);
+    std::atomic<int> count(0);
+    for (int i = 0; i < 8; i++)
+    {
+        pool.Submit([&pool, &count]
+        {
+            for (int j = 0; j < 50; j++)
+            {
+                pool.Submit([&count] { count++; });
+            }
+            count++;
+        });
+    }
+    pool.Wait();
+    EXPECT_EQ(count.load(), 8 * 51);
+}
+
+TEST(ReceiverTest, ImagePoolReusesBuffers)
+{
+    ImagePool pool(4);
+    uint8_t *first;
+    {
+        std::shared_ptr<Image> image = pool.Acquire();
+        image->Resize(32, 32);
+        first = image->m_data;
+    }
+    EXPECT_EQ(pool.Idle(), 1u);
+
+    std::shared_ptr<Image> again = pool.Acquire();
+    EXPECT_EQ(again->m_data, first) << "Released image should be handed out again";
+    again->Resize(32, 32);
+    EXPECT_EQ(again->m_data, first) << "Same size should not reallocate";
+    EXPECT_EQ(pool.Created(), 1u);
+}
+
+TEST(ReceiverTest, DeliversEveryFrameInOrderFromBus)
+{
+    FrameBus bus;
+    Publisher publisher(bus, "cam");
+    const int kFrames = 40;
+
+    Receiver receiver(4, 4);
+    receiver.AddStream(std::unique_ptr<FrameSource>(
+        new BusFrameSource(bus.Subscribe("cam", kFrames))));
+
+    std::mutex mutex;
+    std::vector<uint64_t> sequences;
+    receiver.SetCallback([&](const ReceivedFrame &frame)
+    {
+        EXPECT_EQ(frame.image->GetWidth(), 64);
+        std::lock_guard<std::mutex> lock(mutex);
+        sequences.push_back(frame.sequence);
+    });
+
+    publish_frames(publisher, kFrames, 64, 48);
+    bus.Close();                // Source finishes once drained
+    receiver.Start();
+
+    for (int i = 0; i < 200; i++)
+    {
+        std::vector<ReceiverStreamStats> stats = receiver.Stats();
+        if (stats[0].finished && stats[0].frames == kFrames) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    receiver.Stop();
+
+    ASSERT_EQ(sequences.size(), static_cast<size_t>(kFrames));
+    for (int i = 0; i < kFrames; i++)
+    {
+        EXPECT_EQ(sequences[i], static_cast<uint64_t>(i + 1)) << "Frames must stay in order";
+    }
+    EXPECT_LE(receiver.PooledImages(), 8u) << "Decoded images should come from the pool";
+}
+
+TEST(ReceiverTest, ReceivesOverTcpFromSeveralSubscribers)
+{
+    FrameBus bus;
+    Publisher publisher(bus, "cam");
+    TcpFrameServer server(bus, 64);
+    ASSERT_TRUE(server.Start(0, "127.0.0.1"));
+
+    const int kSubscribers = 3;
+    const int kFrames = 10;
+    Receiver receiver(2, 4);
+    for (int i = 0; i < kSubscribers; i++)
+    {
+        std::unique_ptr<TcpFrameSource> source(
+            new TcpFrameSource("127.0.0.1", server.Port(), "cam"));
+        ASSERT_TRUE(source->Connected());
+        receiver.AddStream(std::move(source));
+    }
+
+    std::atomic<int> delivered(0);
+    receiver.SetCallback([&](const ReceivedFrame &) { delivered++; });
+    receiver.Start();
+
+    // Wait until the server has registered every subscription
+    for (int i = 0; i < 200 && server.Clients() < kSubscribers; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    publish_frames(publisher, kFrames, 32, 32);
+
+    for (int i = 0; i < 300 && delivered < kSubscribers * kFrames; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    receiver.Stop();
+    server.Stop();
+
+    EXPECT_EQ(delivered.load(), kSubscribers * kFrames);
+    for (const ReceiverStreamStats &s : receiver.Stats())
+    {
+        EXPECT_EQ(s.gaps, 0u);
+        EXPECT_EQ(s.errors, 0u);
+    }
+}
@@ -0,0 +1,255 @@
+#include <csignal>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "camera.h"
+#include "image.h"
+#include "recorder.h"
+
+
+class RecorderTest : public ::testing::Test
+{
+protected:
+    std::string prefix;
+
+    void SetUp() override
+    {
+        prefix = (std::filesystem::temp_directory_path() /
+            ("recorder_test_" + std::to_string(::getpid()))).string();
+    }
+
+    void TearDown() override
+    {
+        for (uint64_t i = 0; i < 64; i++)
+        {
+            std::filesystem::remove(Recorder::SegmentPath(prefix, i));
+        }
+    }
+
+    // Record count small synthetic frames, one detection on odd frames
+    void RecordFrames(Recorder &recorder, int count)
+    {
+        SyntheticCamera camera(32, 24, 0.0);
+        Image image;
+        std::vector<uint8_t> jpeg;
+        for (int i = 0; i < count; i++)
+        {
+            camera.Render(image, i);
+            ASSERT_TRUE(image.EncodeJPEG(jpeg, 50));
+
+            std::vector<Detection> detections;
+            if (i % 2)
+            {
+                Detection det;
+                det.x = static_cast<float>(i);
+                det.score = 0.5f;
+                det.classId = i;
+                detections.push_back(det);
+            }
+            ASSERT_TRUE(recorder.Write(100 + i, 1000 * (i + 1), 32, 24,
+                jpeg.data(), jpeg.size(), detections));
+        }
+    }
+};
+
+
+TEST_F(RecorderTest, RecordAndReplayByIndex)
+{
+    Recorder recorder;
+    ASSERT_TRUE(recorder.Open(prefix));
+    RecordFrames(recorder, 10);
+    ASSERT_TRUE(recorder.Close());
+    EXPECT_EQ(recorder.Segments(), 1u);
+
+    Player player;
+    ASSERT_TRUE(player.Open(prefix));
+    ASSERT_EQ(player.FrameCount(), 10u);
+    EXPECT_EQ(player.RecoveredSegments(), 0u);
+
+    RecordedFrame frame;
+    ASSERT_TRUE(player.GetFrame(3, frame));
+    EXPECT_EQ(frame.sequence, 103u);
+    EXPECT_EQ(frame.timestampUs, 4000u);
+    ASSERT_EQ(frame.detectionCount, 1u);
+    EXPECT_EQ(frame.detections[0].classId, 3);
+
+    Image decoded;
+    ASSERT_TRUE(decoded.DecodeJPEG(frame.jpeg, frame.jpegSize)) << "Recorded JPEG should decode";
+    EXPECT_EQ(decoded.GetWidth(), 32);
+    EXPECT_FALSE(player.GetFrame(10, frame));
+}
+
+TEST_F(RecorderTest, SeeksByTimestampAndSequence)
+{
+    Recorder recorder;
+    ASSERT_TRUE(recorder.Open(prefix));
+    RecordFrames(recorder, 10);
+    ASSERT_TRUE(recorder.Close());
+
+    Player player;
+    ASSERT_TRUE(player.Open(prefix));
+    EXPECT_EQ(player.FindByTimestamp(0), 0u);
+    EXPECT_EQ(player.FindByTimestamp(4000), 3u);
+    EXPECT_EQ(player.FindByTimestamp(4001), 4u);
+    EXPECT_EQ(player.FindByTimestamp(999999), player.FrameCount());
+    EXPECT_EQ(player.FindBySequence(107), 7u);
+    EXPECT_EQ(player.FindBySequence(5), player.FrameCount());
+
+    FrameMessage message;
+    ASSERT_TRUE(player.ToMessage(7, message));
+    EXPECT_EQ(message.encoding, FrameEncoding::JPEG);
+    ASSERT_EQ(message.detections.size(), 1u);
+    EXPECT_FLOAT_EQ(message.detections[0].x, 7.0f);
+}
+
+TEST_F(RecorderTest, RollsOverSegments)
+{
+    Recorder recorder(4096);  // Tiny segments, a couple of frames each
+    ASSERT_TRUE(recorder.Open(prefix));
+    RecordFrames(recorder, 12);
+    ASSERT_TRUE(recorder.Close());
+    EXPECT_GT(recorder.Segments(), 2u);
+
+    Player player;
+    ASSERT_TRUE(player.Open(prefix));
+    EXPECT_EQ(player.SegmentCount(), recorder.Segments());
+    ASSERT_EQ(player.FrameCount(), 12u);
+    for (size_t i = 0; i < player.FrameCount(); i++)
+    {
+        RecordedFrame frame;
+        ASSERT_TRUE(player.GetFrame(i, frame));
+        EXPECT_EQ(frame.sequence, 100 + i) << "Frames should stay in order across segments";
+    }
+}
+
+TEST_F(RecorderTest, RecoversSegmentWithoutIndex)
+{
+    Recorder recorder;
+    ASSERT_TRUE(recorder.Open(prefix));
+    RecordFrames(recorder, 5);
+    ASSERT_TRUE(recorder.Close());
+
+    // Simulate a crash: drop the index/footer and half of the last record
+    std::string path = Recorder::SegmentPath(prefix, 0);
+    size_t records = std::filesystem::file_size(path) -
+        sizeof(SegmentFooter) - 5 * sizeof(IndexEntry);
+    std::filesystem::resize_file(path, records - 10);
+
+    Player player;
+    ASSERT_TRUE(player.Open(prefix));
+    EXPECT_EQ(player.RecoveredSegments(), 1u);
+    EXPECT_EQ(player.FrameCount(), 4u) << "The truncated last record should be skipped";
+}
+
+TEST_F(RecorderTest, FailedWriteLeavesNoPartialRecord)
+{
+    Recorder recorder;
+    ASSERT_TRUE(recorder.Open(prefix));
+    RecordFrames(recorder, 3);
+    ASSERT_TRUE(recorder.Flush());
+
+    // The file size limit cuts the next record short part way through
+    // (more than the stdio buffer, so it goes straight to write())
+    struct rlimit saved;
+    ASSERT_EQ(getrlimit(RLIMIT_FSIZE, &saved), 0);
+    struct rlimit limit = saved;
+    limit.rlim_cur = std::filesystem::file_size(Recorder::SegmentPath(prefix, 0)) + 4096;
+    void (*handler)(int) = signal(SIGXFSZ, SIG_IGN);
+    ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &limit), 0);
+    std::vector<uint8_t> big(2 << 20, 0xab);
+    const bool written = recorder.Write(200, 50000, 32, 24, big.data(), big.size());
+    setrlimit(RLIMIT_FSIZE, &saved);
+    signal(SIGXFSZ, handler);
+    EXPECT_FALSE(written);
+
+    RecordFrames(recorder, 2);
+    ASSERT_TRUE(recorder.Close());
+
+    // The index still points at the right records
+    Player player;
+    ASSERT_TRUE(player.Open(prefix));
+    EXPECT_EQ(player.RecoveredSegments(), 0u);
+    ASSERT_EQ(player.FrameCount(), 5u);
+    const uint64_t sequences[] = {100, 101, 102, 100, 101};
+    for (size_t i = 0; i < player.FrameCount(); i++)
+    {
+        RecordedFrame frame;
+        ASSERT_TRUE(player.GetFrame(i, frame));
+        EXPECT_EQ(frame.sequence, sequences[i]);
+        Image decoded;
+        EXPECT_TRUE(decoded.DecodeJPEG(frame.jpeg, frame.jpegSize)) << i;
+    }
+}
+
+TEST_F(RecorderTest, IndexMustMatchTheRecords)
+{
+    Recorder recorder;
+    ASSERT_TRUE(recorder.Open(prefix));
+    RecordFrames(recorder, 5);
+    ASSERT_TRUE(recorder.Close());
+
+    const std::string path = Recorder::SegmentPath(prefix, 0);
+    const uint64_t size = std::filesystem::file_size(path);
+    const uint64_t indexOffset = size - sizeof(SegmentFooter) - 5 * sizeof(IndexEntry);
+    IndexEntry good;
+    {
+        std::ifstream in(path, std::ios::binary);
+        in.seekg(static_cast<std::streamoff>(indexOffset + sizeof(IndexEntry)));
+        in.read(reinterpret_cast<char *>(&good), sizeof(good));
+    }
+
+    // An entry claiming a bigger JPEG than its record, and one pointing
+    // into the middle of a record, both still inside the records: the
+    // index is ignored and the records scanned instead
+    IndexEntry bigger = good, shifted = good;
+    bigger.jpegSize += 16;
+    shifted.offset += 8;
+    for (const IndexEntry &bad : {bigger, shifted})
+    {
+        {
+            std::fstream out(path, std::ios::binary | std::ios::in | std::ios::out);
+            out.seekp(static_cast<std::streamoff>(indexOffset + sizeof(IndexEntry)));
+            out.write(reinterpret_cast<const char *>(&bad), sizeof(bad));
+        }
+        Player player;
+        ASSERT_TRUE(player.Open(prefix));
+        EXPECT_EQ(player.RecoveredSegments(), 1u);
+        ASSERT_EQ(player.FrameCount(), 5u);
+        RecordedFrame frame;
+        ASSERT_TRUE(player.GetFrame(1, frame));
+        EXPECT_EQ(frame.sequence, 101u);
+        EXPECT_EQ(frame.jpegSize, good.jpegSize);
+        ASSERT_EQ(frame.detectionCount, 1u);
+        EXPECT_EQ(frame.detections[0].classId, 1);
+    }
+}
+
+TEST_F(RecorderTest, NewRecordingReplacesOldSegments)
+{
+    Recorder recorder(4096);
+    ASSERT_TRUE(recorder.Open(prefix));
+    RecordFrames(recorder, 12);
+    ASSERT_TRUE(recorder.Close());
+    ASSERT_GT(recorder.Segments(), 2u);
+    const std::string unrelated = prefix + "-notes.mjr";
+    { std::ofstream(unrelated) << "kept"; }
+
+    // A shorter recording under the same prefix: none of the old frames
+    // may follow it on replay
+    ASSERT_TRUE(recorder.Open(prefix));
+    RecordFrames(recorder, 1);
+    ASSERT_TRUE(recorder.Close());
+
+    Player player;
+    ASSERT_TRUE(player.Open(prefix));
+    EXPECT_EQ(player.SegmentCount(), 1u);
+    EXPECT_EQ(player.FrameCount(), 1u);
+    EXPECT_FALSE(std::filesystem::exists(Recorder::SegmentPath(prefix, 1)));
+    EXPECT_TRUE(std::filesystem::exists(unrelated));
+    std::filesystem::remove(unrelated);
+}
@@ -0,0 +1,208 @@
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "json.h"
+#include "pipeline.h"
+#include "remap.h"
+
+
+// Odd sizes, so rows end in the middle of a SIMD step
+static void Fill(Image &image, int w, int h)
+{
+    ASSERT_TRUE(image.Resize(w, h));
+    for (int i = 0; i < w * h * 3; i++)
+    {
+        image.m_data[i] = static_cast<uint8_t>(i * 37 + (i >> 7));
+    }
+}
+
+static bool SamePixels(const Image &a, const Image &b)
+{
+    return a.GetWidth() == b.GetWidth() && a.GetHeight() == b.GetHeight() &&
+        memcmp(a.m_data, b.m_data, static_cast<size_t>(a.GetWidth()) * a.GetHeight() * 3) == 0;
+}
+
+TEST(RemapTest, WarpInterpolatesInFixedPoint)
+{
+    // 97 wide leaves 9 pixels after the last full SIMD step
+    const int w = 97, h = 37;
+    Image src, dst;
+    Fill(src, w, h);
+    SCOPED_TRACE(Remapper::KernelName());
+
+    // Every output pixel gets written, garbage must not survive
+    ASSERT_TRUE(dst.Resize(w, h));
+    memset(dst.m_data, 0x5a, static_cast<size_t>(w) * h * 3);
+
+    // Whole pixels are copied exactly
+    Remapper remapper(1);
+    ASSERT_TRUE(remapper.SetWarp(w, h, w, h, [](double x, double y, double &sx, double &sy)
+    {
+        sx = x;
+        sy = y;
+        return true;
+    }));
+    ASSERT_TRUE(remapper.Apply(src, dst));
+    EXPECT_TRUE(SamePixels(src, dst));
+
+    // Half a pixel right averages neighbours, rounding up; the last column
+    // falls off the source and is black
+    ASSERT_TRUE(remapper.SetWarp(w, h, w, h, [](double x, double y, double &sx, double &sy)
+    {
+        sx = x + 0.5;
+        sy = y;
+        return true;
+    }));
+    ASSERT_TRUE(remapper.Apply(src, dst));
+    for (int y = 0; y < h; y++)
+    {
+        for (int x = 0; x < w; x++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                const uint8_t *in = src.m_data + (y * w + x) * 3 + c;
+                const int expected = x == w - 1 ? 0 : (in[0] + in[3] + 1) >> 1;
+                ASSERT_EQ(dst.m_data[(y * w + x) * 3 + c], expected) << x << "," << y << " " << c;
+            }
+        }
+    }
+
+    // Out of range input is refused
+    Image wrong(w - 1, h);
+    EXPECT_FALSE(remapper.Apply(wrong, dst));
+    EXPECT_FALSE(remapper.Apply(src, src));
+    EXPECT_FALSE(remapper.SetWarp(1, h, w, h, [](double, double, double &, double &) { return true; }));
+    EXPECT_FALSE(Remapper(1).Apply(src, dst));
+}
+
+TEST(RemapTest, OrientationMatchesWarpOnAnyThreads)
+{
+    const int w = 53, h = 29;
+    Image src;
+    Fill(src, w, h);
+
+    struct Case
+    {
+        Orientation orientation;
+        bool turned;
+        Remapper::Warp warp;        // Output pixel to source pixel
+    };
+    const Case cases[] = {
+        {Orientation::Rotate90, true, [&](double x, double y, double &sx, double &sy)
+            { sx = y; sy = h - 1 - x; return true; }},
+        {Orientation::Rotate180, false, [&](double x, double y, double &sx, double &sy)
+            { sx = w - 1 - x; sy = h - 1 - y; return true; }},
+        {Orientation::Rotate270, true, [&](double x, double y, double &sx, double &sy)
+            { sx = w - 1 - y; sy = x; return true; }},
+        {Orientation::FlipHorizontal, false, [&](double x, double y, double &sx, double &sy)
+            { sx = w - 1 - x; sy = y; return true; }},
+        {Orientation::FlipVertical, false, [&](double x, double y, double &sx, double &sy)
+            { sx = x; sy = h - 1 - y; return true; }},
+    };
+    for (const Case &test : cases)
+    {
+        SCOPED_TRACE(static_cast<int>(test.orientation));
+        const int ow = test.turned ? h : w, oh = test.turned ? w : h;
+        Remapper exact(1), mapped(1), threaded(4);
+        ASSERT_TRUE(exact.SetOrientation(test.orientation, w, h));
+        ASSERT_TRUE(mapped.SetWarp(w, h, ow, oh, test.warp));
+        ASSERT_TRUE(threaded.SetOrientation(test.orientation, w, h));
+        EXPECT_EQ(exact.Width(), ow);
+        EXPECT_EQ(exact.Height(), oh);
+        EXPECT_EQ(exact.MapBytes(), 0u);
+
+        Image a, b, c;
+        ASSERT_TRUE(exact.Apply(src, a));
+        ASSERT_TRUE(mapped.Apply(src, b));
+        ASSERT_TRUE(threaded.Apply(src, c));
+        EXPECT_TRUE(SamePixels(a, b));
+        EXPECT_TRUE(SamePixels(a, c));
+    }
+}
+
+TEST(RemapTest, UndistortsWithCalibration)
+{
+    const int w = 160, h = 120;
+    Image src, dst;
+    Fill(src, w, h);
+    CameraCalibration calibration;
+    calibration.fx = calibration.fy = 100.0;
+    calibration.cx = 79.5;
+    calibration.cy = 59.5;
+
+    // No distortion, no zoom: every pixel stays where it is
+    Remapper remapper(1);
+    ASSERT_TRUE(remapper.SetUndistort(calibration, w, h));
+    EXPECT_GE(remapper.MapBytes(), static_cast<size_t>(w) * h * 6);
+    ASSERT_TRUE(remapper.Apply(src, dst));
+    EXPECT_TRUE(SamePixels(src, dst));
+
+    // Barrel distortion shown whole: the principal point stays, the
+    // stretched corners reach past the captured frame and go black
+    calibration.cx = 80.0;
+    calibration.cy = 60.0;
+    calibration.k1 = -0.3;
+    calibration.k2 = 0.08;
+    calibration.p1 = 0.001;
+    ASSERT_TRUE(remapper.SetUndistort(calibration, w, h, 0.6));
+    Image single, threaded;
+    ASSERT_TRUE(remapper.Apply(src, single));
+    const uint8_t *corner = single.m_data;
+    EXPECT_EQ(corner[0] | corner[1] | corner[2], 0);
+    const size_t centre = (60 * w + 80) * 3;
+    EXPECT_EQ(memcmp(single.m_data + centre, src.m_data + centre, 3), 0);
+
+    Remapper parallel(3);
+    ASSERT_TRUE(parallel.SetUndistort(calibration, w, h, 0.6));
+    ASSERT_TRUE(parallel.Apply(src, threaded));
+    EXPECT_TRUE(SamePixels(single, threaded));
+
+    calibration.fx = 0.0;
+    EXPECT_FALSE(remapper.SetUndistort(calibration, w, h));
+    calibration.fx = 100.0;
+    EXPECT_FALSE(remapper.SetUndistort(calibration, w, h, 0.0));
+}
+
+TEST(RemapTest, UndistortNodeRemapsFrames)
+{
+    JsonValue config;
+    std::string error;
+    ASSERT_TRUE(JsonValue::Parse(
+        "{\"nodes\": ["
+        "  {\"name\": \"cam\", \"type\": \"source\", \"width\": 64, \"height\": 48, \"fps\": 0,"
+        "   \"frames\": 3},"
+        "  {\"name\": \"lens\", \"type\": \"undistort\", \"fx\": 50, \"fy\": 50, \"k1\": -0.2,"
+        "   \"threads\": 2}"
+        "],"
+        " \"edges\": [{\"from\": \"cam\", \"to\": \"lens\", \"depth\": 4}]}", config, error)) << error;
+
+    Pipeline pipeline;
+    ASSERT_TRUE(pipeline.Load(config, error)) << error;
+    std::mutex mutex;
+    std::vector<FramePtr> frames;
+    ASSERT_TRUE(pipeline.SetTap("lens", [&](const FramePtr &frame)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        frames.push_back(frame);
+    }));
+    pipeline.Start();
+    pipeline.Wait();
+
+    ASSERT_EQ(frames.size(), 3u);
+    for (const FramePtr &frame : frames)
+    {
+        ASSERT_TRUE(frame->image);
+        EXPECT_EQ(frame->image->GetWidth(), 64);
+        EXPECT_EQ(frame->image->GetHeight(), 48);
+    }
+
+    // Calibration is required
+    ASSERT_TRUE(JsonValue::Parse(
+        "{\"nodes\": [{\"name\": \"lens\", \"type\": \"undistort\", \"fx\": 50}], \"edges\": []}",
+        config, error)) << error;
+    Pipeline bad;
+    EXPECT_FALSE(bad.Load(config, error));
+}
@@ -0,0 +1,114 @@
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "image.h"
+#include "image_proc.h"
+#include "shm_transport.h"
+
+
+static std::string RingName(const char *test)
+{
+    return "/rtml_test_" + std::to_string(getpid()) + "_" + test;
+}
+
+static FrameMessage MakeMeta(uint64_t sequence)
+{
+    FrameMessage meta;
+    meta.sequence = sequence;
+    meta.timestampUs = 1000 * sequence;
+    Detection det;
+    det.x = static_cast<float>(sequence);
+    det.classId = 2;
+    meta.detections.push_back(det);
+    return meta;
+}
+
+TEST(ShmTransportTest, ZeroCopyImageViews)
+{
+    ShmFrameWriter writer;
+    ASSERT_TRUE(writer.Create(RingName("views"), 4, 64 * 48 * 3, "cam0"));
+
+    ShmFrameReader reader;
+    ASSERT_TRUE(reader.Open(writer.Name()));
+    EXPECT_EQ(reader.StreamId(), "cam0");
+
+    Image image(64, 48);
+    ShmFrame frame;
+    for (uint64_t i = 0; i < 3; i++)
+    {
+        FillRect(image, 0, 0, 64, 48, Color{static_cast<uint8_t>(10 * i), 20, 30});
+        ASSERT_TRUE(writer.Publish(MakeMeta(i), image));
+
+        ASSERT_TRUE(reader.Receive(frame, 0));
+        EXPECT_EQ(frame.sequence, i);
+        EXPECT_EQ(frame.timestampUs, 1000 * i);
+        ASSERT_EQ(frame.detections.size(), 1u);
+        EXPECT_EQ(frame.detections[0].x, static_cast<float>(i));
+        EXPECT_TRUE(frame.image.IsView());
+        EXPECT_EQ(frame.image.m_data, frame.payload);
+        EXPECT_TRUE(frame.image == image);
+        EXPECT_TRUE(reader.Valid(frame));
+    }
+    EXPECT_FALSE(reader.Receive(frame, 0));     // Nothing new
+
+    // Payloads that do not fit a slot are refused
+    Image big(65, 48);
+    EXPECT_FALSE(writer.Publish(MakeMeta(3), big));
+}
+
+TEST(ShmTransportTest, SlowReaderSkipsToNewest)
+{
+    ShmFrameWriter writer;
+    ASSERT_TRUE(writer.Create(RingName("lapped"), 4, 1024));
+    ShmFrameReader reader;
+    ASSERT_TRUE(reader.Open(writer.Name()));
+
+    FrameMessage frame;
+    frame.encoding = FrameEncoding::JPEG;
+    frame.payload.assign(100, 0xab);
+    frame.sequence = 0;
+    ASSERT_TRUE(writer.Publish(frame));
+
+    ShmFrame received;
+    ASSERT_TRUE(reader.Receive(received, 0));
+    EXPECT_EQ(received.payloadSize, 100u);
+    EXPECT_FALSE(received.image.IsView());   // Not raw pixels
+
+    // The writer laps the ring: the held frame is invalidated and the
+    // reader continues from the newest one
+    for (frame.sequence = 1; frame.sequence <= 10; frame.sequence++)
+    {
+        ASSERT_TRUE(writer.Publish(frame));
+    }
+    EXPECT_FALSE(reader.Valid(received));
+    ASSERT_TRUE(reader.Receive(received, 0));
+    EXPECT_EQ(received.sequence, 10u);
+    EXPECT_EQ(reader.Missed(), 9u);
+}
+
+TEST(ShmTransportTest, ReceiveWakesOnPublish)
+{
+    ShmFrameWriter writer;
+    ASSERT_TRUE(writer.Create(RingName("wake"), 2, 16));
+    ShmFrameReader reader;
+    ASSERT_TRUE(reader.Open(writer.Name()));
+
+    ShmFrame received;
+    EXPECT_FALSE(reader.Receive(received, 20));     // Times out
+
+    std::thread producer([&writer]
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        writer.Publish(MakeMeta(7));
+    });
+    EXPECT_TRUE(reader.Receive(received, 5000));
+    EXPECT_EQ(received.sequence, 7u);
+    producer.join();
+
+    // Once the writer is gone the name is free again
+    writer.Close();
+    ShmFrameReader late;
+    EXPECT_FALSE(late.Open(RingName("wake")));
+}
@@ -0,0 +1,186 @@
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include "image_proc.h"
+#include "publisher.h"
+#include "simulcast.h"
+#include "tcp_transport.h"
+
+
+static std::shared_ptr<Image> Gradient(int width, int height)
+{
+    auto image = std::make_shared<Image>();
+    image->Resize(width, height);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            uint8_t *p = image->m_data + (static_cast<size_t>(y) * width + x) * 3;
+            p[0] = static_cast<uint8_t>(x);
+            p[1] = static_cast<uint8_t>(y);
+            p[2] = static_cast<uint8_t>((x + y) * 2);
+        }
+    }
+    return image;
+}
+
+static FrameMessage ParseOrFail(const FrameBus::Buffer &buffer)
+{
+    FrameMessage frame;
+    EXPECT_TRUE(ParseFrame(buffer->data(), buffer->size(), frame));
+    return frame;
+}
+
+TEST(SimulcastTest, PyramidBuildsLevelsOnceAndOnDemand)
+{
+    ImagePyramid pyramid;
+    EXPECT_EQ(pyramid.Level(0), nullptr);
+
+    std::shared_ptr<Image> frame = Gradient(64, 48);
+    pyramid.Reset(frame);
+    EXPECT_EQ(pyramid.Level(0), frame.get());
+    EXPECT_EQ(pyramid.LevelsBuilt(), 0u);
+
+    const Image *level2 = pyramid.Level(2);
+    ASSERT_NE(level2, nullptr);
+    EXPECT_EQ(level2->GetWidth(), 16);
+    EXPECT_EQ(level2->GetHeight(), 12);
+    EXPECT_EQ(pyramid.LevelsBuilt(), 2u);
+    EXPECT_EQ(pyramid.Level(2), level2);        // Shared, not rebuilt
+    EXPECT_EQ(pyramid.LevelsBuilt(), 2u);
+
+    // Level 1 pixel (3, 5) is the mean of source (6..7, 10..11)
+    const uint8_t *p = pyramid.Level(1)->m_data + (5 * 32 + 3) * 3;
+    EXPECT_EQ(p[0], 7);     // (6 + 7 + 6 + 7 + 2) / 4
+    EXPECT_EQ(p[1], 11);
+    EXPECT_EQ(p[2], 34);
+
+    // Exact level sizes come straight from the pyramid, others via scratch
+    Image scratch;
+    EXPECT_EQ(pyramid.Scaled(32, 24, scratch), pyramid.Level(1));
+    EXPECT_EQ(pyramid.Scaled(20, 15, scratch), &scratch);
+    EXPECT_EQ(scratch.GetWidth(), 20);
+    EXPECT_EQ(pyramid.Level(6), nullptr);       // 64x48 stops at 1x1 (level 5)
+    EXPECT_NE(pyramid.Level(5), nullptr);
+
+    pyramid.Reset(Gradient(8, 8));
+    EXPECT_EQ(pyramid.Level(1)->GetWidth(), 4);
+}
+
+TEST(SimulcastTest, PublishesEachLayerOnItsOwnTopic)
+{
+    FrameBus bus;
+    SimulcastPublisher simulcast(bus, "cam", 2);
+    EXPECT_TRUE(simulcast.AddLayer({"full", 128, 96, 90}));
+    EXPECT_TRUE(simulcast.AddLayer({"half", 0, 48, 80}));
+    EXPECT_TRUE(simulcast.AddLayer({"thumb", 40, 0, 70}));
+    EXPECT_FALSE(simulcast.AddLayer({"half", 10, 10, 80}));     // Duplicate
+    EXPECT_FALSE(simulcast.AddLayer({"none", 0, 0, 80}));
+    EXPECT_EQ(simulcast.LayerTopic("half"), "cam/half");
+
+    // Nobody subscribed: nothing is scaled or encoded
+    FrameMessage meta;
+    meta.sequence = 1;
+    ASSERT_TRUE(simulcast.Publish(meta, Gradient(128, 96)));
+    EXPECT_EQ(simulcast.Encodes(), 0u);
+
+    auto half1 = bus.Subscribe("cam/half", 8);
+    auto half2 = bus.Subscribe("cam/half", 8);
+    auto thumb = bus.Subscribe("cam/thumb", 8);
+    Detection det;
+    det.x = 64.0f;
+    det.width = 32.0f;
+    meta.detections.push_back(det);
+    for (uint64_t seq = 2; seq <= 4; seq++)
+    {
+        meta.sequence = seq;
+        ASSERT_TRUE(simulcast.Publish(meta, Gradient(128, 96)));
+    }
+    EXPECT_EQ(simulcast.Encodes(), 6u);             // Two layers, not three subscribers
+    EXPECT_EQ(simulcast.PyramidLevels(), 3u);       // 64x48 once per frame, reused for 40x30
+
+    FrameBus::Buffer a, b, c;
+    ASSERT_TRUE(half1->Receive(a, 0));
+    ASSERT_TRUE(half2->Receive(b, 0));
+    ASSERT_TRUE(thumb->Receive(c, 0));
+    EXPECT_EQ(a.get(), b.get());                    // One encode shared by both
+    FrameMessage half = ParseOrFail(a);
+    FrameMessage small = ParseOrFail(c);
+    EXPECT_EQ(half.sequence, 2u);
+    EXPECT_EQ(half.width, 64u);
+    EXPECT_EQ(half.height, 48u);
+    EXPECT_EQ(half.encoding, FrameEncoding::JPEG);
+    ASSERT_EQ(half.detections.size(), 1u);
+    EXPECT_FLOAT_EQ(half.detections[0].x, 32.0f);
+    EXPECT_EQ(small.width, 40u);
+    EXPECT_EQ(small.height, 30u);
+
+    Image decoded;
+    ASSERT_TRUE(decoded.Decode(half.payload.data(), half.payload.size()));
+    EXPECT_EQ(decoded.GetWidth(), 64);
+}
+
+TEST(SimulcastTest, SubscribersSwitchLayersAtRuntime)
+{
+    FrameBus bus;
+    SimulcastPublisher simulcast(bus, "cam", 1);
+    ASSERT_TRUE(simulcast.AddLayer({"hi", 64, 48, 80}));
+    ASSERT_TRUE(simulcast.AddLayer({"lo", 16, 12, 80}));
+
+    // In process
+    auto subscription = bus.Subscribe("cam/hi", 8);
+    FrameMessage meta;
+    meta.sequence = 1;
+    ASSERT_TRUE(simulcast.Publish(meta, Gradient(64, 48)));
+    bus.Switch(subscription, "cam/lo");
+    EXPECT_EQ(subscription->Topic(), "cam/lo");
+    EXPECT_EQ(bus.Subscribers("cam/hi"), 0u);
+    meta.sequence = 2;
+    ASSERT_TRUE(simulcast.Publish(meta, Gradient(64, 48)));
+
+    FrameBus::Buffer message;
+    ASSERT_TRUE(subscription->Receive(message, 0));
+    EXPECT_EQ(ParseOrFail(message).width, 64u);     // Queued before the switch
+    ASSERT_TRUE(subscription->Receive(message, 0));
+    EXPECT_EQ(ParseOrFail(message).width, 16u);
+    EXPECT_EQ(ParseOrFail(message).sequence, 2u);
+    bus.Unsubscribe(subscription);
+
+    // Over TCP, on the same connection
+    TcpFrameServer server(bus, 8);
+    ASSERT_TRUE(server.Start(0, "127.0.0.1"));
+    TcpFrameClient client;
+    ASSERT_TRUE(client.Connect("127.0.0.1", server.Port(), "cam/hi"));
+    for (int i = 0; i < 200 && bus.Subscribers("cam/hi") == 0; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    meta.sequence = 3;
+    ASSERT_TRUE(simulcast.Publish(meta, Gradient(64, 48)));
+
+    std::vector<uint8_t> bytes;
+    FrameMessage frame;
+    ASSERT_TRUE(client.Receive(bytes, 2000));
+    ASSERT_TRUE(ParseFrame(bytes.data(), bytes.size(), frame));
+    EXPECT_EQ(frame.width, 64u);
+
+    ASSERT_TRUE(client.Switch("cam/lo"));
+    for (int i = 0; i < 200 && bus.Subscribers("cam/lo") == 0; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(bus.Subscribers("cam/hi"), 0u);
+    meta.sequence = 4;
+    ASSERT_TRUE(simulcast.Publish(meta, Gradient(64, 48)));
+    ASSERT_TRUE(client.Receive(bytes, 2000));
+    ASSERT_TRUE(ParseFrame(bytes.data(), bytes.size(), frame));
+    EXPECT_EQ(frame.width, 16u);
+    EXPECT_EQ(frame.sequence, 4u);
+
+    client.Close();
+    server.Stop();
+}
@@ -0,0 +1,127 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "image.h"
+#include "camera.h"
+#include "frame_message_util.h"
+#include "publisher.h"
+
+
+TEST(StreamingTest, EncodeDecodeJPEGInMemory)
+{
+    SyntheticCamera camera(64, 48, 0.0);
+    Image original;
+    camera.Render(original, 3);
+
+    std::vector<uint8_t> jpeg;
+    ASSERT_TRUE(original.EncodeJPEG(jpeg, 90)) << "Failed to encode JPEG";
+    ASSERT_GT(jpeg.size(), 2u);
+    EXPECT_EQ(jpeg[0], 0xFF);   // SOI marker
+    EXPECT_EQ(jpeg[1], 0xD8);
+
+    Image decoded;
+    ASSERT_TRUE(decoded.DecodeJPEG(jpeg.data(), jpeg.size())) << "Failed to decode JPEG";
+    EXPECT_EQ(decoded.GetWidth(), 64);
+    EXPECT_EQ(decoded.GetHeight(), 48);
+    EXPECT_TRUE(original.compare(decoded, 0.02)) << "Decoded frame should be close to the original";
+}
+
+TEST(StreamingTest, DecodeJPEGRejectsGarbage)
+{
+    std::vector<uint8_t> garbage(128, 0x42);
+    Image img;
+    EXPECT_FALSE(img.DecodeJPEG(garbage.data(), garbage.size()));
+    EXPECT_FALSE(img.DecodeJPEG(nullptr, 0));
+}
+
+TEST(StreamingTest, FrameMessageRoundTrip)
+{
+    FrameMessage frame;
+    frame.sequence = 123456789012ull;
+    frame.timestampUs = 42;
+    frame.width = 1920;
+    frame.height = 1080;
+    frame.encoding = FrameEncoding::JPEG;
+    frame.payload = {0xFF, 0xD8, 0x00, 0x01, 0xFF, 0xD9};
+    frame.streamId = "cam/0";
+    Detection det;
+    det.x = 10.5f;
+    det.y = 20.25f;
+    det.width = 30.0f;
+    det.height = 40.0f;
+    det.score = 0.75f;
+    det.classId = 3;
+    det.trackId = -1;
+    frame.detections.push_back(det);
+    det.trackId = 0;
+    frame.detections.push_back(det);
+
+    std::vector<uint8_t> wire;
+    SerializeFrame(frame, wire);
+
+    FrameMessage parsed;
+    ASSERT_TRUE(ParseFrame(wire.data(), wire.size(), parsed));
+    EXPECT_EQ(parsed.sequence, frame.sequence);
+    EXPECT_EQ(parsed.timestampUs, frame.timestampUs);
+    EXPECT_EQ(parsed.width, frame.width);
+    EXPECT_EQ(parsed.height, frame.height);
+    EXPECT_EQ(parsed.encoding, FrameEncoding::JPEG);
+    EXPECT_EQ(parsed.payload, frame.payload);
+    EXPECT_EQ(parsed.streamId, frame.streamId);
+    ASSERT_EQ(parsed.detections.size(), 2u);
+    EXPECT_FLOAT_EQ(parsed.detections[0].y, 20.25f);
+    EXPECT_EQ(parsed.detections[0].classId, 3);
+    EXPECT_EQ(parsed.detections[0].trackId, -1);
+    EXPECT_EQ(parsed.detections[1].trackId, 0);
+
+    // Every truncation of a valid message must be rejected or parse cleanly
+    for (size_t n = 0; n < wire.size(); n++)
+    {
+        FrameMessage partial;
+        ParseFrame(wire.data(), n, partial);
+    }
+    EXPECT_FALSE(ParseFrame(wire.data(), wire.size() - 1, parsed));
+}
+
+TEST(StreamingTest, FrameBusDropsOldestWhenFull)
+{
+    FrameBus bus;
+    auto sub = bus.Subscribe("topic", 2);
+
+    for (uint8_t i = 1; i <= 5; i++)
+    {
+        auto msg = std::make_shared<std::vector<uint8_t>>(1, i);
+        EXPECT_EQ(bus.Publish("topic", msg), 1u);
+    }
+    EXPECT_EQ(bus.Publish("other", std::make_shared<std::vector<uint8_t>>()), 0u);
+
+    FrameBus::Buffer msg;
+    ASSERT_TRUE(sub->Receive(msg, 0));
+    EXPECT_EQ((*msg)[0], 4);    // 1..3 were dropped
+    ASSERT_TRUE(sub->Receive(msg, 0));
+    EXPECT_EQ((*msg)[0], 5);
+    EXPECT_FALSE(sub->Receive(msg, 0));
+    EXPECT_EQ(sub->Dropped(), 3u);
+
+    bus.Unsubscribe(sub);
+    EXPECT_EQ(bus.Publish("topic", msg), 0u);
+}
+
+TEST(StreamingTest, PublisherReachesEverySubscriber)
+{
+    FrameBus bus;
+    auto a = bus.Subscribe("cam", 4);
+    auto b = bus.Subscribe("cam", 4);
+    Publisher publisher(bus, "cam");
+
+    FrameMessage frame;
+    frame.sequence = 7;
+    EXPECT_EQ(publisher.Publish(frame), 2u);
+
+    FrameBus::Buffer fromA, fromB;
+    ASSERT_TRUE(a->Receive(fromA, 0));
+    ASSERT_TRUE(b->Receive(fromB, 0));
+    EXPECT_EQ(fromA.get(), fromB.get()) << "Subscribers should share one buffer";
+    EXPECT_EQ(publisher.Bytes(), fromA->size());
+}
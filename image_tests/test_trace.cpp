@@ -0,0 +1,66 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <gtest/gtest.h>
+#include "trace.h"
+
+
+static std::string ReadFile(const std::string &path)
+{
+    std::ifstream in(path);
+    std::stringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+static size_t CountOf(const std::string &text, const std::string &needle)
+{
+    size_t count = 0;
+    for (size_t pos = text.find(needle); pos != std::string::npos; pos = text.find(needle, pos + 1))
+    {
+        count++;
+    }
+    return count;
+}
+
+TEST(TraceTest, LinksStagesOfAFrameAcrossThreads)
+{
+    if (!Trace::Compiled())
+    {
+        GTEST_SKIP() << "built with TRACING=OFF";
+    }
+    const std::string path = "trace_test.json";
+    Trace::Clear();
+
+    {
+        TRACE_SCOPE("disabled");    // Not recorded
+    }
+
+    Trace::Enable(true);
+    {
+        TRACE_SCOPE_FRAME("produce", 42);
+    }
+    std::thread consumer([]
+    {
+        TRACE_THREAD_NAME("consumer \"one\"");
+        TRACE_SCOPE_FRAME("consume", 42);
+        TRACE_SCOPE("inner");
+    });
+    consumer.join();
+    Trace::Enable(false);
+
+    ASSERT_TRUE(Trace::WriteJSON(path));
+    const std::string json = ReadFile(path);
+    remove(path.c_str());
+    Trace::Clear();
+
+    EXPECT_EQ(CountOf(json, "\"disabled\""), 0u);
+    EXPECT_EQ(CountOf(json, "\"ph\":\"X\""), 3u);
+    EXPECT_EQ(CountOf(json, "\"bind_id\":\"0x2a\""), 2u);
+    EXPECT_EQ(CountOf(json, "\"flow_out\":true"), 1u);     // produce -> consume
+    EXPECT_EQ(CountOf(json, "\"flow_in\":true"), 1u);
+    EXPECT_NE(json.find("consumer \\\"one\\\""), std::string::npos);
+    EXPECT_LT(json.find("\"produce\""), json.find("\"consume\""));
+}
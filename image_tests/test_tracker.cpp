@@ -0,0 +1,113 @@
+#include <cmath>
+#include <vector>
+#include <gtest/gtest.h>
+#include "frame_message_util.h"
+#include "tracker.h"
+
+
+static Detection MakeBox(float x, float y, float w, float h, int32_t classId = 0)
+{
+    Detection det;
+    det.x = x;
+    det.y = y;
+    det.width = w;
+    det.height = h;
+    det.score = 0.9f;
+    det.classId = classId;
+    return det;
+}
+
+TEST(TrackerTest, PredictsBetweenDetections)
+{
+    Tracker tracker;
+    tracker.minInterval = 3;
+    tracker.maxInterval = 3;
+
+    // One box moving 4 px per frame, detected only when the tracker asks
+    std::vector<Detection> tracked;
+    int detections = 0;
+    int32_t id = -1;
+    for (int frame = 0; frame < 30; frame++)
+    {
+        const float x = 100.0f + 4.0f * frame;
+        if (tracker.DetectionDue())
+        {
+            tracker.Update({MakeBox(x, 50.0f, 40.0f, 40.0f)}, tracked);
+            detections++;
+        }
+        else
+        {
+            tracker.Predict(tracked);
+        }
+
+        if (frame < 12)
+        {
+            continue;   // Let the velocity settle
+        }
+        ASSERT_EQ(tracked.size(), 1u) << frame;
+        if (id < 0)
+        {
+            id = tracked[0].trackId;
+        }
+        EXPECT_EQ(tracked[0].trackId, id);
+        EXPECT_NEAR(tracked[0].x, x, 2.0f) << frame;
+        EXPECT_NEAR(tracked[0].y, 50.0f, 1.0f) << frame;
+    }
+    EXPECT_EQ(detections, 10);
+}
+
+TEST(TrackerTest, KeepsIdentitiesAndDropsLostTracks)
+{
+    Tracker tracker;
+    tracker.maxMisses = 1;
+    std::vector<Detection> tracked;
+
+    // Two objects, listed in a different order each time
+    tracker.Update({MakeBox(0, 0, 50, 50), MakeBox(200, 0, 50, 50, 1)}, tracked);
+    EXPECT_TRUE(tracked.empty());   // Not confirmed yet
+    tracker.Update({MakeBox(202, 1, 50, 50, 1), MakeBox(2, 1, 50, 50)}, tracked);
+    ASSERT_EQ(tracked.size(), 2u);
+
+    int32_t left = tracked[0].x < 100 ? tracked[0].trackId : tracked[1].trackId;
+    int32_t right = tracked[0].x < 100 ? tracked[1].trackId : tracked[0].trackId;
+    EXPECT_NE(left, right);
+
+    // The right object disappears: hidden at once, gone after maxMisses
+    tracker.Update({MakeBox(4, 2, 50, 50)}, tracked);
+    ASSERT_EQ(tracked.size(), 1u);
+    EXPECT_EQ(tracked[0].trackId, left);
+    EXPECT_EQ(tracker.TrackCount(), 2u);
+    tracker.Update({MakeBox(6, 3, 50, 50)}, tracked);
+    EXPECT_EQ(tracker.TrackCount(), 1u);
+
+    // A new object of the left one's class at the old right spot is a new track
+    tracker.Update({MakeBox(8, 4, 50, 50), MakeBox(200, 0, 50, 50)}, tracked);
+    tracker.Update({MakeBox(10, 5, 50, 50), MakeBox(200, 0, 50, 50)}, tracked);
+    ASSERT_EQ(tracked.size(), 2u);
+    for (const Detection &det : tracked)
+    {
+        EXPECT_EQ(det.trackId == left, det.x < 100) << det.trackId;
+        EXPECT_NE(det.trackId, right);
+    }
+}
+
+TEST(TrackerTest, IntervalFollowsSceneMotion)
+{
+    Tracker tracker;
+    std::vector<Detection> tracked;
+
+    // Still scene: the interval grows to the maximum
+    for (int i = 0; i < 20; i++)
+    {
+        tracker.Update({MakeBox(100, 100, 40, 40)}, tracked);
+    }
+    EXPECT_EQ(tracker.Interval(), tracker.maxInterval);
+
+    // Fast motion (a quarter of the box per frame): back to every frame
+    for (int i = 0; i < 20; i++)
+    {
+        tracker.Update({MakeBox(100.0f + 10.0f * i, 100, 40, 40)}, tracked);
+    }
+    EXPECT_EQ(tracker.Interval(), tracker.minInterval);
+    EXPECT_EQ(tracker.TrackCount(), 1u);
+}
@@ -0,0 +1,126 @@
+#ifndef ASYNC_WRITER_H
+#define ASYNC_WRITER_H
+
+// Includes
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "thread_pool.h"
+
+// Outcome of one AsyncWriter::Write()
+struct WriteResult
+{
+    std::string path;
+    size_t bytes = 0;
+    int error = 0;              // errno, 0 on success
+    bool direct = false;        // Written with O_DIRECT
+    double latencyUs = 0.0;     // Write() to completion
+};
+
+///////////////////////////////////////////////////////////////////////
+// Writes encoded buffers to files off the calling thread
+// NOTE:
+//      Write() only queues: it never touches the disk and never blocks,
+//      so a burst of event snapshots can't stall the stage that takes
+//      them. Instead, once maxInFlightBytes are queued or being written,
+//      further writes are rejected (counted, the caller decides) rather
+//      than letting the backlog grow without bound.
+//
+//      The io_uring backend (raw syscalls, no liburing) has one thread
+//      that opens files and submits their writes in batches, one
+//      io_uring_enter() for everything that queued up meanwhile. Where
+//      the filesystem allows it files are written with O_DIRECT from a
+//      block aligned copy, padded and then truncated to size, so
+//      snapshots don't push frames out of the page cache. Kernels or
+//      sandboxes without io_uring fall back to a thread pool doing plain
+//      pwrite() with the same O_DIRECT handling, as does a ring whose
+//      io_uring_enter() fails for good, once the kernel is done with the
+//      writes it already had.
+//
+//      Callbacks run on the writer's own threads; keep them short.
+///////////////////////////////////////////////////////////////////////
+class AsyncWriter
+{
+    public:
+        using Buffer = std::shared_ptr<const std::vector<uint8_t>>;
+        using Callback = std::function<void(const WriteResult &result)>;
+
+        enum class Backend
+        {
+            Auto,           // io_uring when available, else threads
+            Threads,
+        };
+
+        struct Options
+        {
+            Backend backend = Backend::Auto;
+            size_t maxInFlightBytes = 64u << 20;
+            unsigned queueDepth = 64;   // io_uring entries, writes in flight at once
+            size_t threads = 2;         // Thread backend workers
+            bool direct = true;         // Try O_DIRECT
+
+            // Testing: io_uring_enter() calls failEnterAt (1 based) and the
+            // failEnterCount - 1 after it fail with failEnterErrno
+            unsigned failEnterAt = 0;
+            unsigned failEnterCount = 1;
+            int failEnterErrno = ENOMEM;
+        };
+
+        AsyncWriter();
+        explicit AsyncWriter(const Options &options);
+        ~AsyncWriter();     // Finishes every queued write
+
+        AsyncWriter(const AsyncWriter &) = delete;
+        AsyncWriter &operator=(const AsyncWriter &) = delete;
+
+        // Queue data to be written to path (created or truncated). The
+        // buffer is shared, not copied. Returns false when it does not fit
+        // in the in-flight budget; done is then not called.
+        bool Write(const std::string &path, Buffer data, Callback done = nullptr);
+
+        void Flush();       // Wait until everything queued so far is written
+
+        const char *BackendName() const;
+        uint64_t Written();             // Files completed successfully
+        uint64_t Failed();
+        uint64_t Rejected();            // Over the in-flight budget
+        uint64_t Submits();             // io_uring_enter() submit calls (batches)
+        size_t InFlightBytes() { return m_inFlightBytes.load(); }
+        size_t PeakInFlightBytes() { return m_peakBytes.load(); }
+
+    private:
+        struct Job;     // One file, see async_writer.cpp
+        struct Ring;    // The io_uring queues
+
+        Options m_options;
+        std::unique_ptr<Ring> m_ring;           // Null on the thread backend
+        std::unique_ptr<ThreadPool> m_pool;     // Null on the io_uring backend
+        std::thread m_thread;                   // io_uring submit/complete loop
+
+        std::mutex m_mutex;
+        std::condition_variable m_idle;
+        std::deque<std::unique_ptr<Job>> m_queue;   // Waiting for the ring thread
+        size_t m_pending;                           // Queued or in flight
+        bool m_stop;
+        uint64_t m_written, m_failed, m_rejected, m_submits;
+        std::atomic<size_t> m_inFlightBytes;
+        std::atomic<size_t> m_peakBytes;
+        std::atomic<int> m_ringError;           // io_uring_enter() gave up, threads from then on
+
+        void ringLoop();
+        void syncLoop();
+        void abandonRing(std::vector<Job *> &active, int error);
+        void finish(std::unique_ptr<Job> job);
+};
+
+#endif // ASYNC_WRITER_H
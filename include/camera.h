@@ -0,0 +1,51 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+// Includes
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "image.h"
+
+///////////////////////////////////////////////////////////////////////
+// Synthetic frame source
+// NOTE:
+//      Produces a moving colour gradient with per-pixel noise so that
+//      benchmarks and tests can drive the pipeline without a camera. The
+//      noise keeps JPEG from compressing the frames unrealistically well.
+///////////////////////////////////////////////////////////////////////
+class SyntheticCamera
+{
+    private:
+        int m_width;
+        int m_height;
+        double m_fps;           // 0 = as fast as possible
+        uint64_t m_frameIndex;
+        uint32_t m_seed;        // Noise generator state
+        int m_noise;            // Noise amplitude, 0..255
+        std::chrono::steady_clock::time_point m_nextFrame;
+        Image m_sensor;         // Frame being compressed by CaptureJPEG()
+
+    public:
+        SyntheticCamera(int w, int h, double fps = 30.0, int noise = 16);
+
+        // Fill frame with the next image, waiting until it is due when an
+        // fps is set. frame is resized if needed. timestampUs receives the
+        // capture time from NowMicros().
+        bool Capture(Image &frame, uint64_t &timestampUs);
+
+        // Like a USB camera in MJPEG mode: the next frame, paced the same
+        // way, delivered already JPEG compressed into jpeg (reused). The
+        // encode stands in for the camera's own encoder.
+        bool CaptureJPEG(std::vector<uint8_t> &jpeg, uint64_t &timestampUs, int quality = 80);
+
+        // Render frame number index without pacing (deterministic)
+        void Render(Image &frame, uint64_t index);
+
+        uint64_t FrameIndex() const { return m_frameIndex; }   // Frames captured so far
+        int GetWidth() const { return m_width; }
+        int GetHeight() const { return m_height; }
+};
+
+#endif // CAMERA_H
@@ -0,0 +1,59 @@
+#ifndef FRAME_MESSAGE_UTIL_H
+#define FRAME_MESSAGE_UTIL_H
+
+// Includes
+#include <cstddef>     // for size_t
+#include <cstdint>     // for uint8_t, uint64_t
+#include <string>      // for std::string
+#include <vector>      // for std::vector
+
+///////////////////////////////////////////////////////////////////////
+// Frame message helpers
+// NOTE:
+//      These structs mirror frame.proto. They are serialized directly in
+//      the protobuf wire format, so the Python viewer can parse them with
+//      the generated frame_pb2 module without the C++ side depending on
+//      libprotobuf or generated code.
+///////////////////////////////////////////////////////////////////////
+
+// Payload encoding, values match frame.Frame.Encoding
+enum class FrameEncoding : uint32_t
+{
+    RawRGB = 0,
+    JPEG = 1,
+    PNG = 2,
+};
+
+// One object found by inference (frame.Detection)
+struct Detection
+{
+    float x = 0.0f;         // Left edge in pixels
+    float y = 0.0f;         // Top edge in pixels
+    float width = 0.0f;
+    float height = 0.0f;
+    float score = 0.0f;     // Confidence, 0..1
+    int32_t classId = 0;
+    int32_t trackId = -1;   // -1 when the object is not tracked
+};
+
+// A single published frame (frame.Frame)
+struct FrameMessage
+{
+    uint64_t sequence = 0;      // Increments by one per frame on a stream
+    uint64_t timestampUs = 0;   // Capture time, microseconds
+    uint32_t width = 0;
+    uint32_t height = 0;
+    FrameEncoding encoding = FrameEncoding::RawRGB;
+    std::vector<uint8_t> payload;
+    std::vector<Detection> detections;
+    std::string streamId;
+};
+
+// Serialize a frame into out (replacing its contents, keeping its capacity)
+void SerializeFrame(const FrameMessage &frame, std::vector<uint8_t> &out);
+
+// Parse a serialized frame. Unknown fields are skipped.
+// Returns false if the buffer is truncated or malformed.
+bool ParseFrame(const uint8_t *data, size_t size, FrameMessage &frame);
+
+#endif // FRAME_MESSAGE_UTIL_H
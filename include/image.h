@@ -1,6 +1,49 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
 // Includes
+#include <atomic>      // for std::atomic
+#include <cstddef>     // for size_t
 #include <cstdint>     // for uint8_t
+#include <memory>      // for std::shared_ptr
 #include <string>      // for std::string
+#include <vector>      // for std::vector
+
+// Formats known to the codec registry
+enum class ImageFormat
+{
+    Unknown = 0,
+    PNG,
+    JPEG,
+    QOI,        // "Quite OK Image" format, fast lossless
+};
+
+// Lossless JPEG transforms, see Image::TransformJPEG()
+enum class JPEGTransformType
+{
+    None = 0,           // Crop only
+    Rotate90,           // Clockwise
+    Rotate180,
+    Rotate270,
+    FlipHorizontal,     // Mirror left to right
+    FlipVertical,       // Upside down
+};
+
+struct JPEGTransform
+{
+    JPEGTransformType type = JPEGTransformType::None;
+
+    // Region of the source to keep, before the rotation or flip. The
+    // corner is moved up and left onto the MCU grid (the region grows by
+    // as much); a size of 0 runs to the edge of the image.
+    int cropX = 0;
+    int cropY = 0;
+    int cropWidth = 0;
+    int cropHeight = 0;
+};
+
+// Pyramid levels and integral image kept with the pixels, see image_proc.h
+struct ImageCache;
 
 //Image Class
 class Image
@@ -9,9 +52,14 @@ class Image
         int m_width;
         int m_height;
         int m_buffSize;           // Resolution for JPEG compression
+        bool m_owned;             // m_data was allocated by this Image
+        mutable std::shared_ptr<ImageCache> m_cache;    // Derived from the current pixels
+        mutable std::atomic<bool> m_hasCache{false};    // Touch() skips the shared_ptr op without one
 
         int openJPEG(struct jpeg_decompress_struct *cinfo,
                         std::string infilename);
+        bool decodeJPEG(struct jpeg_decompress_struct *cinfo,
+                        const uint8_t *data, size_t size, int scale);
 
     public:
         uint8_t *m_data;
@@ -19,6 +67,43 @@ class Image
         Image(); // Default constructor
         Image(int w, int h);    // Alocate memory for the Array
 
+        // Images own their pixel buffer, so they can be moved but not copied
+        Image(const Image &) = delete;
+        Image &operator=(const Image &) = delete;
+        Image(Image &&other) noexcept;
+        Image &operator=(Image &&other) noexcept;
+
+        // Non-owning view of w x h RGB pixels that live elsewhere (a shared
+        // memory slot, a mapped file). The memory must outlive the view and
+        // is not freed by it.
+        static Image View(uint8_t *data, int w, int h);
+        bool IsView() const { return m_data && !m_owned; }
+
+        // Largest image Resize() and the decoders accept (1.2 GB of RGB),
+        // so a forged header can't ask for a buffer that wraps an int
+        static const uint64_t kMaxPixels = 400000000ull;
+
+        // Resize the pixel buffer. Memory is only reallocated when the size
+        // changes; the contents are not preserved. A view resized to a new
+        // size gets its own buffer. False for negative sizes or more than
+        // kMaxPixels.
+        bool Resize(int w, int h);
+
+        int GetWidth() const { return m_width; }       // Width in pixels
+        int GetHeight() const { return m_height; }     // Height in pixels
+        int GetBufferSize() const { return m_buffSize; } // Size of m_data in bytes
+
+        // The pixels changed: drops whatever was derived from the old ones
+        // (the ImageCache). Resize(), the decoders and SetPixel do this
+        // themselves; code that writes m_data directly calls it.
+        void Touch();
+
+        // The cache attached to these pixels, null until AttachCache().
+        // AttachCache() keeps whichever cache got there first and returns
+        // it, so threads racing to create one all end up sharing it.
+        std::shared_ptr<ImageCache> Cache() const;
+        std::shared_ptr<ImageCache> AttachCache(std::shared_ptr<ImageCache> cache) const;
+
         bool operator==(const Image &other) const;      
         bool compare(const Image &other, double maxPercentError = 0.0) const; // Compare two images      
         
@@ -36,8 +121,60 @@ class Image
         bool SaveJPEG(std::string filename, int quality = 100); // Save the image to a jpg file
         int OpenJPEG(std::string infilename);
 
-        bool SaveFile(std::string infilename, int quality = 100);
-        bool OpenFile(std::string infilename);
+        // In-memory JPEG. The output vector is reused, so encoding into the
+        // same vector every frame does not allocate once it is big enough.
+        bool EncodeJPEG(std::vector<uint8_t> &out, int quality = 100) const;
+        bool DecodeJPEG(const uint8_t *data, size_t size);
+
+        // Decode at 1/scale of the size (scale 1, 2, 4 or 8, rounding up).
+        // The scaling happens in the IDCT, so a 1/4 decode skips most of
+        // the work instead of decoding everything and shrinking it.
+        bool DecodeJPEG(const uint8_t *data, size_t size, int scale);
+
+        // Size of a JPEG from its header, without decoding
+        static bool JPEGSize(const uint8_t *data, size_t size, int &width, int &height);
+
+        // Largest scale (see DecodeJPEG) that still decodes a width x
+        // height JPEG to at least minWidth x minHeight
+        static int JPEGScaleFor(int width, int height, int minWidth, int minHeight);
+
+        // Rotate, flip and/or crop a JPEG without decoding it: the DCT
+        // coefficients are moved (and sign flipped) block by block, so
+        // there is no IDCT, no re-encode and no generation loss. Blocks
+        // can only move as whole MCUs, so an axis that gets mirrored
+        // drops its partial edge MCU (as jpegtran -trim does). applied
+        // returns the crop actually used; the output is that size, turned
+        // for 90 and 270. Markers (EXIF) are not copied.
+        static bool TransformJPEG(const uint8_t *data, size_t size, std::vector<uint8_t> &out,
+            const JPEGTransform &transform, JPEGTransform *applied = nullptr);
+
+        // In-memory PNG and QOI, the output vector is reused the same way
+        bool EncodePNG(std::vector<uint8_t> &out) const;
+        bool DecodePNG(const uint8_t *data, size_t size);
+        bool EncodeQOI(std::vector<uint8_t> &out) const;
+        bool DecodeQOI(const uint8_t *data, size_t size);
+
+        bool SaveQOI(const std::string &filePath) const;   // Save the image to a qoi file
+        bool OpenQOI(const std::string &filePath);         // Read the image from a qoi file
+
+        // Generic interface through the codec registry. Saving picks the
+        // format from the extension (case-insensitive), opening and Decode()
+        // detect it from the magic bytes, whatever the file is called.
+        bool Encode(std::vector<uint8_t> &out, ImageFormat format, int quality = 100) const;
+        bool Decode(const uint8_t *data, size_t size);
+        bool SaveFile(const std::string &filePath, int quality = 100);
+        bool OpenFile(const std::string &filePath);
+
+        // Why the last codec call on this thread failed. The codecs never
+        // print; every call has its own libjpeg/libpng state, so different
+        // Images can be encoded and decoded on different threads at once.
+        static const char *LastError();
+
+        static ImageFormat DetectFormat(const uint8_t *data, size_t size);
+        static ImageFormat FormatFromPath(const std::string &filePath);
+        static const char *FormatName(ImageFormat format);
 
         ~Image(); // Free memory
-};
\ No newline at end of file
+};
+
+#endif // IMAGE_H
@@ -0,0 +1,47 @@
+#ifndef IMAGE_POOL_H
+#define IMAGE_POOL_H
+
+// Includes
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "image.h"
+
+///////////////////////////////////////////////////////////////////////
+// Pool of reusable Image buffers
+// NOTE:
+//      Acquire() hands out a shared_ptr whose deleter puts the Image back
+//      in the pool instead of freeing it, so decoding a stream of frames
+//      of the same size stops allocating after the first few frames. The
+//      pool may be destroyed while images are still out; they are then
+//      simply freed when released.
+///////////////////////////////////////////////////////////////////////
+class ImagePool
+{
+    private:
+        struct State
+        {
+            std::mutex mutex;
+            std::vector<Image *> idle;
+            size_t maxIdle;
+            size_t created;
+            bool closed;
+        };
+        std::shared_ptr<State> m_state;
+
+    public:
+        explicit ImagePool(size_t maxIdle = 16);
+        ~ImagePool();
+
+        ImagePool(const ImagePool &) = delete;
+        ImagePool &operator=(const ImagePool &) = delete;
+
+        std::shared_ptr<Image> Acquire();   // Pixel contents are unspecified
+
+        size_t Idle();                      // Images waiting in the pool
+        size_t Created();                   // Images allocated so far
+};
+
+#endif // IMAGE_POOL_H
@@ -0,0 +1,130 @@
+#ifndef IMAGE_PROC_H
+#define IMAGE_PROC_H
+
+// Includes
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "frame_message_util.h"   // for Detection
+#include "image.h"
+
+///////////////////////////////////////////////////////////////////////
+// In-place drawing on RGB Images
+// NOTE:
+//      Everything draws straight into Image::m_data and clips to the
+//      image, so overlays can be rendered just before encoding without
+//      copying the frame.
+///////////////////////////////////////////////////////////////////////
+
+struct Color
+{
+    uint8_t r, g, b;
+};
+
+// Distinct colour per class id
+Color ClassColor(int32_t classId);
+
+// Filled rectangle, [x0, x1) x [y0, y1)
+void FillRect(Image &image, int x0, int y0, int x1, int y1, Color color);
+
+// Rectangle outline of the given thickness, growing inwards
+void DrawRect(Image &image, int x0, int y0, int x1, int y1, Color color, int thickness = 2);
+
+// Text with the built-in 5x7 font (digits, letters, " .:-%#/_"), scale
+// is the pixel size of one font dot. Returns the width drawn.
+int DrawText(Image &image, int x, int y, const std::string &text, Color color, int scale = 1);
+
+// Boxes plus a "label score" tag per detection. labels maps class id to
+// a name; classes without a name are shown by number.
+void DrawDetections(Image &image, const std::vector<Detection> &detections,
+    const std::vector<std::string> *labels = nullptr, int thickness = 2);
+
+///////////////////////////////////////////////////////////////////////
+// Scaling
+///////////////////////////////////////////////////////////////////////
+
+// Resize src into dst (dst is resized, its buffer reused when possible).
+// Shrinking averages every source pixel under the output pixel (area
+// filter, no aliasing); enlarging is bilinear. src and dst must differ.
+bool ResizeImage(const Image &src, Image &dst, int width, int height);
+
+///////////////////////////////////////////////////////////////////////
+// Data derived from a frame, cached with its pixels
+// NOTE:
+//      Multi-scale detection, thumbnails and the simulcast layers all
+//      want smaller copies of the same frame. These keep them with the
+//      Image (Image::AttachCache()), so every consumer shares one set,
+//      each part built on first use:
+//        - the pyramid: level 0 is the frame itself, level n + 1 is
+//          level n halved with a 2x2 box filter (an odd last row or
+//          column is dropped), built only down to the level asked for
+//        - the luma integral image, for box sums in constant time
+//      Image::Touch() (which Resize() and the decoders call) drops the
+//      cache, so changed pixels are never served stale levels. Level
+//      buffers come from a shared pool and go back to it with the cache.
+//      Safe from several threads at once; returned pointers stay valid
+//      until the pixels change or the Image goes away.
+///////////////////////////////////////////////////////////////////////
+
+// Luma sums over every [0, x) x [0, y), Y = (77 R + 150 G + 29 B) >> 8.
+// The sums wrap around past 2^32, but any box of up to 16M pixels still
+// comes out exact.
+struct IntegralImage
+{
+    int width = 0;                  // Of the image
+    int height = 0;
+    std::vector<uint32_t> sums;     // (width + 1) x (height + 1), row 0 and column 0 are 0
+
+    // Luma sum over [x0, x1) x [y0, y1)
+    uint32_t Sum(int x0, int y0, int x1, int y1) const
+    {
+        const size_t stride = static_cast<size_t>(width) + 1;
+        return sums[y1 * stride + x1] - sums[y0 * stride + x1] - sums[y1 * stride + x0] + sums[y0 * stride + x0];
+    }
+};
+
+// Level n of the image's pyramid, null past the last level (1x1)
+const Image *PyramidLevel(const Image &image, int level);
+
+// The image at width x height: the level of exactly that size when there
+// is one, otherwise scratch, area-resized from the smallest level that is
+// still at least that big
+const Image *PyramidScaled(const Image &image, int width, int height, Image &scratch);
+
+// Null for an empty image
+const IntegralImage *LumaIntegral(const Image &image);
+
+// Pyramid levels computed so far, all images
+uint64_t PyramidLevelsBuilt();
+
+///////////////////////////////////////////////////////////////////////
+// Pyramid of the current frame of a stream
+// NOTE:
+//      A holder for the frame plus the levels it had to build itself;
+//      the levels live in the frame's cache, shared with everything else
+//      that looks at the same frame. Safe to use from several threads.
+///////////////////////////////////////////////////////////////////////
+class ImagePyramid
+{
+    private:
+        std::mutex m_mutex;
+        std::shared_ptr<const Image> m_source;
+        uint64_t m_built;                       // Levels built through this pyramid
+
+    public:
+        ImagePyramid();
+
+        // Start over with a new frame, kept alive until the next Reset()
+        void Reset(std::shared_ptr<const Image> source);
+
+        // See PyramidLevel() and PyramidScaled(), null without a frame
+        const Image *Level(int level);
+        const Image *Scaled(int width, int height, Image &scratch);
+
+        uint64_t LevelsBuilt();
+};
+
+#endif // IMAGE_PROC_H
@@ -0,0 +1,163 @@
+#ifndef INFERENCE_H
+#define INFERENCE_H
+
+// Includes
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "image.h"
+
+// real = scale * (q - zeroPoint)
+struct QuantParams
+{
+    float scale = 1.0f;
+    int32_t zeroPoint = 0;
+};
+
+// Convolution over an NHWC tensor (a dense layer is a conv whose kernel
+// covers the whole input)
+struct ConvLayer
+{
+    int inChannels = 0;
+    int outChannels = 0;
+    int kernel = 1;
+    int stride = 1;
+    int pad = 0;
+    bool relu = true;
+    std::vector<float> weights;     // [out][ky][kx][in]
+    std::vector<float> bias;        // [out]
+};
+
+// Observed output range of one layer, for calibration
+struct ActivationRange
+{
+    float min = 0.0f;
+    float max = 0.0f;
+};
+
+///////////////////////////////////////////////////////////////////////
+// Float32 network, the reference path
+// NOTE:
+//      Input is the RGB image resized to inputWidth x inputHeight,
+//      normalized per channel with (pixel / 255 - mean) / stddev. Keeps
+//      its scratch tensors between calls: one instance per thread.
+///////////////////////////////////////////////////////////////////////
+class Network
+{
+    private:
+        std::vector<float> m_bufferA, m_bufferB;
+        std::vector<float> m_column;
+        std::vector<float> m_packed;        // Weights of the current layer
+        std::vector<float> m_sums;
+        Image m_resized;
+
+    public:
+        int inputWidth = 224;
+        int inputHeight = 224;
+        float mean[3] = {0.485f, 0.456f, 0.406f};
+        float stddev[3] = {0.229f, 0.224f, 0.225f};
+        std::vector<ConvLayer> layers;
+
+        // Append a layer, false if it does not fit the previous one
+        bool AddLayer(const ConvLayer &layer);
+
+        // Tensor shape after layer index (-1 = the input)
+        void Shape(int layer, int &width, int &height, int &channels) const;
+
+        // Run the image through. With ranges, each layer's output range
+        // is merged into it (sized to layers.size() on first use).
+        bool Forward(const Image &image, std::vector<float> &output,
+            std::vector<ActivationRange> *ranges = nullptr);
+
+        size_t ActivationBytes() const;     // Peak scratch for one Forward()
+};
+
+///////////////////////////////////////////////////////////////////////
+// Int8 network quantized from a float Network
+// NOTE:
+//      Weights are symmetric int8 per output channel, activations are
+//      uint8 per tensor with the scale and zero point calibrated from
+//      sample images. The input normalization is folded into the first
+//      layer, so the quantized input tensor IS the resized RGB buffer
+//      (no float pass, no copy when the image already has the input
+//      size). Convolutions are im2col rows times int8 weights with int32
+//      accumulation, then requantized with one float multiply per value.
+//
+//      The dot product kernel is picked at startup: AVX512-VNNI or
+//      AVX-VNNI (vpdpbusd), AVX2 (vpmaddubsw), NEON sdot, or scalar.
+//      vpmaddubsw saturates its int16 pair sums, so with plain AVX2 the
+//      weights are limited to 7 bits. One instance per thread.
+///////////////////////////////////////////////////////////////////////
+class QuantizedNetwork
+{
+    private:
+        struct QuantLayer
+        {
+            int inWidth, inHeight, inChannels;
+            int outWidth, outHeight, outChannels;
+            int kernel, stride, pad;
+            size_t depth;                       // kernel * kernel * inChannels
+            size_t paddedDepth;                 // Rounded up to whole quads
+            std::vector<int8_t> weights;        // [out / 8][paddedDepth / 4][8][4]
+            std::vector<int32_t> bias;          // Includes the zero point terms
+            std::vector<float> scale;           // Requantization, accumulator to output
+            std::vector<uint8_t> padValue;      // Per input channel, "zero"
+            QuantParams input, output;
+        };
+
+        std::vector<QuantLayer> m_layers;
+        int m_inputWidth = 0;
+        int m_inputHeight = 0;
+        size_t m_kernel = 0;                    // Into the kernel table
+        std::vector<uint8_t> m_bufferA, m_bufferB;
+        std::vector<uint8_t> m_column;
+        std::vector<int32_t> m_sums;
+        Image m_resized;
+
+        void runLayer(const QuantLayer &layer, const uint8_t *in, uint8_t *out);
+
+    public:
+        // Quantize net, calibrating activations on the sample images
+        bool Quantize(Network &net, const std::vector<const Image *> &calibration,
+            std::string &error);
+
+        // Input tensor for image: its own pixels when the size matches
+        const uint8_t *PrepareInput(const Image &image);
+
+        // Quantized output (NHWC) and its parameters
+        bool Forward(const Image &image, std::vector<uint8_t> &output, QuantParams &params);
+
+        // Dequantized output, comparable with Network::Forward
+        bool Forward(const Image &image, std::vector<float> &output);
+
+        size_t ActivationBytes() const;     // Peak scratch for one Forward()
+        const char *KernelName() const;     // Kernel used by this network
+
+        // Kernel for networks quantized from now on. Returns false if the
+        // CPU can't run it. Names: avx512-vnni, avx-vnni, avx2,
+        // neon-dotprod, scalar.
+        static bool SelectKernel(const std::string &name);
+        static const char *SelectedKernel();
+        static std::vector<std::string> AvailableKernels();
+};
+
+///////////////////////////////////////////////////////////////////////
+// Accuracy of the int8 path against the float path
+///////////////////////////////////////////////////////////////////////
+struct QuantizationReport
+{
+    size_t images = 0;
+    size_t values = 0;
+    double maxAbsError = 0.0;
+    double meanAbsError = 0.0;
+    double rmsError = 0.0;
+    double signalRms = 0.0;         // Of the float outputs
+    double top1Agreement = 0.0;     // Positions where both pick the same channel
+};
+
+bool CompareQuantized(Network &net, QuantizedNetwork &quantized,
+    const std::vector<const Image *> &images, QuantizationReport &report);
+
+#endif // INFERENCE_H
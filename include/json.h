@@ -0,0 +1,56 @@
+#ifndef JSON_H
+#define JSON_H
+
+// Includes
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////
+// Minimal JSON reader for configuration files
+// NOTE:
+//      Covers RFC 8259 (objects, arrays, strings with \u escapes, numbers,
+//      true/false/null). Object members keep their file order. Meant for
+//      small config files, not for bulk data.
+///////////////////////////////////////////////////////////////////////
+class JsonValue
+{
+    public:
+        enum class Type
+        {
+            Null,
+            Bool,
+            Number,
+            String,
+            Array,
+            Object,
+        };
+
+        Type type = Type::Null;
+        bool boolean = false;
+        double number = 0.0;
+        std::string string;
+        std::vector<JsonValue> array;
+        std::vector<std::pair<std::string, JsonValue>> object;
+
+        bool IsNull() const { return type == Type::Null; }
+        bool IsNumber() const { return type == Type::Number; }
+        bool IsString() const { return type == Type::String; }
+        bool IsArray() const { return type == Type::Array; }
+        bool IsObject() const { return type == Type::Object; }
+
+        // Object member, nullptr when missing or not an object
+        const JsonValue *Find(const std::string &key) const;
+
+        // Member lookups with a default for missing or mistyped members
+        double GetNumber(const std::string &key, double fallback) const;
+        std::string GetString(const std::string &key, const std::string &fallback) const;
+        bool GetBool(const std::string &key, bool fallback) const;
+
+        // Parse a whole document. On failure error says what and where.
+        static bool Parse(const std::string &text, JsonValue &out, std::string &error);
+        static bool ParseFile(const std::string &path, JsonValue &out, std::string &error);
+};
+
+#endif // JSON_H
@@ -0,0 +1,86 @@
+#ifndef MOTION_GATE_H
+#define MOTION_GATE_H
+
+// Includes
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "image.h"
+
+// Changed area of a frame, in frame pixels
+struct MotionRegion
+{
+    int x, y, width, height;
+};
+
+struct MotionResult
+{
+    bool forward = true;                // Send this frame to inference
+    bool forced = false;                // Only because maxSkip was reached
+    double activity = 0.0;              // Fraction of thumbnail pixels that changed
+    std::vector<MotionRegion> regions;  // Connected changed areas
+};
+
+///////////////////////////////////////////////////////////////////////
+// Motion gate in front of inference
+// NOTE:
+//      Each frame is reduced to a small luma thumbnail (about thumbWidth
+//      pixels wide, box averaged) and compared against a running
+//      background with a SIMD absolute difference + threshold. Frames
+//      whose changed fraction stays below activityThreshold are skipped,
+//      but never more than maxSkip in a row, so static scenes still get
+//      a detection refresh. Costs well under a millisecond per 1080p
+//      frame. One instance per stream, not thread safe.
+///////////////////////////////////////////////////////////////////////
+class MotionGate
+{
+    private:
+        int m_frameWidth, m_frameHeight;
+        int m_thumbWidth, m_thumbHeight;
+        std::vector<int> m_xBegin;          // Frame column where each thumbnail column starts
+        std::vector<uint32_t> m_rowSums;
+        std::vector<uint8_t> m_current;     // Luma thumbnail of the frame
+        std::vector<uint8_t> m_background;  // Background, 8 bit copy for the SIMD kernel
+        std::vector<uint16_t> m_background16;   // Background, 8.8 fixed point
+        std::vector<uint8_t> m_changed;     // 0xff where |current - background| > threshold
+        std::vector<uint16_t> m_cellCounts;
+        std::vector<int32_t> m_labels;
+        std::vector<int32_t> m_stack;
+        bool m_hasBackground;
+        int m_skipped;                      // Frames skipped since the last forward
+        uint64_t m_frames, m_forwarded;
+
+        void setup(int width, int height);
+        void makeThumbnail(const Image &frame);
+        void findRegions(MotionResult &result);
+
+    public:
+        int thumbWidth = 80;
+        int sampleStep = 4;                 // Sample every Nth row and column (1 = all pixels)
+        uint8_t pixelThreshold = 18;        // Luma difference that counts as change
+        double activityThreshold = 0.002;   // Changed fraction that forwards the frame
+        int maxSkip = 15;                   // Force a forward after this many skips, 0 = never
+        int learnShift = 4;                 // Background adapts by 1/2^learnShift per frame
+        int cellSize = 4;                   // Thumbnail pixels per region cell
+        int minCellPixels = 2;              // Changed pixels that make a cell active
+
+        MotionGate();
+
+        // Analyse one RGB frame. Returns result.forward.
+        bool Process(const Image &frame, MotionResult &result);
+
+        void Reset();                       // Forget the background
+
+        uint64_t Frames() const { return m_frames; }
+        uint64_t Forwarded() const { return m_forwarded; }
+        int ThumbnailWidth() const { return m_thumbWidth; }
+        int ThumbnailHeight() const { return m_thumbHeight; }
+};
+
+// Write 0xff to mask where |a - b| > threshold (0 elsewhere) and return
+// how many pixels changed. Vectorised, 16 pixels per step.
+size_t AbsDiffThreshold(const uint8_t *a, const uint8_t *b, uint8_t *mask,
+    size_t count, uint8_t threshold);
+
+#endif // MOTION_GATE_H
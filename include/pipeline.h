@@ -0,0 +1,240 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+// Includes
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame_message_util.h"
+#include "image.h"
+#include "image_pool.h"
+#include "json.h"
+#include "publisher.h"
+#include "stage_stats.h"
+
+///////////////////////////////////////////////////////////////////////
+// Frame flowing through a pipeline graph
+// NOTE:
+//      Frames are immutable once sent. A node that changes something makes
+//      a new PipelineFrame and shares what it did not touch: encode keeps
+//      the pixels, resize drops the stale payload, and a frame fanned out
+//      to several edges is one object with several references.
+//
+//      A frame may carry only its JPEG payload (an MJPEG camera or a
+//      replay): publish and record pass those bytes on untouched, and
+//      nodes that need pixels go through FramePixels(), which decodes
+//      lazily and caches the result on the frame (the one mutable part).
+///////////////////////////////////////////////////////////////////////
+class PipelineNode;
+
+struct PipelineFrame
+{
+    uint64_t sequence = 0;
+    uint64_t timestampUs = 0;
+    std::string streamId;
+    std::shared_ptr<const Image> image;                     // RGB pixels, may be null
+    FrameEncoding encoding = FrameEncoding::RawRGB;         // Of payload
+    std::shared_ptr<const std::vector<uint8_t>> payload;    // Encoded pixels, may be null
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<Detection> detections;
+
+    // Decode cache, see FramePixels()
+    mutable std::mutex decodeMutex;
+    mutable std::shared_ptr<const Image> decoded;
+    mutable int decodes = 0;
+
+    // Nodes the frame reaches, set by the pipeline when it is first sent
+    mutable std::shared_ptr<const std::vector<PipelineNode *>> readers;
+};
+
+typedef std::shared_ptr<const PipelineFrame> FramePtr;
+
+// Pixels of frame, at least minWidth x minHeight (0 = full size). A JPEG
+// payload is decoded once, on first use, at the smallest DCT scale big
+// enough for every node in frame.readers, and kept for all of them. Only
+// a caller outside the graph asking for more than that gets a second
+// decode. Null if the frame has no pixels.
+// Detections stay in frame coordinates (width x height) whatever size
+// the pixels come back at.
+std::shared_ptr<const Image> FramePixels(const PipelineFrame &frame, ImagePool &pool,
+    int minWidth = 0, int minHeight = 0);
+
+///////////////////////////////////////////////////////////////////////
+// Queue between two nodes
+// NOTE:
+//      Bounded: when full the OLDEST frame is dropped, like the FrameBus.
+//      With maxFps set, frames closer than 1/maxFps (by capture time) to
+//      the last accepted one are skipped, so one source can feed models
+//      at different rates.
+///////////////////////////////////////////////////////////////////////
+class PipelineEdge
+{
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_ready;
+        std::deque<FramePtr> m_queue;
+        size_t m_depth;
+        uint64_t m_periodUs;        // 0 = no rate limit
+        uint64_t m_nextDueUs;
+        bool m_closed;
+        uint64_t m_pushed, m_dropped, m_limited;
+
+    public:
+        const std::string from;
+        const std::string to;
+
+        PipelineEdge(const std::string &fromNode, const std::string &toNode,
+            size_t depth, double maxFps);
+
+        // Offer a frame. Returns false if the rate limit skipped it.
+        bool Push(const FramePtr &frame);
+
+        // Wait up to timeoutMs (negative waits forever). Returns false on
+        // timeout or once closed and drained.
+        bool Pop(FramePtr &frame, int timeoutMs = -1);
+
+        void Close();
+        uint64_t Pushed();
+        uint64_t Dropped();         // Queue was full
+        uint64_t Limited();         // Skipped by the rate limit
+};
+
+// Shared by every node of a pipeline, owned by the Pipeline
+struct PipelineContext
+{
+    FrameBus &bus;              // Publish nodes publish here
+    ImagePool &images;          // Pixel buffers for nodes that make new images
+    const std::atomic<bool> &running;
+};
+
+///////////////////////////////////////////////////////////////////////
+// One node of the graph, built by type name from its config object
+///////////////////////////////////////////////////////////////////////
+class PipelineNode
+{
+    public:
+        virtual ~PipelineNode() {}
+
+        virtual bool Configure(const JsonValue &config, PipelineContext &context,
+            std::string &error) = 0;
+        virtual bool IsSource() const { return false; }
+
+        // Sources: next frame, false when finished
+        virtual bool Produce(FramePtr &out) { (void)out; return false; }
+
+        // Everything else: handle one input frame. Leave out empty to send
+        // nothing downstream. Returns false on errors.
+        virtual bool Process(const FramePtr &in, FramePtr &out) { (void)in; (void)out; return false; }
+
+        // Input is finished, flush and close
+        virtual void Finish() {}
+
+        // What Process() will ask FramePixels() for on this frame, as
+        // minWidth x minHeight; false if it won't. Called from the thread
+        // of whichever node decodes the frame first.
+        virtual bool PixelNeed(const PipelineFrame &frame, int &width, int &height)
+        {
+            (void)frame; (void)width; (void)height;
+            return false;
+        }
+
+        // Process() may send its input frame on as it is
+        virtual bool ForwardsInput() const { return false; }
+
+        // Node types known to the factory: source, convert, resize,
+        // undistort, infer, encode, orient, publish, simulcast, record,
+        // snapshot
+        static std::unique_ptr<PipelineNode> Create(const std::string &type);
+};
+
+struct PipelineNodeStats
+{
+    std::string name;
+    std::string type;
+    uint64_t frames;            // Produced or processed
+    uint64_t errors;
+    uint64_t dropped;           // On the input edge, queue full
+    uint64_t limited;           // On the input edge, rate limit
+    double meanUs;              // Per frame; for sources this includes pacing
+    double p99Us;
+    bool finished;
+};
+
+///////////////////////////////////////////////////////////////////////
+// Pipeline graph
+//
+// Config:
+//  {
+//    "nodes": [ {"name": "cam", "type": "source", "width": 1280, ...}, ... ],
+//    "edges": [ {"from": "cam", "to": "jpeg", "depth": 4, "max_fps": 0}, ... ]
+//  }
+// Sources have no input, every other node exactly one; any node can feed
+// any number of edges. Every node runs on its own thread.
+///////////////////////////////////////////////////////////////////////
+class Pipeline
+{
+    private:
+        struct NodeState
+        {
+            std::string name;
+            std::string type;
+            std::unique_ptr<PipelineNode> node;
+            PipelineEdge *input = nullptr;
+            std::vector<PipelineEdge *> outputs;
+            std::function<void(const FramePtr &)> tap;
+            std::thread thread;
+            std::shared_ptr<const std::vector<PipelineNode *>> readers;     // Of what it sends
+
+            std::mutex statsMutex;
+            StageStats latency{"process", 4096};
+            uint64_t frames = 0;
+            uint64_t errors = 0;
+            bool finished = false;
+        };
+
+        FrameBus m_bus;
+        ImagePool m_images;
+        std::atomic<bool> m_running;
+        PipelineContext m_context;      // Outlives the nodes that keep it
+        std::vector<std::unique_ptr<NodeState>> m_nodes;
+        std::vector<std::unique_ptr<PipelineEdge>> m_edges;
+
+        NodeState *find(const std::string &name);
+        void run(NodeState *state);
+        void emit(NodeState *state, const FramePtr &frame);
+        void collectReaders(NodeState *state, std::vector<PipelineNode *> &readers);
+
+    public:
+        Pipeline();
+        ~Pipeline();
+
+        Pipeline(const Pipeline &) = delete;
+        Pipeline &operator=(const Pipeline &) = delete;
+
+        // Build the graph. Returns false with a message on a bad config.
+        bool Load(const JsonValue &config, std::string &error);
+        bool LoadFile(const std::string &path, std::string &error);
+
+        // Called on the node's thread with every frame it sends downstream
+        bool SetTap(const std::string &node, std::function<void(const FramePtr &)> tap);
+
+        void Start();
+        void Stop();            // Ask the sources to stop, then Wait()
+        void Wait();            // Until every node has finished
+        bool Finished();        // Every node has finished
+
+        FrameBus &Bus() { return m_bus; }
+        std::vector<PipelineNodeStats> Stats();
+};
+
+#endif // PIPELINE_H
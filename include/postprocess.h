@@ -0,0 +1,92 @@
+#ifndef POSTPROCESS_H
+#define POSTPROCESS_H
+
+// Includes
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "frame_message_util.h"   // for Detection
+
+///////////////////////////////////////////////////////////////////////
+// Layout of one detection head output
+//
+// The tensor is row major, one row of (5 + numClasses) floats per
+// prediction: x, y, w, h, objectness, class scores. Rows are ordered
+// anchor, grid y, grid x.
+//
+//  - anchors non-empty: YOLOv5 style raw outputs, decoded as
+//      x = (sigmoid(tx) * 2 - 0.5 + gx) * stride
+//      w = (sigmoid(tw) * 2)^2 * anchor_w
+//  - anchors empty: rows already hold centre x/y and w/h in model input
+//    pixels (one row per grid cell)
+//
+// When hasObjectness is false the row is (4 + numClasses) floats and the
+// score is the best class score alone (YOLOv8 style).
+///////////////////////////////////////////////////////////////////////
+struct GridLayout
+{
+    int gridWidth = 0;
+    int gridHeight = 0;
+    int stride = 8;                                 // Input pixels per grid cell
+    int numClasses = 80;
+    std::vector<std::pair<float, float>> anchors;   // (w, h) in input pixels
+    bool hasObjectness = true;
+    bool applySigmoid = true;                       // Scores are logits
+};
+
+// Maps model input coordinates back to the frame (letterbox undo):
+// frame = (input - pad) / scale
+struct InputTransform
+{
+    float scale = 1.0f;
+    float padX = 0.0f;
+    float padY = 0.0f;
+    float frameWidth = 0.0f;    // Clip boxes to the frame, 0 = no clipping
+    float frameHeight = 0.0f;
+};
+
+///////////////////////////////////////////////////////////////////////
+// Detection post-processing: box decoding, thresholding and NMS
+// NOTE:
+//      Keeps its scratch buffers between frames, so steady state
+//      processing does not allocate. One instance per thread.
+///////////////////////////////////////////////////////////////////////
+class Postprocessor
+{
+    private:
+        // Structure of arrays copy of the candidates for the IoU kernel
+        std::vector<float> m_x1, m_y1, m_x2, m_y2, m_area, m_score;
+        std::vector<int32_t> m_class;
+        std::vector<uint8_t> m_keep;
+        std::vector<Detection> m_scratch;
+
+        void loadCandidates(const std::vector<Detection> &detections, bool classAware);
+
+    public:
+        float scoreThreshold = 0.25f;
+        float iouThreshold = 0.45f;
+        size_t maxDetections = 300;
+        bool classAware = true;     // Only suppress boxes of the same class
+
+        // Decode one head and append every box scoring at least
+        // scoreThreshold to out. Returns the number appended.
+        size_t Decode(const float *output, const GridLayout &layout,
+            const InputTransform &transform, std::vector<Detection> &out) const;
+
+        // Sort-free ("fast") NMS in place: a box is dropped when a
+        // higher scoring box of the same class overlaps it by more than
+        // iouThreshold. Survivors keep their input order, at most
+        // maxDetections of the highest scoring are kept.
+        void Suppress(std::vector<Detection> &detections);
+
+        // Classic greedy NMS (sorted by score), the reference behaviour.
+        // Suppress() can remove slightly more in overlap chains.
+        void SuppressGreedy(std::vector<Detection> &detections);
+};
+
+// Intersection over union of two boxes
+float IoU(const Detection &a, const Detection &b);
+
+#endif // POSTPROCESS_H
@@ -0,0 +1,104 @@
+#ifndef PUBLISHER_H
+#define PUBLISHER_H
+
+// Includes
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "frame_message_util.h"
+
+///////////////////////////////////////////////////////////////////////
+// In-process publish/subscribe bus
+// NOTE:
+//      Messages are serialized frames shared by reference count, so every
+//      subscriber of a topic sees the same buffer. Each subscription has a
+//      bounded queue; when it is full the OLDEST message is dropped (live
+//      video wants the newest frame) and the drop is counted.
+///////////////////////////////////////////////////////////////////////
+class FrameBus
+{
+    public:
+        using Buffer = std::shared_ptr<const std::vector<uint8_t>>;
+
+        class Subscription
+        {
+            private:
+                friend class FrameBus;
+
+                std::string m_topic;
+                size_t m_depth;
+                std::deque<Buffer> m_queue;
+                std::mutex m_mutex;
+                std::condition_variable m_ready;
+                uint64_t m_received;
+                uint64_t m_dropped;
+                bool m_closed;
+
+                void push(const Buffer &message);
+
+            public:
+                Subscription(const std::string &topic, size_t depth);
+
+                // Wait up to timeoutMs for a message (negative waits forever).
+                // Returns false on timeout or once closed and drained.
+                bool Receive(Buffer &message, int timeoutMs = -1);
+
+                void Close();                               // Wake any waiting Receive()
+                bool IsClosed();
+                std::string Topic();                        // Changes with FrameBus::Switch()
+                uint64_t Received();                        // Messages queued so far
+                uint64_t Dropped();                         // Messages dropped because the queue was full
+        };
+
+        // Subscribe to a topic with the given queue depth
+        std::shared_ptr<Subscription> Subscribe(const std::string &topic, size_t depth = 4);
+        void Unsubscribe(const std::shared_ptr<Subscription> &subscription);
+
+        // Move a subscription to another topic, e.g. another simulcast
+        // layer. Messages already queued are still delivered.
+        void Switch(const std::shared_ptr<Subscription> &subscription, const std::string &topic);
+
+        size_t Subscribers(const std::string &topic);
+
+        // Deliver a message to every subscriber, returns the number of subscribers
+        size_t Publish(const std::string &topic, const Buffer &message);
+
+        // Close every subscription, used at shutdown
+        void Close();
+
+    private:
+        std::mutex m_mutex;
+        std::unordered_map<std::string,
+            std::vector<std::shared_ptr<Subscription>>> m_topics;
+};
+
+///////////////////////////////////////////////////////////////////////
+// Publisher for one stream
+// Serializes FrameMessages and publishes them on a topic of a FrameBus.
+///////////////////////////////////////////////////////////////////////
+class Publisher
+{
+    private:
+        FrameBus &m_bus;
+        std::string m_topic;
+        uint64_t m_published;
+        uint64_t m_bytes;
+
+    public:
+        Publisher(FrameBus &bus, const std::string &topic);
+
+        // Serialize and publish, returns the number of subscribers reached
+        size_t Publish(const FrameMessage &frame);
+
+        const std::string &Topic() const { return m_topic; }
+        uint64_t Published() const { return m_published; }     // Messages published
+        uint64_t Bytes() const { return m_bytes; }              // Serialized bytes published
+};
+
+#endif // PUBLISHER_H
@@ -0,0 +1,188 @@
+#ifndef RECEIVER_H
+#define RECEIVER_H
+
+// Includes
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame_message_util.h"
+#include "image.h"
+#include "image_pool.h"
+#include "publisher.h"
+#include "stage_stats.h"
+#include "tcp_transport.h"
+#include "thread_pool.h"
+
+///////////////////////////////////////////////////////////////////////
+// Where a receiver stream gets its serialized frames from
+///////////////////////////////////////////////////////////////////////
+class FrameSource
+{
+    public:
+        virtual ~FrameSource() {}
+
+        // Wait up to timeoutMs for the next message. Returns false on
+        // timeout or when the source is finished (see Finished()).
+        virtual bool Receive(FrameBus::Buffer &message, int timeoutMs) = 0;
+        virtual bool Finished() = 0;
+        virtual void Close() = 0;
+        virtual std::string Name() const = 0;
+};
+
+// In-process source reading a FrameBus subscription
+class BusFrameSource : public FrameSource
+{
+    private:
+        std::shared_ptr<FrameBus::Subscription> m_subscription;
+        bool m_finished;
+
+    public:
+        explicit BusFrameSource(std::shared_ptr<FrameBus::Subscription> subscription);
+
+        bool Receive(FrameBus::Buffer &message, int timeoutMs) override;
+        bool Finished() override { return m_finished; }
+        void Close() override;
+        std::string Name() const override { return m_subscription->Topic(); }
+};
+
+// Network source reading from a TcpFrameServer
+class TcpFrameSource : public FrameSource
+{
+    private:
+        TcpFrameClient m_client;
+        std::string m_name;
+
+    public:
+        TcpFrameSource(const std::string &host, uint16_t port, const std::string &topic);
+
+        bool Connected() const { return m_client.IsConnected(); }
+        bool Receive(FrameBus::Buffer &message, int timeoutMs) override;
+        bool Finished() override { return !m_client.IsConnected(); }
+        void Close() override { m_client.Shutdown(); }
+        std::string Name() const override { return m_name; }
+};
+
+///////////////////////////////////////////////////////////////////////
+// A decoded frame handed to the receiver callback
+///////////////////////////////////////////////////////////////////////
+struct ReceivedFrame
+{
+    int stream;                         // Index returned by AddStream()
+    uint64_t sequence;
+    uint64_t timestampUs;               // Capture time from the publisher
+    uint64_t receivedUs;                // When the message arrived
+    std::shared_ptr<Image> image;       // Pooled, returns to the pool when released
+    std::vector<Detection> detections;
+};
+
+// Per stream statistics snapshot. Counters are totals since Start(); fps
+// and decode times cover the interval since the previous Stats() call.
+struct ReceiverStreamStats
+{
+    std::string name;
+    uint64_t frames;            // Frames delivered
+    uint64_t bytes;             // Serialized bytes received
+    uint64_t gaps;              // Frames missing from the sequence
+    uint64_t errors;            // Parse or decode failures
+    double fps;                 // Delivered frames per second
+    double decodeMeanUs;
+    double decodeP50Us;
+    double decodeP99Us;
+    bool finished;
+};
+
+///////////////////////////////////////////////////////////////////////
+// Multi-stream receiver with a shared parallel decode pool
+// NOTE:
+//      Each stream has a reader thread that pulls messages from its
+//      source and hands them to the decode pool. Decodes finish out of
+//      order, so each stream keeps a small reorder buffer and the
+//      callback always sees a stream's frames in arrival order. A stream
+//      never has more than maxInFlight frames decoding at once; when it
+//      falls behind the reader stops pulling and the publisher side
+//      drops frames instead of the receiver queueing without bound.
+///////////////////////////////////////////////////////////////////////
+class Receiver
+{
+    public:
+        using Callback = std::function<void(const ReceivedFrame &frame)>;
+
+        // decodeThreads == 0 uses all cores
+        explicit Receiver(size_t decodeThreads = 0, size_t maxInFlight = 4);
+        ~Receiver();
+
+        Receiver(const Receiver &) = delete;
+        Receiver &operator=(const Receiver &) = delete;
+
+        // Add a stream before Start(), returns its index
+        int AddStream(std::unique_ptr<FrameSource> source);
+
+        // Called from decode threads, serialized per stream (not across
+        // streams). Set before Start().
+        void SetCallback(Callback callback) { m_callback = std::move(callback); }
+
+        void Start();
+        void Stop();    // Close every source and wait for in-flight decodes
+
+        std::vector<ReceiverStreamStats> Stats();
+        size_t PooledImages() { return m_imagePool.Created(); }   // Images allocated so far
+
+    private:
+        struct Pending
+        {
+            bool ok;
+            FrameMessage message;
+            std::shared_ptr<Image> image;
+            uint64_t receivedUs;
+            double decodeUs;
+        };
+
+        struct Stream
+        {
+            int index;
+            std::unique_ptr<FrameSource> source;
+            std::thread reader;
+
+            std::mutex mutex;
+            std::condition_variable slotFree;
+            size_t inFlight = 0;
+            uint64_t nextTicket = 0;                // Assigned on arrival
+            uint64_t nextDeliver = 0;               // Next ticket to deliver
+            std::map<uint64_t, Pending> reorder;    // Decoded, waiting for earlier tickets
+            bool delivering = false;                // A thread is running the callback
+
+            // Statistics, guarded by mutex
+            StageStats decode{"decode"};
+            uint64_t frames = 0;
+            uint64_t bytes = 0;
+            uint64_t gaps = 0;
+            uint64_t errors = 0;
+            bool haveSequence = false;
+            uint64_t lastSequence = 0;
+            bool finished = false;
+            uint64_t framesAtLastStats = 0;
+        };
+
+        ThreadPool m_decodePool;
+        ImagePool m_imagePool;
+        size_t m_maxInFlight;
+        Callback m_callback;
+        std::vector<std::unique_ptr<Stream>> m_streams;
+        std::atomic<bool> m_running;
+        uint64_t m_lastStatsUs;
+
+        void readerLoop(Stream *stream);
+        void decode(Stream *stream, uint64_t ticket, FrameBus::Buffer message,
+            uint64_t receivedUs);
+        void deliver(Stream *stream, uint64_t ticket, Pending &&pending);
+};
+
+#endif // RECEIVER_H
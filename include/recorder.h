@@ -0,0 +1,195 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+// Includes
+#include <cstddef>
+#include <cstdint>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "frame_message_util.h"
+
+///////////////////////////////////////////////////////////////////////
+// MJPEG recording container
+//
+// A recording is a series of segment files <prefix>-000000.mjr,
+// <prefix>-000001.mjr, ... Each segment is append-only:
+//
+//      SegmentHeader
+//      record*             RecordHeader, JPEG bytes, DetectionRecord[],
+//                          padded to 8 bytes
+//      IndexEntry[count]   written when the segment is closed
+//      SegmentFooter       fixed size, last 32 bytes of the file
+//
+// A segment without a footer (the recorder crashed or is still writing)
+// is recovered by scanning its records. All fields are little endian.
+///////////////////////////////////////////////////////////////////////
+
+struct SegmentHeader
+{
+    char magic[8];              // "MJREC\0\0\1"
+    uint32_t version;
+    uint32_t headerSize;        // sizeof(SegmentHeader)
+    uint64_t segmentIndex;
+    uint64_t reserved;
+};
+
+struct RecordHeader
+{
+    uint32_t magic;             // kRecordMagic
+    uint32_t jpegSize;
+    uint64_t sequence;
+    uint64_t timestampUs;
+    uint32_t width;
+    uint32_t height;
+    uint32_t detectionCount;
+    uint32_t reserved;
+};
+
+struct DetectionRecord
+{
+    float x, y, width, height, score;
+    int32_t classId;
+    int32_t trackId;
+    uint32_t reserved;
+};
+
+struct IndexEntry
+{
+    uint64_t offset;            // Of the RecordHeader within the segment
+    uint64_t sequence;
+    uint64_t timestampUs;
+    uint32_t jpegSize;
+    uint32_t detectionCount;
+};
+
+struct SegmentFooter
+{
+    uint64_t indexOffset;
+    uint64_t count;
+    char magic[8];              // "MJRIDX\0\1"
+    uint64_t reserved;
+};
+
+///////////////////////////////////////////////////////////////////////
+// Appends already encoded JPEG frames to segment files
+///////////////////////////////////////////////////////////////////////
+class Recorder
+{
+    private:
+        std::string m_prefix;
+        uint64_t m_maxSegmentBytes;
+        uint64_t m_maxSegmentUs;
+        FILE *m_file;
+        std::vector<char> m_fileBuffer;     // stdio buffer, large writes
+        uint64_t m_segmentIndex;
+        uint64_t m_offset;                  // Bytes written to the current segment
+        uint64_t m_segmentStartUs;
+        std::vector<IndexEntry> m_index;    // Index of the current segment
+        std::vector<DetectionRecord> m_detections;
+        uint64_t m_framesWritten;
+        uint64_t m_bytesWritten;
+
+        bool openSegment(uint64_t timestampUs);
+        bool closeSegment();
+        void dropPartialRecord();
+
+    public:
+        // A new segment is started once the current one would exceed
+        // maxSegmentBytes or covers more than maxSegmentSeconds (0 = no limit)
+        Recorder(uint64_t maxSegmentBytes = 1ull << 30, double maxSegmentSeconds = 0.0);
+        ~Recorder();
+
+        Recorder(const Recorder &) = delete;
+        Recorder &operator=(const Recorder &) = delete;
+
+        bool Open(const std::string &prefix);   // Segments are created lazily
+        bool Close();                           // Writes the index of the last segment
+
+        bool Write(uint64_t sequence, uint64_t timestampUs, uint32_t width, uint32_t height,
+            const uint8_t *jpeg, size_t jpegSize,
+            const std::vector<Detection> &detections = std::vector<Detection>());
+        bool Write(const FrameMessage &frame);  // frame must be JPEG encoded
+
+        bool Flush();                           // Push buffered data to the kernel
+
+        uint64_t Segments() const { return m_segmentIndex; }    // Segments started
+        uint64_t FramesWritten() const { return m_framesWritten; }
+        uint64_t BytesWritten() const { return m_bytesWritten; }
+
+        static std::string SegmentPath(const std::string &prefix, uint64_t index);
+};
+
+///////////////////////////////////////////////////////////////////////
+// A frame served by the Player
+// NOTE:
+//      jpeg points into the memory mapped segment; it stays valid until
+//      the Player is closed. Nothing is copied except the detections.
+///////////////////////////////////////////////////////////////////////
+struct RecordedFrame
+{
+    uint64_t sequence;
+    uint64_t timestampUs;
+    uint32_t width;
+    uint32_t height;
+    const uint8_t *jpeg;
+    size_t jpegSize;
+    const DetectionRecord *detections;
+    uint32_t detectionCount;
+};
+
+///////////////////////////////////////////////////////////////////////
+// Memory maps a recording and serves frames by index or timestamp
+///////////////////////////////////////////////////////////////////////
+class Player
+{
+    private:
+        struct Segment
+        {
+            const uint8_t *data;
+            size_t size;
+            bool recovered;     // Index rebuilt by scanning, no footer
+        };
+        struct Entry
+        {
+            uint32_t segment;
+            IndexEntry index;
+        };
+
+        std::vector<Segment> m_segments;
+        std::vector<Entry> m_entries;       // All frames, in recording order
+
+        bool mapSegment(const std::string &path);
+        bool loadIndex(uint32_t segment);
+        void scanRecords(uint32_t segment);
+
+    public:
+        Player();
+        ~Player();
+
+        Player(const Player &) = delete;
+        Player &operator=(const Player &) = delete;
+
+        // Open every segment of a recording by prefix, or a single .mjr file
+        bool Open(const std::string &prefixOrPath);
+        void Close();
+
+        size_t FrameCount() const { return m_entries.size(); }
+        size_t SegmentCount() const { return m_segments.size(); }
+        size_t RecoveredSegments() const;
+
+        bool GetFrame(size_t index, RecordedFrame &frame) const;
+
+        // Index of the first frame with timestamp >= timestampUs, or
+        // FrameCount() if there is none. Assumes non-decreasing timestamps.
+        size_t FindByTimestamp(uint64_t timestampUs) const;
+
+        // Index of the frame with this sequence number, or FrameCount()
+        size_t FindBySequence(uint64_t sequence) const;
+
+        // Fill a FrameMessage for republishing (copies the JPEG)
+        bool ToMessage(size_t index, FrameMessage &frame) const;
+};
+
+#endif // RECORDER_H
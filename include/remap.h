@@ -0,0 +1,104 @@
+#ifndef REMAP_H
+#define REMAP_H
+
+// Includes
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "image.h"
+#include "thread_pool.h"
+
+// Pinhole intrinsics and Brown-Conrady distortion, as calibrated by
+// OpenCV (calibrateCamera's camera matrix and k1 k2 p1 p2 k3)
+struct CameraCalibration
+{
+    double fx = 0.0, fy = 0.0;      // Focal lengths in pixels
+    double cx = 0.0, cy = 0.0;      // Principal point in pixels
+    double k1 = 0.0, k2 = 0.0, k3 = 0.0;    // Radial
+    double p1 = 0.0, p2 = 0.0;              // Tangential
+};
+
+// Exact pixel moves, no interpolation
+enum class Orientation
+{
+    Rotate90,           // Clockwise
+    Rotate180,
+    Rotate270,
+    FlipHorizontal,     // Mirror left to right
+    FlipVertical,       // Upside down
+};
+
+///////////////////////////////////////////////////////////////////////
+// Geometric remap with a precomputed map
+// NOTE:
+//      The map is built once per calibration: for every output pixel
+//      the byte offset of the top left source pixel of its 2x2
+//      neighbourhood plus 6 bit x and y fractions, i.e. 6 bytes a pixel,
+//      and per output row the runs of pixels that land inside the
+//      source (the rest is black). Apply() only does bilinear
+//      interpolation: AVX2 gathers 8 pixels at a time where the CPU has
+//      it, fixed point scalar code otherwise. Output rows are split into
+//      bands of 32 row strips spread over the threads; each strip reads a
+//      narrow band of source rows, which stays in cache.
+//
+//      SetOrientation() skips the map altogether: rotations and flips
+//      are exact copies, done in cache sized blocks.
+//
+//      Apply() from one thread at a time; it uses the others itself.
+///////////////////////////////////////////////////////////////////////
+class Remapper
+{
+    public:
+        // Output pixel (x, y) to the source position it shows, in source
+        // pixels (centres at integers). False: outside, stays black.
+        using Warp = std::function<bool(double x, double y, double &sourceX, double &sourceY)>;
+
+        // threads == 0 uses all cores
+        explicit Remapper(size_t threads = 0);
+
+        // Undistort width x height frames. zoom < 1 shows more of the
+        // field of view (less cropping of the corners), > 1 less.
+        bool SetUndistort(const CameraCalibration &calibration, int width, int height, double zoom = 1.0);
+
+        // Any warp from a sourceWidth x sourceHeight frame to width x height
+        bool SetWarp(int sourceWidth, int sourceHeight, int width, int height, const Warp &warp);
+
+        // Rotate or flip sourceWidth x sourceHeight frames, no map
+        bool SetOrientation(Orientation orientation, int sourceWidth, int sourceHeight);
+
+        // Remap src into dst (resized to the output size; src and dst must
+        // differ). False when nothing is set or src has the wrong size.
+        bool Apply(const Image &src, Image &dst);
+
+        int Width() const { return m_width; }           // Output size
+        int Height() const { return m_height; }
+        size_t MapBytes() const;                        // Memory held by the map
+        static const char *KernelName();                // "avx2" or "scalar"
+
+    private:
+        enum class Mode { None, Map, Orient };
+
+        struct Run
+        {
+            int x0, x1;     // [x0, x1) of one output row lands in the source
+        };
+
+        Mode m_mode;
+        Orientation m_orientation;
+        int m_sourceWidth, m_sourceHeight;
+        int m_width, m_height;
+        std::vector<int32_t> m_offsets;         // Source byte offset per output pixel
+        std::vector<uint16_t> m_fractions;      // x | y << 8, 0..64 each
+        std::vector<Run> m_runs;
+        std::vector<uint32_t> m_rowRuns;        // Row y's runs are [m_rowRuns[y], m_rowRuns[y + 1])
+        std::unique_ptr<ThreadPool> m_pool;
+        size_t m_threads;
+
+        void remapBand(const Image &src, Image &dst, int y0, int y1) const;
+        void orientBand(const Image &src, Image &dst, int y0, int y1) const;
+};
+
+#endif // REMAP_H
@@ -0,0 +1,129 @@
+#ifndef SHM_TRANSPORT_H
+#define SHM_TRANSPORT_H
+
+// Includes
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "frame_message_util.h"
+#include "image.h"
+
+///////////////////////////////////////////////////////////////////////
+// Shared memory transport for subscribers on the same host
+//
+// Layout of the POSIX shared memory object (/dev/shm/<name>):
+//      [header][slot 0][slot 1]...[slot N-1]
+// Frame k is written to slot k % N. Each slot is a small metadata block
+// (sequence, time, size, encoding, detections) followed by the payload,
+// page aligned, so raw RGB frames can be used in place.
+//
+// There are no locks. Every slot has a seqlock counter: the writer makes
+// it odd while it writes and even again when done, readers check that it
+// did not move while they looked. The writer never waits for readers; a
+// reader that falls more than N - 1 frames behind skips to the newest
+// frame and counts the misses. New frames are signalled with a futex on
+// the shared header, so it works across processes.
+///////////////////////////////////////////////////////////////////////
+
+static const uint32_t kShmMaxDetections = 64;
+
+// Frame as seen by a reader. For RawRGB frames image is a zero-copy view
+// of the slot; it stays intact until the writer laps the ring, which
+// ShmFrameReader::Valid() reports.
+struct ShmFrame
+{
+    uint64_t sequence = 0;
+    uint64_t timestampUs = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    FrameEncoding encoding = FrameEncoding::RawRGB;
+    const uint8_t *payload = nullptr;   // In the shared mapping
+    size_t payloadSize = 0;
+    std::vector<Detection> detections;
+    Image image;                        // View, RawRGB only. Read only.
+
+    uint32_t slot = 0;
+    uint64_t version = 0;               // Slot seqlock value when read
+};
+
+class ShmFrameWriter
+{
+    private:
+        std::string m_name;
+        uint8_t *m_base;
+        size_t m_size;
+        uint32_t m_slotCount;
+        size_t m_slotStride;
+        size_t m_maxPayload;
+        uint64_t m_published;
+
+        uint8_t *beginSlot(uint64_t index, size_t payloadSize);
+        void commitSlot(uint64_t index, const FrameMessage &meta, uint32_t width,
+            uint32_t height, FrameEncoding encoding, size_t payloadSize);
+
+    public:
+        ShmFrameWriter();
+        ~ShmFrameWriter();
+
+        ShmFrameWriter(const ShmFrameWriter &) = delete;
+        ShmFrameWriter &operator=(const ShmFrameWriter &) = delete;
+
+        // Create (or replace) the ring "name" with slotCount slots of up to
+        // maxPayloadBytes each. The name follows shm_open rules: "/stream0".
+        bool Create(const std::string &name, uint32_t slotCount, size_t maxPayloadBytes,
+            const std::string &streamId = "");
+        void Close();           // Unmap and unlink, attached readers keep their mapping
+
+        // Copy one frame into the ring and wake the readers. Fails when the
+        // payload does not fit a slot.
+        bool Publish(const FrameMessage &frame);
+
+        // Publish raw RGB pixels straight from an Image; meta supplies the
+        // sequence, time and detections, its payload is ignored
+        bool Publish(const FrameMessage &meta, const Image &image);
+
+        const std::string &Name() const { return m_name; }
+        uint64_t Published() const { return m_published; }
+        uint32_t SlotCount() const { return m_slotCount; }
+};
+
+class ShmFrameReader
+{
+    private:
+        const uint8_t *m_base;
+        size_t m_size;
+        uint32_t m_slotCount;
+        size_t m_slotStride;
+        uint64_t m_next;        // Index of the next frame to read
+        uint64_t m_missed;
+        std::string m_streamId;
+
+        bool readSlot(uint64_t index, ShmFrame &frame);
+
+    public:
+        ShmFrameReader();
+        ~ShmFrameReader();
+
+        ShmFrameReader(const ShmFrameReader &) = delete;
+        ShmFrameReader &operator=(const ShmFrameReader &) = delete;
+
+        // Attach to a ring created by a ShmFrameWriter. Reading starts at
+        // the newest frame already published.
+        bool Open(const std::string &name);
+        void Close();
+        bool IsOpen() const { return m_base != nullptr; }
+
+        // Wait up to timeoutMs (negative waits forever) for the next frame.
+        // Returns false on timeout.
+        bool Receive(ShmFrame &frame, int timeoutMs = -1);
+
+        // The writer has not reused the frame's slot since Receive()
+        bool Valid(const ShmFrame &frame) const;
+
+        uint64_t Missed() const { return m_missed; }    // Frames overwritten before they were read
+        const std::string &StreamId() const { return m_streamId; }
+};
+
+#endif // SHM_TRANSPORT_H
@@ -0,0 +1,88 @@
+#ifndef SIMULCAST_H
+#define SIMULCAST_H
+
+// Includes
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "frame_message_util.h"
+#include "image.h"
+#include "image_proc.h"
+#include "publisher.h"
+#include "thread_pool.h"
+
+// One resolution of a simulcast stream
+struct SimulcastLayer
+{
+    std::string name;       // Published on <topic>/<name>
+    int width = 0;          // 0 keeps the aspect ratio from height
+    int height = 0;         // 0 keeps the aspect ratio from width
+    int quality = 80;       // JPEG quality
+};
+
+///////////////////////////////////////////////////////////////////////
+// Publishes one capture at several resolutions
+// NOTE:
+//      Every frame is scaled once per layer through a shared ImagePyramid
+//      (a 1080p -> 540p -> 270p chain builds each level once for all the
+//      layers), the layers are JPEG encoded in parallel and each one goes
+//      out on its own topic. That is one encode per layer, however many
+//      subscribers it has, and none for a layer nobody subscribes to.
+//      Subscribers pick a layer by topic and move between layers with
+//      FrameBus::Switch() or, over TCP, TcpFrameClient::Switch().
+///////////////////////////////////////////////////////////////////////
+class SimulcastPublisher
+{
+    private:
+        struct Layer
+        {
+            SimulcastLayer config;
+            std::unique_ptr<Publisher> publisher;
+            Image scratch;                      // When no pyramid level fits
+            FrameMessage message;
+            bool active;                        // Has subscribers this frame
+            bool ok;
+        };
+
+        FrameBus &m_bus;
+        std::string m_topic;
+        std::vector<std::unique_ptr<Layer>> m_layers;
+        ImagePyramid m_pyramid;
+        ThreadPool m_pool;
+        uint64_t m_encodes;
+
+        bool encode(Layer &layer, const FrameMessage &meta, int width, int height);
+        static void layerSize(const SimulcastLayer &layer, int frameWidth, int frameHeight,
+            int &width, int &height);
+
+    public:
+        // threads == 0 uses all cores
+        SimulcastPublisher(FrameBus &bus, const std::string &topic, size_t threads = 0);
+
+        // Add a layer before the first Publish(). False on a duplicate or
+        // empty name, no size, or a bad quality.
+        bool AddLayer(const SimulcastLayer &layer);
+
+        // Scale, encode and publish image on every layer with subscribers.
+        // meta supplies everything but the pixels; its detections are in
+        // meta.width x meta.height coordinates (the image size when 0) and
+        // are scaled to each layer. Returns false if a layer failed.
+        bool Publish(const FrameMessage &meta, std::shared_ptr<const Image> image);
+
+        // Whether any layer has a subscriber, i.e. Publish() needs pixels
+        bool HasSubscribers();
+
+        // Size of the biggest layer for a frameWidth x frameHeight frame
+        void LargestLayer(int frameWidth, int frameHeight, int &width, int &height) const;
+
+        static std::string LayerTopic(const std::string &topic, const std::string &layer);
+        std::string LayerTopic(const std::string &layer) const { return LayerTopic(m_topic, layer); }
+
+        size_t Layers() const { return m_layers.size(); }
+        uint64_t Encodes() const { return m_encodes; }          // Layer frames encoded
+        uint64_t PyramidLevels() { return m_pyramid.LevelsBuilt(); }
+};
+
+#endif // SIMULCAST_H
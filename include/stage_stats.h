@@ -0,0 +1,47 @@
+#ifndef STAGE_STATS_H
+#define STAGE_STATS_H
+
+// Includes
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Monotonic time in microseconds, shared by every pipeline stage
+inline uint64_t NowMicros()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+///////////////////////////////////////////////////////////////////////
+// Latency samples for one pipeline stage
+// NOTE:
+//      Not thread safe; each stage records from a single thread. Samples
+//      are kept so exact percentiles can be reported at the end of a run.
+///////////////////////////////////////////////////////////////////////
+class StageStats
+{
+    private:
+        std::string m_name;
+        std::vector<double> m_samples;  // Microseconds
+        double m_sum;
+
+    public:
+        explicit StageStats(const std::string &name, size_t expected = 1024);
+
+        void Add(double micros);                    // Record one sample
+        void Clear();
+
+        const std::string &Name() const { return m_name; }
+        size_t Count() const { return m_samples.size(); }
+        double Mean() const;
+        double Percentile(double p) const;          // p in 0..100
+        double Max() const;
+
+        std::string Summary() const;                // One human readable line
+        std::string ToJSON() const;                 // {"name":..,"p50_us":..}
+};
+
+#endif // STAGE_STATS_H
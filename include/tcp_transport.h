@@ -0,0 +1,95 @@
+#ifndef TCP_TRANSPORT_H
+#define TCP_TRANSPORT_H
+
+// Includes
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "publisher.h"
+
+///////////////////////////////////////////////////////////////////////
+// TCP transport for serialized frames
+//
+// Protocol:
+//      client -> server    "SUB <topic>\n"
+//      server -> client    repeated [uint32 little endian length][frame]
+//      client -> server    "SUB <other topic>\n" at any time to switch
+//
+// The server bridges topics of a FrameBus to the network, so a slow
+// client only drops frames from its own subscription queue.
+///////////////////////////////////////////////////////////////////////
+
+static const uint32_t kMaxTcpFrameBytes = 64u * 1024u * 1024u;
+
+class TcpFrameServer
+{
+    private:
+        struct Client
+        {
+            int fd;
+            std::shared_ptr<FrameBus::Subscription> subscription;
+            std::thread thread;
+            std::atomic<bool> done{false};
+        };
+
+        FrameBus &m_bus;
+        size_t m_depth;
+        int m_listenFd;
+        uint16_t m_port;
+        std::atomic<bool> m_running;
+        std::thread m_acceptThread;
+        std::mutex m_mutex;
+        std::list<std::unique_ptr<Client>> m_clients;
+
+        void acceptLoop();
+        void clientLoop(Client *client);
+        void reapClients(bool all);
+
+    public:
+        // depth is the per-client subscription queue depth
+        explicit TcpFrameServer(FrameBus &bus, size_t depth = 4);
+        ~TcpFrameServer();
+
+        TcpFrameServer(const TcpFrameServer &) = delete;
+        TcpFrameServer &operator=(const TcpFrameServer &) = delete;
+
+        // Listen on port (0 picks a free port, see Port())
+        bool Start(uint16_t port, const std::string &bindAddress = "0.0.0.0");
+        void Stop();
+
+        uint16_t Port() const { return m_port; }
+        size_t Clients();       // Clients currently subscribed to a topic
+};
+
+class TcpFrameClient
+{
+    private:
+        std::atomic<int> m_fd;
+
+        bool readFully(uint8_t *data, size_t size, int timeoutMs);
+
+    public:
+        TcpFrameClient();
+        ~TcpFrameClient();
+
+        TcpFrameClient(const TcpFrameClient &) = delete;
+        TcpFrameClient &operator=(const TcpFrameClient &) = delete;
+
+        bool Connect(const std::string &host, uint16_t port, const std::string &topic);
+        bool Switch(const std::string &topic);      // Safe while Receive() runs elsewhere
+        void Close();
+        void Shutdown();    // Wake a Receive() blocked in another thread
+        bool IsConnected() const { return m_fd >= 0; }
+
+        // Read one frame into out. Returns false on timeout (connection
+        // still open) or on error/disconnect (IsConnected() becomes false).
+        bool Receive(std::vector<uint8_t> &out, int timeoutMs = -1);
+};
+
+#endif // TCP_TRANSPORT_H
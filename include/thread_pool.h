@@ -0,0 +1,64 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// Includes
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////
+// Fixed size pool of worker threads with work stealing
+// NOTE:
+//      Every worker has its own task deque. Tasks submitted from outside
+//      the pool are spread round robin over the deques; tasks submitted
+//      by a task go to the deque of the worker running it and are popped
+//      newest first (cache warm). A worker whose deque is empty steals
+//      the oldest task of another worker, so uneven jobs (a 4K frame next
+//      to thumbnails) still keep every core busy without every Submit
+//      contending on one lock.
+///////////////////////////////////////////////////////////////////////
+class ThreadPool
+{
+    private:
+        struct WorkerQueue
+        {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        std::vector<std::thread> m_workers;
+        std::vector<std::unique_ptr<WorkerQueue>> m_queues;   // One per worker
+        std::atomic<size_t> m_queued;       // Tasks waiting in any deque
+        std::atomic<size_t> m_pending;      // Queued + running tasks
+        std::atomic<size_t> m_nextQueue;    // Round robin for outside submits
+        std::atomic<size_t> m_steals;
+        std::mutex m_sleepMutex;            // Only for sleeping and waking
+        std::condition_variable m_taskReady;
+        std::condition_variable m_idle;
+        bool m_stop;
+
+        bool popTask(size_t worker, std::function<void()> &task);
+        void workerLoop(size_t worker);
+
+    public:
+        // threads == 0 uses std::thread::hardware_concurrency()
+        explicit ThreadPool(size_t threads = 0);
+        ~ThreadPool();      // Finishes queued tasks, then joins
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        void Submit(std::function<void()> task);
+        void Wait();        // Block until every submitted task has finished (not from a task)
+
+        size_t Size() const { return m_workers.size(); }
+        size_t Steals() const { return m_steals.load(std::memory_order_relaxed); }
+};
+
+#endif // THREAD_POOL_H
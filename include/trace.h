@@ -0,0 +1,100 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Includes
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+///////////////////////////////////////////////////////////////////////
+// Pipeline tracing in Chrome trace-event format
+//
+// TRACE_SCOPE("stage") records how long the enclosing scope took;
+// TRACE_SCOPE_FRAME("stage", sequence) also ties it to a frame, so a
+// trace viewer draws arrows from stage to stage of the same frame across
+// threads. Open the file written by Trace::WriteJSON() in ui.perfetto.dev
+// or chrome://tracing.
+//
+// Tracing is off until Trace::Enable(true); a disabled scope costs one
+// relaxed atomic load. Configuring with -DTRACING=OFF removes the macros
+// altogether. Each thread records into its own ring buffer without locks;
+// when a ring is full the oldest events are overwritten.
+///////////////////////////////////////////////////////////////////////
+
+struct TraceEvent
+{
+    const char *name;       // String literal, never copied
+    uint64_t startNs;
+    uint64_t durationNs;
+    uint64_t frame;
+    bool hasFrame;
+};
+
+class Trace
+{
+    private:
+        static std::atomic<bool> s_enabled;
+
+    public:
+        static bool Enabled() { return s_enabled.load(std::memory_order_relaxed); }
+        static void Enable(bool on);
+        static bool Compiled();             // Built with WITH_TRACING
+
+        // Events kept per thread, for threads that start recording afterwards
+        static void SetBufferEvents(size_t events);
+        static void SetThreadName(const char *name);
+
+        static uint64_t NowNs();
+        static void Record(const char *name, uint64_t startNs, uint64_t endNs,
+            bool hasFrame, uint64_t frame);
+
+        // Write every thread's events as Chrome trace-event JSON. Best called
+        // with tracing disabled, so no ring wraps while it is read.
+        static bool WriteJSON(const std::string &path);
+        static void Clear();
+};
+
+// Records its own lifetime as one complete event
+class TraceScope
+{
+    private:
+        const char *m_name;
+        uint64_t m_start;
+        uint64_t m_frame;
+        bool m_hasFrame;
+
+    public:
+        explicit TraceScope(const char *name)
+            : m_name(Trace::Enabled() ? name : nullptr), m_start(0), m_frame(0), m_hasFrame(false)
+        {
+            if (m_name) m_start = Trace::NowNs();
+        }
+        TraceScope(const char *name, uint64_t frame)
+            : m_name(Trace::Enabled() ? name : nullptr), m_start(0), m_frame(frame), m_hasFrame(true)
+        {
+            if (m_name) m_start = Trace::NowNs();
+        }
+        ~TraceScope()
+        {
+            if (m_name) Trace::Record(m_name, m_start, Trace::NowNs(), m_hasFrame, m_frame);
+        }
+
+        TraceScope(const TraceScope &) = delete;
+        TraceScope &operator=(const TraceScope &) = delete;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef WITH_TRACING
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_SCOPE_FRAME(name, frame) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name, frame)
+#define TRACE_THREAD_NAME(name) Trace::SetThreadName(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_SCOPE_FRAME(name, frame) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#endif
+
+#endif // TRACE_H
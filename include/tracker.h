@@ -0,0 +1,104 @@
+#ifndef TRACKER_H
+#define TRACKER_H
+
+// Includes
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "frame_message_util.h"   // for Detection
+
+///////////////////////////////////////////////////////////////////////
+// Constant velocity Kalman filter for one box coordinate
+// NOTE:
+//      The box state (cx, cy, w, h and their velocities) is tracked as
+//      four independent position/velocity filters. With diagonal noise
+//      this is exactly the 8 state SORT filter, at a fraction of the cost
+//      of 8x8 matrix algebra.
+///////////////////////////////////////////////////////////////////////
+struct KalmanAxis
+{
+    float x = 0.0f;             // Position
+    float v = 0.0f;             // Velocity per frame
+    float p00 = 0.0f, p01 = 0.0f, p11 = 0.0f;  // Covariance
+
+    void Init(float position, float positionVar, float velocityVar);
+    void Predict(float positionNoise, float velocityNoise);
+    void Correct(float measurement, float measurementVar);
+};
+
+// One tracked object
+struct Track
+{
+    int32_t id;
+    int32_t classId;
+    KalmanAxis cx, cy, w, h;
+    float score;                // Score of the last matched detection
+    int hits;                   // Detections matched so far
+    int misses;                 // Detection rounds without a match, in a row
+    int sinceDetection;         // Frames since the last matched detection
+
+    Detection ToDetection(float confidence) const;
+};
+
+///////////////////////////////////////////////////////////////////////
+// Multi-object tracker with IoU association and an adaptive detection
+// interval
+//
+// Per frame, call Update() with the detector output when DetectionDue()
+// is true, and Predict() otherwise. Both fill tracked with the boxes to
+// publish for that frame, with trackId set.
+//
+// The interval between detections adapts to the scene: it shrinks when
+// tracks move fast relative to their size (the prediction would drift),
+// when confidence drops or when tracks are born or lost, and grows back
+// towards maxInterval while everything is stable.
+///////////////////////////////////////////////////////////////////////
+class Tracker
+{
+    private:
+        std::vector<Track> m_tracks;
+        int32_t m_nextId;
+        int m_interval;             // Current detection interval in frames
+        int m_sinceDetection;       // Frames since the last Update()
+        bool m_detected;            // Update() has been called at least once
+
+        // Association scratch
+        struct Candidate
+        {
+            float iou;
+            uint32_t track;
+            uint32_t detection;
+        };
+        std::vector<Candidate> m_candidates;
+        std::vector<uint8_t> m_trackMatched;
+        std::vector<uint8_t> m_detectionMatched;
+
+        void predictTracks();
+        void emit(std::vector<Detection> &tracked) const;
+        void adaptInterval(int births, int deaths);
+
+    public:
+        float iouThreshold = 0.3f;      // Minimum IoU to associate
+        int maxMisses = 2;              // Detection rounds a track survives unmatched
+        int minHits = 2;                // Matches before a track is published
+        int minInterval = 1;            // Detect at least every maxInterval frames,
+        int maxInterval = 6;            //  at most every minInterval frames
+        float driftBudget = 0.25f;      // Allowed predicted motion between detections, in box sizes
+        float confidenceDecay = 0.9f;   // Per predicted frame
+        float lowConfidence = 0.35f;    // Detect every minInterval below this
+        bool classAware = true;         // Only associate boxes of the same class
+
+        Tracker();
+
+        bool DetectionDue() const;
+        void Update(const std::vector<Detection> &detections, std::vector<Detection> &tracked);
+        void Predict(std::vector<Detection> &tracked);
+        void Reset();
+
+        int Interval() const { return m_interval; }
+        size_t TrackCount() const { return m_tracks.size(); }
+        const std::vector<Track> &Tracks() const { return m_tracks; }
+};
+
+#endif // TRACKER_H
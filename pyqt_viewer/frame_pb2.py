@@ -0,0 +1,29 @@
+# -*- coding: utf-8 -*-
+# Generated by the protocol buffer compiler.  DO NOT EDIT!
+# source: frame.proto
+"""Generated protocol buffer code."""
+from google.protobuf.internal import builder as _builder
+from google.protobuf import descriptor as _descriptor
+from google.protobuf import descriptor_pool as _descriptor_pool
+from google.protobuf import symbol_database as _symbol_database
+# @@protoc_insertion_point(imports)
+
+_sym_db = _symbol_database.Default()
+
+
+
+
+DESCRIPTOR = _descriptor_pool.Default().AddSerializedFile(b'\n\x0b\x66rame.proto\x12\x05\x66rame\"s\n\tDetection\x12\t\n\x01x\x18\x01 \x01(\x02\x12\t\n\x01y\x18\x02 \x01(\x02\x12\r\n\x05width\x18\x03 \x01(\x02\x12\x0e\n\x06height\x18\x04 \x01(\x02\x12\r\n\x05score\x18\x05 \x01(\x02\x12\x10\n\x08\x63lass_id\x18\x06 \x01(\x05\x12\x10\n\x08track_id\x18\x07 \x01(\x05\"\xed\x01\n\x05\x46rame\x12\x10\n\x08sequence\x18\x01 \x01(\x04\x12\x14\n\x0ctimestamp_us\x18\x02 \x01(\x04\x12\r\n\x05width\x18\x03 \x01(\r\x12\x0e\n\x06height\x18\x04 \x01(\r\x12\'\n\x08\x65ncoding\x18\x05 \x01(\x0e\x32\x15.frame.Frame.Encoding\x12\x0f\n\x07payload\x18\x06 \x01(\x0c\x12$\n\ndetections\x18\x07 \x03(\x0b\x32\x10.frame.Detection\x12\x11\n\tstream_id\x18\x08 \x01(\t\"*\n\x08\x45ncoding\x12\x0b\n\x07RAW_RGB\x10\x00\x12\x08\n\x04JPEG\x10\x01\x12\x07\n\x03PNG\x10\x02\x62\x06proto3')
+
+_builder.BuildMessageAndEnumDescriptors(DESCRIPTOR, globals())
+_builder.BuildTopDescriptorsAndMessages(DESCRIPTOR, 'frame_pb2', globals())
+if _descriptor._USE_C_DESCRIPTORS == False:
+
+  DESCRIPTOR._options = None
+  _DETECTION._serialized_start=22
+  _DETECTION._serialized_end=137
+  _FRAME._serialized_start=140
+  _FRAME._serialized_end=377
+  _FRAME_ENCODING._serialized_start=335
+  _FRAME_ENCODING._serialized_end=377
+# @@protoc_insertion_point(module_scope)
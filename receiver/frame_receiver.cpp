@@ -0,0 +1,207 @@
+// Includes
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "receiver.h"
+
+///////////////////////////////////////////////////////////////////////
+// Native frame receiver
+//
+// Subscribes to one or more streams served by a TcpFrameServer, decodes
+// them on a shared thread pool and prints per-stream fps, decode time
+// and sequence gaps. With --subscribers N every stream is subscribed N
+// times, which turns it into a load generator for the publisher.
+///////////////////////////////////////////////////////////////////////
+
+struct StreamAddress
+{
+    std::string host;
+    uint16_t port;
+    std::string topic;
+};
+
+struct ReceiverOptions
+{
+    std::vector<StreamAddress> streams;
+    int subscribers = 1;        // Subscriptions per stream
+    int threads = 0;            // Decode threads, 0 = all cores
+    int inFlight = 4;           // Max decoding frames per subscription
+    double seconds = 0.0;       // 0 = until interrupted
+    double interval = 1.0;      // Report interval
+    double minFps = 0.0;        // Gate on the final interval, 0 = disabled
+};
+
+static std::atomic<bool> g_interrupted(false);
+
+static void on_signal(int)
+{
+    g_interrupted = true;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+        "Usage: %s --stream host:port/topic [--stream ...] [options]\n"
+        "  --subscribers N    subscribe to every stream N times (1)\n"
+        "  --threads N        decode threads, 0 = all cores (0)\n"
+        "  --in-flight N      frames decoding at once per subscription (4)\n"
+        "  --seconds S        run time, 0 = until interrupted (0)\n"
+        "  --interval S       report interval (1)\n"
+        "  --min-fps F        fail if any subscription ends below F fps\n",
+        argv0);
+}
+
+// Parse "host:port/topic"
+static bool parse_address(const char *text, StreamAddress &address)
+{
+    const char *colon = strchr(text, ':');
+    const char *slash = colon ? strchr(colon, '/') : nullptr;
+    if (!colon || !slash || slash[1] == '\0')
+    {
+        return false;
+    }
+
+    int port = atoi(colon + 1);
+    if (port <= 0 || port > 65535)
+    {
+        return false;
+    }
+
+    address.host.assign(text, colon);
+    address.port = static_cast<uint16_t>(port);
+    address.topic = slash + 1;
+    return true;
+}
+
+static bool parse_options(int argc, char **argv, ReceiverOptions &opt)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (!strcmp(arg, "--help") || !strcmp(arg, "-h"))
+        {
+            return false;
+        }
+        if (!value)
+        {
+            fprintf(stderr, "Missing value for %s\n", arg);
+            return false;
+        }
+
+        if (!strcmp(arg, "--stream"))
+        {
+            StreamAddress address;
+            if (!parse_address(value, address))
+            {
+                fprintf(stderr, "Bad stream address %s\n", value);
+                return false;
+            }
+            opt.streams.push_back(address);
+        }
+        else if (!strcmp(arg, "--subscribers")) opt.subscribers = atoi(value);
+        else if (!strcmp(arg, "--threads")) opt.threads = atoi(value);
+        else if (!strcmp(arg, "--in-flight")) opt.inFlight = atoi(value);
+        else if (!strcmp(arg, "--seconds")) opt.seconds = atof(value);
+        else if (!strcmp(arg, "--interval")) opt.interval = atof(value);
+        else if (!strcmp(arg, "--min-fps")) opt.minFps = atof(value);
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            return false;
+        }
+        i++;
+    }
+
+    return !opt.streams.empty() && opt.subscribers > 0 && opt.threads >= 0 &&
+        opt.inFlight > 0 && opt.interval > 0.0;
+}
+
+int main(int argc, char **argv)
+{
+    ReceiverOptions opt;
+    if (!parse_options(argc, argv, opt))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    Receiver receiver(static_cast<size_t>(opt.threads), static_cast<size_t>(opt.inFlight));
+    for (const StreamAddress &address : opt.streams)
+    {
+        for (int i = 0; i < opt.subscribers; i++)
+        {
+            std::unique_ptr<TcpFrameSource> source(
+                new TcpFrameSource(address.host, address.port, address.topic));
+            if (!source->Connected())
+            {
+                return 1;
+            }
+            receiver.AddStream(std::move(source));
+        }
+    }
+
+    receiver.Start();
+
+    const auto start = std::chrono::steady_clock::now();
+    auto nextReport = start;
+    std::vector<ReceiverStreamStats> stats;
+    bool allFinished = false;
+
+    while (!g_interrupted && !allFinished)
+    {
+        nextReport += std::chrono::microseconds(static_cast<int64_t>(opt.interval * 1e6));
+        std::this_thread::sleep_until(nextReport);
+
+        stats = receiver.Stats();
+        double elapsed = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+
+        printf("[%7.1fs] %zu subscriptions, %zu pooled images\n", elapsed,
+            stats.size(), receiver.PooledImages());
+        allFinished = true;
+        for (size_t i = 0; i < stats.size(); i++)
+        {
+            const ReceiverStreamStats &s = stats[i];
+            printf("  #%-3zu %-32s %7.1f fps  frames %-8llu gaps %-6llu errors %-4llu "
+                "decode mean %7.0fus p50 %7.0fus p99 %7.0fus%s\n",
+                i, s.name.c_str(), s.fps, (unsigned long long)s.frames,
+                (unsigned long long)s.gaps, (unsigned long long)s.errors,
+                s.decodeMeanUs, s.decodeP50Us, s.decodeP99Us,
+                s.finished ? "  (disconnected)" : "");
+            allFinished = allFinished && s.finished;
+        }
+        fflush(stdout);
+
+        if (opt.seconds > 0.0 && elapsed >= opt.seconds)
+        {
+            break;
+        }
+    }
+
+    receiver.Stop();
+
+    int status = 0;
+    for (const ReceiverStreamStats &s : stats)
+    {
+        if (s.errors || (opt.minFps > 0.0 && s.fps < opt.minFps))
+        {
+            fprintf(stderr, "FAIL: %s at %.1f fps with %llu errors\n",
+                s.name.c_str(), s.fps, (unsigned long long)s.errors);
+            status = 1;
+        }
+    }
+    return status;
+}
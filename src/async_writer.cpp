@@ -0,0 +1,704 @@
+// Includes
+#include <algorithm>   // for std::min, std::max
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <stdlib.h>     // for posix_memalign
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "async_writer.h"
+#include "stage_stats.h"
+#include "trace.h"
+
+// O_DIRECT buffer, length and offset alignment. 4 KiB suits every block
+// device we write to (SD cards, eMMC, NVMe).
+static const size_t kDirectAlign = 4096;
+
+// user_data of the eventfd poll that wakes the ring thread
+static const uint64_t kWakeup = 0;
+
+///////////////////////////////////////////////////////////////////////
+// One file being written
+///////////////////////////////////////////////////////////////////////
+struct AsyncWriter::Job
+{
+    std::string path;
+    Buffer data;
+    Callback done;
+    uint64_t startUs = 0;
+    int fd = -1;
+    bool direct = false;
+    uint8_t *staging = nullptr;     // Aligned, padded copy for O_DIRECT
+    size_t length = 0;              // Bytes to write, padded when direct
+    size_t offset = 0;              // Written so far
+    int error = 0;
+
+    ~Job()
+    {
+        free(staging);
+        if (fd >= 0) close(fd);
+    }
+
+    const uint8_t *bytes() const { return staging ? staging : data->data(); }
+
+    // Create the file. O_DIRECT needs a whole number of aligned blocks
+    // from an aligned buffer: the data is copied and zero padded, and
+    // complete() cuts the padding off again. Filesystems that refuse
+    // O_DIRECT (tmpfs) get a buffered write.
+    bool open(bool tryDirect)
+    {
+        const size_t size = data->size();
+        if (tryDirect && size >= kDirectAlign)
+        {
+            fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+            if (fd >= 0)
+            {
+                length = (size + kDirectAlign - 1) / kDirectAlign * kDirectAlign;
+                void *aligned = nullptr;
+                if (posix_memalign(&aligned, kDirectAlign, length) == 0)
+                {
+                    staging = static_cast<uint8_t *>(aligned);
+                    memcpy(staging, data->data(), size);
+                    memset(staging + size, 0, length - size);
+                    direct = true;
+                    return true;
+                }
+                close(fd);
+            }
+        }
+
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            error = errno;
+            return false;
+        }
+        length = size;
+        return true;
+    }
+
+    // All bytes are out: drop the padding and close
+    void complete()
+    {
+        if (!error && direct && length != data->size() &&
+            ftruncate(fd, static_cast<off_t>(data->size())) != 0)
+        {
+            error = errno;
+        }
+        if (close(fd) != 0 && !error)
+        {
+            error = errno;
+        }
+        fd = -1;
+    }
+
+    // Thread backend: the whole file on the calling thread
+    void writeSync()
+    {
+        while (offset < length)
+        {
+            ssize_t n = pwrite(fd, bytes() + offset, length - offset, static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0)
+            {
+                error = n < 0 ? errno : EIO;
+                break;
+            }
+            offset += static_cast<size_t>(n);
+        }
+        complete();
+    }
+};
+
+///////////////////////////////////////////////////////////////////////
+// io_uring submission and completion queues, set up with raw syscalls
+// NOTE:
+//      Only the ring thread touches the queues. The kernel reads the SQ
+//      tail and writes the CQ tail concurrently, hence the acquire and
+//      release accesses on those two.
+///////////////////////////////////////////////////////////////////////
+struct AsyncWriter::Ring
+{
+    int fd = -1;
+    int wakeFd = -1;                // eventfd, written by Write()
+    void *sqRing = MAP_FAILED;
+    void *cqRing = MAP_FAILED;
+    size_t sqRingSize = 0, cqRingSize = 0;
+    struct io_uring_sqe *sqes = static_cast<struct io_uring_sqe *>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    unsigned *sqHead = nullptr;
+    unsigned *sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned *sqArray = nullptr;
+    unsigned entries = 0;
+    unsigned *cqHead = nullptr;
+    unsigned *cqTail = nullptr;
+    unsigned cqMask = 0;
+    struct io_uring_cqe *cqes = nullptr;
+    unsigned unsubmitted = 0;       // SQEs queued since the last enter()
+
+    // Options::failEnterAt and friends
+    unsigned enterCalls = 0;
+    unsigned failFrom = 0, failCount = 0;
+    int failErrno = 0;
+
+    ~Ring()
+    {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if (fd >= 0) close(fd);
+        if (wakeFd >= 0) close(wakeFd);
+    }
+
+    bool setup(unsigned depth)
+    {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, depth, &params));
+        // FAST_POLL (5.7) implies IORING_OP_WRITE and POLL_ADD (5.6)
+        if (fd < 0 || !(params.features & IORING_FEAT_FAST_POLL))
+        {
+            return false;
+        }
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED)
+        {
+            return false;
+        }
+        cqRing = (params.features & IORING_FEAT_SINGLE_MMAP) ? sqRing :
+            mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                fd, IORING_OFF_CQ_RING);
+        sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        sqes = static_cast<struct io_uring_sqe *>(mmap(nullptr, sqesSize,
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (cqRing == MAP_FAILED || sqes == MAP_FAILED)
+        {
+            return false;
+        }
+
+        uint8_t *sq = static_cast<uint8_t *>(sqRing);
+        uint8_t *cq = static_cast<uint8_t *>(cqRing);
+        sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        entries = params.sq_entries;
+        cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+        wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        return wakeFd >= 0;
+    }
+
+    // Next free SQE, zeroed. The caller never has more than entries out.
+    struct io_uring_sqe *next()
+    {
+        const unsigned tail = *sqTail;
+        const unsigned index = tail & sqMask;
+        struct io_uring_sqe *sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        unsubmitted++;
+        return sqe;
+    }
+
+    void queueWrite(Job *job)
+    {
+        struct io_uring_sqe *sqe = next();
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = job->fd;
+        sqe->addr = reinterpret_cast<uint64_t>(job->bytes() + job->offset);
+        sqe->len = static_cast<uint32_t>(std::min<size_t>(job->length - job->offset, 1u << 30));
+        sqe->off = job->offset;
+        sqe->user_data = reinterpret_cast<uint64_t>(job);
+    }
+
+    void queueWakeup()
+    {
+        struct io_uring_sqe *sqe = next();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = wakeFd;
+        sqe->poll32_events = POLLIN;
+        sqe->user_data = kWakeup;
+    }
+
+    // Submit what is queued (unless !submit) and wait for at least one
+    // completion. Returns 0, or the errno when the ring can't be used any
+    // more. EBUSY (completion queue full) and EAGAIN (kernel short of
+    // request memory) submit nothing: the caller reaps and enters again,
+    // and with nothing to reap this waits a millisecond rather than spin.
+    int enter(bool submit = true)
+    {
+        for (;;)
+        {
+            long n;
+            enterCalls++;
+            if (failFrom && enterCalls >= failFrom && enterCalls - failFrom < failCount)
+            {
+                n = -1;
+                errno = failErrno;
+            }
+            else
+            {
+                n = syscall(__NR_io_uring_enter, fd, submit ? unsubmitted : 0u, 1u,
+                    IORING_ENTER_GETEVENTS, nullptr, 0);
+            }
+            if (n >= 0)
+            {
+                unsubmitted -= std::min(unsubmitted, static_cast<unsigned>(n));
+                return 0;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EBUSY && errno != EAGAIN)
+            {
+                return errno;
+            }
+            if (*cqHead == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+            {
+                usleep(1000);
+            }
+            return 0;
+        }
+    }
+
+    // Take back the SQEs the kernel has not consumed yet
+    template <typename F>
+    void takeBack(F handle)
+    {
+        const unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        for (unsigned i = head; i != *sqTail; i++)
+        {
+            handle(sqes[i & sqMask].user_data);
+        }
+        __atomic_store_n(sqTail, head, __ATOMIC_RELEASE);
+        unsubmitted = 0;
+    }
+
+    // Close the kernel side. The kernel cancels what it still has and
+    // lets go of the buffers; wakeFd stays open.
+    void shutdown()
+    {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        sqes = static_cast<struct io_uring_sqe *>(MAP_FAILED);
+        sqRing = cqRing = MAP_FAILED;
+        close(fd);
+        fd = -1;
+    }
+
+    template <typename F>
+    void reap(F handle)
+    {
+        unsigned head = *cqHead;
+        const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            const struct io_uring_cqe &cqe = cqes[head & cqMask];
+            handle(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+};
+
+///////////////////////////////////////////////////////////////////////
+// AsyncWriter constructor
+///////////////////////////////////////////////////////////////////////
+AsyncWriter::AsyncWriter() : AsyncWriter(Options()) {}
+
+AsyncWriter::AsyncWriter(const Options &options)
+    : m_options(options), m_pending(0), m_stop(false),
+      m_written(0), m_failed(0), m_rejected(0), m_submits(0),
+      m_inFlightBytes(0), m_peakBytes(0), m_ringError(0)
+{
+    if (m_options.backend == Backend::Auto)
+    {
+        m_ring.reset(new Ring());
+        m_ring->failFrom = m_options.failEnterAt;
+        m_ring->failCount = m_options.failEnterCount;
+        m_ring->failErrno = m_options.failEnterErrno;
+        if (m_ring->setup(std::max(4u, m_options.queueDepth)))
+        {
+            m_thread = std::thread(&AsyncWriter::ringLoop, this);
+            return;
+        }
+        m_ring.reset();     // No io_uring here (old kernel, seccomp)
+    }
+    m_pool.reset(new ThreadPool(std::max<size_t>(1, m_options.threads)));
+}
+
+AsyncWriter::~AsyncWriter()
+{
+    Flush();
+    if (m_ring)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        uint64_t one = 1;
+        (void)!write(m_ring->wakeFd, &one, sizeof(one));
+        m_thread.join();
+    }
+    m_pool.reset();
+}
+
+const char *AsyncWriter::BackendName() const
+{
+    return m_ring && !m_ringError ? "io_uring" : "threads";
+}
+
+///////////////////////////////////////////////////////////////////////
+// Queue a file
+///////////////////////////////////////////////////////////////////////
+bool AsyncWriter::Write(const std::string &path, Buffer data, Callback done)
+{
+    if (!data || path.empty())
+    {
+        return false;
+    }
+
+    // Claim the bytes, or reject without waiting
+    const size_t size = data->size();
+    size_t current = m_inFlightBytes.load();
+    do
+    {
+        if (current + size > m_options.maxInFlightBytes)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_rejected++;
+            return false;
+        }
+    } while (!m_inFlightBytes.compare_exchange_weak(current, current + size));
+    size_t peak = m_peakBytes.load();
+    while (current + size > peak && !m_peakBytes.compare_exchange_weak(peak, current + size)) {}
+
+    std::unique_ptr<Job> job(new Job());
+    job->path = path;
+    job->data = std::move(data);
+    job->done = std::move(done);
+    job->startUs = NowMicros();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending++;
+        if (m_ring)
+        {
+            m_queue.push_back(std::move(job));
+        }
+    }
+
+    if (m_ring)
+    {
+        uint64_t one = 1;
+        (void)!write(m_ring->wakeFd, &one, sizeof(one));
+        return true;
+    }
+
+    Job *raw = job.release();   // std::function needs a copyable task
+    const bool direct = m_options.direct;
+    m_pool->Submit([this, raw, direct]
+    {
+        std::unique_ptr<Job> owned(raw);
+        TRACE_SCOPE("async write");
+        if (owned->open(direct))
+        {
+            owned->writeSync();
+        }
+        finish(std::move(owned));
+    });
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Report a finished job and release its bytes
+///////////////////////////////////////////////////////////////////////
+void AsyncWriter::finish(std::unique_ptr<Job> job)
+{
+    WriteResult result;
+    result.path = job->path;
+    result.bytes = job->data->size();
+    result.error = job->error;
+    result.direct = job->direct;
+    result.latencyUs = static_cast<double>(NowMicros() - job->startUs);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        (result.error ? m_failed : m_written)++;
+    }
+    if (job->done)
+    {
+        job->done(result);
+    }
+
+    // The budget covers the callback, so a slow one pushes back
+    m_inFlightBytes -= result.bytes;
+    job.reset();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending--;
+    }
+    m_idle.notify_all();
+}
+
+void AsyncWriter::Flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_pending == 0; });
+}
+
+///////////////////////////////////////////////////////////////////////
+// Ring thread: open what queued up, submit it in one go, handle
+// completions, repeat. Blocks in io_uring_enter() until a write completes
+// or Write() signals the eventfd.
+// NOTE:
+//      If io_uring_enter() fails for good, see abandonRing(), the thread
+//      carries on as a one worker thread backend.
+///////////////////////////////////////////////////////////////////////
+void AsyncWriter::ringLoop()
+{
+    TRACE_THREAD_NAME("async writer");
+    Ring &ring = *m_ring;
+    const size_t maxActive = ring.entries - 1;      // One entry for the wakeup poll
+    std::vector<Job *> active;                      // Queued in the ring or in the kernel
+    bool wakeupArmed = false;
+    std::vector<std::unique_ptr<Job>> batch;
+
+    for (;;)
+    {
+        bool stop;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            while (!m_queue.empty() && active.size() + batch.size() < maxActive)
+            {
+                batch.push_back(std::move(m_queue.front()));
+                m_queue.pop_front();
+            }
+            stop = m_stop && m_queue.empty();
+        }
+        if (stop && active.empty() && batch.empty())
+        {
+            break;
+        }
+
+        {
+            TRACE_SCOPE("async write submit");
+            for (std::unique_ptr<Job> &job : batch)
+            {
+                if (!job->open(m_options.direct) || job->length == 0)
+                {
+                    if (job->fd >= 0) job->complete();      // Empty file
+                    finish(std::move(job));
+                    continue;
+                }
+                active.push_back(job.get());
+                ring.queueWrite(job.release());
+            }
+            batch.clear();
+            if (!wakeupArmed)
+            {
+                ring.queueWakeup();
+                wakeupArmed = true;
+            }
+            if (ring.unsubmitted)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_submits++;
+            }
+        }
+        const int error = ring.enter();
+        if (error)
+        {
+            abandonRing(active, error);
+            syncLoop();
+            return;
+        }
+
+        ring.reap([&](uint64_t userData, int res)
+        {
+            if (userData == kWakeup)
+            {
+                uint64_t count;
+                while (read(ring.wakeFd, &count, sizeof(count)) > 0) {}
+                wakeupArmed = false;
+                return;
+            }
+
+            Job *job = reinterpret_cast<Job *>(userData);
+            if (res == -EINTR || res == -EAGAIN)
+            {
+                ring.queueWrite(job);       // Try again
+                return;
+            }
+            if (res <= 0)
+            {
+                job->error = res < 0 ? -res : EIO;
+            }
+            else
+            {
+                job->offset += static_cast<size_t>(res);
+                if (job->offset < job->length)
+                {
+                    ring.queueWrite(job);   // Short write, send the rest
+                    return;
+                }
+            }
+            job->complete();
+            active.erase(std::find(active.begin(), active.end(), job));
+            finish(std::unique_ptr<Job>(job));
+        });
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// io_uring_enter() failed with error. Nothing more goes to the ring.
+// Writes the kernel has not taken are done here instead; the ones it has
+// read their buffers until they complete, so those are waited for. If
+// the ring can't even wait, it is closed, which makes the kernel drop
+// them, and only then are they failed with the errno.
+///////////////////////////////////////////////////////////////////////
+void AsyncWriter::abandonRing(std::vector<Job *> &active, int error)
+{
+    Ring &ring = *m_ring;
+    m_ringError = error;
+
+    std::vector<Job *> local;
+    ring.takeBack([&](uint64_t userData)
+    {
+        if (userData != kWakeup) local.push_back(reinterpret_cast<Job *>(userData));
+    });
+    std::vector<Job *> inKernel;
+    for (Job *job : active)
+    {
+        if (std::find(local.begin(), local.end(), job) == local.end())
+            inKernel.push_back(job);
+    }
+    active.clear();
+
+    int waitError = 0;
+    while (!inKernel.empty() && !waitError)
+    {
+        waitError = ring.enter(false);
+        ring.reap([&](uint64_t userData, int res)
+        {
+            if (userData == kWakeup)
+            {
+                return;
+            }
+            Job *job = reinterpret_cast<Job *>(userData);
+            inKernel.erase(std::find(inKernel.begin(), inKernel.end(), job));
+            if (res > 0)
+                job->offset += static_cast<size_t>(res);
+            else if (res < 0 && res != -EINTR && res != -EAGAIN)
+                job->error = -res;
+            local.push_back(job);       // Any rest is written below
+        });
+    }
+    if (!inKernel.empty())
+    {
+        ring.shutdown();
+        for (Job *job : inKernel)
+        {
+            job->error = waitError;
+            local.push_back(job);
+        }
+    }
+
+    for (Job *job : local)
+    {
+        std::unique_ptr<Job> owned(job);
+        if (owned->error)
+            owned->complete();
+        else
+            owned->writeSync();
+        finish(std::move(owned));
+    }
+}
+
+// What the ring thread does once the ring has failed: the thread
+// backend's work, one file at a time, woken by the same eventfd
+void AsyncWriter::syncLoop()
+{
+    for (;;)
+    {
+        std::unique_ptr<Job> job;
+        bool stop;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_queue.empty())
+            {
+                job = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+            stop = m_stop;
+        }
+        if (job)
+        {
+            TRACE_SCOPE("async write");
+            if (job->open(m_options.direct))
+            {
+                job->writeSync();
+            }
+            finish(std::move(job));
+            continue;
+        }
+        if (stop)
+        {
+            break;
+        }
+
+        struct pollfd wake;
+        wake.fd = m_ring->wakeFd;
+        wake.events = POLLIN;
+        wake.revents = 0;
+        if (poll(&wake, 1, -1) > 0)
+        {
+            uint64_t count;
+            while (read(m_ring->wakeFd, &count, sizeof(count)) > 0) {}
+        }
+    }
+}
+
+uint64_t AsyncWriter::Written()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_written;
+}
+
+uint64_t AsyncWriter::Failed()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_failed;
+}
+
+uint64_t AsyncWriter::Rejected()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_rejected;
+}
+
+uint64_t AsyncWriter::Submits()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_submits;
+}
@@ -0,0 +1,77 @@
+// Includes
+#include <thread>      // for std::this_thread::sleep_until
+
+#include "camera.h"
+#include "stage_stats.h"
+#include "trace.h"
+
+///////////////////////////////////////////////////////////////////////
+// SyntheticCamera constructor
+///////////////////////////////////////////////////////////////////////
+SyntheticCamera::SyntheticCamera(int w, int h, double fps, int noise)
+    : m_width(w), m_height(h), m_fps(fps), m_frameIndex(0),
+      m_seed(0x9E3779B9u), m_noise(noise & 0xFF),
+      m_nextFrame(std::chrono::steady_clock::now()) {}
+
+///////////////////////////////////////////////////////////////////////
+// Capture the next frame, paced to the configured frame rate
+// NOTE:
+//      Pacing is against an absolute schedule, so a slow consumer makes
+//      frames late rather than slowly shifting the whole timeline.
+///////////////////////////////////////////////////////////////////////
+bool SyntheticCamera::Capture(Image &frame, uint64_t &timestampUs)
+{
+    if (m_fps > 0.0)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (m_nextFrame > now)
+        {
+            std::this_thread::sleep_until(m_nextFrame);
+        }
+        m_nextFrame += std::chrono::microseconds(static_cast<int64_t>(1e6 / m_fps));
+    }
+
+    TRACE_SCOPE("capture");
+    timestampUs = NowMicros();
+    Render(frame, m_frameIndex++);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Capture the next frame as JPEG
+///////////////////////////////////////////////////////////////////////
+bool SyntheticCamera::CaptureJPEG(std::vector<uint8_t> &jpeg, uint64_t &timestampUs, int quality)
+{
+    return Capture(m_sensor, timestampUs) && m_sensor.EncodeJPEG(jpeg, quality);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Render one frame: a diagonal gradient that scrolls with the frame
+// index, plus xorshift noise
+///////////////////////////////////////////////////////////////////////
+void SyntheticCamera::Render(Image &frame, uint64_t index)
+{
+    frame.Resize(m_width, m_height);
+
+    const int shift = static_cast<int>(index * 4);
+    uint32_t seed = m_seed ^ static_cast<uint32_t>(index * 2654435761u);
+    if (seed == 0) seed = 1;
+
+    for (int y = 0; y < m_height; y++)
+    {
+        uint8_t *row = frame.m_data + 3 * m_width * y;
+        const int gy = (y * 255) / (m_height > 1 ? m_height - 1 : 1);
+        for (int x = 0; x < m_width; x++)
+        {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            const int n = m_noise ? static_cast<int>(seed % (m_noise + 1)) : 0;
+            const int gx = ((x + shift) * 255) / (m_width > 1 ? m_width - 1 : 1);
+
+            row[3 * x + 0] = static_cast<uint8_t>(gx + n);
+            row[3 * x + 1] = static_cast<uint8_t>(gy + n);
+            row[3 * x + 2] = static_cast<uint8_t>((gx + gy) / 2 + n);
+        }
+    }
+}
@@ -0,0 +1,367 @@
+// Includes
+#include <cstdint>     // for uint8_t
+#include <string.h>    // for memcpy
+
+#include "frame_message_util.h"
+
+///////////////////////////////////////////////////////////////////////
+// Protobuf wire format
+// NOTE:
+//      Only the pieces frame.proto needs: varints (wire type 0),
+//      length delimited fields (wire type 2) and 32 bit floats
+//      (wire type 5). See
+//      https://protobuf.dev/programming-guides/encoding/
+///////////////////////////////////////////////////////////////////////
+enum WireType
+{
+    WIRE_VARINT = 0,
+    WIRE_FIXED64 = 1,
+    WIRE_LENGTH = 2,
+    WIRE_FIXED32 = 5,
+};
+
+// Field numbers from frame.proto
+enum FrameField
+{
+    FRAME_SEQUENCE = 1,
+    FRAME_TIMESTAMP = 2,
+    FRAME_WIDTH = 3,
+    FRAME_HEIGHT = 4,
+    FRAME_ENCODING = 5,
+    FRAME_PAYLOAD = 6,
+    FRAME_DETECTIONS = 7,
+    FRAME_STREAM_ID = 8,
+};
+
+enum DetectionField
+{
+    DET_X = 1,
+    DET_Y = 2,
+    DET_WIDTH = 3,
+    DET_HEIGHT = 4,
+    DET_SCORE = 5,
+    DET_CLASS_ID = 6,
+    DET_TRACK_ID = 7,
+};
+
+static size_t varint_size(uint64_t value)
+{
+    size_t n = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static void put_varint(std::vector<uint8_t> &out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static void put_tag(std::vector<uint8_t> &out, uint32_t field, WireType type)
+{
+    put_varint(out, (static_cast<uint64_t>(field) << 3) | type);
+}
+
+static void put_float(std::vector<uint8_t> &out, uint32_t field, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    put_tag(out, field, WIRE_FIXED32);
+    for (int i = 0; i < 4; i++)
+    {
+        out.push_back(static_cast<uint8_t>(bits >> (8 * i)));  // Little endian
+    }
+}
+
+// int32 fields are sign extended to 64 bits on the wire
+static uint64_t int32_wire(int32_t value)
+{
+    return static_cast<uint64_t>(static_cast<int64_t>(value));
+}
+
+// Encoded size of a Detection message (every field is always written)
+static size_t detection_size(const Detection &det)
+{
+    return 5 * (1 + 4) +
+        1 + varint_size(int32_wire(det.classId)) +
+        1 + varint_size(int32_wire(det.trackId));
+}
+
+///////////////////////////////////////////////////////////////////////
+// Serialize a frame
+// NOTE:
+//      Like protobuf, zero valued scalars are omitted. Detections always
+//      carry every field, because track_id -1 and 0 must stay distinct.
+///////////////////////////////////////////////////////////////////////
+void SerializeFrame(const FrameMessage &frame, std::vector<uint8_t> &out)
+{
+    out.clear();
+    out.reserve(frame.payload.size() + frame.streamId.size() +
+        frame.detections.size() * 40 + 64);
+
+    if (frame.sequence)
+    {
+        put_tag(out, FRAME_SEQUENCE, WIRE_VARINT);
+        put_varint(out, frame.sequence);
+    }
+    if (frame.timestampUs)
+    {
+        put_tag(out, FRAME_TIMESTAMP, WIRE_VARINT);
+        put_varint(out, frame.timestampUs);
+    }
+    if (frame.width)
+    {
+        put_tag(out, FRAME_WIDTH, WIRE_VARINT);
+        put_varint(out, frame.width);
+    }
+    if (frame.height)
+    {
+        put_tag(out, FRAME_HEIGHT, WIRE_VARINT);
+        put_varint(out, frame.height);
+    }
+    if (frame.encoding != FrameEncoding::RawRGB)
+    {
+        put_tag(out, FRAME_ENCODING, WIRE_VARINT);
+        put_varint(out, static_cast<uint32_t>(frame.encoding));
+    }
+    if (!frame.payload.empty())
+    {
+        put_tag(out, FRAME_PAYLOAD, WIRE_LENGTH);
+        put_varint(out, frame.payload.size());
+        out.insert(out.end(), frame.payload.begin(), frame.payload.end());
+    }
+    for (const Detection &det : frame.detections)
+    {
+        put_tag(out, FRAME_DETECTIONS, WIRE_LENGTH);
+        put_varint(out, detection_size(det));
+        put_float(out, DET_X, det.x);
+        put_float(out, DET_Y, det.y);
+        put_float(out, DET_WIDTH, det.width);
+        put_float(out, DET_HEIGHT, det.height);
+        put_float(out, DET_SCORE, det.score);
+        put_tag(out, DET_CLASS_ID, WIRE_VARINT);
+        put_varint(out, int32_wire(det.classId));
+        put_tag(out, DET_TRACK_ID, WIRE_VARINT);
+        put_varint(out, int32_wire(det.trackId));
+    }
+    if (!frame.streamId.empty())
+    {
+        put_tag(out, FRAME_STREAM_ID, WIRE_LENGTH);
+        put_varint(out, frame.streamId.size());
+        out.insert(out.end(), frame.streamId.begin(), frame.streamId.end());
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Bounds checked reader over a serialized buffer
+///////////////////////////////////////////////////////////////////////
+struct WireReader
+{
+    const uint8_t *pos;
+    const uint8_t *end;
+
+    bool ReadVarint(uint64_t &value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (pos >= end)
+            {
+                return false;
+            }
+            uint8_t byte = *pos++;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+            {
+                return true;
+            }
+        }
+        return false;   // More than 10 bytes, malformed
+    }
+
+    bool ReadFloat(float &value)
+    {
+        if (end - pos < 4)
+        {
+            return false;
+        }
+        uint32_t bits = static_cast<uint32_t>(pos[0]) |
+            (static_cast<uint32_t>(pos[1]) << 8) |
+            (static_cast<uint32_t>(pos[2]) << 16) |
+            (static_cast<uint32_t>(pos[3]) << 24);
+        memcpy(&value, &bits, sizeof(value));
+        pos += 4;
+        return true;
+    }
+
+    bool ReadLength(const uint8_t *&data, size_t &size)
+    {
+        uint64_t length;
+        if (!ReadVarint(length) || length > static_cast<uint64_t>(end - pos))
+        {
+            return false;
+        }
+        data = pos;
+        size = static_cast<size_t>(length);
+        pos += size;
+        return true;
+    }
+
+    // Skip a field we do not know about
+    bool Skip(uint32_t type)
+    {
+        uint64_t ignored;
+        const uint8_t *data;
+        size_t size;
+
+        switch (type)
+        {
+            case WIRE_VARINT:
+                return ReadVarint(ignored);
+            case WIRE_FIXED64:
+                if (end - pos < 8) return false;
+                pos += 8;
+                return true;
+            case WIRE_LENGTH:
+                return ReadLength(data, size);
+            case WIRE_FIXED32:
+                if (end - pos < 4) return false;
+                pos += 4;
+                return true;
+            default:
+                return false;   // Groups are not supported
+        }
+    }
+};
+
+static bool parse_detection(const uint8_t *data, size_t size, Detection &det)
+{
+    WireReader reader = {data, data + size};
+    uint64_t key, value;
+
+    while (reader.pos < reader.end)
+    {
+        if (!reader.ReadVarint(key))
+        {
+            return false;
+        }
+        uint32_t field = static_cast<uint32_t>(key >> 3);
+        uint32_t type = static_cast<uint32_t>(key & 7);
+
+        bool ok;
+        if (type == WIRE_FIXED32 && field >= DET_X && field <= DET_SCORE)
+        {
+            float *targets[] = {&det.x, &det.y, &det.width, &det.height, &det.score};
+            ok = reader.ReadFloat(*targets[field - DET_X]);
+        }
+        else if (type == WIRE_VARINT && field == DET_CLASS_ID)
+        {
+            ok = reader.ReadVarint(value);
+            det.classId = static_cast<int32_t>(value);
+        }
+        else if (type == WIRE_VARINT && field == DET_TRACK_ID)
+        {
+            ok = reader.ReadVarint(value);
+            det.trackId = static_cast<int32_t>(value);
+        }
+        else
+        {
+            ok = reader.Skip(type);
+        }
+
+        if (!ok)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Parse a frame
+///////////////////////////////////////////////////////////////////////
+bool ParseFrame(const uint8_t *data, size_t size, FrameMessage &frame)
+{
+    WireReader reader = {data, data + size};
+    uint64_t key, value;
+    const uint8_t *bytes;
+    size_t length;
+
+    // Reset to defaults, keeping buffer capacity
+    frame.sequence = 0;
+    frame.timestampUs = 0;
+    frame.width = 0;
+    frame.height = 0;
+    frame.encoding = FrameEncoding::RawRGB;
+    frame.payload.clear();
+    frame.detections.clear();
+    frame.streamId.clear();
+
+    while (reader.pos < reader.end)
+    {
+        if (!reader.ReadVarint(key))
+        {
+            return false;
+        }
+        uint32_t field = static_cast<uint32_t>(key >> 3);
+        uint32_t type = static_cast<uint32_t>(key & 7);
+
+        bool ok = true;
+        if (type == WIRE_VARINT && field >= FRAME_SEQUENCE && field <= FRAME_ENCODING)
+        {
+            ok = reader.ReadVarint(value);
+            switch (field)
+            {
+                case FRAME_SEQUENCE: frame.sequence = value; break;
+                case FRAME_TIMESTAMP: frame.timestampUs = value; break;
+                case FRAME_WIDTH: frame.width = static_cast<uint32_t>(value); break;
+                case FRAME_HEIGHT: frame.height = static_cast<uint32_t>(value); break;
+                case FRAME_ENCODING: frame.encoding = static_cast<FrameEncoding>(value); break;
+            }
+        }
+        else if (type == WIRE_LENGTH && field == FRAME_PAYLOAD)
+        {
+            ok = reader.ReadLength(bytes, length);
+            if (ok)
+            {
+                frame.payload.assign(bytes, bytes + length);
+            }
+        }
+        else if (type == WIRE_LENGTH && field == FRAME_DETECTIONS)
+        {
+            ok = reader.ReadLength(bytes, length);
+            if (ok)
+            {
+                frame.detections.emplace_back();
+                ok = parse_detection(bytes, length, frame.detections.back());
+            }
+        }
+        else if (type == WIRE_LENGTH && field == FRAME_STREAM_ID)
+        {
+            ok = reader.ReadLength(bytes, length);
+            if (ok)
+            {
+                frame.streamId.assign(reinterpret_cast<const char *>(bytes), length);
+            }
+        }
+        else
+        {
+            ok = reader.Skip(type);
+        }
+
+        if (!ok)
+        {
+            return false;
+        }
+    }
+    return true;
+}
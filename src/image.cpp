@@ -1,16 +1,15 @@
 // Includes
+#include <algorithm>   // for std::min, std::swap
 #include <cstdint>     // for uint8_t
+#include <memory>      // for std::atomic_load on the cache
 #include <string.h>      // for std::string and std::memcpy
-#include <iostream>     // for std::cout
 #include <stdio.h>
 #include <cstdio>
 #include <stdlib.h>
-#include <unordered_map>
-#include <cctype>
-
-#include <functional> // for std::function
+#include <strings.h>    // for strcasecmp
 
 #include "image.h" // for Image class
+#include "trace.h"
 
 #include <png.h>
 #include "jpeglib.h"
@@ -35,16 +34,27 @@
 // #include "stb_image_write.h"
 
 ///////////////////////////////////////////////////////////////////////
-// QUESTION:
-// The following two functions and structs are custom error handlers
-// for JPEG. Should they be in a separate file? Should they be member
-// Functions of the Image class? 
+// Codec error handling
+// NOTE:
+//      Every codec call owns its libjpeg/libpng state and jump buffer, so
+//      the codecs can run on many threads at once. Nothing is printed:
+//      the message of the last failure is kept per thread and can be read
+//      back with Image::LastError().
 ///////////////////////////////////////////////////////////////////////
+static thread_local char t_lastError[JMSG_LENGTH_MAX + 64] = "";
+
+static void set_last_error(const char *format, const char *detail = "")
+{
+    snprintf(t_lastError, sizeof(t_lastError), format, detail);
+}
 
+const char *Image::LastError()
+{
+    return t_lastError;
+}
 
 ///////////////////////////////////////////////////////////////////////
 // Custom error handler for JPEG
-// QUESTION Should this be in a separate file?
 ///////////////////////////////////////////////////////////////////////
 struct custom_error_mgr {
     jpeg_error_mgr pub;       // "Inherit" base JPEG error manager
@@ -52,13 +62,15 @@ struct custom_error_mgr {
 };
 
 // Function alias
-typedef struct custom_error_mgr* custom_error_ptr; // QUESTION: What and why?
+typedef struct custom_error_mgr* custom_error_ptr;
 
 void custom_error_exit(j_common_ptr cinfo) {
     custom_error_ptr myerr = (custom_error_ptr)cinfo->err;
 
-    // Optional: print the default message
-    (*cinfo->err->output_message)(cinfo);
+    // Keep the message instead of printing it
+    char buffer[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, buffer);
+    set_last_error("JPEG: %s", buffer);
 
     // Jump back to setjmp
     longjmp(myerr->setjmp_buffer, 1);
@@ -74,7 +86,7 @@ struct my_error_mgr
     jmp_buf setjmp_buffer; /* for return to caller */
 };
 
-typedef struct my_error_mgr *my_error_ptr; // QUESTION: What and why?
+typedef struct my_error_mgr *my_error_ptr;
 
 ///////////////////////////////////////////////////////////////////////
 // routine to replace the standard error_exit method - Reading
@@ -84,18 +96,36 @@ void my_error_exit(j_common_ptr cinfo)
     /* cinfo->err really points to a my_error_mgr struct, so coerce pointer */
     my_error_ptr myerr = (my_error_ptr)cinfo->err;
 
-    /* Always display the message. */
-    /* We could postpone this until after returning, if we chose. */
-    (*cinfo->err->output_message)(cinfo);
+    char buffer[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, buffer);
+    set_last_error("JPEG: %s", buffer);
 
     /* Return control to the setjmp point */
     longjmp(myerr->setjmp_buffer, 1);
 }
 
+///////////////////////////////////////////////////////////////////////
+// libjpeg reports recoverable warnings (e.g. corrupt data) through
+// output_message, which would print to stderr; they are dropped and
+// remain countable in err->num_warnings.
+///////////////////////////////////////////////////////////////////////
+static void silent_output_message(j_common_ptr) {}
+
+///////////////////////////////////////////////////////////////////////
+// libpng error and warning handlers, same policy as for JPEG
+///////////////////////////////////////////////////////////////////////
+static void png_error_handler(png_structp png, png_const_charp message)
+{
+    set_last_error("PNG: %s", message);
+    png_longjmp(png, 1);
+}
+
+static void png_warning_handler(png_structp, png_const_charp) {}
+
 ///////////////////////////////////////////////////////////////////////
 // Image class constructor
 ///////////////////////////////////////////////////////////////////////
-Image::Image() : m_width(0), m_height(0), m_data(nullptr) {}
+Image::Image() : m_width(0), m_height(0), m_buffSize(0), m_owned(true), m_data(nullptr) {}
 
 ///////////////////////////////////////////////////////////////////////
 // Image class constructor
@@ -105,6 +135,7 @@ Image::Image(int w, int h)
     m_width = w;
     m_height = h;
     m_buffSize = m_width * m_height * 3; // Calculate the resolution
+    m_owned = true;
 
     // Allocate memory for the pixel data Array
     // Initialize to 0
@@ -119,10 +150,140 @@ Image::Image(int w, int h)
 ///////////////////////////////////////////////////////////////////////
 Image::~Image() // Free memory
 {
-    if (m_data) {
+    if (m_data && m_owned) {
         delete[] m_data;
-        m_data = nullptr;
     }
+    m_data = nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Non-owning view of existing pixels
+///////////////////////////////////////////////////////////////////////
+Image Image::View(uint8_t *data, int w, int h)
+{
+    Image view;
+    if (data && w > 0 && h > 0)
+    {
+        view.m_width = w;
+        view.m_height = h;
+        view.m_buffSize = w * h * 3;
+        view.m_owned = false;
+        view.m_data = data;
+    }
+    return view;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Move constructor, takes over the other image's buffer
+///////////////////////////////////////////////////////////////////////
+Image::Image(Image &&other) noexcept
+    : m_width(other.m_width), m_height(other.m_height), m_buffSize(other.m_buffSize),
+      m_owned(other.m_owned), m_cache(std::move(other.m_cache)),
+      m_hasCache(other.m_hasCache.exchange(false)), m_data(other.m_data)
+{
+    other.m_width = 0;
+    other.m_height = 0;
+    other.m_buffSize = 0;
+    other.m_owned = true;
+    other.m_data = nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Move assignment
+///////////////////////////////////////////////////////////////////////
+Image &Image::operator=(Image &&other) noexcept
+{
+    if (this != &other)
+    {
+        if (m_owned)
+        {
+            delete[] m_data;
+        }
+
+        m_width = other.m_width;
+        m_height = other.m_height;
+        m_buffSize = other.m_buffSize;
+        m_owned = other.m_owned;
+        m_cache = std::move(other.m_cache);     // Still matches the pixels
+        m_hasCache = other.m_hasCache.exchange(false);
+        m_data = other.m_data;
+
+        other.m_width = 0;
+        other.m_height = 0;
+        other.m_buffSize = 0;
+        other.m_owned = true;
+        other.m_data = nullptr;
+    }
+    return *this;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Resize the pixel buffer
+// NOTE:
+//      The buffer is only reallocated when the size actually changes, so
+//      decoding frame after frame into the same Image reuses its memory.
+//      The contents are NOT preserved or cleared.
+//      Sizes come from untrusted headers (a JPEG may claim 65500x65500),
+//      so the byte count is worked out in 64 bits and anything over
+//      kMaxPixels is refused, keeping every row offset within an int.
+///////////////////////////////////////////////////////////////////////
+bool Image::Resize(int w, int h)
+{
+    if (w < 0 || h < 0 || static_cast<uint64_t>(w) * static_cast<uint64_t>(h) > kMaxPixels)
+    {
+        set_last_error("image too large");
+        return false;
+    }
+
+    int buffSize = static_cast<int>(static_cast<uint64_t>(w) * h * 3);
+    if (buffSize != m_buffSize || !m_data)
+    {
+        if (m_owned)
+        {
+            delete[] m_data;
+        }
+        m_data = (buffSize > 0) ? new uint8_t[buffSize] : nullptr;
+        m_owned = true;
+    }
+
+    m_width = w;
+    m_height = h;
+    m_buffSize = buffSize;
+    Touch();                // About to be written
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Derived data cache, created by image_proc.cpp
+// NOTE:
+//      Frames are shared as const Images between threads, so the cache
+//      pointer is swapped atomically rather than under a lock.
+///////////////////////////////////////////////////////////////////////
+void Image::Touch()
+{
+    // Only the writer calls this, nothing can attach a cache meanwhile;
+    // the flag keeps per-pixel writes (SetPixel) free of the shared_ptr op
+    if (m_hasCache.load(std::memory_order_relaxed))
+    {
+        std::atomic_store(&m_cache, std::shared_ptr<ImageCache>());
+        m_hasCache.store(false, std::memory_order_relaxed);
+    }
+}
+
+std::shared_ptr<ImageCache> Image::Cache() const
+{
+    return std::atomic_load(&m_cache);
+}
+
+std::shared_ptr<ImageCache> Image::AttachCache(std::shared_ptr<ImageCache> cache) const
+{
+    std::shared_ptr<ImageCache> expected;
+    if (std::atomic_compare_exchange_strong(&m_cache, &expected, cache))
+    {
+        m_hasCache.store(true, std::memory_order_relaxed);
+        return cache;
+    }
+    return expected;
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -227,6 +388,7 @@ void Image::SetPixelRed(uint8_t x, uint8_t y,uint8_t r)
     }
 
     m_data[3* m_width *y+ 3 * x + 0] = r; 
+    Touch();
 }
 ///////////////////////////////////////////////////////////////////////
 // SET the GREEN value of a pixel
@@ -239,6 +401,7 @@ void Image::SetPixelGreen(uint8_t x, uint8_t y, uint8_t g)
     }
 
     m_data[3* m_width *y+ 3 * x + 1] = g; 
+    Touch();
 }
 ///////////////////////////////////////////////////////////////////////
 // SET the BLUE value of a pixel
@@ -251,6 +414,7 @@ void Image::SetPixelBlue(uint8_t x, uint8_t y, uint8_t b)
     }
 
     m_data[3* m_width *y+ 3 * x + 2] = b; 
+    Touch();
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -258,11 +422,13 @@ void Image::SetPixelBlue(uint8_t x, uint8_t y, uint8_t b)
 ///////////////////////////////////////////////////////////////////////
 bool Image::SavePNG(std::string filePath) 
 {   
+    TRACE_SCOPE("SavePNG");
     // This section opens the file for writing in binary mode ("wb")
     // If the file can't be opened, it returns false
     FILE* fp = fopen(filePath.c_str(), "wb");   
     if (!fp)
     {
+        set_last_error("Can't open %s", filePath.c_str());
         return false; 
     }
 
@@ -278,7 +444,7 @@ bool Image::SavePNG(std::string filePath)
     // PNG_LIBPNG_VER_STRING is a string that contains the version number 
     //      of libpng
     png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING,
-        nullptr,nullptr,nullptr); 
+        nullptr, png_error_handler, png_warning_handler); 
     if (!png)
     {
         fclose(fp); // Close the file if png_create_write_struct fails
@@ -290,7 +456,7 @@ bool Image::SavePNG(std::string filePath)
     if (!info)
     {
         // Destroy the png struct if info creation fails
-        // png_destroy_write_struct(&png, nullptr); 
+        png_destroy_write_struct(&png, nullptr);
         fclose(fp); // Close the file if png_create_info_struct fails
         return false; // Return false if png_create_info_struct fails
     }
@@ -356,26 +522,25 @@ bool Image::SavePNG(std::string filePath)
         bit_depth, color_type, interlace_type,
         compression_type, filter_method);
 
-    // Create an array of pointers to each row of the image
-    png_bytep* row_pointers = NULL;
-    row_pointers = (png_bytep*)malloc(sizeof(png_bytep) * m_height);
-
-    // png_bytep* row_pointers = new png_bytep[height];
+    // Write the image data to the file, one row at a time straight from
+    // m_data. (A malloc'd row pointer array would leak if libpng jumped
+    // back to the setjmp above.)
+    png_write_info(png, info);
     for (int y = 0; y < m_height; y++)
     {
-        row_pointers[y] = m_data + y * m_width * 3; 
+        png_write_row(png, m_data + y * m_width * 3);
     }
+    png_write_end(png, info);
 
-    // Write the image data to the file
-    png_set_rows(png, info, row_pointers);
-    png_write_png(png, info, PNG_TRANSFORM_STRIP_ALPHA, nullptr);
-
-    free(row_pointers);
-
-    fclose(fp);
-    
     png_destroy_write_struct(&png, &info);
 
+    // fclose flushes, so its result tells whether the data reached the file
+    if (fclose(fp) != 0)
+    {
+        set_last_error("PNG: write to %s failed", filePath.c_str());
+        return false;
+    }
+
     return true; // Return true if successful
 
 }
@@ -385,25 +550,27 @@ bool Image::SavePNG(std::string filePath)
 ///////////////////////////////////////////////////////////////////////
 bool Image::OpenPNG(std::string filePath)
 {
+    TRACE_SCOPE("OpenPNG");
     // Open the file for reading in binary mode ("rb")
     FILE *fp = fopen(filePath.c_str(), "rb");
     if (!fp) 
     {
+        set_last_error("Can't open %s", filePath.c_str());
         return false; // Return false if file cannot be opened
     }
 
     // Check if the file is a PNG file by reading the first 8 bytes
     png_byte header[8];
-    fread(header, 1, 8, fp);
-    if(png_sig_cmp(header,0,8))
+    if (fread(header, 1, 8, fp) != 8 || png_sig_cmp(header, 0, 8))
     {
+        set_last_error("PNG: %s is not a PNG file", filePath.c_str());
         fclose(fp);
         return false; // Return false if file is not a PNG
     }
 
     // Create libpng structures
     png_struct* png = png_create_read_struct
-        (PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+        (PNG_LIBPNG_VER_STRING, nullptr, png_error_handler, png_warning_handler);
     // Return false if png_create_read_struct fails
     if (!png) 
     {
@@ -449,10 +616,12 @@ bool Image::OpenPNG(std::string filePath)
 
     // Read in the image data into the Image object
 
-    m_height = png_get_image_height(png, info);
-    m_width = png_get_image_width(png, info);
-    m_buffSize = m_width * m_height * 3; // Calculate the resolution
-    m_data = new uint8_t[m_buffSize];
+    if (!Resize(png_get_image_width(png, info), png_get_image_height(png, info)))
+    {
+        png_destroy_read_struct(&png, &info, &end);
+        fclose(fp);
+        return false;
+    }
 
     for (int i = 0; i < m_height; i++)
     {
@@ -467,49 +636,52 @@ bool Image::OpenPNG(std::string filePath)
 
 ///////////////////////////////////////////////////////////////////////
 // Save the image using turbo jpeg
+// NOTE:
+//      Everything the error path has to release (the compression object
+//      and the FILE*) is set up before setjmp() and never modified after
+//      it, so the values are still valid when libjpeg longjmps back.
 ///////////////////////////////////////////////////////////////////////
 bool Image::SaveJPEG(std::string filename, int quality)
 {
+    TRACE_SCOPE("SaveJPEG");
     // Create a jpeg compression object
     struct jpeg_compress_struct cinfo;
 
     struct custom_error_mgr jerr; // JPEG error handler.
-    FILE *outfile;  // Target File
 
-    // Pointer to array of pointers to image rows
-    JSAMPARRAY  row_pointers = new JSAMPROW[m_height]; // Pointer to a single row of pixels
-    for (int x = 0; x < m_height; x++)
+    if (m_width == 0 || m_height == 0 || !m_data)
     {
-        row_pointers[x] = m_data + x * m_width * 3; // Set row pointers to the image data
+        set_last_error("JPEG: empty image");
+        return false;
     }
 
-    int row_stride; // Physical row width in bytes
-    int row, col; // Dimensions of the image
+    // Step 1 Open the target file first, so the error path can close it
+    FILE *const outfile = fopen(filename.c_str(), "wb");
+    if (outfile == NULL)
+    {
+        set_last_error("Can't open %s", filename.c_str());
+        return false; // Exit if the file cannot be opened
+    }
 
-    // Step 1 Allocate and initialize JPEG compression object
+    // Step 2 Allocate and initialize JPEG compression object
 
-    // Step 1.1 Set up the error handler
+    // Step 2.1 Set up the error handler
     cinfo.err = jpeg_std_error(&jerr.pub);
     jerr.pub.error_exit = custom_error_exit;
+    jerr.pub.output_message = silent_output_message;
 
-    // Step 1.2 Initialize the JPEG compression object
+    // Step 2.2 Initialize the JPEG compression object
     jpeg_create_compress(&cinfo);
 
-    // Step 1.3 Set up the jump point
+    // Step 2.3 Set up the jump point
     if (setjmp(jerr.setjmp_buffer)) 
     {
         // We jumped here from a fatal JPEG error
         jpeg_destroy_compress(&cinfo);
+        fclose(outfile);
         return false;
     }
 
-    // Step 2 Specify data destination
-    if ((outfile = fopen(filename.c_str(), "wb")) == NULL)
-    {
-        jpeg_destroy_compress(&cinfo);
-        return false; // Exit if the file cannot be opened
-    }
-
     jpeg_stdio_dest(&cinfo, outfile); // send compressed data to a stdio stream
 
     // Step 3 Set parameters for compression
@@ -527,19 +699,24 @@ bool Image::SaveJPEG(std::string filename, int quality)
     // Step 4 Start compressor
     jpeg_start_compress(&cinfo, TRUE);  // TRUE ensures that we will write a complete interchange-JPEG file
     
-    // Step 6 Write scanlines
+    // Step 5 Write scanlines straight from m_data
     while (cinfo.next_scanline < cinfo.image_height)
     {
-        jpeg_write_scanlines(&cinfo, &row_pointers[cinfo.next_scanline], 1);
+        JSAMPROW row = m_data + cinfo.next_scanline * m_width * 3;
+        jpeg_write_scanlines(&cinfo, &row, 1);
     }
 
-    // Step 7 Finish Compression
+    // Step 6 Finish Compression
     jpeg_finish_compress(&cinfo);
-    fclose(outfile); // Close the output file
 
-    // Step 8 Release JPEG compression object
+    // Step 7 Release JPEG compression object
     jpeg_destroy_compress(&cinfo); // Release the JPEG compression object
-    delete[] row_pointers;
+
+    if (fclose(outfile) != 0) // Close the output file
+    {
+        set_last_error("JPEG: write to %s failed", filename.c_str());
+        return false;
+    }
 
     return true; // Return true if successful
 }
@@ -566,6 +743,7 @@ int Image::OpenJPEG(std::string infilename)
 ///////////////////////////////////////////////////////////////////////
 int Image::openJPEG(struct jpeg_decompress_struct *cinfo, std::string infilename)
 {
+    TRACE_SCOPE("OpenJPEG");
     struct my_error_mgr jerr;   // Create an instance of our custom error manager
     FILE *infile;               // source file
     JSAMPARRAY buffer = NULL;   // Output row buffer 
@@ -575,7 +753,7 @@ int Image::openJPEG(struct jpeg_decompress_struct *cinfo, std::string infilename
     // Open the input and output files so they can be closed if we long jump.
     if ((infile = fopen(infilename.c_str(), "rb")) == NULL)
     {
-        fprintf(stderr, "can't open %s\n", infilename.c_str());
+        set_last_error("Can't open %s", infilename.c_str());
         return 0;
     }
 
@@ -583,6 +761,7 @@ int Image::openJPEG(struct jpeg_decompress_struct *cinfo, std::string infilename
 
     cinfo->err = jpeg_std_error(&jerr.pub);
     jerr.pub.error_exit = my_error_exit; // then override error_exit.
+    jerr.pub.output_message = silent_output_message;
 
     // Set up the jump point for error handling
     if (setjmp(jerr.setjmp_buffer))
@@ -605,9 +784,6 @@ int Image::openJPEG(struct jpeg_decompress_struct *cinfo, std::string infilename
     // This is type-cast as void because we are only reading entire images
     (void)jpeg_read_header(cinfo, TRUE);
 
-    m_width = cinfo->image_width; // Set the image width
-    m_height = cinfo->image_height; // Set the image height
-    m_buffSize = m_width * m_height * 3; // Calculate the resolution
 
 
     // Step 4: set parameters for decompression 
@@ -625,7 +801,12 @@ int Image::openJPEG(struct jpeg_decompress_struct *cinfo, std::string infilename
     buffer = (*cinfo->mem->alloc_sarray)((j_common_ptr)cinfo, JPOOL_IMAGE, row_stride, 1);
 
     // Write to data member m_data adaptation
-    m_data = new uint8_t[m_buffSize];
+    if (!Resize(cinfo->output_width, cinfo->output_height))
+    {
+        jpeg_destroy_decompress(cinfo);
+        fclose(infile);
+        return 0;
+    }
 
 
     // Step 6: Line by line, read jpeg to ppm
@@ -651,79 +832,1153 @@ int Image::openJPEG(struct jpeg_decompress_struct *cinfo, std::string infilename
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Public Interface to Save the image, regardless of format.
-// Note: This is currently only able to save at default quality.
+// JPEG destination manager that writes into a std::vector
+// NOTE:
+//      jpeg_mem_dest() mallocs a fresh buffer for every image. Writing into
+//      a caller-owned vector instead lets a streaming caller reuse the same
+//      output buffer for every frame.
+///////////////////////////////////////////////////////////////////////
+struct vector_dest_mgr {
+    jpeg_destination_mgr pub;       // "Inherit" base destination manager
+    std::vector<uint8_t> *out;      // Target buffer
+};
+
+static const size_t kJPEGInitialOutput = 64 * 1024;
+
+static void vector_init_destination(j_compress_ptr cinfo)
+{
+    vector_dest_mgr *dest = (vector_dest_mgr *)cinfo->dest;
+
+    if (dest->out->size() < kJPEGInitialOutput)
+    {
+        dest->out->resize(kJPEGInitialOutput);
+    }
+    dest->pub.next_output_byte = dest->out->data();
+    dest->pub.free_in_buffer = dest->out->size();
+}
+
+static boolean vector_empty_output_buffer(j_compress_ptr cinfo)
+{
+    vector_dest_mgr *dest = (vector_dest_mgr *)cinfo->dest;
+
+    // libjpeg only calls this when the whole buffer is full
+    size_t used = dest->out->size();
+    dest->out->resize(used * 2);
+    dest->pub.next_output_byte = dest->out->data() + used;
+    dest->pub.free_in_buffer = dest->out->size() - used;
+    return TRUE;
+}
+
+static void vector_term_destination(j_compress_ptr cinfo)
+{
+    vector_dest_mgr *dest = (vector_dest_mgr *)cinfo->dest;
+
+    // Trim to the number of bytes actually written (keeps the capacity)
+    dest->out->resize(dest->out->size() - dest->pub.free_in_buffer);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Encode the image to JPEG in memory
 ///////////////////////////////////////////////////////////////////////
-bool Image::SaveFile(std::string infilename,int quality)
+bool Image::EncodeJPEG(std::vector<uint8_t> &out, int quality) const
 {
-    // Isolate the file extension from the filename
-    int iLoc = infilename.find_last_of('.');
-    if (iLoc == std::string::npos) return false; // No extension found
-    std::string szExtention = infilename.substr(iLoc);
-    int szExtentionLength = szExtention.length();
-    for (int i = 0; i < szExtentionLength; i++)
+    TRACE_SCOPE("EncodeJPEG");
+    if (m_width == 0 || m_height == 0 || !m_data)
     {
-        std::cout << "I'm here!" << std::endl;
-        szExtention[i] = std::tolower(szExtention[i]); // Convert to lowercase
+        return false;
+    }
+
+    struct jpeg_compress_struct cinfo;
+    struct custom_error_mgr jerr;
+    vector_dest_mgr dest;
+
+    // Step 1 Allocate and initialize JPEG compression object
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = custom_error_exit;
+    jerr.pub.output_message = silent_output_message;
+    jpeg_create_compress(&cinfo);
+
+    if (setjmp(jerr.setjmp_buffer))
+    {
+        // We jumped here from a fatal JPEG error
+        jpeg_destroy_compress(&cinfo);
+        out.clear();
+        return false;
     }
 
-    std::unordered_map<std::string, 
-        std::function<bool(const std::string filePath)>> saveFunctions;
-    saveFunctions[".png"] = [this](std::string filePath)
+    // Step 2 Specify data destination
+    dest.pub.init_destination = vector_init_destination;
+    dest.pub.empty_output_buffer = vector_empty_output_buffer;
+    dest.pub.term_destination = vector_term_destination;
+    dest.out = &out;
+    cinfo.dest = &dest.pub;
+
+    // Step 3 Set parameters for compression (same as SaveJPEG)
+    cinfo.image_width = m_width;
+    cinfo.image_height = m_height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    cinfo.data_precision = 8;
+
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    cinfo.comp_info[0].h_samp_factor = cinfo.comp_info[0].v_samp_factor = 1;
+
+    // Step 4 Start compressor
+    jpeg_start_compress(&cinfo, TRUE);
+
+    // Step 5 Write scanlines straight from m_data, no row pointer array needed
+    while (cinfo.next_scanline < cinfo.image_height)
     {
-        return this->SavePNG(filePath);
-    };
-    saveFunctions[".jpg"] = [this,quality](std::string filePath)
+        JSAMPROW row = m_data + cinfo.next_scanline * m_width * 3;
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+
+    // Step 6 Finish compression and release the compression object
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Public Encapsulation to Decode a JPEG from memory
+///////////////////////////////////////////////////////////////////////
+bool Image::DecodeJPEG(const uint8_t *data, size_t size)
+{
+    TRACE_SCOPE("DecodeJPEG");
+    struct jpeg_decompress_struct cinfo;
+
+    return decodeJPEG(&cinfo, data, size, 1);
+}
+
+bool Image::DecodeJPEG(const uint8_t *data, size_t size, int scale)
+{
+    TRACE_SCOPE("DecodeJPEG scaled");
+    struct jpeg_decompress_struct cinfo;
+
+    if (scale != 1 && scale != 2 && scale != 4 && scale != 8)
     {
-        return this->SaveJPEG(filePath,quality);
-    };
-    saveFunctions[".jpeg"] = [this,quality](std::string filePath)
+        return false;
+    }
+    return decodeJPEG(&cinfo, data, size, scale);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Read the size from a JPEG header
+///////////////////////////////////////////////////////////////////////
+static bool read_jpeg_size(struct jpeg_decompress_struct *cinfo,
+    const uint8_t *data, size_t size, int &width, int &height)
+{
+    struct my_error_mgr jerr;
+
+    cinfo->err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = my_error_exit;
+    jerr.pub.output_message = silent_output_message;
+
+    if (setjmp(jerr.setjmp_buffer))
     {
-        return this->SaveJPEG(filePath,quality);
-    };
+        jpeg_destroy_decompress(cinfo);
+        return false;
+    }
+
+    jpeg_create_decompress(cinfo);
+    jpeg_mem_src(cinfo, data, static_cast<unsigned long>(size));
+    (void)jpeg_read_header(cinfo, TRUE);
+    width = static_cast<int>(cinfo->image_width);
+    height = static_cast<int>(cinfo->image_height);
+    jpeg_destroy_decompress(cinfo);
+    return true;
+}
+
+bool Image::JPEGSize(const uint8_t *data, size_t size, int &width, int &height)
+{
+    struct jpeg_decompress_struct cinfo;
 
-    auto extensionFound = saveFunctions.find(szExtention);
+    if (!data || size == 0)
+    {
+        return false;
+    }
+    return read_jpeg_size(&cinfo, data, size, width, height);
+}
 
-    // Check if the extension is in the map
-    // Return false if it fails to save or if the extension is not supported
-    return (extensionFound != saveFunctions.end()) ? (saveFunctions[szExtention](infilename)) : false;
+int Image::JPEGScaleFor(int width, int height, int minWidth, int minHeight)
+{
+    for (int scale = 8; scale > 1; scale /= 2)
+    {
+        if ((width + scale - 1) / scale >= minWidth && (height + scale - 1) / scale >= minHeight)
+        {
+            return scale;
+        }
+    }
+    return 1;
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Public Interface to Open the image, regardless of format.
+// Lossless JPEG transforms on the DCT coefficients
+// NOTE:
+//      Mirroring an 8x8 block left to right turns basis function u into
+//      (-1)^u times itself, so a flip negates the odd columns (or rows) of
+//      coefficients and a transpose swaps rows and columns. Rotations are
+//      a transpose plus a flip; the quantization tables and sampling
+//      factors are transposed with them.
 ///////////////////////////////////////////////////////////////////////
-bool Image::OpenFile(std::string infilename)
+static bool transform_transposes(JPEGTransformType type)
+{
+    return type == JPEGTransformType::Rotate90 || type == JPEGTransformType::Rotate270;
+}
+
+// Source block (sx, sy) that lands on destination block (dx, dy), both
+// relative to the crop region, which is regionW x regionH blocks
+static void transform_source_block(JPEGTransformType type, int dx, int dy,
+    int regionW, int regionH, int &sx, int &sy)
+{
+    switch (type)
+    {
+        case JPEGTransformType::Rotate90:       sx = dy;                sy = regionH - 1 - dx;  break;
+        case JPEGTransformType::Rotate180:      sx = regionW - 1 - dx;  sy = regionH - 1 - dy;  break;
+        case JPEGTransformType::Rotate270:      sx = regionW - 1 - dy;  sy = dx;                break;
+        case JPEGTransformType::FlipHorizontal: sx = regionW - 1 - dx;  sy = dy;                break;
+        case JPEGTransformType::FlipVertical:   sx = dx;                sy = regionH - 1 - dy;  break;
+        default:                                sx = dx;                sy = dy;                break;
+    }
+}
+
+// One block's coefficients: a transpose and sign flips of odd frequencies
+template <bool Transpose, bool NegateOddRows, bool NegateOddCols>
+static void transform_block(const JCOEF *__restrict src, JCOEF *__restrict dst)
+{
+    for (int row = 0; row < DCTSIZE; row++)
+    {
+        for (int col = 0; col < DCTSIZE; col++)
+        {
+            const JCOEF value = Transpose ? src[col * DCTSIZE + row] : src[row * DCTSIZE + col];
+            const bool negate = (NegateOddRows && (row & 1)) != (NegateOddCols && (col & 1));
+            dst[row * DCTSIZE + col] = negate ? static_cast<JCOEF>(-value) : value;
+        }
+    }
+}
+
+typedef void (*transform_block_fn)(const JCOEF *, JCOEF *);
+
+static transform_block_fn transform_block_for(JPEGTransformType type)
 {
+    switch (type)
+    {
+        case JPEGTransformType::Rotate90:       return transform_block<true, false, true>;
+        case JPEGTransformType::Rotate180:      return transform_block<false, true, true>;
+        case JPEGTransformType::Rotate270:      return transform_block<true, true, false>;
+        case JPEGTransformType::FlipHorizontal: return transform_block<false, false, true>;
+        case JPEGTransformType::FlipVertical:   return transform_block<false, true, false>;
+        default:                                return transform_block<false, false, false>;
+    }
+}
 
-    // Isolate the file extension from the filename
-    int iLoc = infilename.find_last_of('.');
-    if (iLoc == std::string::npos) return false; // No extension found
-    std::string szExtention = infilename.substr(iLoc);
-    int szExtentionLength = szExtention.length();
-    for (int i = 0; i < szExtentionLength; i++)
+bool Image::TransformJPEG(const uint8_t *data, size_t size, std::vector<uint8_t> &out,
+    const JPEGTransform &transform, JPEGTransform *applied)
+{
+    TRACE_SCOPE("TransformJPEG");
+    if (!data || size == 0 || transform.cropX < 0 || transform.cropY < 0 ||
+        transform.cropWidth < 0 || transform.cropHeight < 0)
     {
-        szExtention[i] = std::tolower(szExtention[i]); // Convert to lowercase
+        set_last_error("JPEG: bad transform");
+        return false;
     }
 
+    struct jpeg_decompress_struct src;
+    struct jpeg_compress_struct dst;
+    struct my_error_mgr jerr;
+    vector_dest_mgr dest;
 
-    std::unordered_map<std::string, 
-        std::function<bool(const std::string filePath)>> openFunctions;
-    openFunctions[".png"] = [this](std::string filePath)
+    // One error manager for both objects, both released on any error
+    src.err = jpeg_std_error(&jerr.pub);
+    dst.err = &jerr.pub;
+    jerr.pub.error_exit = my_error_exit;
+    jerr.pub.output_message = silent_output_message;
+    jpeg_create_decompress(&src);
+    jpeg_create_compress(&dst);
+
+    if (setjmp(jerr.setjmp_buffer))
+    {
+        jpeg_destroy_compress(&dst);
+        jpeg_destroy_decompress(&src);
+        out.clear();
+        return false;
+    }
+
+    jpeg_mem_src(&src, data, static_cast<unsigned long>(size));
+    (void)jpeg_read_header(&src, TRUE);
+
+    // Crop region in pixels, starting on the MCU grid
+    const JPEGTransformType type = transform.type;
+    const bool transpose = transform_transposes(type);
+    const bool mirrorX = type == JPEGTransformType::FlipHorizontal ||
+        type == JPEGTransformType::Rotate180 || type == JPEGTransformType::Rotate270;
+    const bool mirrorY = type == JPEGTransformType::FlipVertical ||
+        type == JPEGTransformType::Rotate180 || type == JPEGTransformType::Rotate90;
+    const int mcuWidth = src.max_h_samp_factor * DCTSIZE;
+    const int mcuHeight = src.max_v_samp_factor * DCTSIZE;
+    const int imageWidth = static_cast<int>(src.image_width);
+    const int imageHeight = static_cast<int>(src.image_height);
+
+    const int x0 = transform.cropX / mcuWidth * mcuWidth;
+    const int y0 = transform.cropY / mcuHeight * mcuHeight;
+    int regionWidth = transform.cropWidth ? transform.cropX + transform.cropWidth : imageWidth;
+    int regionHeight = transform.cropHeight ? transform.cropY + transform.cropHeight : imageHeight;
+    regionWidth = std::min(regionWidth, imageWidth) - x0;
+    regionHeight = std::min(regionHeight, imageHeight) - y0;
+    if (mirrorX)
+    {
+        regionWidth = regionWidth / mcuWidth * mcuWidth;    // Partial MCUs can't move
+    }
+    if (mirrorY)
     {
-        return this->OpenPNG(filePath);
-    };
-    openFunctions[".jpg"] = [this](std::string filePath)
+        regionHeight = regionHeight / mcuHeight * mcuHeight;
+    }
+    if (transform.cropX >= imageWidth || transform.cropY >= imageHeight ||
+        regionWidth <= 0 || regionHeight <= 0)
+    {
+        set_last_error("JPEG: crop region is outside the image");
+        jpeg_destroy_compress(&dst);
+        jpeg_destroy_decompress(&src);
+        return false;
+    }
+    const int outWidth = transpose ? regionHeight : regionWidth;
+    const int outHeight = transpose ? regionWidth : regionHeight;
+    const int outMcuWidth = transpose ? mcuHeight : mcuWidth;
+    const int outMcuHeight = transpose ? mcuWidth : mcuHeight;
+
+    // A flip or half turn of a region at the origin rearranges blocks
+    // within the input arrays, swapping them pairwise, and writes those.
+    // Anything else needs output arrays, allocated with the input's.
+    // NOTE:
+    //      libjpeg(-turbo) keeps virtual arrays entirely in memory, so
+    //      row pointers stay valid between access_virt_barray() calls.
+    const bool inPlace = !transpose && x0 == 0 && y0 == 0;
+    jvirt_barray_ptr dstCoefs[MAX_COMPONENTS];
+    for (int c = 0; c < src.num_components && !inPlace; c++)
+    {
+        const jpeg_component_info &comp = src.comp_info[c];
+        const int hs = transpose ? comp.v_samp_factor : comp.h_samp_factor;
+        const int vs = transpose ? comp.h_samp_factor : comp.v_samp_factor;
+        dstCoefs[c] = (*src.mem->request_virt_barray)((j_common_ptr)&src, JPOOL_IMAGE, FALSE,
+            static_cast<JDIMENSION>((outWidth + outMcuWidth - 1) / outMcuWidth * hs),
+            static_cast<JDIMENSION>((outHeight + outMcuHeight - 1) / outMcuHeight * vs),
+            static_cast<JDIMENSION>(vs));
+    }
+    jvirt_barray_ptr *srcCoefs = jpeg_read_coefficients(&src);
+
+    // Move the blocks
+    const transform_block_fn move_block = transform_block_for(type);
+    for (int c = 0; c < src.num_components; c++)
     {
-        return this->OpenJPEG(filePath);
-    };
-    openFunctions[".jpeg"] = [this](std::string filePath)
+        const jpeg_component_info &comp = src.comp_info[c];
+        const int regionBlocksX = (regionWidth * comp.h_samp_factor + mcuWidth - 1) / mcuWidth;
+        const int regionBlocksY = (regionHeight * comp.v_samp_factor + mcuHeight - 1) / mcuHeight;
+
+        if (inPlace)
+        {
+            for (int dy = 0; dy < regionBlocksY; dy++)
+            {
+                JBLOCKROW row = (*src.mem->access_virt_barray)((j_common_ptr)&src, srcCoefs[c],
+                    static_cast<JDIMENSION>(dy), 1, TRUE)[0];
+                for (int dx = 0; dx < regionBlocksX; dx++)
+                {
+                    int sx, sy;
+                    transform_source_block(type, dx, dy, regionBlocksX, regionBlocksY, sx, sy);
+                    if (sy < dy || (sy == dy && sx < dx))
+                    {
+                        continue;       // Done as the other half of a pair
+                    }
+                    JBLOCKROW other = sy == dy ? row : (*src.mem->access_virt_barray)(
+                        (j_common_ptr)&src, srcCoefs[c], static_cast<JDIMENSION>(sy), 1, TRUE)[0];
+                    JBLOCK moved;
+                    move_block(other[sx], moved);
+                    move_block(row[dx], other[sx]);
+                    memcpy(row[dx], moved, sizeof(JBLOCK));
+                }
+            }
+            dstCoefs[c] = srcCoefs[c];
+            continue;
+        }
+
+        const int hs = transpose ? comp.v_samp_factor : comp.h_samp_factor;
+        const int vs = transpose ? comp.h_samp_factor : comp.v_samp_factor;
+        const int dstBlocksX = (outWidth + outMcuWidth - 1) / outMcuWidth * hs;
+        const int dstBlocksY = (outHeight + outMcuHeight - 1) / outMcuHeight * vs;
+        const int srcX0 = x0 / mcuWidth * comp.h_samp_factor;
+        const int srcY0 = y0 / mcuHeight * comp.v_samp_factor;
+
+        // Source arrays are whole MCUs too
+        const int srcBlocksX = static_cast<int>((comp.width_in_blocks + comp.h_samp_factor - 1) /
+            comp.h_samp_factor * comp.h_samp_factor);
+        const int srcBlocksY = static_cast<int>((comp.height_in_blocks + comp.v_samp_factor - 1) /
+            comp.v_samp_factor * comp.v_samp_factor);
+
+        for (int dy = 0; dy < dstBlocksY; dy++)
+        {
+            JBLOCKROW dstRow = (*src.mem->access_virt_barray)((j_common_ptr)&src, dstCoefs[c],
+                static_cast<JDIMENSION>(dy), 1, TRUE)[0];
+            JBLOCKROW srcRow = nullptr;
+            int srcRowY = -1;       // Whole row for flips, a block at a time when transposing
+            for (int dx = 0; dx < dstBlocksX; dx++)
+            {
+                int sx, sy;
+                transform_source_block(type, dx, dy, regionBlocksX, regionBlocksY, sx, sy);
+                sx += srcX0;
+                sy += srcY0;
+                if (sx < 0 || sy < 0 || sx >= srcBlocksX || sy >= srcBlocksY)
+                {
+                    memset(dstRow[dx], 0, sizeof(JBLOCK));      // MCU padding
+                    continue;
+                }
+                if (sy != srcRowY)
+                {
+                    srcRow = (*src.mem->access_virt_barray)((j_common_ptr)&src, srcCoefs[c],
+                        static_cast<JDIMENSION>(sy), 1, FALSE)[0];
+                    srcRowY = sy;
+                }
+                move_block(srcRow[sx], dstRow[dx]);
+            }
+        }
+    }
+
+    // Same tables and sampling, transposed along with the blocks
+    jpeg_copy_critical_parameters(&src, &dst);
+    dst.image_width = static_cast<JDIMENSION>(outWidth);
+    dst.image_height = static_cast<JDIMENSION>(outHeight);
+    if (transpose)
     {
-        return this->OpenJPEG(filePath);
-    };
+        for (int c = 0; c < dst.num_components; c++)
+        {
+            std::swap(dst.comp_info[c].h_samp_factor, dst.comp_info[c].v_samp_factor);
+        }
+        for (int t = 0; t < NUM_QUANT_TBLS; t++)
+        {
+            JQUANT_TBL *table = dst.quant_tbl_ptrs[t];
+            for (int row = 0; table && row < DCTSIZE; row++)
+            {
+                for (int col = row + 1; col < DCTSIZE; col++)
+                {
+                    std::swap(table->quantval[row * DCTSIZE + col], table->quantval[col * DCTSIZE + row]);
+                }
+            }
+        }
+    }
+
+    dest.pub.init_destination = vector_init_destination;
+    dest.pub.empty_output_buffer = vector_empty_output_buffer;
+    dest.pub.term_destination = vector_term_destination;
+    dest.out = &out;
+    dst.dest = &dest.pub;
 
-    auto extensionFound = openFunctions.find(szExtention);
+    jpeg_write_coefficients(&dst, dstCoefs);
+    jpeg_finish_compress(&dst);
+    jpeg_destroy_compress(&dst);
+    (void)jpeg_finish_decompress(&src);
+    jpeg_destroy_decompress(&src);
 
-    // Check if the extension is in the map
-    // Return false if it fails to save or if the extension is not supported
-    return (extensionFound != openFunctions.end()) ? (openFunctions[szExtention](infilename)) : false;
-}
\ No newline at end of file
+    if (applied)
+    {
+        applied->type = type;
+        applied->cropX = x0;
+        applied->cropY = y0;
+        applied->cropWidth = regionWidth;
+        applied->cropHeight = regionHeight;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Decode a JPEG from memory
+// NOTE:
+//      Same structure as openJPEG(), see the note there on why the libjpeg
+//      calls live in a separate function. The pixel buffer is reused when
+//      the decoded size matches the current size.
+///////////////////////////////////////////////////////////////////////
+bool Image::decodeJPEG(struct jpeg_decompress_struct *cinfo,
+    const uint8_t *data, size_t size, int scale)
+{
+    struct my_error_mgr jerr;
+    JSAMPROW row;
+
+    if (!data || size == 0)
+    {
+        return false;
+    }
+
+    // Step 1: allocate and initialize JPEG decompression object
+    cinfo->err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = my_error_exit;
+    jerr.pub.output_message = silent_output_message;
+
+    if (setjmp(jerr.setjmp_buffer))
+    {
+        jpeg_destroy_decompress(cinfo);
+        return false;
+    }
+
+    jpeg_create_decompress(cinfo);
+
+    // Step 2: specify data source
+    jpeg_mem_src(cinfo, data, static_cast<unsigned long>(size));
+
+    // Step 3: read parameters, always decode to 8 bit RGB
+    (void)jpeg_read_header(cinfo, TRUE);
+    cinfo->out_color_space = JCS_RGB;
+    cinfo->scale_num = 1;
+    cinfo->scale_denom = static_cast<unsigned int>(scale);
+
+    // Step 4: start decompressor
+    (void)jpeg_start_decompress(cinfo);
+
+    if (!Resize(cinfo->output_width, cinfo->output_height))
+    {
+        jpeg_destroy_decompress(cinfo);
+        return false;
+    }
+
+    // Step 5: decode straight into m_data
+    while (cinfo->output_scanline < cinfo->output_height)
+    {
+        row = m_data + cinfo->output_scanline * m_width * 3;
+        (void)jpeg_read_scanlines(cinfo, &row, 1);
+    }
+
+    // Step 6: finish and release
+    (void)jpeg_finish_decompress(cinfo);
+    jpeg_destroy_decompress(cinfo);
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// In-memory PNG I/O callbacks
+///////////////////////////////////////////////////////////////////////
+struct png_mem_reader {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+};
+
+static void png_vector_write(png_structp png, png_bytep data, png_size_t length)
+{
+    std::vector<uint8_t> *out = (std::vector<uint8_t> *)png_get_io_ptr(png);
+    out->insert(out->end(), data, data + length);
+}
+
+static void png_vector_flush(png_structp) {}
+
+static void png_mem_read(png_structp png, png_bytep data, png_size_t length)
+{
+    png_mem_reader *reader = (png_mem_reader *)png_get_io_ptr(png);
+    if (reader->size - reader->pos < length)
+    {
+        png_error(png, "Read past the end of the PNG buffer");
+    }
+    memcpy(data, reader->data + reader->pos, length);
+    reader->pos += length;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Encode the image to PNG in memory
+// NOTE:
+//      Rows are written straight from m_data with png_write_row, so
+//      unlike SavePNG no row pointer array is needed.
+///////////////////////////////////////////////////////////////////////
+bool Image::EncodePNG(std::vector<uint8_t> &out) const
+{
+    TRACE_SCOPE("EncodePNG");
+    if (m_width == 0 || m_height == 0 || !m_data)
+    {
+        return false;
+    }
+
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING,
+        nullptr, png_error_handler, png_warning_handler);
+    if (!png)
+    {
+        return false;
+    }
+    png_infop info = png_create_info_struct(png);
+    if (!info)
+    {
+        png_destroy_write_struct(&png, nullptr);
+        return false;
+    }
+
+    out.clear();    // Keeps the capacity
+
+    if (setjmp(png_jmpbuf(png)))
+    {
+        png_destroy_write_struct(&png, &info);
+        out.clear();
+        return false;
+    }
+
+    png_set_write_fn(png, &out, png_vector_write, png_vector_flush);
+    png_set_IHDR(png, info, m_width, m_height, 8, PNG_COLOR_TYPE_RGB,
+        PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+
+    for (int y = 0; y < m_height; y++)
+    {
+        png_write_row(png, m_data + y * m_width * 3);
+    }
+
+    png_write_end(png, info);
+    png_destroy_write_struct(&png, &info);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Decode a PNG from memory
+// NOTE:
+//      Any PNG is accepted; palette, grey, 16 bit and alpha images are
+//      converted to 8 bit RGB by libpng while reading.
+///////////////////////////////////////////////////////////////////////
+bool Image::DecodePNG(const uint8_t *data, size_t size)
+{
+    TRACE_SCOPE("DecodePNG");
+    if (!data || size < 8 || png_sig_cmp(data, 0, 8))
+    {
+        return false;
+    }
+
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING,
+        nullptr, png_error_handler, png_warning_handler);
+    if (!png)
+    {
+        return false;
+    }
+    png_infop info = png_create_info_struct(png);
+    if (!info)
+    {
+        png_destroy_read_struct(&png, nullptr, nullptr);
+        return false;
+    }
+
+    png_mem_reader reader = {data, size, 0};
+
+    if (setjmp(png_jmpbuf(png)))
+    {
+        png_destroy_read_struct(&png, &info, nullptr);
+        return false;
+    }
+
+    png_set_read_fn(png, &reader, png_mem_read);
+    png_read_info(png, info);
+
+    // Normalise everything to 8 bit RGB
+    png_set_strip_16(png);
+    png_set_strip_alpha(png);
+    png_set_palette_to_rgb(png);
+    png_set_expand_gray_1_2_4_to_8(png);
+    png_set_gray_to_rgb(png);
+    int passes = png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+
+    if (!Resize(png_get_image_width(png, info), png_get_image_height(png, info)))
+    {
+        png_destroy_read_struct(&png, &info, nullptr);
+        return false;
+    }
+
+    for (int pass = 0; pass < passes; pass++)
+    {
+        for (int y = 0; y < m_height; y++)
+        {
+            png_read_row(png, m_data + y * m_width * 3, nullptr);
+        }
+    }
+
+    png_read_end(png, nullptr);
+    png_destroy_read_struct(&png, &info, nullptr);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// QOI, the "Quite OK Image" format (https://qoiformat.org)
+// NOTE:
+//      Lossless like PNG, but a single pass over the pixels with a 64
+//      entry colour cache and small deltas instead of zlib, so it encodes
+//      and decodes an order of magnitude faster at a similar size on
+//      camera frames. Files are compatible with the reference qoi.h.
+///////////////////////////////////////////////////////////////////////
+static const uint8_t kQOIMagic[4] = {'q', 'o', 'i', 'f'};
+static const uint8_t kQOIEnd[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+static const size_t kQOIHeaderSize = 14;
+
+static const uint8_t kQOIOpIndex = 0x00;    // 00xxxxxx
+static const uint8_t kQOIOpDiff = 0x40;     // 01xxxxxx
+static const uint8_t kQOIOpLuma = 0x80;     // 10xxxxxx
+static const uint8_t kQOIOpRun = 0xc0;      // 11xxxxxx
+static const uint8_t kQOIOpRGB = 0xfe;
+static const uint8_t kQOIOpRGBA = 0xff;
+static const uint8_t kQOIMask = 0xc0;
+
+struct qoi_pixel {
+    uint8_t r, g, b, a;
+};
+
+static inline int qoi_hash(const qoi_pixel &px)
+{
+    return (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) & 63;
+}
+
+static inline bool qoi_equal(const qoi_pixel &a, const qoi_pixel &b)
+{
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+static inline void write_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+static inline uint32_t read_be32(const uint8_t *p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+///////////////////////////////////////////////////////////////////////
+// Encode the image to QOI in memory
+///////////////////////////////////////////////////////////////////////
+bool Image::EncodeQOI(std::vector<uint8_t> &out) const
+{
+    TRACE_SCOPE("EncodeQOI");
+    if (m_width <= 0 || m_height <= 0 || !m_data)
+    {
+        return false;
+    }
+
+    // Worst case is one 4 byte QOI_OP_RGB per pixel
+    const size_t pixels = static_cast<size_t>(m_width) * m_height;
+    const size_t maxSize = kQOIHeaderSize + pixels * 4 + sizeof(kQOIEnd);
+    if (out.size() < maxSize)
+    {
+        out.resize(maxSize);
+    }
+
+    uint8_t *p = out.data();
+    memcpy(p, kQOIMagic, 4);
+    write_be32(p + 4, m_width);
+    write_be32(p + 8, m_height);
+    p[12] = 3;      // RGB
+    p[13] = 0;      // sRGB with linear alpha
+    p += kQOIHeaderSize;
+
+    qoi_pixel index[64];
+    memset(index, 0, sizeof(index));
+    qoi_pixel prev = {0, 0, 0, 255};
+    int run = 0;
+
+    const uint8_t *src = m_data;
+    for (size_t i = 0; i < pixels; i++, src += 3)
+    {
+        qoi_pixel px = {src[0], src[1], src[2], 255};
+
+        if (qoi_equal(px, prev))
+        {
+            run++;
+            if (run == 62 || i == pixels - 1)
+            {
+                *p++ = kQOIOpRun | (run - 1);
+                run = 0;
+            }
+            continue;
+        }
+
+        if (run > 0)
+        {
+            *p++ = kQOIOpRun | (run - 1);
+            run = 0;
+        }
+
+        int hash = qoi_hash(px);
+        if (qoi_equal(index[hash], px))
+        {
+            *p++ = kQOIOpIndex | hash;
+        }
+        else
+        {
+            index[hash] = px;
+
+            int8_t vr = static_cast<int8_t>(px.r - prev.r);
+            int8_t vg = static_cast<int8_t>(px.g - prev.g);
+            int8_t vb = static_cast<int8_t>(px.b - prev.b);
+            int8_t vgr = static_cast<int8_t>(vr - vg);
+            int8_t vgb = static_cast<int8_t>(vb - vg);
+
+            if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+            {
+                *p++ = kQOIOpDiff | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2);
+            }
+            else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8)
+            {
+                *p++ = kQOIOpLuma | (vg + 32);
+                *p++ = static_cast<uint8_t>(((vgr + 8) << 4) | (vgb + 8));
+            }
+            else
+            {
+                *p++ = kQOIOpRGB;
+                *p++ = px.r;
+                *p++ = px.g;
+                *p++ = px.b;
+            }
+        }
+        prev = px;
+    }
+
+    memcpy(p, kQOIEnd, sizeof(kQOIEnd));
+    p += sizeof(kQOIEnd);
+
+    out.resize(p - out.data());     // Keeps the capacity
+    return true;
+}
+
+static bool qoi_truncated()
+{
+    set_last_error("QOI: truncated data");
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Decode a QOI image from memory (RGB or RGBA, alpha is dropped)
+///////////////////////////////////////////////////////////////////////
+bool Image::DecodeQOI(const uint8_t *data, size_t size)
+{
+    TRACE_SCOPE("DecodeQOI");
+    if (!data || size < kQOIHeaderSize + sizeof(kQOIEnd) ||
+        memcmp(data, kQOIMagic, 4) != 0)
+    {
+        set_last_error("QOI: not a QOI image");
+        return false;
+    }
+
+    uint32_t width = read_be32(data + 4);
+    uint32_t height = read_be32(data + 8);
+    uint8_t channels = data[12];
+    if (width == 0 || height == 0 || (channels != 3 && channels != 4) ||
+        static_cast<uint64_t>(width) * height > kMaxPixels)
+    {
+        set_last_error("QOI: bad header");
+        return false;
+    }
+
+    if (!Resize(width, height))
+    {
+        return false;
+    }
+
+    const uint8_t *p = data + kQOIHeaderSize;
+    const uint8_t *end = data + size - sizeof(kQOIEnd);
+
+    qoi_pixel index[64];
+    memset(index, 0, sizeof(index));
+    qoi_pixel px = {0, 0, 0, 255};
+    int run = 0;
+
+    const size_t pixels = static_cast<size_t>(width) * height;
+    uint8_t *dst = m_data;
+    for (size_t i = 0; i < pixels; i++, dst += 3)
+    {
+        if (run > 0)
+        {
+            run--;
+        }
+        else
+        {
+            if (p >= end)
+            {
+                return qoi_truncated();
+            }
+
+            uint8_t b1 = *p++;
+            if (b1 == kQOIOpRGB)
+            {
+                if (end - p < 3) return qoi_truncated();
+                px.r = p[0];
+                px.g = p[1];
+                px.b = p[2];
+                p += 3;
+            }
+            else if (b1 == kQOIOpRGBA)
+            {
+                if (end - p < 4) return qoi_truncated();
+                px.r = p[0];
+                px.g = p[1];
+                px.b = p[2];
+                px.a = p[3];
+                p += 4;
+            }
+            else if ((b1 & kQOIMask) == kQOIOpIndex)
+            {
+                px = index[b1];
+            }
+            else if ((b1 & kQOIMask) == kQOIOpDiff)
+            {
+                px.r += ((b1 >> 4) & 0x03) - 2;
+                px.g += ((b1 >> 2) & 0x03) - 2;
+                px.b += (b1 & 0x03) - 2;
+            }
+            else if ((b1 & kQOIMask) == kQOIOpLuma)
+            {
+                if (end - p < 1) return qoi_truncated();
+                uint8_t b2 = *p++;
+                int vg = (b1 & 0x3f) - 32;
+                px.r += vg - 8 + ((b2 >> 4) & 0x0f);
+                px.g += vg;
+                px.b += vg - 8 + (b2 & 0x0f);
+            }
+            else
+            {
+                run = b1 & 0x3f;
+            }
+
+            index[qoi_hash(px)] = px;
+        }
+
+        dst[0] = px.r;
+        dst[1] = px.g;
+        dst[2] = px.b;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Whole-file helpers for the codecs that work on memory buffers
+///////////////////////////////////////////////////////////////////////
+static bool write_file(const std::string &filePath, const std::vector<uint8_t> &bytes)
+{
+    FILE *fp = fopen(filePath.c_str(), "wb");
+    if (!fp)
+    {
+        set_last_error("Can't open %s", filePath.c_str());
+        return false;
+    }
+    bool ok = fwrite(bytes.data(), 1, bytes.size(), fp) == bytes.size();
+    return (fclose(fp) == 0) && ok;
+}
+
+static bool read_file(const std::string &filePath, std::vector<uint8_t> &bytes)
+{
+    FILE *fp = fopen(filePath.c_str(), "rb");
+    if (!fp)
+    {
+        set_last_error("Can't open %s", filePath.c_str());
+        return false;
+    }
+    bool ok = fseek(fp, 0, SEEK_END) == 0;
+    long size = ok ? ftell(fp) : -1;
+    ok = size >= 0 && fseek(fp, 0, SEEK_SET) == 0;
+    if (ok)
+    {
+        bytes.resize(static_cast<size_t>(size));
+        ok = fread(bytes.data(), 1, bytes.size(), fp) == bytes.size();
+    }
+    fclose(fp);
+    return ok;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Save / Open a QOI file
+///////////////////////////////////////////////////////////////////////
+bool Image::SaveQOI(const std::string &filePath) const
+{
+    std::vector<uint8_t> bytes;
+    return EncodeQOI(bytes) && write_file(filePath, bytes);
+}
+
+bool Image::OpenQOI(const std::string &filePath)
+{
+    std::vector<uint8_t> bytes;
+    return read_file(filePath, bytes) && DecodeQOI(bytes.data(), bytes.size());
+}
+
+///////////////////////////////////////////////////////////////////////
+// Codec registry
+// NOTE:
+//      A constant table built at compile time, so dispatching through it
+//      costs a handful of comparisons and never allocates. To add a
+//      format, add an ImageFormat value and one row here.
+///////////////////////////////////////////////////////////////////////
+struct codec_entry {
+    ImageFormat format;
+    const char *name;
+    const char *extensions[3];                  // Without the dot, nullptr terminated
+    const uint8_t *magic;                       // Leading bytes of every file
+    size_t magicSize;
+    bool (*encode)(const Image &, std::vector<uint8_t> &, int quality);
+    bool (*decode)(Image &, const uint8_t *, size_t);
+    bool (*save)(Image &, const std::string &, int quality);
+    bool (*open)(Image &, const std::string &);
+};
+
+static const uint8_t kPNGMagic[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+static const uint8_t kJPEGMagic[3] = {0xff, 0xd8, 0xff};
+
+static const codec_entry kCodecs[] = {
+    {
+        ImageFormat::PNG, "PNG", {"png", nullptr, nullptr}, kPNGMagic, sizeof(kPNGMagic),
+        [](const Image &img, std::vector<uint8_t> &out, int) { return img.EncodePNG(out); },
+        [](Image &img, const uint8_t *data, size_t size) { return img.DecodePNG(data, size); },
+        [](Image &img, const std::string &path, int) { return img.SavePNG(path); },
+        [](Image &img, const std::string &path) { return img.OpenPNG(path); },
+    },
+    {
+        ImageFormat::JPEG, "JPEG", {"jpg", "jpeg", nullptr}, kJPEGMagic, sizeof(kJPEGMagic),
+        [](const Image &img, std::vector<uint8_t> &out, int q) { return img.EncodeJPEG(out, q); },
+        [](Image &img, const uint8_t *data, size_t size) { return img.DecodeJPEG(data, size); },
+        [](Image &img, const std::string &path, int q) { return img.SaveJPEG(path, q); },
+        [](Image &img, const std::string &path) { return img.OpenJPEG(path) != 0; },
+    },
+    {
+        ImageFormat::QOI, "QOI", {"qoi", nullptr, nullptr}, kQOIMagic, sizeof(kQOIMagic),
+        [](const Image &img, std::vector<uint8_t> &out, int) { return img.EncodeQOI(out); },
+        [](Image &img, const uint8_t *data, size_t size) { return img.DecodeQOI(data, size); },
+        [](Image &img, const std::string &path, int) { return img.SaveQOI(path); },
+        [](Image &img, const std::string &path) { return img.OpenQOI(path); },
+    },
+};
+
+static const size_t kMagicProbeSize = 8;    // Longest magic in the table
+
+static const codec_entry *find_codec(ImageFormat format)
+{
+    for (const codec_entry &codec : kCodecs)
+    {
+        if (codec.format == format)
+        {
+            return &codec;
+        }
+    }
+    return nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Detect the format of an encoded image from its magic bytes
+///////////////////////////////////////////////////////////////////////
+ImageFormat Image::DetectFormat(const uint8_t *data, size_t size)
+{
+    if (!data)
+    {
+        return ImageFormat::Unknown;
+    }
+    for (const codec_entry &codec : kCodecs)
+    {
+        if (size >= codec.magicSize && memcmp(data, codec.magic, codec.magicSize) == 0)
+        {
+            return codec.format;
+        }
+    }
+    return ImageFormat::Unknown;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Format from the file extension, case-insensitive, no allocation
+///////////////////////////////////////////////////////////////////////
+ImageFormat Image::FormatFromPath(const std::string &filePath)
+{
+    size_t dot = filePath.find_last_of('.');
+    size_t slash = filePath.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        return ImageFormat::Unknown;    // No extension found
+    }
+
+    const char *extension = filePath.c_str() + dot + 1;
+    for (const codec_entry &codec : kCodecs)
+    {
+        for (const char *candidate : codec.extensions)
+        {
+            if (candidate && strcasecmp(extension, candidate) == 0)
+            {
+                return codec.format;
+            }
+        }
+    }
+    return ImageFormat::Unknown;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Human readable format name
+///////////////////////////////////////////////////////////////////////
+const char *Image::FormatName(ImageFormat format)
+{
+    const codec_entry *codec = find_codec(format);
+    return codec ? codec->name : "unknown";
+}
+
+///////////////////////////////////////////////////////////////////////
+// Encode to any registered format in memory
+// NOTE:
+//      quality only applies to lossy formats (JPEG).
+///////////////////////////////////////////////////////////////////////
+bool Image::Encode(std::vector<uint8_t> &out, ImageFormat format, int quality) const
+{
+    const codec_entry *codec = find_codec(format);
+    return codec ? codec->encode(*this, out, quality) : false;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Decode any registered format from memory
+///////////////////////////////////////////////////////////////////////
+bool Image::Decode(const uint8_t *data, size_t size)
+{
+    const codec_entry *codec = find_codec(DetectFormat(data, size));
+    if (!codec)
+    {
+        set_last_error("Unknown image format");
+        return false;
+    }
+    return codec->decode(*this, data, size);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Public Interface to Save the image, regardless of format.
+// The format comes from the file extension.
+///////////////////////////////////////////////////////////////////////
+bool Image::SaveFile(const std::string &filePath, int quality)
+{
+    const codec_entry *codec = find_codec(FormatFromPath(filePath));
+    if (!codec)
+    {
+        set_last_error("Unsupported extension: %s", filePath.c_str());
+        return false;
+    }
+
+    // Return false if it fails to save
+    return codec->save(*this, filePath, quality);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Public Interface to Open the image, regardless of format.
+// The format comes from the first bytes of the file, not its name.
+///////////////////////////////////////////////////////////////////////
+bool Image::OpenFile(const std::string &filePath)
+{
+    uint8_t magic[kMagicProbeSize];
+
+    FILE *fp = fopen(filePath.c_str(), "rb");
+    if (!fp)
+    {
+        set_last_error("Can't open %s", filePath.c_str());
+        return false;
+    }
+    size_t got = fread(magic, 1, sizeof(magic), fp);
+    fclose(fp);
+
+    const codec_entry *codec = find_codec(DetectFormat(magic, got));
+    if (!codec)
+    {
+        set_last_error("Unknown image format: %s", filePath.c_str());
+        return false;
+    }
+
+    // Return false if it fails to open
+    return codec->open(*this, filePath);
+}
@@ -0,0 +1,79 @@
+// Includes
+#include "image_pool.h"
+
+///////////////////////////////////////////////////////////////////////
+// ImagePool constructor
+///////////////////////////////////////////////////////////////////////
+ImagePool::ImagePool(size_t maxIdle) : m_state(std::make_shared<State>())
+{
+    m_state->maxIdle = maxIdle;
+    m_state->created = 0;
+    m_state->closed = false;
+}
+
+///////////////////////////////////////////////////////////////////////
+// ImagePool destructor, frees idle images. Images still in use are
+// freed when their last reference goes away.
+///////////////////////////////////////////////////////////////////////
+ImagePool::~ImagePool()
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    for (Image *image : m_state->idle)
+    {
+        delete image;
+    }
+    m_state->idle.clear();
+    m_state->closed = true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Take an image from the pool, allocating one if the pool is empty
+///////////////////////////////////////////////////////////////////////
+std::shared_ptr<Image> ImagePool::Acquire()
+{
+    Image *image = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        if (!m_state->idle.empty())
+        {
+            image = m_state->idle.back();
+            m_state->idle.pop_back();
+        }
+        else
+        {
+            m_state->created++;
+        }
+    }
+    if (!image)
+    {
+        image = new Image();
+    }
+
+    // The deleter keeps the pool state alive until the image comes back
+    std::shared_ptr<State> state = m_state;
+    return std::shared_ptr<Image>(image, [state](Image *released)
+    {
+        released->Touch();      // Its pyramid levels go back to their own pool
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (!state->closed && state->idle.size() < state->maxIdle)
+            {
+                state->idle.push_back(released);
+                return;
+            }
+        }
+        delete released;
+    });
+}
+
+size_t ImagePool::Idle()
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    return m_state->idle.size();
+}
+
+size_t ImagePool::Created()
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    return m_state->created;
+}
@@ -0,0 +1,692 @@
+// Includes
+#include <algorithm>   // for std::min, std::max
+#include <atomic>      // for the levels built counter
+#include <cmath>       // for std::lround
+#include <cstdio>      // for snprintf
+
+#include "image_pool.h"
+#include "image_proc.h"
+#include "trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////
+// 5x7 font, one byte per row, bit 4 is the leftmost column
+///////////////////////////////////////////////////////////////////////
+static const int kGlyphWidth = 5;
+static const int kGlyphHeight = 7;
+
+static const uint8_t kDigits[10][kGlyphHeight] = {
+    {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E},     // 0
+    {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E},     // 1
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F},     // 2
+    {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E},     // 3
+    {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02},     // 4
+    {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E},     // 5
+    {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E},     // 6
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08},     // 7
+    {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E},     // 8
+    {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C},     // 9
+};
+
+static const uint8_t kLetters[26][kGlyphHeight] = {
+    {0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11},     // A
+    {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E},     // B
+    {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E},     // C
+    {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C},     // D
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F},     // E
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10},     // F
+    {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F},     // G
+    {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11},     // H
+    {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E},     // I
+    {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C},     // J
+    {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11},     // K
+    {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F},     // L
+    {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11},     // M
+    {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11},     // N
+    {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E},     // O
+    {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10},     // P
+    {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D},     // Q
+    {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11},     // R
+    {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E},     // S
+    {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04},     // T
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E},     // U
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04},     // V
+    {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A},     // W
+    {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11},     // X
+    {0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04},     // Y
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F},     // Z
+};
+
+static const uint8_t kSpace[kGlyphHeight] = {0, 0, 0, 0, 0, 0, 0};
+static const uint8_t kDot[kGlyphHeight] = {0, 0, 0, 0, 0, 0x0C, 0x0C};
+static const uint8_t kColon[kGlyphHeight] = {0, 0x0C, 0x0C, 0, 0x0C, 0x0C, 0};
+static const uint8_t kDash[kGlyphHeight] = {0, 0, 0, 0x1F, 0, 0, 0};
+static const uint8_t kPercent[kGlyphHeight] = {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03};
+static const uint8_t kHash[kGlyphHeight] = {0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A};
+static const uint8_t kSlash[kGlyphHeight] = {0, 0x01, 0x02, 0x04, 0x08, 0x10, 0};
+static const uint8_t kUnderscore[kGlyphHeight] = {0, 0, 0, 0, 0, 0, 0x1F};
+static const uint8_t kUnknown[kGlyphHeight] = {0x1F, 0x11, 0x11, 0x11, 0x11, 0x11, 0x1F};
+
+static const uint8_t *glyph(char c)
+{
+    if (c >= '0' && c <= '9') return kDigits[c - '0'];
+    if (c >= 'A' && c <= 'Z') return kLetters[c - 'A'];
+    if (c >= 'a' && c <= 'z') return kLetters[c - 'a'];
+    switch (c)
+    {
+        case ' ': return kSpace;
+        case '.': return kDot;
+        case ':': return kColon;
+        case '-': return kDash;
+        case '%': return kPercent;
+        case '#': return kHash;
+        case '/': return kSlash;
+        case '_': return kUnderscore;
+        default:  return kUnknown;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Colour per class id
+///////////////////////////////////////////////////////////////////////
+Color ClassColor(int32_t classId)
+{
+    static const Color kPalette[] = {
+        {255, 56, 56}, {255, 157, 151}, {255, 112, 31}, {255, 178, 29}, {207, 210, 49},
+        {72, 249, 10}, {146, 204, 23}, {61, 219, 134}, {26, 147, 52}, {0, 212, 187},
+        {44, 153, 168}, {0, 194, 255}, {52, 69, 147}, {100, 115, 255}, {0, 24, 236},
+        {132, 56, 255}, {82, 0, 133}, {203, 56, 255}, {255, 149, 200}, {255, 55, 199},
+    };
+    static const int kPaletteSize = sizeof(kPalette) / sizeof(kPalette[0]);
+
+    if (classId < 0)
+    {
+        return Color{160, 160, 160};
+    }
+    return kPalette[classId % kPaletteSize];
+}
+
+///////////////////////////////////////////////////////////////////////
+// Filled rectangle, clipped to the image
+///////////////////////////////////////////////////////////////////////
+void FillRect(Image &image, int x0, int y0, int x1, int y1, Color color)
+{
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, image.GetWidth());
+    y1 = std::min(y1, image.GetHeight());
+    if (x0 >= x1 || y0 >= y1 || image.m_data == nullptr)
+    {
+        return;
+    }
+
+    const size_t stride = static_cast<size_t>(image.GetWidth()) * 3;
+    for (int y = y0; y < y1; y++)
+    {
+        uint8_t *p = image.m_data + y * stride + static_cast<size_t>(x0) * 3;
+        for (int x = x0; x < x1; x++, p += 3)
+        {
+            p[0] = color.r;
+            p[1] = color.g;
+            p[2] = color.b;
+        }
+    }
+    image.Touch();
+}
+
+///////////////////////////////////////////////////////////////////////
+// Rectangle outline, thickness grows inwards from [x0, x1) x [y0, y1)
+///////////////////////////////////////////////////////////////////////
+void DrawRect(Image &image, int x0, int y0, int x1, int y1, Color color, int thickness)
+{
+    if (x0 >= x1 || y0 >= y1 || thickness <= 0)
+    {
+        return;
+    }
+    int tx = std::min(thickness, x1 - x0);
+    int ty = std::min(thickness, y1 - y0);
+
+    FillRect(image, x0, y0, x1, y0 + ty, color);            // Top
+    FillRect(image, x0, y1 - ty, x1, y1, color);            // Bottom
+    FillRect(image, x0, y0 + ty, x0 + tx, y1 - ty, color);  // Left
+    FillRect(image, x1 - tx, y0 + ty, x1, y1 - ty, color);  // Right
+}
+
+///////////////////////////////////////////////////////////////////////
+// Text with the built-in font, one pixel gap between characters
+///////////////////////////////////////////////////////////////////////
+int DrawText(Image &image, int x, int y, const std::string &text, Color color, int scale)
+{
+    scale = std::max(scale, 1);
+    const int advance = (kGlyphWidth + 1) * scale;
+
+    int penX = x;
+    for (char c : text)
+    {
+        const uint8_t *rows = glyph(c);
+        for (int row = 0; row < kGlyphHeight; row++)
+        {
+            uint8_t bits = rows[row];
+            for (int col = 0; col < kGlyphWidth; col++)
+            {
+                if (bits & (0x10 >> col))
+                {
+                    int px = penX + col * scale;
+                    int py = y + row * scale;
+                    FillRect(image, px, py, px + scale, py + scale, color);
+                }
+            }
+        }
+        penX += advance;
+    }
+    return penX - x;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Boxes with a "label score" tag above them (inside when at the top)
+///////////////////////////////////////////////////////////////////////
+void DrawDetections(Image &image, const std::vector<Detection> &detections,
+    const std::vector<std::string> *labels, int thickness)
+{
+    const int scale = image.GetHeight() >= 720 ? 2 : 1;
+    const int tagHeight = kGlyphHeight * scale + 2 * scale;
+    const Color text = {255, 255, 255};
+    char tag[96];
+
+    for (const Detection &det : detections)
+    {
+        int x0 = static_cast<int>(std::lround(det.x));
+        int y0 = static_cast<int>(std::lround(det.y));
+        int x1 = static_cast<int>(std::lround(det.x + det.width));
+        int y1 = static_cast<int>(std::lround(det.y + det.height));
+        Color color = ClassColor(det.classId);
+
+        DrawRect(image, x0, y0, x1, y1, color, thickness);
+
+        int percent = static_cast<int>(std::lround(det.score * 100.0f));
+        bool named = labels != nullptr && det.classId >= 0 &&
+            static_cast<size_t>(det.classId) < labels->size();
+        if (named)
+        {
+            snprintf(tag, sizeof(tag), "%s %d%%", (*labels)[det.classId].c_str(), percent);
+        }
+        else
+        {
+            snprintf(tag, sizeof(tag), "#%d %d%%", det.classId, percent);
+        }
+        if (det.trackId >= 0)
+        {
+            size_t len = std::char_traits<char>::length(tag);
+            snprintf(tag + len, sizeof(tag) - len, " ID%d", det.trackId);
+        }
+
+        int tagWidth = static_cast<int>(std::char_traits<char>::length(tag)) *
+            (kGlyphWidth + 1) * scale + scale;
+        int tagY = y0 - tagHeight >= 0 ? y0 - tagHeight : y0;
+        FillRect(image, x0, tagY, x0 + tagWidth, tagY + tagHeight, color);
+        DrawText(image, x0 + scale, tagY + scale, tag, text, scale);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Area filter: each output pixel is the mean of the source pixels it
+// covers (integer box bounds, so no weights are needed)
+///////////////////////////////////////////////////////////////////////
+static void resize_area(const Image &src, Image &dst)
+{
+    const int sw = src.GetWidth(), sh = src.GetHeight();
+    const int dw = dst.GetWidth(), dh = dst.GetHeight();
+    const size_t srcStride = static_cast<size_t>(sw) * 3;
+
+    std::vector<uint32_t> sums(static_cast<size_t>(dw) * 3);
+    std::vector<int> xBegin(dw + 1);
+    for (int x = 0; x <= dw; x++)
+    {
+        xBegin[x] = static_cast<int>(static_cast<int64_t>(x) * sw / dw);
+    }
+
+    for (int y = 0; y < dh; y++)
+    {
+        int y0 = static_cast<int>(static_cast<int64_t>(y) * sh / dh);
+        int y1 = std::max(static_cast<int>(static_cast<int64_t>(y + 1) * sh / dh), y0 + 1);
+
+        std::fill(sums.begin(), sums.end(), 0u);
+        for (int sy = y0; sy < y1; sy++)
+        {
+            const uint8_t *row = src.m_data + sy * srcStride;
+            for (int x = 0; x < dw; x++)
+            {
+                int x1 = std::max(xBegin[x + 1], xBegin[x] + 1);
+                uint32_t r = 0, g = 0, b = 0;
+                for (const uint8_t *p = row + xBegin[x] * 3; p < row + x1 * 3; p += 3)
+                {
+                    r += p[0];
+                    g += p[1];
+                    b += p[2];
+                }
+                sums[x * 3 + 0] += r;
+                sums[x * 3 + 1] += g;
+                sums[x * 3 + 2] += b;
+            }
+        }
+
+        uint8_t *out = dst.m_data + static_cast<size_t>(y) * dw * 3;
+        for (int x = 0; x < dw; x++)
+        {
+            uint32_t count = static_cast<uint32_t>(
+                (std::max(xBegin[x + 1], xBegin[x] + 1) - xBegin[x]) * (y1 - y0));
+            for (int c = 0; c < 3; c++)
+            {
+                out[x * 3 + c] = static_cast<uint8_t>((sums[x * 3 + c] + count / 2) / count);
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Bilinear filter, 8 bit fixed point weights
+///////////////////////////////////////////////////////////////////////
+static void resize_bilinear(const Image &src, Image &dst)
+{
+    const int sw = src.GetWidth(), sh = src.GetHeight();
+    const int dw = dst.GetWidth(), dh = dst.GetHeight();
+    const size_t srcStride = static_cast<size_t>(sw) * 3;
+
+    // Source column offsets and weights, shared by every row
+    std::vector<int> x0s(dw), x1s(dw), wxs(dw);
+    for (int x = 0; x < dw; x++)
+    {
+        float fx = std::max((x + 0.5f) * sw / dw - 0.5f, 0.0f);
+        int x0 = std::min(static_cast<int>(fx), sw - 1);
+        x0s[x] = x0 * 3;
+        x1s[x] = std::min(x0 + 1, sw - 1) * 3;
+        wxs[x] = static_cast<int>((fx - x0) * 256.0f);
+    }
+
+    for (int y = 0; y < dh; y++)
+    {
+        float fy = std::max((y + 0.5f) * sh / dh - 0.5f, 0.0f);
+        int y0 = std::min(static_cast<int>(fy), sh - 1);
+        int wy = static_cast<int>((fy - y0) * 256.0f);
+        const uint8_t *top = src.m_data + y0 * srcStride;
+        const uint8_t *bottom = src.m_data + std::min(y0 + 1, sh - 1) * srcStride;
+
+        uint8_t *out = dst.m_data + static_cast<size_t>(y) * dw * 3;
+        for (int x = 0; x < dw; x++)
+        {
+            const int wx = wxs[x];
+            for (int c = 0; c < 3; c++)
+            {
+                int t = top[x0s[x] + c] * (256 - wx) + top[x1s[x] + c] * wx;
+                int b = bottom[x0s[x] + c] * (256 - wx) + bottom[x1s[x] + c] * wx;
+                out[x * 3 + c] = static_cast<uint8_t>((t * (256 - wy) + b * wy + 32768) >> 16);
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Resize, picking the filter by direction
+///////////////////////////////////////////////////////////////////////
+bool ResizeImage(const Image &src, Image &dst, int width, int height)
+{
+    if (&src == &dst || width <= 0 || height <= 0 ||
+        src.GetWidth() <= 0 || src.GetHeight() <= 0 || !src.m_data)
+    {
+        return false;
+    }
+    if (!dst.Resize(width, height))
+    {
+        return false;
+    }
+
+    if (width <= src.GetWidth() && height <= src.GetHeight())
+    {
+        resize_area(src, dst);
+    }
+    else
+    {
+        resize_bilinear(src, dst);
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Pyramid levels: 2x2 box halving
+///////////////////////////////////////////////////////////////////////
+typedef void (*halve_row_fn)(const uint8_t *top, const uint8_t *bottom, int width, uint8_t *out);
+
+// width output pixels, each the rounded mean of a 2x2 block
+static void halve_row_scalar(const uint8_t *top, const uint8_t *bottom, int width, uint8_t *out)
+{
+    for (int x = 0; x < width; x++, top += 6, bottom += 6, out += 3)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            out[c] = static_cast<uint8_t>((top[c] + top[c + 3] + bottom[c] + bottom[c + 3] + 2) >> 2);
+        }
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+///////////////////////////////////////////////////////////////////////
+// AVX2, 8 output pixels at a time
+// NOTE:
+//      Each 128 bit lane loads the 4 source pixels of 2 output pixels,
+//      a shuffle puts the horizontal neighbours of every channel side by
+//      side and maddubs adds them, so the sums are words right away.
+///////////////////////////////////////////////////////////////////////
+__attribute__((target("avx2")))
+static inline __m256i load_lanes(const uint8_t *p, int low, int high)
+{
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + low))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + high)), 1);
+}
+
+// Rounded 2x2 means as words: output pixels 0 1 in the low lane, the two
+// starting high bytes on in the high lane
+__attribute__((target("avx2")))
+static inline __m256i halve_sums(const uint8_t *top, const uint8_t *bottom, int high)
+{
+    const __m256i pairs = _mm256_setr_epi8(0, 3, 1, 4, 2, 5, 6, 9, 7, 10, 8, 11, -1, -1, -1, -1,
+        0, 3, 1, 4, 2, 5, 6, 9, 7, 10, 8, 11, -1, -1, -1, -1);
+    const __m256i ones = _mm256_set1_epi8(1);
+    const __m256i t = _mm256_maddubs_epi16(_mm256_shuffle_epi8(load_lanes(top, 0, high), pairs), ones);
+    const __m256i b = _mm256_maddubs_epi16(_mm256_shuffle_epi8(load_lanes(bottom, 0, high), pairs), ones);
+    return _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(t, b), _mm256_set1_epi16(2)), 2);
+}
+
+__attribute__((target("avx2")))
+static void halve_row_avx2(const uint8_t *top, const uint8_t *bottom, int width, uint8_t *out)
+{
+    const __m256i compact = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 8, 9, 10, 11, 12, 13, -1, -1, -1, -1,
+        0, 1, 2, 3, 4, 5, 8, 9, 10, 11, 12, 13, -1, -1, -1, -1);
+    int x = 0;
+    for (; x + 10 <= width; x += 8, top += 48, bottom += 48, out += 24)   // The stores spill 4 bytes
+    {
+        // Output pixels 0 1 | 4 5 and 2 3 | 6 7
+        const __m256i a = halve_sums(top, bottom, 24);
+        const __m256i b = halve_sums(top + 12, bottom + 12, 24);
+        const __m256i rgb = _mm256_shuffle_epi8(_mm256_packus_epi16(a, b), compact);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm256_castsi256_si128(rgb));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 12), _mm256_extracti128_si256(rgb, 1));
+    }
+    halve_row_scalar(top, bottom, width - x, out);
+}
+
+static bool has_avx2() { return __builtin_cpu_supports("avx2"); }
+
+#endif
+
+static halve_row_fn halve_kernel()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    static const halve_row_fn kernel = has_avx2() ? halve_row_avx2 : halve_row_scalar;
+    return kernel;
+#else
+    return halve_row_scalar;
+#endif
+}
+
+// dst = src halved, an odd last row or column is dropped
+static void halve(const Image &src, Image &dst)
+{
+    const halve_row_fn kernel = halve_kernel();
+    const size_t srcStride = static_cast<size_t>(src.GetWidth()) * 3;
+    const int dw = dst.GetWidth(), dh = dst.GetHeight();
+    for (int y = 0; y < dh; y++)
+    {
+        const uint8_t *top = src.m_data + static_cast<size_t>(2 * y) * srcStride;
+        kernel(top, top + srcStride, dw, dst.m_data + static_cast<size_t>(y) * dw * 3);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// The cache attached to an Image
+///////////////////////////////////////////////////////////////////////
+struct ImageCache
+{
+    std::mutex mutex;
+    std::vector<std::shared_ptr<Image>> levels;     // Level n at [n - 1]
+    std::shared_ptr<IntegralImage> integral;
+};
+
+static ImagePool &level_pool()
+{
+    static ImagePool pool(64);
+    return pool;
+}
+
+// Integral images (4 bytes a pixel) are recycled the same way
+static std::shared_ptr<IntegralImage> acquire_integral()
+{
+    struct integral_pool
+    {
+        std::mutex mutex;
+        std::vector<IntegralImage *> idle;
+    };
+    static integral_pool *pool = new integral_pool();     // Never freed, caches may outlive it
+
+    IntegralImage *integral = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        if (!pool->idle.empty())
+        {
+            integral = pool->idle.back();
+            pool->idle.pop_back();
+        }
+    }
+    if (!integral)
+    {
+        integral = new IntegralImage();
+    }
+    return std::shared_ptr<IntegralImage>(integral, [](IntegralImage *released)
+    {
+        {
+            std::lock_guard<std::mutex> lock(pool->mutex);
+            if (pool->idle.size() < 8)
+            {
+                pool->idle.push_back(released);
+                return;
+            }
+        }
+        delete released;
+    });
+}
+
+static std::atomic<uint64_t> g_levelsBuilt(0);
+
+static std::shared_ptr<ImageCache> cache_of(const Image &image)
+{
+    std::shared_ptr<ImageCache> cache = image.Cache();
+    if (!cache)
+    {
+        cache = image.AttachCache(std::make_shared<ImageCache>());
+    }
+    return cache;
+}
+
+// Level n, built (and counted in *built) down to it as needed
+static const Image *pyramid_level(const Image &image, int level, uint64_t *built)
+{
+    if (level < 0 || image.GetWidth() <= 0 || image.GetHeight() <= 0 || !image.m_data)
+    {
+        return nullptr;
+    }
+    if (level == 0)
+    {
+        return &image;
+    }
+
+    std::shared_ptr<ImageCache> cache = cache_of(image);
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    while (cache->levels.size() < static_cast<size_t>(level))
+    {
+        const Image &src = cache->levels.empty() ? image : *cache->levels.back();
+        if (src.GetWidth() < 2 || src.GetHeight() < 2)
+        {
+            return nullptr;
+        }
+        std::shared_ptr<Image> dst = level_pool().Acquire();
+        if (!dst->Resize(src.GetWidth() / 2, src.GetHeight() / 2))
+        {
+            return nullptr;
+        }
+        TRACE_SCOPE("Pyramid level");
+        halve(src, *dst);
+        cache->levels.push_back(dst);
+        g_levelsBuilt++;
+        if (built)
+        {
+            (*built)++;
+        }
+    }
+    return cache->levels[level - 1].get();
+}
+
+static const Image *pyramid_scaled(const Image &image, int width, int height, Image &scratch,
+    uint64_t *built)
+{
+    if (width <= 0 || height <= 0)
+    {
+        return nullptr;
+    }
+
+    // Walk down while the next level still covers the target
+    const Image *best = pyramid_level(image, 0, built);
+    for (int level = 1; best; level++)
+    {
+        if (best->GetWidth() == width && best->GetHeight() == height)
+        {
+            return best;
+        }
+        if (best->GetWidth() / 2 < width || best->GetHeight() / 2 < height)
+        {
+            break;
+        }
+        best = pyramid_level(image, level, built);
+    }
+    if (!best || !ResizeImage(*best, scratch, width, height))
+    {
+        return nullptr;
+    }
+    return &scratch;
+}
+
+const Image *PyramidLevel(const Image &image, int level)
+{
+    return pyramid_level(image, level, nullptr);
+}
+
+const Image *PyramidScaled(const Image &image, int width, int height, Image &scratch)
+{
+    return pyramid_scaled(image, width, height, scratch, nullptr);
+}
+
+uint64_t PyramidLevelsBuilt()
+{
+    return g_levelsBuilt.load();
+}
+
+///////////////////////////////////////////////////////////////////////
+// Luma integral image
+// NOTE:
+//      One pass: a running sum along the row plus the row above. The
+//      arithmetic is modulo 2^32 on purpose, see IntegralImage.
+///////////////////////////////////////////////////////////////////////
+const IntegralImage *LumaIntegral(const Image &image)
+{
+    if (image.GetWidth() <= 0 || image.GetHeight() <= 0 || !image.m_data)
+    {
+        return nullptr;
+    }
+
+    std::shared_ptr<ImageCache> cache = cache_of(image);
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    if (cache->integral)
+    {
+        return cache->integral.get();
+    }
+
+    TRACE_SCOPE("Integral image");
+    const int w = image.GetWidth(), h = image.GetHeight();
+    const size_t stride = static_cast<size_t>(w) + 1;
+    std::shared_ptr<IntegralImage> integral = acquire_integral();
+    integral->width = w;
+    integral->height = h;
+    integral->sums.resize(stride * (h + 1));
+    std::fill(integral->sums.begin(), integral->sums.begin() + stride, 0u);
+    for (int y = 0; y < h; y++)
+    {
+        const uint8_t *p = image.m_data + static_cast<size_t>(y) * w * 3;
+        const uint32_t *above = integral->sums.data() + y * stride;
+        uint32_t *row = integral->sums.data() + (y + 1) * stride;
+        uint32_t running = 0;
+        row[0] = 0;
+        for (int x = 0; x < w; x++, p += 3)
+        {
+            running += (77u * p[0] + 150u * p[1] + 29u * p[2]) >> 8;
+            row[x + 1] = above[x + 1] + running;
+        }
+    }
+    cache->integral = std::move(integral);
+    return cache->integral.get();
+}
+
+///////////////////////////////////////////////////////////////////////
+// ImagePyramid
+///////////////////////////////////////////////////////////////////////
+ImagePyramid::ImagePyramid() : m_built(0) {}
+
+void ImagePyramid::Reset(std::shared_ptr<const Image> source)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_source = std::move(source);
+}
+
+const Image *ImagePyramid::Level(int level)
+{
+    std::shared_ptr<const Image> source;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        source = m_source;
+    }
+    if (!source)
+    {
+        return nullptr;
+    }
+    uint64_t built = 0;
+    const Image *result = pyramid_level(*source, level, &built);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_built += built;
+    return result;
+}
+
+const Image *ImagePyramid::Scaled(int width, int height, Image &scratch)
+{
+    std::shared_ptr<const Image> source;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        source = m_source;
+    }
+    if (!source)
+    {
+        return nullptr;
+    }
+    uint64_t built = 0;
+    const Image *result = pyramid_scaled(*source, width, height, scratch, &built);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_built += built;
+    return result;
+}
+
+uint64_t ImagePyramid::LevelsBuilt()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_built;
+}
@@ -0,0 +1,824 @@
+// Includes
+#include <algorithm>   // for std::max, std::min
+#include <cmath>       // for std::frexp, std::lround, std::sqrt
+
+#include "image_proc.h"
+#include "inference.h"
+#include "trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
+// Output channels computed together: one 256-bit vector of int32 sums
+static const int kBlock = 8;
+
+// Pixels computed together, so each weight load is used 4 times
+static const int kPixels = 4;
+
+// Pixels whose sums are gathered before requantizing them in one pass
+static const int kStrip = 32;
+
+static size_t round_up(size_t value, size_t multiple)
+{
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+static int out_size(int in, int kernel, int stride, int pad)
+{
+    return (in + 2 * pad - kernel) / stride + 1;
+}
+
+// im2col of one output pixel: the input patch under the kernel as one
+// row, padValue outside the input and zeros up to paddedDepth
+template <typename T>
+static void patch_row(const T *in, int width, int height, int channels, int kernel, int stride,
+    int pad, int ox, int oy, const T *padValue, T *row, size_t paddedDepth)
+{
+    const int x0 = ox * stride - pad;
+    const int y0 = oy * stride - pad;
+    const size_t span = static_cast<size_t>(kernel) * channels;
+    T *dst = row;
+    for (int ky = 0; ky < kernel; ky++, dst += span)
+    {
+        const int y = y0 + ky;
+        if (y >= 0 && y < height && x0 >= 0 && x0 + kernel <= width)
+        {
+            // Inside the input a kernel row is one contiguous run
+            const T *src = in + (static_cast<size_t>(y) * width + x0) * channels;
+            for (size_t i = 0; i < span; i++)
+            {
+                dst[i] = src[i];
+            }
+            continue;
+        }
+        for (int kx = 0; kx < kernel; kx++)
+        {
+            const int x = x0 + kx;
+            const T *src = (x < 0 || y < 0 || x >= width || y >= height) ? padValue
+                : in + (static_cast<size_t>(y) * width + x) * channels;
+            std::copy(src, src + channels, dst + kx * channels);
+        }
+    }
+    std::fill(dst, row + paddedDepth, T(0));
+}
+
+///////////////////////////////////////////////////////////////////////
+// Float kernel
+// NOTE:
+//      GCC/Clang vector extensions, SSE on x86 and NEON on the Jetson,
+//      blocked exactly like the int8 kernels so the reference path is a
+//      fair baseline and not a scalar straw man.
+///////////////////////////////////////////////////////////////////////
+typedef float v4f __attribute__((vector_size(16)));
+
+static inline v4f load4(const float *p)
+{
+    v4f v;
+    __builtin_memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+
+// out[p * stride + c] = sum(a[p][k] * w[k * 8 + c]) for 4 pixels, 8 channels
+static void gemm_float(const float *const a[kPixels], const float *w, size_t depth,
+    float *out, size_t stride)
+{
+    v4f acc[kPixels][2] = {};
+    for (size_t k = 0; k < depth; k++, w += kBlock)
+    {
+        const v4f w0 = load4(w);
+        const v4f w1 = load4(w + 4);
+        for (int p = 0; p < kPixels; p++)
+        {
+            acc[p][0] += a[p][k] * w0;
+            acc[p][1] += a[p][k] * w1;
+        }
+    }
+    for (int p = 0; p < kPixels; p++)
+    {
+        __builtin_memcpy(out + p * stride, &acc[p][0], sizeof(v4f));
+        __builtin_memcpy(out + p * stride + 4, &acc[p][1], sizeof(v4f));
+    }
+}
+
+// out = sums + bias, then ReLU (restrict: lets the compiler vectorize)
+static void bias_row(const float *__restrict sums, const float *__restrict bias, bool relu,
+    int count, float *__restrict out)
+{
+    for (int c = 0; c < count; c++)
+    {
+        const float v = sums[c] + bias[c];
+        out[c] = relu ? std::max(v, 0.0f) : v;
+    }
+}
+
+// out = clamp(round(zero + (sums + bias) * scale)). Integer clamping keeps
+// the loop branch free, so it vectorizes down to packuswb.
+static void requantize_row(const int32_t *__restrict sums, const int32_t *__restrict bias,
+    const float *__restrict scale, int32_t zero, int count, uint8_t *__restrict out)
+{
+    const float offset = static_cast<float>(zero) + 0.5f;
+    for (int c = 0; c < count; c++)
+    {
+        int32_t q = static_cast<int32_t>(static_cast<float>(sums[c] + bias[c]) * scale[c] + offset);
+        q = q < 0 ? 0 : q;
+        q = q > 255 ? 255 : q;
+        out[c] = static_cast<uint8_t>(q);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Int8 kernels
+//      out[p * stride + c] = sum(a[p][k] * w[c][k]), a uint8, w int8, for 4 pixels
+//      and 8 output channels. Weights are packed as [k / 4][8][4]: every
+//      4 bytes of a pixel row are broadcast and multiplied with 4 depth
+//      steps of all 8 channels at once, so the sums land in 8 int32 lanes
+//      with no horizontal reduction.
+///////////////////////////////////////////////////////////////////////
+typedef void (*gemm_int8_fn)(const uint8_t *const a[kPixels], const int8_t *w, size_t quads,
+    int32_t *out, size_t stride);
+
+static void gemm_scalar(const uint8_t *const a[kPixels], const int8_t *w, size_t quads,
+    int32_t *out, size_t stride)
+{
+    for (int p = 0; p < kPixels; p++)
+    {
+        int32_t *sums = out + p * stride;
+        std::fill(sums, sums + kBlock, 0);
+        const int8_t *wq = w;
+        for (size_t q = 0; q < quads; q++, wq += 4 * kBlock)
+        {
+            const uint8_t *quad = a[p] + 4 * q;
+            for (int c = 0; c < kBlock; c++)
+            {
+                sums[c] += quad[0] * wq[4 * c] + quad[1] * wq[4 * c + 1] +
+                    quad[2] * wq[4 * c + 2] + quad[3] * wq[4 * c + 3];
+            }
+        }
+    }
+}
+
+static bool always_supported() { return true; }
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("avx2")))
+static inline __m256i broadcast_quad(const uint8_t *p)
+{
+    int32_t quad;
+    __builtin_memcpy(&quad, p, sizeof(quad));
+    return _mm256_set1_epi32(quad);
+}
+
+// vpmaddubsw: u8 x s8 pairs summed to int16 (saturating, hence 7 bit
+// weights), vpmaddwd by 1 adds the pairs of each quad into int32
+__attribute__((target("avx2")))
+static void gemm_avx2(const uint8_t *const a[kPixels], const int8_t *w, size_t quads,
+    int32_t *out, size_t stride)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i acc[kPixels] = {_mm256_setzero_si256(), _mm256_setzero_si256(),
+        _mm256_setzero_si256(), _mm256_setzero_si256()};
+    for (size_t q = 0; q < quads; q++, w += 4 * kBlock)
+    {
+        const __m256i vw = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(w));
+        for (int p = 0; p < kPixels; p++)
+        {
+            const __m256i pairs = _mm256_maddubs_epi16(broadcast_quad(a[p] + 4 * q), vw);
+            acc[p] = _mm256_add_epi32(acc[p], _mm256_madd_epi16(pairs, ones));
+        }
+    }
+    for (int p = 0; p < kPixels; p++)
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + p * stride), acc[p]);
+    }
+}
+
+// vpdpbusd: u8 x s8 quads straight into int32, no saturation
+__attribute__((target("avxvnni,avx2")))
+static void gemm_avx_vnni(const uint8_t *const a[kPixels], const int8_t *w, size_t quads,
+    int32_t *out, size_t stride)
+{
+    __m256i acc[kPixels] = {_mm256_setzero_si256(), _mm256_setzero_si256(),
+        _mm256_setzero_si256(), _mm256_setzero_si256()};
+    for (size_t q = 0; q < quads; q++, w += 4 * kBlock)
+    {
+        const __m256i vw = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(w));
+        for (int p = 0; p < kPixels; p++)
+        {
+            acc[p] = _mm256_dpbusd_avx_epi32(acc[p], broadcast_quad(a[p] + 4 * q), vw);
+        }
+    }
+    for (int p = 0; p < kPixels; p++)
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + p * stride), acc[p]);
+    }
+}
+
+__attribute__((target("avx512vnni,avx512vl,avx2")))
+static void gemm_avx512_vnni(const uint8_t *const a[kPixels], const int8_t *w, size_t quads,
+    int32_t *out, size_t stride)
+{
+    __m256i acc[kPixels] = {_mm256_setzero_si256(), _mm256_setzero_si256(),
+        _mm256_setzero_si256(), _mm256_setzero_si256()};
+    for (size_t q = 0; q < quads; q++, w += 4 * kBlock)
+    {
+        const __m256i vw = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(w));
+        for (int p = 0; p < kPixels; p++)
+        {
+            acc[p] = _mm256_dpbusd_epi32(acc[p], broadcast_quad(a[p] + 4 * q), vw);
+        }
+    }
+    for (int p = 0; p < kPixels; p++)
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + p * stride), acc[p]);
+    }
+}
+
+static bool has_avx2() { return __builtin_cpu_supports("avx2"); }
+static bool has_avx_vnni() { return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("avxvnni"); }
+static bool has_avx512_vnni()
+{
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("avx512vnni") &&
+        __builtin_cpu_supports("avx512vl");
+}
+
+#endif
+
+#if defined(__aarch64__)
+
+// sdot is s8 x s8, so activations are flipped to a - 128 (xor 0x80) and
+// the layer bias carries the + 128 * sum(w) that undoes it
+__attribute__((target("+dotprod")))
+static void gemm_neon_dotprod(const uint8_t *const a[kPixels], const int8_t *w, size_t quads,
+    int32_t *out, size_t stride)
+{
+    const uint32x4_t flip = vdupq_n_u32(0x80808080u);
+    int32x4_t acc[kPixels][2];
+    for (int p = 0; p < kPixels; p++)
+    {
+        acc[p][0] = vdupq_n_s32(0);
+        acc[p][1] = vdupq_n_s32(0);
+    }
+    for (size_t q = 0; q < quads; q++, w += 4 * kBlock)
+    {
+        const int8x16_t w0 = vld1q_s8(w);
+        const int8x16_t w1 = vld1q_s8(w + 16);
+        for (int p = 0; p < kPixels; p++)
+        {
+            uint32_t quad;
+            __builtin_memcpy(&quad, a[p] + 4 * q, sizeof(quad));
+            const int8x16_t va = vreinterpretq_s8_u32(veorq_u32(vdupq_n_u32(quad), flip));
+            acc[p][0] = vdotq_s32(acc[p][0], w0, va);
+            acc[p][1] = vdotq_s32(acc[p][1], w1, va);
+        }
+    }
+    for (int p = 0; p < kPixels; p++)
+    {
+        vst1q_s32(out + p * stride, acc[p][0]);
+        vst1q_s32(out + p * stride + 4, acc[p][1]);
+    }
+}
+
+static bool has_dotprod() { return (getauxval(AT_HWCAP) & HWCAP_ASIMDDP) != 0; }
+
+#endif
+
+struct int8_kernel
+{
+    const char *name;
+    bool (*supported)();
+    gemm_int8_fn gemm;
+    int weightMax;          // Weights are quantized to +-weightMax
+    bool flipsInput;        // Computes sum((a - 128) * w)
+};
+
+// Fastest first, the first supported one is the default
+static const int8_kernel kKernels[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    {"avx512-vnni",  has_avx512_vnni,  gemm_avx512_vnni,  127, false},
+    {"avx-vnni",     has_avx_vnni,     gemm_avx_vnni,     127, false},
+    {"avx2",         has_avx2,         gemm_avx2,         63,  false},
+#endif
+#if defined(__aarch64__)
+    {"neon-dotprod", has_dotprod,      gemm_neon_dotprod, 127, true},
+#endif
+    {"scalar",       always_supported, gemm_scalar,       127, false},
+};
+
+static const size_t kKernelCount = sizeof(kKernels) / sizeof(kKernels[0]);
+
+static size_t default_kernel()
+{
+    for (size_t i = 0; i < kKernelCount; i++)
+    {
+        if (kKernels[i].supported())
+        {
+            return i;
+        }
+    }
+    return kKernelCount - 1;
+}
+
+static size_t s_selectedKernel = default_kernel();
+
+bool QuantizedNetwork::SelectKernel(const std::string &name)
+{
+    for (size_t i = 0; i < kKernelCount; i++)
+    {
+        if (name == kKernels[i].name && kKernels[i].supported())
+        {
+            s_selectedKernel = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *QuantizedNetwork::SelectedKernel()
+{
+    return kKernels[s_selectedKernel].name;
+}
+
+std::vector<std::string> QuantizedNetwork::AvailableKernels()
+{
+    std::vector<std::string> names;
+    for (const int8_kernel &kernel : kKernels)
+    {
+        if (kernel.supported())
+        {
+            names.push_back(kernel.name);
+        }
+    }
+    return names;
+}
+
+const char *QuantizedNetwork::KernelName() const
+{
+    return kKernels[m_kernel].name;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Network
+///////////////////////////////////////////////////////////////////////
+bool Network::AddLayer(const ConvLayer &layer)
+{
+    int width, height, channels;
+    Shape(static_cast<int>(layers.size()) - 1, width, height, channels);
+    if (layer.inChannels != channels || layer.outChannels <= 0 || layer.kernel <= 0 ||
+        layer.stride <= 0 || layer.pad < 0 ||
+        out_size(width, layer.kernel, layer.stride, layer.pad) <= 0 ||
+        out_size(height, layer.kernel, layer.stride, layer.pad) <= 0 ||
+        layer.weights.size() != static_cast<size_t>(layer.outChannels) * layer.kernel * layer.kernel * layer.inChannels ||
+        layer.bias.size() != static_cast<size_t>(layer.outChannels))
+    {
+        return false;
+    }
+    layers.push_back(layer);
+    return true;
+}
+
+void Network::Shape(int layer, int &width, int &height, int &channels) const
+{
+    width = inputWidth;
+    height = inputHeight;
+    channels = 3;
+    for (int i = 0; i <= layer && i < static_cast<int>(layers.size()); i++)
+    {
+        const ConvLayer &l = layers[i];
+        width = out_size(width, l.kernel, l.stride, l.pad);
+        height = out_size(height, l.kernel, l.stride, l.pad);
+        channels = l.outChannels;
+    }
+}
+
+size_t Network::ActivationBytes() const
+{
+    size_t largest = 0;
+    for (int i = -1; i < static_cast<int>(layers.size()); i++)
+    {
+        int width, height, channels;
+        Shape(i, width, height, channels);
+        largest = std::max(largest, static_cast<size_t>(width) * height * channels);
+    }
+    return 2 * largest * sizeof(float);     // Ping-pong buffers
+}
+
+bool Network::Forward(const Image &image, std::vector<float> &output,
+    std::vector<ActivationRange> *ranges)
+{
+    TRACE_SCOPE("float forward");
+    if (layers.empty() || image.GetWidth() <= 0 || image.GetHeight() <= 0)
+    {
+        return false;
+    }
+    // Scaled through the frame's pyramid, shared with other consumers
+    const Image *input = PyramidScaled(image, inputWidth, inputHeight, m_resized);
+    if (!input)
+    {
+        return false;
+    }
+
+    // Normalize
+    const size_t pixels = static_cast<size_t>(inputWidth) * inputHeight;
+    m_bufferA.resize(pixels * 3);
+    for (size_t i = 0; i < pixels * 3; i++)
+    {
+        const int c = static_cast<int>(i % 3);
+        m_bufferA[i] = (input->m_data[i] * (1.0f / 255.0f) - mean[c]) / stddev[c];
+    }
+
+    if (ranges && ranges->size() != layers.size())
+    {
+        ranges->assign(layers.size(), ActivationRange());
+    }
+
+    int width = inputWidth, height = inputHeight;
+    for (size_t l = 0; l < layers.size(); l++)
+    {
+        const ConvLayer &layer = layers[l];
+        const int outWidth = out_size(width, layer.kernel, layer.stride, layer.pad);
+        const int outHeight = out_size(height, layer.kernel, layer.stride, layer.pad);
+        const size_t depth = static_cast<size_t>(layer.kernel) * layer.kernel * layer.inChannels;
+        const int blocks = (layer.outChannels + kBlock - 1) / kBlock;
+
+        // Packed [block][k][8] like the int8 weights
+        m_packed.assign(static_cast<size_t>(blocks) * depth * kBlock, 0.0f);
+        for (int o = 0; o < layer.outChannels; o++)
+        {
+            float *dst = &m_packed[(o / kBlock) * depth * kBlock + o % kBlock];
+            for (size_t k = 0; k < depth; k++)
+            {
+                dst[k * kBlock] = layer.weights[o * depth + k];
+            }
+        }
+
+        const std::vector<float> zeros(layer.inChannels, 0.0f);
+        const bool direct = layer.kernel == 1 && layer.stride == 1 && layer.pad == 0;
+        const int count = outWidth * outHeight;
+        const size_t stride = static_cast<size_t>(blocks) * kBlock;
+        m_column.resize(kPixels * depth);
+        m_sums.resize(kStrip * stride);
+        m_bufferB.resize(static_cast<size_t>(count) * layer.outChannels);
+        for (int s0 = 0; s0 < count; s0 += kStrip)
+        {
+            const int strip = std::min(kStrip, count - s0);
+            for (int p0 = 0; p0 < strip; p0 += kPixels)
+            {
+                // Past the end the last pixel is repeated into spare rows
+                const float *rows[kPixels];
+                for (int p = 0; p < kPixels; p++)
+                {
+                    const int pixel = s0 + std::min(p0 + p, strip - 1);
+                    if (direct)
+                    {
+                        rows[p] = &m_bufferA[static_cast<size_t>(pixel) * layer.inChannels];
+                        continue;
+                    }
+                    float *row = &m_column[p * depth];
+                    patch_row(m_bufferA.data(), width, height, layer.inChannels, layer.kernel,
+                        layer.stride, layer.pad, pixel % outWidth, pixel / outWidth, zeros.data(),
+                        row, depth);
+                    rows[p] = row;
+                }
+                for (int b = 0; b < blocks; b++)
+                {
+                    gemm_float(rows, &m_packed[b * depth * kBlock], depth,
+                        &m_sums[p0 * stride + b * kBlock], stride);
+                }
+            }
+
+            for (int p = 0; p < strip; p++)
+            {
+                bias_row(&m_sums[p * stride], layer.bias.data(), layer.relu, layer.outChannels,
+                    &m_bufferB[static_cast<size_t>(s0 + p) * layer.outChannels]);
+            }
+        }
+
+        if (ranges)
+        {
+            ActivationRange &range = (*ranges)[l];
+            for (float v : m_bufferB)
+            {
+                range.min = std::min(range.min, v);
+                range.max = std::max(range.max, v);
+            }
+        }
+        m_bufferA.swap(m_bufferB);
+        width = outWidth;
+        height = outHeight;
+    }
+
+    output.assign(m_bufferA.begin(), m_bufferA.end());
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Quantization
+///////////////////////////////////////////////////////////////////////
+
+// Asymmetric uint8 parameters covering [min, max] (which must hold 0)
+static QuantParams choose_params(float min, float max)
+{
+    QuantParams params;
+    min = std::min(min, 0.0f);
+    max = std::max(max, 0.0f);
+    if (max - min < 1e-8f)
+    {
+        return params;
+    }
+    params.scale = (max - min) / 255.0f;
+    params.zeroPoint = std::min(255, std::max(0, static_cast<int32_t>(std::lround(-min / params.scale))));
+    return params;
+}
+
+bool QuantizedNetwork::Quantize(Network &net, const std::vector<const Image *> &calibration,
+    std::string &error)
+{
+    TRACE_SCOPE("quantize");
+    if (net.layers.empty() || calibration.empty())
+    {
+        error = "need layers and calibration images";
+        return false;
+    }
+
+    // Output ranges of every layer on the sample images
+    std::vector<ActivationRange> ranges;
+    std::vector<float> output;
+    for (const Image *image : calibration)
+    {
+        if (!net.Forward(*image, output, &ranges))
+        {
+            error = "calibration image can't be run";
+            return false;
+        }
+    }
+
+    const int8_kernel &kernel = kKernels[s_selectedKernel];
+    m_kernel = s_selectedKernel;
+    m_inputWidth = net.inputWidth;
+    m_inputHeight = net.inputHeight;
+    m_layers.clear();
+
+    // The input tensor is the raw RGB bytes
+    QuantParams input;
+    int width = net.inputWidth, height = net.inputHeight;
+    for (size_t l = 0; l < net.layers.size(); l++)
+    {
+        const ConvLayer &src = net.layers[l];
+        QuantLayer layer;
+        layer.inWidth = width;
+        layer.inHeight = height;
+        layer.inChannels = src.inChannels;
+        layer.kernel = src.kernel;
+        layer.stride = src.stride;
+        layer.pad = src.pad;
+        layer.outWidth = out_size(width, src.kernel, src.stride, src.pad);
+        layer.outHeight = out_size(height, src.kernel, src.stride, src.pad);
+        layer.outChannels = src.outChannels;
+        layer.depth = static_cast<size_t>(src.kernel) * src.kernel * src.inChannels;
+        layer.paddedDepth = round_up(layer.depth, 4);
+        layer.input = input;
+        layer.output = choose_params(src.relu ? 0.0f : ranges[l].min, ranges[l].max);
+        layer.padValue.assign(src.inChannels, static_cast<uint8_t>(input.zeroPoint));
+
+        // Fold (pixel / 255 - mean) / stddev into the first layer: the
+        // weights see raw pixels, and padding with the mean pixel is 0
+        std::vector<float> weights = src.weights;
+        std::vector<double> bias(src.bias.begin(), src.bias.end());
+        if (l == 0)
+        {
+            for (int o = 0; o < src.outChannels; o++)
+            {
+                for (size_t i = 0; i < layer.depth; i++)
+                {
+                    const int c = static_cast<int>(i % src.inChannels);
+                    float &w = weights[o * layer.depth + i];
+                    bias[o] -= static_cast<double>(w) * net.mean[c] / net.stddev[c];
+                    w /= 255.0f * net.stddev[c];
+                }
+            }
+            for (int c = 0; c < 3; c++)
+            {
+                layer.padValue[c] = static_cast<uint8_t>(std::lround(net.mean[c] * 255.0f));
+            }
+        }
+
+        const int blocks = (src.outChannels + kBlock - 1) / kBlock;
+        layer.weights.assign(static_cast<size_t>(blocks) * kBlock * layer.paddedDepth, 0);
+        layer.bias.assign(blocks * kBlock, 0);
+        layer.scale.assign(blocks * kBlock, 0.0f);
+        for (int o = 0; o < src.outChannels; o++)
+        {
+            // Symmetric per output channel
+            float largest = 0.0f;
+            for (size_t i = 0; i < layer.depth; i++)
+            {
+                largest = std::max(largest, std::fabs(weights[o * layer.depth + i]));
+            }
+            const float scale = largest > 0.0f ? largest / kernel.weightMax : 1.0f;
+
+            // Packed [block][k / 4][8][4]
+            int32_t sum = 0;
+            int8_t *packed = &layer.weights[(o / kBlock) * kBlock * layer.paddedDepth + (o % kBlock) * 4];
+            for (size_t i = 0; i < layer.depth; i++)
+            {
+                long q = std::lround(weights[o * layer.depth + i] / scale);
+                int8_t w = static_cast<int8_t>(std::max(-kernel.weightMax, std::min(kernel.weightMax, static_cast<int>(q))));
+                packed[(i / 4) * 4 * kBlock + i % 4] = w;
+                sum += w;
+            }
+
+            // acc = sum(a * w) - za * sum(w) + bias / (sa * sw), where the
+            // kernel may compute sum((a - 128) * w) instead
+            const double accScale = static_cast<double>(input.scale) * scale;
+            int64_t b = std::llround(bias[o] / accScale) - static_cast<int64_t>(input.zeroPoint) * sum;
+            if (kernel.flipsInput)
+            {
+                b += 128ll * sum;
+            }
+            layer.bias[o] = static_cast<int32_t>(std::max<int64_t>(INT32_MIN, std::min<int64_t>(INT32_MAX, b)));
+            layer.scale[o] = static_cast<float>(accScale / layer.output.scale);
+        }
+
+        input = layer.output;
+        width = layer.outWidth;
+        height = layer.outHeight;
+        m_layers.push_back(std::move(layer));
+    }
+    return true;
+}
+
+size_t QuantizedNetwork::ActivationBytes() const
+{
+    size_t largest = static_cast<size_t>(m_inputWidth) * m_inputHeight * 3;
+    for (const QuantLayer &layer : m_layers)
+    {
+        largest = std::max(largest, static_cast<size_t>(layer.outWidth) * layer.outHeight * layer.outChannels);
+    }
+    return 2 * largest;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Int8 forward pass
+///////////////////////////////////////////////////////////////////////
+const uint8_t *QuantizedNetwork::PrepareInput(const Image &image)
+{
+    const Image *input = PyramidScaled(image, m_inputWidth, m_inputHeight, m_resized);
+    return input ? input->m_data : nullptr;
+}
+
+void QuantizedNetwork::runLayer(const QuantLayer &layer, const uint8_t *in, uint8_t *out)
+{
+    const gemm_int8_fn gemm = kKernels[m_kernel].gemm;
+    const int blocks = (layer.outChannels + kBlock - 1) / kBlock;
+    const size_t stride = static_cast<size_t>(blocks) * kBlock;
+    const size_t quads = layer.paddedDepth / 4;
+
+    // A 1x1 conv reads the input rows in place
+    const bool direct = layer.kernel == 1 && layer.stride == 1 && layer.pad == 0 &&
+        layer.depth == layer.paddedDepth;
+    const int count = layer.outWidth * layer.outHeight;
+    m_column.resize(kPixels * layer.paddedDepth);
+    m_sums.resize(kStrip * stride);
+
+    for (int s0 = 0; s0 < count; s0 += kStrip)
+    {
+        const int strip = std::min(kStrip, count - s0);
+        for (int p0 = 0; p0 < strip; p0 += kPixels)
+        {
+            // Past the end the last pixel is repeated into spare rows
+            const uint8_t *rows[kPixels];
+            for (int p = 0; p < kPixels; p++)
+            {
+                const int pixel = s0 + std::min(p0 + p, strip - 1);
+                if (direct)
+                {
+                    rows[p] = in + static_cast<size_t>(pixel) * layer.inChannels;
+                    continue;
+                }
+                uint8_t *row = &m_column[p * layer.paddedDepth];
+                patch_row(in, layer.inWidth, layer.inHeight, layer.inChannels, layer.kernel,
+                    layer.stride, layer.pad, pixel % layer.outWidth, pixel / layer.outWidth,
+                    layer.padValue.data(), row, layer.paddedDepth);
+                rows[p] = row;
+            }
+            for (int b = 0; b < blocks; b++)
+            {
+                gemm(rows, &layer.weights[b * kBlock * layer.paddedDepth], quads,
+                    &m_sums[p0 * stride + b * kBlock], stride);
+            }
+        }
+
+        for (int p = 0; p < strip; p++)
+        {
+            requantize_row(&m_sums[p * stride], layer.bias.data(), layer.scale.data(),
+                layer.output.zeroPoint, layer.outChannels,
+                out + static_cast<size_t>(s0 + p) * layer.outChannels);
+        }
+    }
+}
+
+bool QuantizedNetwork::Forward(const Image &image, std::vector<uint8_t> &output, QuantParams &params)
+{
+    TRACE_SCOPE("int8 forward");
+    if (m_layers.empty())
+    {
+        return false;
+    }
+    const uint8_t *in = PrepareInput(image);
+    if (!in)
+    {
+        return false;
+    }
+
+    const size_t half = ActivationBytes() / 2;
+    m_bufferA.resize(half);
+    m_bufferB.resize(half);
+    uint8_t *out = m_bufferA.data();
+    for (const QuantLayer &layer : m_layers)
+    {
+        runLayer(layer, in, out);
+        in = out;
+        out = (out == m_bufferA.data()) ? m_bufferB.data() : m_bufferA.data();
+    }
+
+    const QuantLayer &last = m_layers.back();
+    output.assign(in, in + static_cast<size_t>(last.outWidth) * last.outHeight * last.outChannels);
+    params = last.output;
+    return true;
+}
+
+bool QuantizedNetwork::Forward(const Image &image, std::vector<float> &output)
+{
+    std::vector<uint8_t> quantized;
+    QuantParams params;
+    if (!Forward(image, quantized, params))
+    {
+        return false;
+    }
+    output.resize(quantized.size());
+    for (size_t i = 0; i < quantized.size(); i++)
+    {
+        output[i] = params.scale * (static_cast<int32_t>(quantized[i]) - params.zeroPoint);
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Accuracy comparison
+///////////////////////////////////////////////////////////////////////
+bool CompareQuantized(Network &net, QuantizedNetwork &quantized,
+    const std::vector<const Image *> &images, QuantizationReport &report)
+{
+    report = QuantizationReport();
+    int width, height, channels;
+    net.Shape(static_cast<int>(net.layers.size()) - 1, width, height, channels);
+
+    std::vector<float> expected, actual;
+    double absSum = 0.0, squaredError = 0.0, squaredSignal = 0.0;
+    size_t positions = 0, agree = 0;
+    for (const Image *image : images)
+    {
+        if (!net.Forward(*image, expected) || !quantized.Forward(*image, actual) ||
+            expected.size() != actual.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < expected.size(); i++)
+        {
+            const double error = std::fabs(static_cast<double>(expected[i]) - actual[i]);
+            report.maxAbsError = std::max(report.maxAbsError, error);
+            absSum += error;
+            squaredError += error * error;
+            squaredSignal += static_cast<double>(expected[i]) * expected[i];
+        }
+
+        // Channel picked at every output position (the class, for a classifier)
+        for (size_t p = 0; p + channels <= expected.size(); p += channels)
+        {
+            auto first = expected.begin() + p;
+            auto second = actual.begin() + p;
+            agree += std::max_element(first, first + channels) - first ==
+                std::max_element(second, second + channels) - second;
+            positions++;
+        }
+        report.values += expected.size();
+        report.images++;
+    }
+
+    if (report.values)
+    {
+        report.meanAbsError = absSum / report.values;
+        report.rmsError = std::sqrt(squaredError / report.values);
+        report.signalRms = std::sqrt(squaredSignal / report.values);
+    }
+    report.top1Agreement = positions ? static_cast<double>(agree) / positions : 0.0;
+    return true;
+}
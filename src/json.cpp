@@ -0,0 +1,362 @@
+// Includes
+#include <cctype>      // for isdigit
+#include <cstdint>
+#include <cstdlib>     // for strtod
+#include <stdio.h>
+
+#include "json.h"
+
+// Deep enough for any config, shallow enough to never blow the stack
+static const int kMaxDepth = 64;
+
+///////////////////////////////////////////////////////////////////////
+// Recursive descent parser over the document text
+///////////////////////////////////////////////////////////////////////
+struct JsonParser
+{
+    const std::string &text;
+    size_t pos;
+    std::string error;
+
+    explicit JsonParser(const std::string &t) : text(t), pos(0) {}
+
+    bool fail(const char *what)
+    {
+        if (error.empty())
+        {
+            // Report a line:column, that is what an editor jumps to
+            size_t line = 1, column = 1;
+            for (size_t i = 0; i < pos && i < text.size(); i++)
+            {
+                if (text[i] == '\n') { line++; column = 1; }
+                else column++;
+            }
+            char buffer[160];
+            snprintf(buffer, sizeof(buffer), "%s at line %zu column %zu", what, line, column);
+            error = buffer;
+        }
+        return false;
+    }
+
+    void skipSpace()
+    {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' ||
+            text[pos] == '\n' || text[pos] == '\r'))
+        {
+            pos++;
+        }
+    }
+
+    bool literal(const char *word)
+    {
+        size_t i = 0;
+        for (; word[i]; i++)
+        {
+            if (pos + i >= text.size() || text[pos + i] != word[i])
+            {
+                return fail("invalid literal");
+            }
+        }
+        pos += i;
+        return true;
+    }
+
+    static void putUtf8(std::string &out, uint32_t code)
+    {
+        if (code < 0x80)
+        {
+            out.push_back(static_cast<char>(code));
+        }
+        else if (code < 0x800)
+        {
+            out.push_back(static_cast<char>(0xc0 | (code >> 6)));
+            out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+        }
+        else if (code < 0x10000)
+        {
+            out.push_back(static_cast<char>(0xe0 | (code >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+            out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+        }
+        else
+        {
+            out.push_back(static_cast<char>(0xf0 | (code >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3f)));
+            out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+            out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+        }
+    }
+
+    bool hex4(uint32_t &code)
+    {
+        if (pos + 4 > text.size())
+        {
+            return fail("truncated \\u escape");
+        }
+        code = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            char c = text[pos++];
+            code <<= 4;
+            if (c >= '0' && c <= '9') code |= static_cast<uint32_t>(c - '0');
+            else if (c >= 'a' && c <= 'f') code |= static_cast<uint32_t>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') code |= static_cast<uint32_t>(c - 'A' + 10);
+            else return fail("bad \\u escape");
+        }
+        return true;
+    }
+
+    bool parseString(std::string &out)
+    {
+        pos++;  // Opening quote
+        out.clear();
+        while (pos < text.size())
+        {
+            char c = text[pos++];
+            if (c == '"')
+            {
+                return true;
+            }
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                return fail("control character in string");
+            }
+            if (c != '\\')
+            {
+                out.push_back(c);
+                continue;
+            }
+            if (pos >= text.size())
+            {
+                break;
+            }
+            switch (text[pos++])
+            {
+                case '"':  out.push_back('"'); break;
+                case '\\': out.push_back('\\'); break;
+                case '/':  out.push_back('/'); break;
+                case 'b':  out.push_back('\b'); break;
+                case 'f':  out.push_back('\f'); break;
+                case 'n':  out.push_back('\n'); break;
+                case 'r':  out.push_back('\r'); break;
+                case 't':  out.push_back('\t'); break;
+                case 'u':
+                {
+                    uint32_t code;
+                    if (!hex4(code)) return false;
+                    // Surrogate pair
+                    if (code >= 0xd800 && code < 0xdc00 && pos + 1 < text.size() &&
+                        text[pos] == '\\' && text[pos + 1] == 'u')
+                    {
+                        pos += 2;
+                        uint32_t low;
+                        if (!hex4(low)) return false;
+                        if (low < 0xdc00 || low >= 0xe000) return fail("bad surrogate pair");
+                        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    putUtf8(out, code);
+                    break;
+                }
+                default:
+                    return fail("bad escape");
+            }
+        }
+        return fail("unterminated string");
+    }
+
+    bool parseNumber(double &out)
+    {
+        // Validate the JSON grammar, then let strtod convert
+        size_t start = pos;
+        if (pos < text.size() && text[pos] == '-') pos++;
+        if (pos < text.size() && text[pos] == '0') pos++;
+        else if (pos < text.size() && text[pos] >= '1' && text[pos] <= '9')
+            while (pos < text.size() && isdigit(static_cast<unsigned char>(text[pos]))) pos++;
+        else
+            return fail("bad number");
+        if (pos < text.size() && text[pos] == '.')
+        {
+            pos++;
+            if (pos >= text.size() || !isdigit(static_cast<unsigned char>(text[pos])))
+                return fail("bad number");
+            while (pos < text.size() && isdigit(static_cast<unsigned char>(text[pos]))) pos++;
+        }
+        if (pos < text.size() && (text[pos] == 'e' || text[pos] == 'E'))
+        {
+            pos++;
+            if (pos < text.size() && (text[pos] == '+' || text[pos] == '-')) pos++;
+            if (pos >= text.size() || !isdigit(static_cast<unsigned char>(text[pos])))
+                return fail("bad number");
+            while (pos < text.size() && isdigit(static_cast<unsigned char>(text[pos]))) pos++;
+        }
+        out = strtod(text.substr(start, pos - start).c_str(), nullptr);
+        return true;
+    }
+
+    bool parseValue(JsonValue &out, int depth)
+    {
+        if (depth > kMaxDepth)
+        {
+            return fail("nested too deep");
+        }
+        skipSpace();
+        if (pos >= text.size())
+        {
+            return fail("unexpected end");
+        }
+
+        out = JsonValue();
+        switch (text[pos])
+        {
+            case '{':
+            {
+                out.type = JsonValue::Type::Object;
+                pos++;
+                skipSpace();
+                if (pos < text.size() && text[pos] == '}')
+                {
+                    pos++;
+                    return true;
+                }
+                for (;;)
+                {
+                    skipSpace();
+                    if (pos >= text.size() || text[pos] != '"')
+                    {
+                        return fail("expected member name");
+                    }
+                    std::pair<std::string, JsonValue> member;
+                    if (!parseString(member.first)) return false;
+                    skipSpace();
+                    if (pos >= text.size() || text[pos] != ':')
+                    {
+                        return fail("expected ':'");
+                    }
+                    pos++;
+                    if (!parseValue(member.second, depth + 1)) return false;
+                    out.object.push_back(std::move(member));
+                    skipSpace();
+                    if (pos < text.size() && text[pos] == ',') { pos++; continue; }
+                    if (pos < text.size() && text[pos] == '}') { pos++; return true; }
+                    return fail("expected ',' or '}'");
+                }
+            }
+            case '[':
+            {
+                out.type = JsonValue::Type::Array;
+                pos++;
+                skipSpace();
+                if (pos < text.size() && text[pos] == ']')
+                {
+                    pos++;
+                    return true;
+                }
+                for (;;)
+                {
+                    out.array.emplace_back();
+                    if (!parseValue(out.array.back(), depth + 1)) return false;
+                    skipSpace();
+                    if (pos < text.size() && text[pos] == ',') { pos++; continue; }
+                    if (pos < text.size() && text[pos] == ']') { pos++; return true; }
+                    return fail("expected ',' or ']'");
+                }
+            }
+            case '"':
+                out.type = JsonValue::Type::String;
+                return parseString(out.string);
+            case 't':
+                out.type = JsonValue::Type::Bool;
+                out.boolean = true;
+                return literal("true");
+            case 'f':
+                out.type = JsonValue::Type::Bool;
+                return literal("false");
+            case 'n':
+                return literal("null");
+            default:
+                out.type = JsonValue::Type::Number;
+                return parseNumber(out.number);
+        }
+    }
+};
+
+///////////////////////////////////////////////////////////////////////
+// Parse a document
+///////////////////////////////////////////////////////////////////////
+bool JsonValue::Parse(const std::string &text, JsonValue &out, std::string &error)
+{
+    JsonParser parser(text);
+    bool ok = parser.parseValue(out, 0);
+    if (ok)
+    {
+        parser.skipSpace();
+        if (parser.pos != text.size())
+        {
+            ok = parser.fail("trailing characters");
+        }
+    }
+    error = parser.error;
+    return ok;
+}
+
+bool JsonValue::ParseFile(const std::string &path, JsonValue &out, std::string &error)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp)
+    {
+        error = "can't open " + path;
+        return false;
+    }
+    std::string text;
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+    {
+        text.append(buffer, n);
+    }
+    fclose(fp);
+
+    if (!Parse(text, out, error))
+    {
+        error = path + ": " + error;
+        return false;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Member lookups
+///////////////////////////////////////////////////////////////////////
+const JsonValue *JsonValue::Find(const std::string &key) const
+{
+    if (type != Type::Object)
+    {
+        return nullptr;
+    }
+    for (const auto &member : object)
+    {
+        if (member.first == key)
+        {
+            return &member.second;
+        }
+    }
+    return nullptr;
+}
+
+double JsonValue::GetNumber(const std::string &key, double fallback) const
+{
+    const JsonValue *value = Find(key);
+    return (value && value->type == Type::Number) ? value->number : fallback;
+}
+
+std::string JsonValue::GetString(const std::string &key, const std::string &fallback) const
+{
+    const JsonValue *value = Find(key);
+    return (value && value->type == Type::String) ? value->string : fallback;
+}
+
+bool JsonValue::GetBool(const std::string &key, bool fallback) const
+{
+    const JsonValue *value = Find(key);
+    return (value && value->type == Type::Bool) ? value->boolean : fallback;
+}
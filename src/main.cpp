@@ -0,0 +1,178 @@
+// Includes
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pipeline.h"
+#include "trace.h"
+
+///////////////////////////////////////////////////////////////////////
+// Config-driven pipeline
+//
+// Builds the node graph described by a JSON file (see config/) and runs
+// it, printing per-node throughput and latency. Changing what a device
+// captures, infers, publishes or records is an edit to that file, not a
+// rebuild.
+///////////////////////////////////////////////////////////////////////
+
+struct PipelineOptions
+{
+    std::string configPath;
+    double seconds = 0.0;       // 0 = until interrupted or the sources finish
+    double interval = 1.0;      // Report interval
+    std::string tracePath;      // Write a trace of the run
+};
+
+static std::atomic<bool> g_interrupted(false);
+
+static void on_signal(int)
+{
+    g_interrupted = true;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+        "Usage: %s CONFIG.json [options]\n"
+        "  --seconds S        run time, 0 = until interrupted (0)\n"
+        "  --interval S       report interval (1)\n"
+        "  --trace PATH       write a Chrome/Perfetto trace of the run\n",
+        argv0);
+}
+
+static bool parse_options(int argc, char **argv, PipelineOptions &opt)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (!strcmp(arg, "--help") || !strcmp(arg, "-h"))
+        {
+            return false;
+        }
+        if (arg[0] != '-' && opt.configPath.empty())
+        {
+            opt.configPath = arg;
+            continue;
+        }
+        if (!value)
+        {
+            fprintf(stderr, "Missing value for %s\n", arg);
+            return false;
+        }
+
+        if (!strcmp(arg, "--seconds")) opt.seconds = atof(value);
+        else if (!strcmp(arg, "--interval")) opt.interval = atof(value);
+        else if (!strcmp(arg, "--trace")) opt.tracePath = value;
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            return false;
+        }
+        i++;
+    }
+
+    return !opt.configPath.empty() && opt.seconds >= 0.0 && opt.interval > 0.0;
+}
+
+int main(int argc, char **argv)
+{
+    PipelineOptions opt;
+    if (!parse_options(argc, argv, opt))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    Pipeline pipeline;
+    std::string error;
+    if (!pipeline.LoadFile(opt.configPath, error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    const bool tracing = !opt.tracePath.empty();
+    if (tracing)
+    {
+        if (!Trace::Compiled())
+        {
+            fprintf(stderr, "warning: built with TRACING=OFF, the trace will be empty\n");
+        }
+        Trace::Enable(true);
+    }
+
+    pipeline.Start();
+
+    const auto start = std::chrono::steady_clock::now();
+    auto nextReport = start;
+    std::vector<PipelineNodeStats> stats;
+    bool finished = false;
+
+    while (!g_interrupted && !finished)
+    {
+        nextReport += std::chrono::microseconds(static_cast<int64_t>(opt.interval * 1e6));
+        while (!g_interrupted && !pipeline.Finished() &&
+            std::chrono::steady_clock::now() < nextReport)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        finished = pipeline.Finished();
+        stats = pipeline.Stats();
+        double elapsed = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+
+        printf("[%7.1fs] %zu nodes\n", elapsed, stats.size());
+        for (const PipelineNodeStats &s : stats)
+        {
+            printf("  %-16s %-8s %7.1f fps  frames %-8llu dropped %-6llu limited %-6llu "
+                "errors %-4llu mean %7.0fus p99 %7.0fus%s\n",
+                s.name.c_str(), s.type.c_str(), elapsed > 0.0 ? s.frames / elapsed : 0.0,
+                (unsigned long long)s.frames, (unsigned long long)s.dropped,
+                (unsigned long long)s.limited, (unsigned long long)s.errors,
+                s.meanUs, s.p99Us, s.finished ? "  (finished)" : "");
+        }
+        fflush(stdout);
+
+        if (opt.seconds > 0.0 && elapsed >= opt.seconds)
+        {
+            break;
+        }
+    }
+
+    pipeline.Stop();
+    stats = pipeline.Stats();
+
+    if (tracing)
+    {
+        Trace::Enable(false);
+        if (!Trace::WriteJSON(opt.tracePath))
+        {
+            fprintf(stderr, "can't write %s\n", opt.tracePath.c_str());
+            return 1;
+        }
+        printf("trace written to %s\n", opt.tracePath.c_str());
+    }
+
+    int status = 0;
+    for (const PipelineNodeStats &s : stats)
+    {
+        if (s.errors)
+        {
+            fprintf(stderr, "%s: %llu errors\n", s.name.c_str(), (unsigned long long)s.errors);
+            status = 1;
+        }
+    }
+    return status;
+}
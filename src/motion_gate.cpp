@@ -0,0 +1,288 @@
+// Includes
+#include <algorithm>   // for std::min, std::max, std::fill
+#include <cstring>     // for memcpy
+
+#include "motion_gate.h"
+#include "trace.h"
+
+///////////////////////////////////////////////////////////////////////
+// SIMD absolute difference and threshold
+// NOTE:
+//      GCC vector extensions, so this is SSE2 on x86 and NEON on the
+//      Jetson. max(a,b) - min(a,b) is the unsigned |a - b| without
+//      widening; the compare yields 0x00/0xff lanes that double as the
+//      output mask, and the changed count is a popcount of their low bits.
+///////////////////////////////////////////////////////////////////////
+typedef uint8_t v16u8 __attribute__((vector_size(16)));
+
+static const uint64_t kLowBits = 0x0101010101010101ull;
+
+size_t AbsDiffThreshold(const uint8_t *a, const uint8_t *b, uint8_t *mask,
+    size_t count, uint8_t threshold)
+{
+    v16u8 limit;
+    memset(&limit, threshold, sizeof(limit));
+
+    size_t changed = 0;
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        v16u8 va, vb;
+        memcpy(&va, a + i, sizeof(va));
+        memcpy(&vb, b + i, sizeof(vb));
+
+        v16u8 hi = va > vb ? va : vb;
+        v16u8 lo = va > vb ? vb : va;
+        v16u8 over = (v16u8)((hi - lo) > limit);
+        memcpy(mask + i, &over, sizeof(over));
+
+        uint64_t halves[2];
+        memcpy(halves, &over, sizeof(halves));
+        changed += __builtin_popcountll(halves[0] & kLowBits) +
+            __builtin_popcountll(halves[1] & kLowBits);
+    }
+
+    for (; i < count; i++)
+    {
+        int diff = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+        mask[i] = diff > threshold ? 0xff : 0;
+        changed += diff > threshold;
+    }
+    return changed;
+}
+
+///////////////////////////////////////////////////////////////////////
+// MotionGate constructor
+///////////////////////////////////////////////////////////////////////
+MotionGate::MotionGate()
+    : m_frameWidth(0), m_frameHeight(0), m_thumbWidth(0), m_thumbHeight(0),
+      m_hasBackground(false), m_skipped(0), m_frames(0), m_forwarded(0)
+{
+}
+
+///////////////////////////////////////////////////////////////////////
+// Forget the background, the next frame is always forwarded
+///////////////////////////////////////////////////////////////////////
+void MotionGate::Reset()
+{
+    m_hasBackground = false;
+    m_skipped = 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Size the thumbnail for a frame size (only when it changes)
+///////////////////////////////////////////////////////////////////////
+void MotionGate::setup(int width, int height)
+{
+    m_frameWidth = width;
+    m_frameHeight = height;
+    m_thumbWidth = std::max(1, std::min(thumbWidth, width));
+    m_thumbHeight = std::max(1, std::min(height,
+        static_cast<int>((static_cast<int64_t>(m_thumbWidth) * height + width / 2) / width)));
+
+    m_xBegin.resize(m_thumbWidth + 1);
+    for (int x = 0; x <= m_thumbWidth; x++)
+    {
+        m_xBegin[x] = static_cast<int>(static_cast<int64_t>(x) * width / m_thumbWidth);
+    }
+
+    const size_t pixels = static_cast<size_t>(m_thumbWidth) * m_thumbHeight;
+    m_rowSums.resize(m_thumbWidth);
+    m_current.resize(pixels);
+    m_background.resize(pixels);
+    m_background16.resize(pixels);
+    m_changed.resize(pixels);
+    m_hasBackground = false;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Box averaged luma thumbnail, Y = (77 R + 150 G + 29 B) / 256
+///////////////////////////////////////////////////////////////////////
+void MotionGate::makeThumbnail(const Image &frame)
+{
+    const int step = std::max(1, sampleStep);
+    const size_t stride = static_cast<size_t>(m_frameWidth) * 3;
+
+    for (int ty = 0; ty < m_thumbHeight; ty++)
+    {
+        int y0 = static_cast<int>(static_cast<int64_t>(ty) * m_frameHeight / m_thumbHeight);
+        int y1 = static_cast<int>(static_cast<int64_t>(ty + 1) * m_frameHeight / m_thumbHeight);
+        y1 = std::max(y1, y0 + 1);
+
+        std::fill(m_rowSums.begin(), m_rowSums.end(), 0u);
+        int rows = 0;
+        for (int sy = y0; sy < y1; sy += step, rows++)
+        {
+            const uint8_t *row = frame.m_data + sy * stride;
+            for (int tx = 0; tx < m_thumbWidth; tx++)
+            {
+                uint32_t sum = 0;
+                const uint8_t *p = row + m_xBegin[tx] * 3;
+                const uint8_t *end = row + std::max(m_xBegin[tx + 1], m_xBegin[tx] + 1) * 3;
+                for (; p < end; p += 3 * step)
+                {
+                    sum += 77u * p[0] + 150u * p[1] + 29u * p[2];
+                }
+                m_rowSums[tx] += sum;
+            }
+        }
+
+        uint8_t *out = m_current.data() + static_cast<size_t>(ty) * m_thumbWidth;
+        for (int tx = 0; tx < m_thumbWidth; tx++)
+        {
+            int width = std::max(m_xBegin[tx + 1] - m_xBegin[tx], 1);
+            uint32_t samples = static_cast<uint32_t>(rows * ((width + step - 1) / step));
+            out[tx] = static_cast<uint8_t>(m_rowSums[tx] / (samples * 256u));
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Group changed pixels into cells and connected cells into regions
+///////////////////////////////////////////////////////////////////////
+void MotionGate::findRegions(MotionResult &result)
+{
+    const int cell = std::max(1, cellSize);
+    const int cellsX = (m_thumbWidth + cell - 1) / cell;
+    const int cellsY = (m_thumbHeight + cell - 1) / cell;
+
+    m_cellCounts.assign(static_cast<size_t>(cellsX) * cellsY, 0);
+    for (int y = 0; y < m_thumbHeight; y++)
+    {
+        const uint8_t *row = m_changed.data() + static_cast<size_t>(y) * m_thumbWidth;
+        uint16_t *counts = m_cellCounts.data() + static_cast<size_t>(y / cell) * cellsX;
+        for (int x = 0; x < m_thumbWidth; x++)
+        {
+            counts[x / cell] += row[x] & 1;
+        }
+    }
+
+    // 8-connected flood fill over the active cells
+    m_labels.assign(m_cellCounts.size(), -1);
+    for (int start = 0; start < static_cast<int>(m_cellCounts.size()); start++)
+    {
+        if (m_labels[start] >= 0 || m_cellCounts[start] < minCellPixels)
+        {
+            continue;
+        }
+
+        int minX = cellsX, minY = cellsY, maxX = -1, maxY = -1;
+        m_stack.clear();
+        m_stack.push_back(start);
+        m_labels[start] = static_cast<int32_t>(result.regions.size());
+        while (!m_stack.empty())
+        {
+            int index = m_stack.back();
+            m_stack.pop_back();
+            int cx = index % cellsX, cy = index / cellsX;
+            minX = std::min(minX, cx);
+            maxX = std::max(maxX, cx);
+            minY = std::min(minY, cy);
+            maxY = std::max(maxY, cy);
+
+            for (int ny = std::max(cy - 1, 0); ny <= std::min(cy + 1, cellsY - 1); ny++)
+            {
+                for (int nx = std::max(cx - 1, 0); nx <= std::min(cx + 1, cellsX - 1); nx++)
+                {
+                    int neighbour = ny * cellsX + nx;
+                    if (m_labels[neighbour] < 0 && m_cellCounts[neighbour] >= minCellPixels)
+                    {
+                        m_labels[neighbour] = m_labels[start];
+                        m_stack.push_back(neighbour);
+                    }
+                }
+            }
+        }
+
+        // Cells -> thumbnail pixels -> frame pixels
+        int tx0 = minX * cell, ty0 = minY * cell;
+        int tx1 = std::min((maxX + 1) * cell, m_thumbWidth);
+        int ty1 = std::min((maxY + 1) * cell, m_thumbHeight);
+        MotionRegion region;
+        region.x = m_xBegin[tx0];
+        region.y = static_cast<int>(static_cast<int64_t>(ty0) * m_frameHeight / m_thumbHeight);
+        region.width = m_xBegin[tx1] - region.x;
+        region.height = static_cast<int>(static_cast<int64_t>(ty1) * m_frameHeight / m_thumbHeight) - region.y;
+        result.regions.push_back(region);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Analyse one frame
+///////////////////////////////////////////////////////////////////////
+bool MotionGate::Process(const Image &frame, MotionResult &result)
+{
+    TRACE_SCOPE("motion gate");
+    result.forward = true;
+    result.forced = false;
+    result.activity = 0.0;
+    result.regions.clear();
+    m_frames++;
+
+    if (frame.GetWidth() <= 0 || frame.GetHeight() <= 0 || !frame.m_data)
+    {
+        m_forwarded++;
+        return true;    // Nothing to judge, let inference decide
+    }
+    if (frame.GetWidth() != m_frameWidth || frame.GetHeight() != m_frameHeight)
+    {
+        setup(frame.GetWidth(), frame.GetHeight());
+    }
+
+    makeThumbnail(frame);
+    const size_t pixels = m_current.size();
+
+    if (!m_hasBackground)
+    {
+        // First frame: it becomes the background and is always forwarded
+        for (size_t i = 0; i < pixels; i++)
+        {
+            m_background[i] = m_current[i];
+            m_background16[i] = static_cast<uint16_t>(m_current[i] << 8);
+        }
+        m_hasBackground = true;
+        m_skipped = 0;
+        m_forwarded++;
+        result.activity = 1.0;
+        result.regions.push_back(MotionRegion{0, 0, m_frameWidth, m_frameHeight});
+        return true;
+    }
+
+    size_t changed = AbsDiffThreshold(m_current.data(), m_background.data(),
+        m_changed.data(), pixels, pixelThreshold);
+    result.activity = static_cast<double>(changed) / static_cast<double>(pixels);
+
+    // Let the background follow slow changes (lighting, parked objects)
+    for (size_t i = 0; i < pixels; i++)
+    {
+        int target = m_current[i] << 8;
+        int bg = m_background16[i];
+        bg += (target - bg) >> learnShift;
+        m_background16[i] = static_cast<uint16_t>(bg);
+        m_background[i] = static_cast<uint8_t>((bg + 128) >> 8);
+    }
+
+    if (result.activity >= activityThreshold)
+    {
+        findRegions(result);
+    }
+    else if (maxSkip > 0 && m_skipped >= maxSkip)
+    {
+        result.forced = true;
+    }
+    else
+    {
+        result.forward = false;
+    }
+
+    if (result.forward)
+    {
+        m_skipped = 0;
+        m_forwarded++;
+    }
+    else
+    {
+        m_skipped++;
+    }
+    return result.forward;
+}
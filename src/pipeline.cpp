@@ -0,0 +1,1566 @@
+// Includes
+#include <algorithm>   // for std::min
+#include <chrono>
+#include <strings.h>   // for strcasecmp
+#include <thread>
+
+#include "async_writer.h"
+#include "camera.h"
+#include "image_proc.h"
+#include "motion_gate.h"
+#include "pipeline.h"
+#include "recorder.h"
+#include "remap.h"
+#include "shm_transport.h"
+#include "simulcast.h"
+#include "tcp_transport.h"
+#include "trace.h"
+
+///////////////////////////////////////////////////////////////////////
+// PipelineEdge
+///////////////////////////////////////////////////////////////////////
+PipelineEdge::PipelineEdge(const std::string &fromNode, const std::string &toNode,
+    size_t depth, double maxFps)
+    : m_depth(depth > 0 ? depth : 1),
+      m_periodUs(maxFps > 0.0 ? static_cast<uint64_t>(1e6 / maxFps) : 0),
+      m_nextDueUs(0), m_closed(false), m_pushed(0), m_dropped(0), m_limited(0),
+      from(fromNode), to(toNode) {}
+
+bool PipelineEdge::Push(const FramePtr &frame)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_closed)
+        {
+            return false;
+        }
+
+        // Rate limit on capture time, so it is exact however late we are.
+        // The schedule advances by whole periods and only resyncs after a
+        // gap, so 30 -> 10 fps takes every third frame despite jitter.
+        if (m_periodUs)
+        {
+            const uint64_t t = frame->timestampUs;
+            if (m_nextDueUs && t < m_nextDueUs)
+            {
+                m_limited++;
+                return false;
+            }
+            m_nextDueUs = (m_nextDueUs && t - m_nextDueUs < m_periodUs)
+                ? m_nextDueUs + m_periodUs : t + m_periodUs;
+        }
+
+        if (m_queue.size() >= m_depth)
+        {
+            m_queue.pop_front();
+            m_dropped++;
+        }
+        m_queue.push_back(frame);
+        m_pushed++;
+    }
+    m_ready.notify_one();
+    return true;
+}
+
+bool PipelineEdge::Pop(FramePtr &frame, int timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto ready = [this] { return !m_queue.empty() || m_closed; };
+    if (timeoutMs < 0)
+    {
+        m_ready.wait(lock, ready);
+    }
+    else if (!m_ready.wait_for(lock, std::chrono::milliseconds(timeoutMs), ready))
+    {
+        return false;
+    }
+    if (m_queue.empty())
+    {
+        return false;   // Closed and drained
+    }
+    frame = std::move(m_queue.front());
+    m_queue.pop_front();
+    return true;
+}
+
+void PipelineEdge::Close()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+    }
+    m_ready.notify_all();
+}
+
+uint64_t PipelineEdge::Pushed()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pushed;
+}
+
+uint64_t PipelineEdge::Dropped()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dropped;
+}
+
+uint64_t PipelineEdge::Limited()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_limited;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Node helpers
+///////////////////////////////////////////////////////////////////////
+
+// New frame with the metadata of in and nothing else
+static std::shared_ptr<PipelineFrame> derive_frame(const PipelineFrame &in)
+{
+    auto out = std::make_shared<PipelineFrame>();
+    out->sequence = in.sequence;
+    out->timestampUs = in.timestampUs;
+    out->streamId = in.streamId;
+    out->width = in.width;
+    out->height = in.height;
+    out->detections = in.detections;
+    return out;
+}
+
+// A pixel request as a size: one side given, the other follows the
+// aspect ratio; none given, full size
+static void request_size(const PipelineFrame &frame, int &minWidth, int &minHeight)
+{
+    const int width = static_cast<int>(frame.width);
+    const int height = static_cast<int>(frame.height);
+    if (minWidth <= 0 || minHeight <= 0)
+    {
+        // One side given: the other follows the aspect ratio
+        if (minWidth > 0 && width > 0)
+        {
+            minHeight = static_cast<int>(static_cast<int64_t>(minWidth) * height / width);
+        }
+        else if (minHeight > 0 && height > 0)
+        {
+            minWidth = static_cast<int>(static_cast<int64_t>(minHeight) * width / height);
+        }
+        else
+        {
+            minWidth = width;
+            minHeight = height;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Pixels of a frame, decoding the payload if it only has that
+///////////////////////////////////////////////////////////////////////
+std::shared_ptr<const Image> FramePixels(const PipelineFrame &frame, ImagePool &pool,
+    int minWidth, int minHeight)
+{
+    if (frame.image)
+    {
+        return frame.image;
+    }
+    if (!frame.payload)
+    {
+        return nullptr;
+    }
+
+    const int width = static_cast<int>(frame.width);
+    const int height = static_cast<int>(frame.height);
+    request_size(frame, minWidth, minHeight);
+
+    std::lock_guard<std::mutex> lock(frame.decodeMutex);
+    if (frame.decoded && frame.decoded->GetWidth() >= std::min(minWidth, width) &&
+        frame.decoded->GetHeight() >= std::min(minHeight, height))
+    {
+        return frame.decoded;
+    }
+
+    // The first decode is the only one: big enough for every node the
+    // frame goes to, whichever of them gets here first
+    if (!frame.decoded && frame.readers)
+    {
+        for (PipelineNode *reader : *frame.readers)
+        {
+            int needWidth = 0, needHeight = 0;
+            if (reader->PixelNeed(frame, needWidth, needHeight))
+            {
+                request_size(frame, needWidth, needHeight);
+                minWidth = std::max(minWidth, needWidth);
+                minHeight = std::max(minHeight, needHeight);
+            }
+        }
+    }
+
+    std::shared_ptr<Image> image = pool.Acquire();
+    if (frame.encoding == FrameEncoding::RawRGB)
+    {
+        if (frame.payload->size() != static_cast<size_t>(width) * height * 3 ||
+            !image->Resize(width, height))
+        {
+            return nullptr;
+        }
+        std::copy(frame.payload->begin(), frame.payload->end(), image->m_data);
+    }
+    else if (frame.encoding == FrameEncoding::JPEG)
+    {
+        if (!image->DecodeJPEG(frame.payload->data(), frame.payload->size(),
+                Image::JPEGScaleFor(width, height, minWidth, minHeight)))
+        {
+            return nullptr;
+        }
+    }
+    else if (!image->Decode(frame.payload->data(), frame.payload->size()))
+    {
+        return nullptr;
+    }
+    frame.decoded = image;
+    frame.decodes++;
+    return image;
+}
+
+///////////////////////////////////////////////////////////////////////
+// source: synthetic camera or a recording
+//      width, height, fps, noise   synthetic camera (1280, 720, 30, 16)
+//      mjpeg                       the camera delivers JPEG frames (false)
+//      quality                     of those frames (80)
+//      replay                      recording prefix instead of the camera
+//      frames                      stop after this many, 0 = never (0)
+//      stream_id                   (node name)
+// NOTE:
+//      MJPEG and replayed frames go out as their JPEG bytes only, so they
+//      reach publish and record without a decode and re-encode.
+///////////////////////////////////////////////////////////////////////
+class SourceNode : public PipelineNode
+{
+    private:
+        PipelineContext *m_context = nullptr;
+        std::unique_ptr<SyntheticCamera> m_camera;
+        Player m_player;
+        bool m_replay = false;
+        bool m_mjpeg = false;
+        int m_quality = 80;
+        double m_fps = 30.0;
+        std::chrono::steady_clock::time_point m_nextFrame;
+        uint64_t m_limit = 0;
+        uint64_t m_sequence = 0;
+        std::string m_streamId;
+        FrameMessage m_message;
+
+    public:
+        bool IsSource() const override { return true; }
+
+        bool Configure(const JsonValue &config, PipelineContext &context, std::string &error) override
+        {
+            m_context = &context;
+            m_fps = config.GetNumber("fps", 30.0);
+            m_limit = static_cast<uint64_t>(std::max(0.0, config.GetNumber("frames", 0.0)));
+            m_streamId = config.GetString("stream_id", config.GetString("name", ""));
+
+            const std::string replay = config.GetString("replay", "");
+            if (!replay.empty())
+            {
+                m_replay = true;
+                if (!m_player.Open(replay) || m_player.FrameCount() == 0)
+                {
+                    error = "can't replay " + replay;
+                    return false;
+                }
+                m_nextFrame = std::chrono::steady_clock::now();
+                return true;
+            }
+
+            int width = static_cast<int>(config.GetNumber("width", 1280));
+            int height = static_cast<int>(config.GetNumber("height", 720));
+            int noise = static_cast<int>(config.GetNumber("noise", 16));
+            if (width <= 0 || height <= 0 || m_fps < 0.0)
+            {
+                error = "bad width, height or fps";
+                return false;
+            }
+            m_camera.reset(new SyntheticCamera(width, height, m_fps, noise));
+            m_mjpeg = config.GetBool("mjpeg", false);
+            m_quality = static_cast<int>(config.GetNumber("quality", 80));
+            if (m_quality <= 0 || m_quality > 100)
+            {
+                error = "bad quality";
+                return false;
+            }
+            return true;
+        }
+
+        bool Produce(FramePtr &out) override
+        {
+            if (!m_context->running || (m_limit && m_sequence >= m_limit))
+            {
+                return false;
+            }
+
+            auto frame = std::make_shared<PipelineFrame>();
+            if (m_replay)
+            {
+                if (m_fps > 0.0)
+                {
+                    std::this_thread::sleep_until(m_nextFrame);
+                    m_nextFrame += std::chrono::microseconds(static_cast<int64_t>(1e6 / m_fps));
+                }
+                if (!m_player.ToMessage(m_sequence % m_player.FrameCount(), m_message))
+                {
+                    return false;
+                }
+                frame->timestampUs = NowMicros();
+                frame->width = m_message.width;
+                frame->height = m_message.height;
+                frame->detections = m_message.detections;
+            }
+            else if (m_mjpeg)
+            {
+                if (!m_camera->CaptureJPEG(m_message.payload, frame->timestampUs, m_quality))
+                {
+                    return false;
+                }
+                frame->width = static_cast<uint32_t>(m_camera->GetWidth());
+                frame->height = static_cast<uint32_t>(m_camera->GetHeight());
+            }
+            else
+            {
+                std::shared_ptr<Image> image = m_context->images.Acquire();
+                m_camera->Capture(*image, frame->timestampUs);
+                frame->width = static_cast<uint32_t>(image->GetWidth());
+                frame->height = static_cast<uint32_t>(image->GetHeight());
+                frame->image = image;
+            }
+            if (!frame->image)
+            {
+                frame->encoding = FrameEncoding::JPEG;
+                frame->payload = std::make_shared<const std::vector<uint8_t>>(std::move(m_message.payload));
+            }
+
+            frame->sequence = ++m_sequence;
+            frame->streamId = m_streamId;
+            out = frame;
+            return true;
+        }
+};
+
+///////////////////////////////////////////////////////////////////////
+// convert: colour conversion
+//      to          "gray" (kept as 3 equal channels) or "bgr"
+///////////////////////////////////////////////////////////////////////
+class ConvertNode : public PipelineNode
+{
+    private:
+        PipelineContext *m_context = nullptr;
+        bool m_gray = true;
+
+    public:
+        bool Configure(const JsonValue &config, PipelineContext &context, std::string &error) override
+        {
+            m_context = &context;
+            const std::string to = config.GetString("to", "gray");
+            if (!strcasecmp(to.c_str(), "gray") || !strcasecmp(to.c_str(), "grey"))
+                m_gray = true;
+            else if (!strcasecmp(to.c_str(), "bgr"))
+                m_gray = false;
+            else
+            {
+                error = "unknown conversion " + to;
+                return false;
+            }
+            return true;
+        }
+
+        bool PixelNeed(const PipelineFrame &frame, int &width, int &height) override
+        {
+            (void)frame;
+            width = height = 0;     // Full size
+            return true;
+        }
+
+        bool Process(const FramePtr &in, FramePtr &out) override
+        {
+            std::shared_ptr<const Image> src = FramePixels(*in, m_context->images);
+            if (!src)
+            {
+                return false;
+            }
+            std::shared_ptr<Image> dst = m_context->images.Acquire();
+            dst->Resize(src->GetWidth(), src->GetHeight());
+
+            const uint8_t *s = src->m_data;
+            uint8_t *d = dst->m_data;
+            const size_t pixels = static_cast<size_t>(src->GetWidth()) * src->GetHeight();
+            for (size_t i = 0; i < pixels; i++, s += 3, d += 3)
+            {
+                if (m_gray)
+                {
+                    uint8_t y = static_cast<uint8_t>((77u * s[0] + 150u * s[1] + 29u * s[2]) >> 8);
+                    d[0] = d[1] = d[2] = y;
+                }
+                else
+                {
+                    d[0] = s[2];
+                    d[1] = s[1];
+                    d[2] = s[0];
+                }
+            }
+
+            auto frame = derive_frame(*in);
+            frame->image = dst;
+            out = frame;
+            return true;
+        }
+};
+
+///////////////////////////////////////////////////////////////////////
+// resize: scale the pixels
+//      width, height   target size, 0 keeps the aspect ratio from the other
+///////////////////////////////////////////////////////////////////////
+class ResizeNode : public PipelineNode
+{
+    private:
+        PipelineContext *m_context = nullptr;
+        int m_width = 0;
+        int m_height = 0;
+
+    public:
+        bool Configure(const JsonValue &config, PipelineContext &context, std::string &error) override
+        {
+            m_context = &context;
+            m_width = static_cast<int>(config.GetNumber("width", 0));
+            m_height = static_cast<int>(config.GetNumber("height", 0));
+            if (m_width < 0 || m_height < 0 || (m_width == 0 && m_height == 0))
+            {
+                error = "resize needs width and/or height";
+                return false;
+            }
+            return true;
+        }
+
+        bool PixelNeed(const PipelineFrame &frame, int &width, int &height) override
+        {
+            (void)frame;
+            width = m_width;
+            height = m_height;
+            return true;
+        }
+
+        bool Process(const FramePtr &in, FramePtr &out) override
+        {
+            const int sw = static_cast<int>(in->width), sh = static_cast<int>(in->height);
+            if (sw <= 0 || sh <= 0)
+            {
+                return false;
+            }
+            int width = m_width, height = m_height;
+            if (width == 0)
+                width = std::max(1, static_cast<int>(static_cast<int64_t>(sw) * height / sh));
+            if (height == 0)
+                height = std::max(1, static_cast<int>(static_cast<int64_t>(sh) * width / sw));
+
+            // A JPEG only needs decoding to about the target size
+            std::shared_ptr<const Image> src = FramePixels(*in, m_context->images, width, height);
+            if (!src)
+            {
+                return false;
+            }
+
+            // Through the frame's pyramid: a level of the right size is
+            // passed on as is (sharing the source's lifetime), anything
+            // else is resized from the nearest level, and the levels are
+            // there for the next consumer of the same frame
+            std::shared_ptr<Image> dst = m_context->images.Acquire();
+            const Image *scaled = PyramidScaled(*src, width, height, *dst);
+            if (!scaled)
+            {
+                return false;
+            }
+
+            // Boxes follow the pixels
+            auto frame = derive_frame(*in);
+            const float sx = static_cast<float>(width) / static_cast<float>(sw);
+            const float sy = static_cast<float>(height) / static_cast<float>(sh);
+            for (Detection &det : frame->detections)
+            {
+                det.x *= sx;
+                det.width *= sx;
+                det.y *= sy;
+                det.height *= sy;
+            }
+            frame->width = static_cast<uint32_t>(width);
+            frame->height = static_cast<uint32_t>(height);
+            if (scaled == dst.get())
+                frame->image = dst;
+            else
+                frame->image = std::shared_ptr<const Image>(src, scaled);
+            out = frame;
+            return true;
+        }
+};
+
+///////////////////////////////////////////////////////////////////////
+// undistort: remove lens distortion
+//      fx, fy          focal lengths in pixels (required)
+//      cx, cy          principal point (frame centre)
+//      k1, k2, k3      radial distortion (0)
+//      p1, p2          tangential distortion (0)
+//      zoom            < 1 keeps more of the corners, > 1 crops (1)
+//      threads         remap threads, 0 for all cores (0)
+// NOTE:
+//      The calibration is OpenCV's. The map is built on the first frame
+//      and again only when the frame size changes. Detections are passed
+//      on unchanged, so run infer after this node.
+///////////////////////////////////////////////////////////////////////
+class UndistortNode : public PipelineNode
+{
+    private:
+        PipelineContext *m_context = nullptr;
+        CameraCalibration m_calibration;
+        bool m_centred = true;          // cx, cy not given
+        double m_zoom = 1.0;
+        std::unique_ptr<Remapper> m_remapper;
+
+    public:
+        bool Configure(const JsonValue &config, PipelineContext &context, std::string &error) override
+        {
+            m_context = &context;
+            m_calibration.fx = config.GetNumber("fx", 0.0);
+            m_calibration.fy = config.GetNumber("fy", 0.0);
+            m_centred = !config.Find("cx") && !config.Find("cy");
+            m_calibration.cx = config.GetNumber("cx", 0.0);
+            m_calibration.cy = config.GetNumber("cy", 0.0);
+            m_calibration.k1 = config.GetNumber("k1", 0.0);
+            m_calibration.k2 = config.GetNumber("k2", 0.0);
+            m_calibration.k3 = config.GetNumber("k3", 0.0);
+            m_calibration.p1 = config.GetNumber("p1", 0.0);
+            m_calibration.p2 = config.GetNumber("p2", 0.0);
+            m_zoom = config.GetNumber("zoom", 1.0);
+            const double threads = config.GetNumber("threads", 0);
+            if (m_calibration.fx <= 0.0 || m_calibration.fy <= 0.0)
+            {
+                error = "undistort needs fx and fy";
+                return false;
+            }
+            if (m_zoom <= 0.0 || threads < 0)
+            {
+                error = "zoom must be positive and threads not negative";
+                return false;
+            }
+            m_remapper.reset(new Remapper(static_cast<size_t>(threads)));
+            return true;
+        }
+
+        bool PixelNeed(const PipelineFrame &frame, int &width, int &height) override
+        {
+            (void)frame;
+            width = height = 0;     // Full size
+            return true;
+        }
+
+        bool Process(const FramePtr &in, FramePtr &out) override
+        {
+            const int width = static_cast<int>(in->width), height = static_cast<int>(in->height);
+            if (width != m_remapper->Width() || height != m_remapper->Height())
+            {
+                CameraCalibration calibration = m_calibration;
+                if (m_centred)
+                {
+                    calibration.cx = (width - 1) * 0.5;
+                    calibration.cy = (height - 1) * 0.5;
+                }
+                if (!m_remapper->SetUndistort(calibration, width, height, m_zoom))
+                {
+                    return false;
+                }
+            }
+
+            std::shared_ptr<const Image> src = FramePixels(*in, m_context->images);
+            if (!src)
+            {
+                return false;
+            }
+            std::shared_ptr<Image> dst = m_context->images.Acquire();
+            if (!m_remapper->Apply(*src, *dst))
+            {
+                return false;
+            }
+
+            auto frame = derive_frame(*in);
+            frame->image = dst;
+            out = frame;
+            return true;
+        }
+};
+
+///////////////////////////////////////////////////////////////////////
+// infer: run a model and attach its detections
+//      model       "motion": the motion gate, one detection per changed
+//                  region; frames it skips are not sent on
+//      max_skip, pixel_threshold, activity_threshold   motion gate tuning
+// NOTE:
+//      This is where a real detector plugs in: a frame in, detections out.
+///////////////////////////////////////////////////////////////////////
+class InferNode : public PipelineNode
+{
+    private:
+        PipelineContext *m_context = nullptr;
+        MotionGate m_gate;
+        MotionResult m_result;
+
+    public:
+        bool Configure(const JsonValue &config, PipelineContext &context, std::string &error) override
+        {
+            m_context = &context;
+            const std::string model = config.GetString("model", "motion");
+            if (model != "motion")
+            {
+                error = "unknown model " + model + " (available: motion)";
+                return false;
+            }
+            m_gate.maxSkip = static_cast<int>(config.GetNumber("max_skip", m_gate.maxSkip));
+            m_gate.pixelThreshold = static_cast<uint8_t>(config.GetNumber("pixel_threshold", m_gate.pixelThreshold));
+            m_gate.activityThreshold = config.GetNumber("activity_threshold", m_gate.activityThreshold);
+            return true;
+        }
+
+        bool PixelNeed(const PipelineFrame &frame, int &width, int &height) override
+        {
+            (void)frame;
+            width = m_gate.thumbWidth * m_gate.sampleStep;
+            height = 0;
+            return true;
+        }
+
+        bool Process(const FramePtr &in, FramePtr &out) override
+        {
+            // The gate samples a thumbnail, a reduced decode is plenty
+            std::shared_ptr<const Image> image = FramePixels(*in, m_context->images,
+                m_gate.thumbWidth * m_gate.sampleStep, 0);
+            if (!image)
+            {
+                return false;
+            }
+            if (!m_gate.Process(*image, m_result))
+            {
+                return true;    // Nothing changed, nothing to report
+            }
+
+            // Regions come in the pixels' coordinates, boxes are in the frame's
+            auto frame = derive_frame(*in);
+            if (image->GetWidth() == static_cast<int>(in->width) &&
+                image->GetHeight() == static_cast<int>(in->height))
+            {
+                frame->image = image;
+            }
+            frame->encoding = in->encoding;
+            frame->payload = in->payload;
+            frame->detections.clear();
+            const float sx = static_cast<float>(in->width) / static_cast<float>(image->GetWidth());
+            const float sy = static_cast<float>(in->height) / static_cast<float>(image->GetHeight());
+            for (const MotionRegion &region : m_result.regions)
+            {
+                Detection det;
+                det.x = static_cast<float>(region.x) * sx;
+                det.y = static_cast<float>(region.y) * sy;
+                det.width = static_cast<float>(region.width) * sx;
+                det.height = static_cast<float>(region.height) * sy;
+                det.score = static_cast<float>(std::min(1.0, m_result.activity / m_gate.activityThreshold));
+                frame->detections.push_back(det);
+            }
+            out = frame;
+            return true;
+        }
+};
+
+///////////////////////////////////////////////////////////////////////
+// encode: compress the pixels
+//      format      "jpeg" or "png" ("jpeg")
+//      quality     JPEG quality (80)
+///////////////////////////////////////////////////////////////////////
+class EncodeNode : public PipelineNode
+{
+    private:
+        PipelineContext *m_context = nullptr;
+        ImageFormat m_format = ImageFormat::JPEG;
+        FrameEncoding m_encoding = FrameEncoding::JPEG;
+        int m_quality = 80;
+
+    public:
+        bool Configure(const JsonValue &config, PipelineContext &context, std::string &error) override
+        {
+            m_context = &context;
+            const std::string format = config.GetString("format", "jpeg");
+            m_format = Image::FormatFromPath("." + format);
+            if (m_format == ImageFormat::JPEG)
+                m_encoding = FrameEncoding::JPEG;
+            else if (m_format == ImageFormat::PNG)
+                m_encoding = FrameEncoding::PNG;
+            else
+            {
+                error = "can't send " + format + " frames (jpeg or png)";
+                return false;
+            }
+            m_quality = static_cast<int>(config.GetNumber("quality", 80));
+            if (m_quality < 1 || m_quality > 100)
+            {
+                error = "quality must be 1..100";
+                return false;
+            }
+            return true;
+        }
+
+        bool PixelNeed(const PipelineFrame &frame, int &width, int &height) override
+        {
+            width = height = 0;
+            return !frame.payload || frame.encoding != m_encoding;
+        }
+
+        bool ForwardsInput() const override { return true; }
+
+        bool Process(const FramePtr &in, FramePtr &out) override
+        {
+            // Already encoded this way (a replayed recording): pass it on
+            if (in->payload && in->encoding == m_encoding)
+            {
+                out = in;
+                return true;
+            }
+            std::shared_ptr<const Image> image = FramePixels(*in, m_context->images);
+            auto payload = std::make_shared<std::vector<uint8_t>>();
+            if (!image || !image->Encode(*payload, m_format, m_quality))
+            {
+                return false;
+            }
+
+            auto frame = derive_frame(*in);
+            frame->image = image;
+            frame->encoding = m_encoding;
+            frame->payload = payload;
+            out = frame;
+            return true;
+        }
+};
+
+///////////////////////////////////////////////////////////////////////
+// orient: rotate, flip or crop JPEG frames without re-encoding them
+//      rotate      0, 90, 180 or 270 degrees clockwise (0)
+//      flip        "horizontal" or "vertical", instead of rotate ("")
+//      crop        [x, y, width, height] of the frame to keep, applied
+//                  first; the corner snaps to the 8 or 16 pixel MCU grid
+// NOTE:
+//      For a camera mounted sideways or upside down. The payload's DCT
+//      blocks are moved, see Image::TransformJPEG(), and detections are
+//      moved with them.
+///////////////////////////////////////////////////////////////////////
+class OrientNode : public PipelineNode
+{
+    private:
+        JPEGTransform m_transform;
+
+        // Detection in the source frame to the transformed one
+        static Detection orient_detection(Detection det, const JPEGTransform &applied)
+        {
+            const float width = static_cast<float>(applied.cropWidth);
+            const float height = static_cast<float>(applied.cropHeight);
+            det.x -= static_cast<float>(applied.cropX);
+            det.y -= static_cast<float>(applied.cropY);
+            const Detection in = det;
+            switch (applied.type)
+            {
+                case JPEGTransformType::Rotate90:
+                    det.x = height - in.y - in.height;
+                    det.y = in.x;
+                    det.width = in.height;
+                    det.height = in.width;
+                    break;
+                case JPEGTransformType::Rotate180:
+                    det.x = width - in.x - in.width;
+                    det.y = height - in.y - in.height;
+                    break;
+                case JPEGTransformType::Rotate270:
+                    det.x = in.y;
+                    det.y = width - in.x - in.width;
+                    det.width = in.height;
+                    det.height = in.width;
+                    break;
+                case JPEGTransformType::FlipHorizontal:
+                    det.x = width - in.x - in.width;
+                    break;
+                case JPEGTransformType::FlipVertical:
+                    det.y = height - in.y - in.height;
+                    break;
+                default:
+                    break;
+            }
+            return det;
+        }
+
+    public:
+        bool Configure(const JsonValue &config, PipelineContext &context, std::string &error) override
+        {
+            (void)context;
+            const int rotate = static_cast<int>(config.GetNumber("rotate", 0));
+            const std::string flip = config.GetString("flip", "");
+            if (rotate == 90)
+                m_transform.type = JPEGTransformType::Rotate90;
+            else if (rotate == 180)
+                m_transform.type = JPEGTransformType::Rotate180;
+            else if (rotate == 270)
+                m_transform.type = JPEGTransformType::Rotate270;
+            else if (rotate != 0)
+            {
+                error = "rotate must be 0, 90, 180 or 270";
+                return false;
+            }
+            if (!flip.empty() && rotate != 0)
+            {
+                error = "rotate or flip, not both";
+                return false;
+            }
+            if (flip == "horizontal")
+                m_transform.type = JPEGTransformType::FlipHorizontal;
+            else if (flip == "vertical")
+                m_transform.type = JPEGTransformType::FlipVertical;
+            else if (!flip.empty())
+            {
+                error = "flip must be horizontal or vertical";
+                return false;
+            }
+
+            const JsonValue *crop = config.Find("crop");
+            if (crop)
+            {
+                if (!crop->IsArray() || crop->array.size() != 4 || !crop->array[0].IsNumber() ||
+                    !crop->array[1].IsNumber() || !crop->array[2].IsNumber() || !crop->array[3].IsNumber())
+                {
+                    error = "crop is [x, y, width, height]";
+                    return false;
+                }
+                m_transform.cropX = static_cast<int>(crop->array[0].number);
+                m_transform.cropY = static_cast<int>(crop->array[1].number);
+                m_transform.cropWidth = static_cast<int>(crop->array[2].number);
+                m_transform.cropHeight = static_cast<int>(crop->array[3].number);
+            }
+            return true;
+        }
+
+        bool Process(const FramePtr &in, FramePtr &out) override
+        {
+            if (!in->payload || in->encoding != FrameEncoding::JPEG)
+            {
+                return false;   // Put an encode node in front
+            }
+            auto payload = std::make_shared<std::vector<uint8_t>>();
+            JPEGTransform applied;
+            if (!Image::TransformJPEG(in->payload->data(), in->payload->size(), *payload,
+                    m_transform, &applied))
+            {
+                return false;
+            }
+
+            auto frame = derive_frame(*in);
+            const bool turned = applied.type == JPEGTransformType::Rotate90 ||
+                applied.type == JPEGTransformType::Rotate270;
+            frame->width = static_cast<uint32_t>(turned ? applied.cropHeight : applied.cropWidth);
+            frame->height = static_cast<uint32_t>(turned ? applied.cropWidth : applied.cropHeight);
+            frame->encoding = FrameEncoding::JPEG;
+            frame->payload = payload;
+            for (Detection &det : frame->detections)
+            {
+                det = orient_detection(det, applied);
+            }
+            out = frame;
+            return true;
+        }
+};
+
+///////////////////////////////////////////////////////////////////////
+// publish: send frames to subscribers
+//      topic       FrameBus topic (node name)
+//      tcp_port    also serve the topic over TCP, 0 = any port (off)
+//      shm         also write frames to this shared memory ring (off)
+//      shm_slots   ring size (4)
+//      shm_max_bytes   largest payload a slot holds (0: the worst case
+//                  for the first frame's size, raw RGB plus a quarter for
+//                  an encoding that grows; frames beyond it are errors)
+///////////////////////////////////////////////////////////////////////
+class PublishNode : public PipelineNode
+{
+    private:
+        std::unique_ptr<Publisher> m_publisher;
+        std::unique_ptr<TcpFrameServer> m_server;
+        ShmFrameWriter m_shm;
+        std::string m_shmName;
+        uint32_t m_shmSlots = 4;
+        size_t m_shmMaxBytes = 0;
+        FrameMessage m_message;
+
+    public:
+        ~PublishNode() override
+        {
+            if (m_server) m_server->Stop();
+        }
+
+        bool Configure(const JsonValue &config, PipelineContext &context, std::string &error) override
+        {
+            const std::string topic = config.GetString("topic", config.GetString("name", ""));
+            m_publisher.reset(new Publisher(context.bus, topic));
+
+            int port = static_cast<int>(config.GetNumber("tcp_port", -1));
+            if (port >= 0)
+            {
+                m_server.reset(new TcpFrameServer(context.bus));
+                if (!m_server->Start(static_cast<uint16_t>(port)))
+                {
+                    error = "can't listen on tcp port " + std::to_string(port);
+                    return false;
+                }
+                printf("serving %s on tcp port %u\n", topic.c_str(), m_server->Port());
+            }
+            m_shmName = config.GetString("shm", "");
+            m_shmSlots = static_cast<uint32_t>(std::max(2.0, config.GetNumber("shm_slots", 4)));
+            const double maxBytes = config.GetNumber("shm_max_bytes", 0);
+            if (maxBytes < 0)
+            {
+                error = "shm_max_bytes must not be negative";
+                return false;
+            }
+            m_shmMaxBytes = static_cast<size_t>(maxBytes);
+            return true;
+        }
+
+        bool Process(const FramePtr &in, FramePtr &out) override
+        {
+            (void)out;      // Sink
+            m_message.sequence = in->sequence;
+            m_message.timestampUs = in->timestampUs;
+            m_message.width = in->width;
+            m_message.height = in->height;
+            m_message.streamId = in->streamId;
+            m_message.detections = in->detections;
+            if (in->payload)
+            {
+                m_message.encoding = in->encoding;
+                m_message.payload.assign(in->payload->begin(), in->payload->end());
+            }
+            else if (in->image)
+            {
+                m_message.encoding = FrameEncoding::RawRGB;
+                m_message.payload.assign(in->image->m_data,
+                    in->image->m_data + in->image->GetBufferSize());
+            }
+            else
+            {
+                return false;
+            }
+            m_publisher->Publish(m_message);
+
+            if (m_shmName.empty())
+            {
+                return true;
+            }
+            // Slots fit the worst case for the first frame's size, not its
+            // payload: a flat startup frame compresses far better than the
+            // ones after it. The ring carries pixels when the frame has them.
+            if (m_shm.Name().empty())
+            {
+                const size_t raw = static_cast<size_t>(in->width) * in->height * 3;
+                size_t bytes = m_shmMaxBytes;
+                if (bytes == 0)
+                {
+                    bytes = in->image ? std::max(raw, static_cast<size_t>(in->image->GetBufferSize()))
+                        : raw + raw / 4 + 65536;
+                }
+                bytes = std::max(bytes, m_message.payload.size());
+                if (!m_shm.Create(m_shmName, m_shmSlots, bytes, in->streamId))
+                {
+                    m_shmName.clear();
+                    return false;
+                }
+            }
+            return in->image ? m_shm.Publish(m_message, *in->image) : m_shm.Publish(m_message);
+        }
+};
+
+///////////////////////////////////////////////////////////////////////
+// simulcast: publish the pixels at several resolutions
+//      topic       layer topics are <topic>/<layer name> (node name)
+//      layers      [{"name": "720p", "width": 0, "height": 720,
+//                    "quality": 80}, ...], 0 keeps the aspect ratio
+//      threads     encode threads, 0 = all cores (0)
+//      tcp_port    also serve the layers over TCP, 0 = any port (off)
+///////////////////////////////////////////////////////////////////////
+class SimulcastNode : public PipelineNode
+{
+    private:
+        PipelineContext *m_context = nullptr;
+        std::unique_ptr<SimulcastPublisher> m_publisher;
+        std::unique_ptr<TcpFrameServer> m_server;
+        FrameMessage m_meta;
+
+    public:
+        ~SimulcastNode() override
+        {
+            if (m_server) m_server->Stop();
+        }
+
+        bool Configure(const JsonValue &config, PipelineContext &context, std::string &error) override
+        {
+            m_context = &context;
+            const std::string topic = config.GetString("topic", config.GetString("name", ""));
+            const size_t threads = static_cast<size_t>(std::max(0.0, config.GetNumber("threads", 0)));
+            m_publisher.reset(new SimulcastPublisher(context.bus, topic, threads));
+
+            const JsonValue *layers = config.Find("layers");
+            if (!layers || !layers->IsArray() || layers->array.empty())
+            {
+                error = "simulcast needs a \"layers\" array";
+                return false;
+            }
+            for (const JsonValue &layerConfig : layers->array)
+            {
+                SimulcastLayer layer;
+                layer.name = layerConfig.GetString("name", "");
+                layer.width = static_cast<int>(layerConfig.GetNumber("width", 0));
+                layer.height = static_cast<int>(layerConfig.GetNumber("height", 0));
+                layer.quality = static_cast<int>(layerConfig.GetNumber("quality", 80));
+                if (!m_publisher->AddLayer(layer))
+                {
+                    error = "bad or duplicate layer \"" + layer.name + "\"";
+                    return false;
+                }
+            }
+
+            int port = static_cast<int>(config.GetNumber("tcp_port", -1));
+            if (port >= 0)
+            {
+                m_server.reset(new TcpFrameServer(context.bus));
+                if (!m_server->Start(static_cast<uint16_t>(port)))
+                {
+                    error = "can't listen on tcp port " + std::to_string(port);
+                    return false;
+                }
+                printf("serving %s/* on tcp port %u\n", topic.c_str(), m_server->Port());
+            }
+            return true;
+        }
+
+        bool PixelNeed(const PipelineFrame &frame, int &width, int &height) override
+        {
+            if (!m_publisher->HasSubscribers())
+            {
+                return false;
+            }
+            m_publisher->LargestLayer(static_cast<int>(frame.width), static_cast<int>(frame.height),
+                width, height);
+            return true;
+        }
+
+        bool Process(const FramePtr &in, FramePtr &out) override
+        {
+            (void)out;      // Sink
+            m_meta.sequence = in->sequence;
+            m_meta.timestampUs = in->timestampUs;
+            m_meta.streamId = in->streamId;
+            m_meta.width = in->width;
+            m_meta.height = in->height;
+            m_meta.detections = in->detections;
+            if (!m_publisher->HasSubscribers())
+            {
+                return true;    // Don't decode for nobody
+            }
+
+            // A JPEG only needs decoding to the biggest layer's size
+            int width, height;
+            m_publisher->LargestLayer(static_cast<int>(in->width), static_cast<int>(in->height),
+                width, height);
+            return m_publisher->Publish(m_meta, FramePixels(*in, m_context->images, width, height));
+        }
+};
+
+///////////////////////////////////////////////////////////////////////
+// record: write JPEG frames to a segmented recording
+//      prefix              segment path prefix (node name)
+//      segment_mb          roll over after this many MB (1024)
+//      segment_seconds     roll over after this long, 0 = never (0)
+///////////////////////////////////////////////////////////////////////
+class RecordNode : public PipelineNode
+{
+    private:
+        std::unique_ptr<Recorder> m_recorder;
+
+    public:
+        bool Configure(const JsonValue &config, PipelineContext &context, std::string &error) override
+        {
+            (void)context;
+            uint64_t bytes = static_cast<uint64_t>(config.GetNumber("segment_mb", 1024) * 1024 * 1024);
+            m_recorder.reset(new Recorder(bytes, config.GetNumber("segment_seconds", 0.0)));
+            const std::string prefix = config.GetString("prefix", config.GetString("name", ""));
+            if (!m_recorder->Open(prefix))
+            {
+                error = "can't record to " + prefix;
+                return false;
+            }
+            return true;
+        }
+
+        bool Process(const FramePtr &in, FramePtr &out) override
+        {
+            (void)out;      // Sink
+            if (!in->payload || in->encoding != FrameEncoding::JPEG)
+            {
+                return false;   // Put an encode node in front
+            }
+            return m_recorder->Write(in->sequence, in->timestampUs, in->width, in->height,
+                in->payload->data(), in->payload->size(), in->detections);
+        }
+
+        void Finish() override
+        {
+            m_recorder->Close();
+        }
+};
+
+///////////////////////////////////////////////////////////////////////
+// snapshot: save encoded frames as individual files
+//      prefix          files are <prefix>-<sequence>.jpg or .png (node name)
+//      events_only     only frames with detections (true)
+//      max_inflight_mb writes queued or in progress; frames beyond it are
+//                      dropped, not waited for (64)
+//      backend         "auto" (io_uring if available) or "threads" ("auto")
+// NOTE:
+//      Files are written by an AsyncWriter, so a burst of events never
+//      stalls the graph on the disk.
+///////////////////////////////////////////////////////////////////////
+class SnapshotNode : public PipelineNode
+{
+    private:
+        std::unique_ptr<AsyncWriter> m_writer;
+        std::string m_prefix;
+        bool m_eventsOnly = true;
+
+    public:
+        bool Configure(const JsonValue &config, PipelineContext &context, std::string &error) override
+        {
+            (void)context;
+            m_prefix = config.GetString("prefix", config.GetString("name", ""));
+            m_eventsOnly = config.GetBool("events_only", true);
+
+            AsyncWriter::Options options;
+            options.maxInFlightBytes = static_cast<size_t>(config.GetNumber("max_inflight_mb", 64) * 1024 * 1024);
+            const std::string backend = config.GetString("backend", "auto");
+            if (backend == "threads")
+                options.backend = AsyncWriter::Backend::Threads;
+            else if (backend != "auto")
+            {
+                error = "unknown snapshot backend " + backend;
+                return false;
+            }
+            if (m_prefix.empty() || options.maxInFlightBytes == 0)
+            {
+                error = "snapshot needs a prefix and max_inflight_mb";
+                return false;
+            }
+            m_writer.reset(new AsyncWriter(options));
+            return true;
+        }
+
+        bool Process(const FramePtr &in, FramePtr &out) override
+        {
+            (void)out;      // Sink
+            if (m_eventsOnly && in->detections.empty())
+            {
+                return true;
+            }
+            if (!in->payload || (in->encoding != FrameEncoding::JPEG && in->encoding != FrameEncoding::PNG))
+            {
+                return false;   // Put an encode node in front
+            }
+            const std::string path = m_prefix + "-" + std::to_string(in->sequence) +
+                (in->encoding == FrameEncoding::PNG ? ".png" : ".jpg");
+            m_writer->Write(path, in->payload);     // Over budget: counted and dropped
+            return true;
+        }
+
+        void Finish() override
+        {
+            m_writer->Flush();
+        }
+};
+
+///////////////////////////////////////////////////////////////////////
+// Node factory
+///////////////////////////////////////////////////////////////////////
+struct node_type
+{
+    const char *name;
+    std::unique_ptr<PipelineNode> (*create)();
+};
+
+template <typename T>
+static std::unique_ptr<PipelineNode> make_node()
+{
+    return std::unique_ptr<PipelineNode>(new T());
+}
+
+static const node_type kNodeTypes[] = {
+    {"source",  make_node<SourceNode>},
+    {"convert", make_node<ConvertNode>},
+    {"resize",  make_node<ResizeNode>},
+    {"undistort", make_node<UndistortNode>},
+    {"infer",   make_node<InferNode>},
+    {"encode",  make_node<EncodeNode>},
+    {"orient",  make_node<OrientNode>},
+    {"publish", make_node<PublishNode>},
+    {"simulcast", make_node<SimulcastNode>},
+    {"record",  make_node<RecordNode>},
+    {"snapshot", make_node<SnapshotNode>},
+};
+
+static const node_type *find_node_type(const std::string &type)
+{
+    for (const node_type &entry : kNodeTypes)
+    {
+        if (type == entry.name)
+        {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+std::unique_ptr<PipelineNode> PipelineNode::Create(const std::string &type)
+{
+    const node_type *entry = find_node_type(type);
+    return entry ? entry->create() : nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Pipeline constructor
+///////////////////////////////////////////////////////////////////////
+Pipeline::Pipeline() : m_images(32), m_running(false), m_context{m_bus, m_images, m_running} {}
+
+Pipeline::~Pipeline()
+{
+    Stop();
+}
+
+Pipeline::NodeState *Pipeline::find(const std::string &name)
+{
+    for (auto &state : m_nodes)
+    {
+        if (state->name == name)
+        {
+            return state.get();
+        }
+    }
+    return nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Build the graph from its config
+///////////////////////////////////////////////////////////////////////
+bool Pipeline::Load(const JsonValue &config, std::string &error)
+{
+    if (!m_nodes.empty())
+    {
+        error = "pipeline already loaded";
+        return false;
+    }
+
+    const JsonValue *nodes = config.Find("nodes");
+    const JsonValue *edges = config.Find("edges");
+    if (!nodes || !nodes->IsArray() || nodes->array.empty())
+    {
+        error = "config needs a \"nodes\" array";
+        return false;
+    }
+
+    // Nodes are configured as they are read, so resources (ports, files)
+    // are claimed before anything runs
+    for (const JsonValue &nodeConfig : nodes->array)
+    {
+        const std::string name = nodeConfig.GetString("name", "");
+        const std::string type = nodeConfig.GetString("type", "");
+        if (name.empty() || find(name))
+        {
+            error = name.empty() ? "node without a name" : "duplicate node " + name;
+            return false;
+        }
+
+        std::unique_ptr<NodeState> state(new NodeState());
+        state->name = name;
+        state->type = type;
+        state->node = PipelineNode::Create(type);
+        if (!state->node)
+        {
+            error = "node " + name + ": unknown type \"" + type + "\"";
+            return false;
+        }
+        std::string nodeError;
+        if (!state->node->Configure(nodeConfig, m_context, nodeError))
+        {
+            error = "node " + name + ": " + (nodeError.empty() ? "bad config" : nodeError);
+            return false;
+        }
+        m_nodes.push_back(std::move(state));
+    }
+
+    if (edges && !edges->IsArray())
+    {
+        error = "\"edges\" must be an array";
+        return false;
+    }
+    for (const JsonValue &edgeConfig : edges ? edges->array : std::vector<JsonValue>())
+    {
+        const std::string from = edgeConfig.GetString("from", "");
+        const std::string to = edgeConfig.GetString("to", "");
+        NodeState *source = find(from);
+        NodeState *target = find(to);
+        if (!source || !target)
+        {
+            error = "edge " + from + " -> " + to + ": no such node";
+            return false;
+        }
+        if (target->node->IsSource() || target->input)
+        {
+            error = "edge " + from + " -> " + to + ": " + to +
+                (target->input ? " already has an input" : " is a source");
+            return false;
+        }
+
+        const double depth = edgeConfig.GetNumber("depth", 4);
+        const double maxFps = edgeConfig.GetNumber("max_fps", 0.0);
+        if (depth < 1 || maxFps < 0.0)
+        {
+            error = "edge " + from + " -> " + to + ": bad depth or max_fps";
+            return false;
+        }
+        m_edges.emplace_back(new PipelineEdge(from, to, static_cast<size_t>(depth), maxFps));
+        target->input = m_edges.back().get();
+        source->outputs.push_back(m_edges.back().get());
+    }
+
+    // With one input per node, anything a source can't reach is either
+    // unconnected or part of a cycle
+    std::vector<NodeState *> reached;
+    for (auto &state : m_nodes)
+    {
+        if (state->node->IsSource())
+            reached.push_back(state.get());
+    }
+    if (reached.empty())
+    {
+        error = "no source node";
+        return false;
+    }
+    for (size_t i = 0; i < reached.size(); i++)
+    {
+        for (PipelineEdge *edge : reached[i]->outputs)
+        {
+            reached.push_back(find(edge->to));
+        }
+    }
+    for (auto &state : m_nodes)
+    {
+        if (std::find(reached.begin(), reached.end(), state.get()) == reached.end())
+        {
+            error = "node " + state->name + " is not fed by any source";
+            return false;
+        }
+    }
+
+    // Who reads each node's frames, so the first decode of a frame can
+    // serve them all
+    for (auto &state : m_nodes)
+    {
+        auto readers = std::make_shared<std::vector<PipelineNode *>>();
+        collectReaders(state.get(), *readers);
+        state->readers = readers;
+    }
+    return true;
+}
+
+// Nodes fed by state, and through nodes that pass frames on as they are,
+// the nodes fed by those
+void Pipeline::collectReaders(NodeState *state, std::vector<PipelineNode *> &readers)
+{
+    for (PipelineEdge *edge : state->outputs)
+    {
+        NodeState *target = find(edge->to);
+        readers.push_back(target->node.get());
+        if (target->node->ForwardsInput())
+        {
+            collectReaders(target, readers);
+        }
+    }
+}
+
+bool Pipeline::LoadFile(const std::string &path, std::string &error)
+{
+    JsonValue config;
+    return JsonValue::ParseFile(path, config, error) && Load(config, error);
+}
+
+bool Pipeline::SetTap(const std::string &node, std::function<void(const FramePtr &)> tap)
+{
+    NodeState *state = find(node);
+    if (!state || state->thread.joinable())
+    {
+        return false;
+    }
+    state->tap = std::move(tap);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Threads
+///////////////////////////////////////////////////////////////////////
+void Pipeline::Start()
+{
+    if (m_running || m_nodes.empty())
+    {
+        return;
+    }
+    m_running = true;
+    for (auto &state : m_nodes)
+    {
+        state->thread = std::thread(&Pipeline::run, this, state.get());
+    }
+}
+
+void Pipeline::emit(NodeState *state, const FramePtr &frame)
+{
+    // Set before anyone else sees the frame; a forwarded frame keeps the
+    // readers of the node that first sent it, which include this node's
+    if (!frame->readers)
+    {
+        frame->readers = state->readers;
+    }
+    if (state->tap)
+    {
+        state->tap(frame);
+    }
+    for (PipelineEdge *edge : state->outputs)
+    {
+        edge->Push(frame);
+    }
+}
+
+void Pipeline::run(NodeState *state)
+{
+    TRACE_THREAD_NAME(state->name.c_str());
+    const char *traceName = find_node_type(state->type)->name;    // Static, outlives the trace
+    (void)traceName;
+    FramePtr frame;
+
+    if (state->node->IsSource())
+    {
+        for (;;)
+        {
+            uint64_t t0 = NowMicros();
+            bool ok = state->node->Produce(frame);
+            if (!ok)
+            {
+                break;
+            }
+            {
+                std::lock_guard<std::mutex> lock(state->statsMutex);
+                state->latency.Add(static_cast<double>(NowMicros() - t0));
+                state->frames++;
+            }
+            TRACE_SCOPE_FRAME(traceName, frame->sequence);    // Starts the frame's flow
+            emit(state, frame);
+        }
+    }
+    else
+    {
+        FramePtr out;
+        while (state->input->Pop(frame))
+        {
+            uint64_t t0 = NowMicros();
+            bool ok;
+            {
+                TRACE_SCOPE_FRAME(traceName, frame->sequence);
+                out.reset();
+                ok = state->node->Process(frame, out);
+            }
+            {
+                std::lock_guard<std::mutex> lock(state->statsMutex);
+                state->latency.Add(static_cast<double>(NowMicros() - t0));
+                state->frames++;
+                state->errors += !ok;
+            }
+            frame.reset();
+            if (out)
+            {
+                emit(state, out);
+            }
+        }
+    }
+
+    state->node->Finish();
+    for (PipelineEdge *edge : state->outputs)
+    {
+        edge->Close();
+    }
+    std::lock_guard<std::mutex> lock(state->statsMutex);
+    state->finished = true;
+}
+
+void Pipeline::Stop()
+{
+    m_running = false;
+    Wait();
+}
+
+void Pipeline::Wait()
+{
+    for (auto &state : m_nodes)
+    {
+        if (state->thread.joinable())
+        {
+            state->thread.join();
+        }
+    }
+}
+
+bool Pipeline::Finished()
+{
+    for (auto &state : m_nodes)
+    {
+        std::lock_guard<std::mutex> lock(state->statsMutex);
+        if (!state->finished)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Per-node statistics
+///////////////////////////////////////////////////////////////////////
+std::vector<PipelineNodeStats> Pipeline::Stats()
+{
+    std::vector<PipelineNodeStats> stats;
+    for (auto &state : m_nodes)
+    {
+        PipelineNodeStats s;
+        s.name = state->name;
+        s.type = state->type;
+        s.dropped = state->input ? state->input->Dropped() : 0;
+        s.limited = state->input ? state->input->Limited() : 0;
+
+        std::lock_guard<std::mutex> lock(state->statsMutex);
+        s.frames = state->frames;
+        s.errors = state->errors;
+        s.meanUs = state->latency.Mean();
+        s.p99Us = state->latency.Percentile(99.0);
+        s.finished = state->finished;
+        stats.push_back(s);
+    }
+    return stats;
+}
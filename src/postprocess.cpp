@@ -0,0 +1,346 @@
+// Includes
+#include <algorithm>   // for std::nth_element, std::sort
+#include <cmath>       // for std::exp, std::log
+#include <limits>
+
+#include "postprocess.h"
+#include "trace.h"
+
+///////////////////////////////////////////////////////////////////////
+// SIMD helpers
+// NOTE:
+//      GCC/Clang vector extensions compile to SSE on x86 and NEON on the
+//      Jetson, so the IoU kernel is written once for both.
+///////////////////////////////////////////////////////////////////////
+typedef float v4f __attribute__((vector_size(16)));
+typedef int32_t v4i __attribute__((vector_size(16)));
+
+static const int kLanes = 4;
+
+static inline v4f load4(const float *p)
+{
+    v4f v;
+    __builtin_memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline v4i load4(const int32_t *p)
+{
+    v4i v;
+    __builtin_memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline v4f vmax(v4f a, v4f b) { return a > b ? a : b; }
+static inline v4f vmin(v4f a, v4f b) { return a < b ? a : b; }
+
+static inline bool any(v4i mask)
+{
+    return (mask[0] | mask[1] | mask[2] | mask[3]) != 0;
+}
+
+static inline float sigmoid(float x)
+{
+    return 1.0f / (1.0f + std::exp(-x));
+}
+
+///////////////////////////////////////////////////////////////////////
+// Intersection over union
+///////////////////////////////////////////////////////////////////////
+float IoU(const Detection &a, const Detection &b)
+{
+    float ix = std::min(a.x + a.width, b.x + b.width) - std::max(a.x, b.x);
+    float iy = std::min(a.y + a.height, b.y + b.height) - std::max(a.y, b.y);
+    if (ix <= 0.0f || iy <= 0.0f)
+    {
+        return 0.0f;
+    }
+    float inter = ix * iy;
+    float uni = a.width * a.height + b.width * b.height - inter;
+    return uni > 0.0f ? inter / uni : 0.0f;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Decode one detection head
+///////////////////////////////////////////////////////////////////////
+size_t Postprocessor::Decode(const float *output, const GridLayout &layout,
+    const InputTransform &transform, std::vector<Detection> &out) const
+{
+    TRACE_SCOPE("postprocess decode");
+    const int numAnchors = layout.anchors.empty() ? 1 : static_cast<int>(layout.anchors.size());
+    const int boxFields = layout.hasObjectness ? 5 : 4;
+    const int rowSize = boxFields + layout.numClasses;
+    const float invScale = transform.scale > 0.0f ? 1.0f / transform.scale : 1.0f;
+    const float threshold = std::max(scoreThreshold, 1e-6f);
+
+    // Reject on the raw logit where possible, it avoids an exp per row
+    const float logitThreshold = layout.applySigmoid
+        ? std::log(threshold / (1.0f - std::min(threshold, 0.999999f)))
+        : threshold;
+
+    const size_t before = out.size();
+    const float *row = output;
+
+    for (int a = 0; a < numAnchors; a++)
+    {
+        for (int gy = 0; gy < layout.gridHeight; gy++)
+        {
+            for (int gx = 0; gx < layout.gridWidth; gx++, row += rowSize)
+            {
+                float objectness = 1.0f;
+                if (layout.hasObjectness)
+                {
+                    if (row[4] < logitThreshold)
+                    {
+                        continue;   // Score can only get lower
+                    }
+                    objectness = layout.applySigmoid ? sigmoid(row[4]) : row[4];
+                }
+
+                // Best class
+                const float *classes = row + boxFields;
+                int best = 0;
+                for (int c = 1; c < layout.numClasses; c++)
+                {
+                    if (classes[c] > classes[best]) best = c;
+                }
+                float classScore = layout.numClasses > 0 ? classes[best] : 1.0f;
+                if (layout.applySigmoid && layout.numClasses > 0)
+                {
+                    classScore = sigmoid(classScore);
+                }
+
+                float score = objectness * classScore;
+                if (score < scoreThreshold)
+                {
+                    continue;
+                }
+
+                // Box centre and size in model input pixels
+                float cx, cy, w, h;
+                if (!layout.anchors.empty())
+                {
+                    const float stride = static_cast<float>(layout.stride);
+                    cx = (sigmoid(row[0]) * 2.0f - 0.5f + gx) * stride;
+                    cy = (sigmoid(row[1]) * 2.0f - 0.5f + gy) * stride;
+                    float sw = sigmoid(row[2]) * 2.0f;
+                    float sh = sigmoid(row[3]) * 2.0f;
+                    w = sw * sw * layout.anchors[a].first;
+                    h = sh * sh * layout.anchors[a].second;
+                }
+                else
+                {
+                    cx = row[0];
+                    cy = row[1];
+                    w = row[2];
+                    h = row[3];
+                }
+
+                // Back to frame coordinates, top-left corner
+                float x0 = (cx - 0.5f * w - transform.padX) * invScale;
+                float y0 = (cy - 0.5f * h - transform.padY) * invScale;
+                float x1 = (cx + 0.5f * w - transform.padX) * invScale;
+                float y1 = (cy + 0.5f * h - transform.padY) * invScale;
+                if (transform.frameWidth > 0.0f)
+                {
+                    x0 = std::min(std::max(x0, 0.0f), transform.frameWidth);
+                    x1 = std::min(std::max(x1, 0.0f), transform.frameWidth);
+                }
+                if (transform.frameHeight > 0.0f)
+                {
+                    y0 = std::min(std::max(y0, 0.0f), transform.frameHeight);
+                    y1 = std::min(std::max(y1, 0.0f), transform.frameHeight);
+                }
+                if (x1 <= x0 || y1 <= y0)
+                {
+                    continue;
+                }
+
+                Detection det;
+                det.x = x0;
+                det.y = y0;
+                det.width = x1 - x0;
+                det.height = y1 - y0;
+                det.score = score;
+                det.classId = best;
+                out.push_back(det);
+            }
+        }
+    }
+    return out.size() - before;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Copy candidates into the structure of arrays used by the IoU kernel
+// NOTE:
+//      With classAware every class gets its own id, otherwise they all
+//      share class 0 so every box competes with every other box.
+///////////////////////////////////////////////////////////////////////
+void Postprocessor::loadCandidates(const std::vector<Detection> &detections, bool classAware)
+{
+    const size_t n = detections.size();
+    const size_t padded = (n + kLanes - 1) / kLanes * kLanes;
+
+    m_x1.resize(padded);
+    m_y1.resize(padded);
+    m_x2.resize(padded);
+    m_y2.resize(padded);
+    m_area.resize(padded);
+    m_score.resize(padded);
+    m_class.resize(padded);
+    m_keep.assign(n, 1);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        const Detection &det = detections[i];
+        m_x1[i] = det.x;
+        m_y1[i] = det.y;
+        m_x2[i] = det.x + det.width;
+        m_y2[i] = det.y + det.height;
+        m_area[i] = det.width * det.height;
+        m_score[i] = det.score;
+        m_class[i] = classAware ? det.classId : 0;
+    }
+
+    // Padding lanes never suppress anything
+    for (size_t i = n; i < padded; i++)
+    {
+        m_x1[i] = m_y1[i] = m_x2[i] = m_y2[i] = m_area[i] = 0.0f;
+        m_score[i] = -std::numeric_limits<float>::infinity();
+        m_class[i] = -1;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Sort-free NMS
+// NOTE:
+//      Box i is dropped if ANY box j with (score_j, -j) > (score_i, -i)
+//      of the same class overlaps it by more than iouThreshold, whether
+//      or not j is itself dropped ("Fast NMS"). Every decision is
+//      independent, so there is no sort and the inner loop is a straight
+//      SIMD sweep. The IoU test is rearranged to avoid the division:
+//          inter / (a + b - inter) > t  <=>  inter * (1 + t) > t * (a + b)
+///////////////////////////////////////////////////////////////////////
+void Postprocessor::Suppress(std::vector<Detection> &detections)
+{
+    TRACE_SCOPE("nms");
+    const size_t n = detections.size();
+    if (n == 0 || maxDetections == 0)
+    {
+        detections.clear();
+        return;
+    }
+
+    loadCandidates(detections, classAware);
+
+    const size_t padded = m_x1.size();
+    const v4f onePlusT = {1.0f + iouThreshold, 1.0f + iouThreshold,
+        1.0f + iouThreshold, 1.0f + iouThreshold};
+    const v4f t = {iouThreshold, iouThreshold, iouThreshold, iouThreshold};
+    const v4f zero = {0.0f, 0.0f, 0.0f, 0.0f};
+    const v4i laneIndex = {0, 1, 2, 3};
+
+    for (size_t i = 0; i < n; i++)
+    {
+        const v4f x1 = {m_x1[i], m_x1[i], m_x1[i], m_x1[i]};
+        const v4f y1 = {m_y1[i], m_y1[i], m_y1[i], m_y1[i]};
+        const v4f x2 = {m_x2[i], m_x2[i], m_x2[i], m_x2[i]};
+        const v4f y2 = {m_y2[i], m_y2[i], m_y2[i], m_y2[i]};
+        const v4f area = {m_area[i], m_area[i], m_area[i], m_area[i]};
+        const v4f score = {m_score[i], m_score[i], m_score[i], m_score[i]};
+        const v4i cls = {m_class[i], m_class[i], m_class[i], m_class[i]};
+        const int32_t ii = static_cast<int32_t>(i);
+        const v4i self = {ii, ii, ii, ii};
+
+        for (size_t j = 0; j < padded; j += kLanes)
+        {
+            v4f w = vmin(x2, load4(&m_x2[j])) - vmax(x1, load4(&m_x1[j]));
+            v4f h = vmin(y2, load4(&m_y2[j])) - vmax(y1, load4(&m_y1[j]));
+            v4f inter = vmax(w, zero) * vmax(h, zero);
+
+            v4i overlaps = inter * onePlusT > t * (area + load4(&m_area[j]));
+            v4f otherScore = load4(&m_score[j]);
+            v4i index = laneIndex + static_cast<int32_t>(j);
+            v4i higher = (otherScore > score) | ((otherScore == score) & (index < self));
+            v4i sameClass = load4(&m_class[j]) == cls;
+
+            if (any(overlaps & higher & sameClass))
+            {
+                m_keep[i] = 0;
+                break;
+            }
+        }
+    }
+
+    // Compact survivors, keeping input order
+    size_t kept = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (m_keep[i])
+        {
+            detections[kept++] = detections[i];
+        }
+    }
+    detections.resize(kept);
+
+    // Cap the count, keeping the best scores (only partially ordered)
+    if (detections.size() > maxDetections)
+    {
+        m_scratch.assign(detections.begin(), detections.end());
+        std::nth_element(m_scratch.begin(), m_scratch.begin() + maxDetections, m_scratch.end(),
+            [](const Detection &a, const Detection &b) { return a.score > b.score; });
+        float cutoff = m_scratch[maxDetections - 1].score;
+
+        size_t out = 0, equalAllowed = 0;
+        for (size_t i = 0; i < maxDetections; i++)
+        {
+            if (m_scratch[i].score == cutoff) equalAllowed++;
+        }
+        for (size_t i = 0; i < detections.size(); i++)
+        {
+            float s = detections[i].score;
+            if (s > cutoff || (s == cutoff && equalAllowed > 0))
+            {
+                if (s == cutoff) equalAllowed--;
+                detections[out++] = detections[i];
+            }
+        }
+        detections.resize(out);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Greedy NMS: highest score first, each kept box removes the boxes it
+// overlaps
+///////////////////////////////////////////////////////////////////////
+void Postprocessor::SuppressGreedy(std::vector<Detection> &detections)
+{
+    if (maxDetections == 0)
+    {
+        detections.clear();
+        return;
+    }
+    std::stable_sort(detections.begin(), detections.end(),
+        [](const Detection &a, const Detection &b) { return a.score > b.score; });
+
+    m_scratch.clear();
+    for (const Detection &candidate : detections)
+    {
+        bool keep = true;
+        for (const Detection &kept : m_scratch)
+        {
+            if ((!classAware || kept.classId == candidate.classId) &&
+                IoU(kept, candidate) > iouThreshold)
+            {
+                keep = false;
+                break;
+            }
+        }
+        if (keep)
+        {
+            m_scratch.push_back(candidate);
+            if (m_scratch.size() >= maxDetections) break;
+        }
+    }
+    detections.assign(m_scratch.begin(), m_scratch.end());
+}
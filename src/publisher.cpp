@@ -0,0 +1,236 @@
+// Includes
+#include <algorithm>   // for std::find
+#include <chrono>
+
+#include "publisher.h"
+#include "trace.h"
+
+///////////////////////////////////////////////////////////////////////
+// Subscription constructor
+///////////////////////////////////////////////////////////////////////
+FrameBus::Subscription::Subscription(const std::string &topic, size_t depth)
+    : m_topic(topic), m_depth(depth > 0 ? depth : 1),
+      m_received(0), m_dropped(0), m_closed(false) {}
+
+///////////////////////////////////////////////////////////////////////
+// Queue a message, dropping the oldest one if the queue is full
+///////////////////////////////////////////////////////////////////////
+void FrameBus::Subscription::push(const Buffer &message)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_closed)
+        {
+            return;
+        }
+        if (m_queue.size() >= m_depth)
+        {
+            m_queue.pop_front();
+            m_dropped++;
+        }
+        m_queue.push_back(message);
+        m_received++;
+    }
+    m_ready.notify_one();
+}
+
+///////////////////////////////////////////////////////////////////////
+// Wait for the next message
+///////////////////////////////////////////////////////////////////////
+bool FrameBus::Subscription::Receive(Buffer &message, int timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto ready = [this] { return !m_queue.empty() || m_closed; };
+
+    if (timeoutMs < 0)
+    {
+        m_ready.wait(lock, ready);
+    }
+    else if (!m_ready.wait_for(lock, std::chrono::milliseconds(timeoutMs), ready))
+    {
+        return false;   // Timed out
+    }
+
+    if (m_queue.empty())
+    {
+        return false;   // Closed and drained
+    }
+    message = std::move(m_queue.front());
+    m_queue.pop_front();
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Close the subscription, waking any waiting Receive()
+///////////////////////////////////////////////////////////////////////
+void FrameBus::Subscription::Close()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+    }
+    m_ready.notify_all();
+}
+
+bool FrameBus::Subscription::IsClosed()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_closed;
+}
+
+std::string FrameBus::Subscription::Topic()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_topic;
+}
+
+uint64_t FrameBus::Subscription::Received()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_received;
+}
+
+uint64_t FrameBus::Subscription::Dropped()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dropped;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Subscribe to a topic
+///////////////////////////////////////////////////////////////////////
+std::shared_ptr<FrameBus::Subscription> FrameBus::Subscribe(
+    const std::string &topic, size_t depth)
+{
+    auto subscription = std::make_shared<Subscription>(topic, depth);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_topics[topic].push_back(subscription);
+    return subscription;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Remove a subscription from its topic
+///////////////////////////////////////////////////////////////////////
+void FrameBus::Unsubscribe(const std::shared_ptr<Subscription> &subscription)
+{
+    if (!subscription)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto topic = m_topics.find(subscription->Topic());
+        if (topic != m_topics.end())
+        {
+            auto &subs = topic->second;
+            subs.erase(std::remove(subs.begin(), subs.end(), subscription), subs.end());
+            if (subs.empty())
+            {
+                m_topics.erase(topic);
+            }
+        }
+    }
+    subscription->Close();
+}
+
+///////////////////////////////////////////////////////////////////////
+// Move a subscription to another topic
+///////////////////////////////////////////////////////////////////////
+void FrameBus::Switch(const std::shared_ptr<Subscription> &subscription, const std::string &topic)
+{
+    if (!subscription)
+    {
+        return;
+    }
+
+    // Lock order is bus then subscription, as in Publish()
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto current = m_topics.find(subscription->Topic());
+    if (current == m_topics.end())
+    {
+        return;     // Unsubscribed
+    }
+    auto &subs = current->second;
+    auto found = std::find(subs.begin(), subs.end(), subscription);
+    if (found == subs.end())
+    {
+        return;
+    }
+    subs.erase(found);
+    if (subs.empty())
+    {
+        m_topics.erase(current);
+    }
+    {
+        std::lock_guard<std::mutex> subscriptionLock(subscription->m_mutex);
+        subscription->m_topic = topic;
+    }
+    m_topics[topic].push_back(subscription);
+}
+
+size_t FrameBus::Subscribers(const std::string &topic)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_topics.find(topic);
+    return found == m_topics.end() ? 0 : found->second.size();
+}
+
+///////////////////////////////////////////////////////////////////////
+// Deliver a message to every subscriber of a topic
+///////////////////////////////////////////////////////////////////////
+size_t FrameBus::Publish(const std::string &topic, const Buffer &message)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto found = m_topics.find(topic);
+    if (found == m_topics.end())
+    {
+        return 0;   // Nobody is listening
+    }
+
+    for (auto &subscription : found->second)
+    {
+        subscription->push(message);
+    }
+    return found->second.size();
+}
+
+///////////////////////////////////////////////////////////////////////
+// Close every subscription
+///////////////////////////////////////////////////////////////////////
+void FrameBus::Close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &topic : m_topics)
+    {
+        for (auto &subscription : topic.second)
+        {
+            subscription->Close();
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Publisher constructor
+///////////////////////////////////////////////////////////////////////
+Publisher::Publisher(FrameBus &bus, const std::string &topic)
+    : m_bus(bus), m_topic(topic), m_published(0), m_bytes(0) {}
+
+///////////////////////////////////////////////////////////////////////
+// Serialize and publish a frame
+// NOTE:
+//      A new buffer is needed per message because subscribers may still
+//      hold the previous one.
+///////////////////////////////////////////////////////////////////////
+size_t Publisher::Publish(const FrameMessage &frame)
+{
+    TRACE_SCOPE_FRAME("publish", frame.sequence);
+    auto buffer = std::make_shared<std::vector<uint8_t>>();
+    SerializeFrame(frame, *buffer);
+
+    m_published++;
+    m_bytes += buffer->size();
+    return m_bus.Publish(m_topic, buffer);
+}
@@ -0,0 +1,317 @@
+// Includes
+#include <algorithm>   // for std::copy
+
+#include "receiver.h"
+#include "trace.h"
+
+// How often blocked threads re-check whether the receiver is stopping
+static const int kPollMs = 100;
+
+///////////////////////////////////////////////////////////////////////
+// BusFrameSource
+///////////////////////////////////////////////////////////////////////
+BusFrameSource::BusFrameSource(std::shared_ptr<FrameBus::Subscription> subscription)
+    : m_subscription(std::move(subscription)), m_finished(false) {}
+
+bool BusFrameSource::Receive(FrameBus::Buffer &message, int timeoutMs)
+{
+    if (m_subscription->Receive(message, timeoutMs))
+    {
+        return true;
+    }
+    if (m_subscription->IsClosed())
+    {
+        m_finished = true;  // Closed and drained
+    }
+    return false;
+}
+
+void BusFrameSource::Close()
+{
+    m_subscription->Close();
+    m_finished = true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// TcpFrameSource
+///////////////////////////////////////////////////////////////////////
+TcpFrameSource::TcpFrameSource(const std::string &host, uint16_t port,
+    const std::string &topic)
+    : m_name(host + ":" + std::to_string(port) + "/" + topic)
+{
+    m_client.Connect(host, port, topic);
+}
+
+bool TcpFrameSource::Receive(FrameBus::Buffer &message, int timeoutMs)
+{
+    // Each message needs its own buffer, it is decoded asynchronously
+    auto buffer = std::make_shared<std::vector<uint8_t>>();
+    if (!m_client.Receive(*buffer, timeoutMs))
+    {
+        return false;
+    }
+    message = std::move(buffer);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Receiver constructor
+///////////////////////////////////////////////////////////////////////
+Receiver::Receiver(size_t decodeThreads, size_t maxInFlight)
+    : m_decodePool(decodeThreads),
+      m_imagePool(64),
+      m_maxInFlight(maxInFlight > 0 ? maxInFlight : 1),
+      m_running(false),
+      m_lastStatsUs(0) {}
+
+Receiver::~Receiver()
+{
+    Stop();
+}
+
+int Receiver::AddStream(std::unique_ptr<FrameSource> source)
+{
+    m_streams.emplace_back(new Stream());
+    Stream *stream = m_streams.back().get();
+    stream->index = static_cast<int>(m_streams.size() - 1);
+    stream->source = std::move(source);
+    return stream->index;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Start one reader thread per stream
+///////////////////////////////////////////////////////////////////////
+void Receiver::Start()
+{
+    if (m_running.exchange(true))
+    {
+        return;
+    }
+
+    m_lastStatsUs = NowMicros();
+    for (auto &stream : m_streams)
+    {
+        stream->reader = std::thread(&Receiver::readerLoop, this, stream.get());
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Stop reading, then wait for in-flight decodes to be delivered
+///////////////////////////////////////////////////////////////////////
+void Receiver::Stop()
+{
+    if (!m_running.exchange(false))
+    {
+        return;
+    }
+
+    for (auto &stream : m_streams)
+    {
+        stream->source->Close();
+        stream->slotFree.notify_all();
+    }
+    for (auto &stream : m_streams)
+    {
+        if (stream->reader.joinable())
+        {
+            stream->reader.join();
+        }
+    }
+    m_decodePool.Wait();
+}
+
+///////////////////////////////////////////////////////////////////////
+// Reader thread: pull messages and hand them to the decode pool
+///////////////////////////////////////////////////////////////////////
+void Receiver::readerLoop(Stream *stream)
+{
+    FrameBus::Buffer message;
+
+    while (m_running)
+    {
+        // Back pressure: wait for a free decode slot
+        {
+            std::unique_lock<std::mutex> lock(stream->mutex);
+            stream->slotFree.wait(lock, [this, stream]
+                { return stream->inFlight < m_maxInFlight || !m_running; });
+            if (!m_running)
+            {
+                break;
+            }
+        }
+
+        if (!stream->source->Receive(message, kPollMs))
+        {
+            if (stream->source->Finished())
+            {
+                break;
+            }
+            continue;
+        }
+
+        uint64_t receivedUs = NowMicros();
+        uint64_t ticket;
+        {
+            std::lock_guard<std::mutex> lock(stream->mutex);
+            ticket = stream->nextTicket++;
+            stream->inFlight++;
+            stream->bytes += message->size();
+        }
+
+        m_decodePool.Submit([this, stream, ticket, message, receivedUs]
+        {
+            decode(stream, ticket, message, receivedUs);
+        });
+        message.reset();
+    }
+
+    std::lock_guard<std::mutex> lock(stream->mutex);
+    stream->finished = true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Decode task, runs on the decode pool
+///////////////////////////////////////////////////////////////////////
+void Receiver::decode(Stream *stream, uint64_t ticket, FrameBus::Buffer message,
+    uint64_t receivedUs)
+{
+    Pending pending;
+    pending.receivedUs = receivedUs;
+    pending.decodeUs = 0.0;
+    pending.ok = ParseFrame(message->data(), message->size(), pending.message);
+
+    if (pending.ok)
+    {
+        TRACE_SCOPE_FRAME("receiver decode", pending.message.sequence);
+        pending.image = m_imagePool.Acquire();
+        const std::vector<uint8_t> &payload = pending.message.payload;
+
+        uint64_t t0 = NowMicros();
+        switch (pending.message.encoding)
+        {
+            case FrameEncoding::JPEG:
+                pending.ok = pending.image->DecodeJPEG(payload.data(), payload.size());
+                break;
+            case FrameEncoding::RawRGB:
+                pending.ok = payload.size() ==
+                    static_cast<size_t>(pending.message.width) * pending.message.height * 3 &&
+                    pending.image->Resize(pending.message.width, pending.message.height);
+                if (pending.ok && !payload.empty())
+                {
+                    std::copy(payload.begin(), payload.end(), pending.image->m_data);
+                }
+                break;
+            default:
+                pending.ok = false;
+                break;
+        }
+        pending.decodeUs = static_cast<double>(NowMicros() - t0);
+
+        // The payload is no longer needed; keep the rest of the message
+        pending.message.payload.clear();
+        pending.message.payload.shrink_to_fit();
+    }
+
+    deliver(stream, ticket, std::move(pending));
+}
+
+///////////////////////////////////////////////////////////////////////
+// Put a decoded frame in the reorder buffer and deliver every frame
+// that is now in order. Only one thread delivers per stream at a time.
+///////////////////////////////////////////////////////////////////////
+void Receiver::deliver(Stream *stream, uint64_t ticket, Pending &&pending)
+{
+    std::unique_lock<std::mutex> lock(stream->mutex);
+    stream->reorder.emplace(ticket, std::move(pending));
+    if (stream->delivering)
+    {
+        return;     // The delivering thread will pick it up
+    }
+    stream->delivering = true;
+
+    for (;;)
+    {
+        auto next = stream->reorder.find(stream->nextDeliver);
+        if (next == stream->reorder.end())
+        {
+            break;
+        }
+
+        Pending ready = std::move(next->second);
+        stream->reorder.erase(next);
+        stream->nextDeliver++;
+        stream->inFlight--;
+        stream->slotFree.notify_one();
+
+        if (!ready.ok)
+        {
+            stream->errors++;
+            continue;
+        }
+
+        // Sequence gap accounting
+        uint64_t sequence = ready.message.sequence;
+        if (stream->haveSequence && sequence > stream->lastSequence + 1)
+        {
+            stream->gaps += sequence - stream->lastSequence - 1;
+        }
+        if (!stream->haveSequence || sequence > stream->lastSequence)
+        {
+            stream->lastSequence = sequence;
+        }
+        stream->haveSequence = true;
+        stream->frames++;
+        stream->decode.Add(ready.decodeUs);
+
+        if (m_callback)
+        {
+            ReceivedFrame frame;
+            frame.stream = stream->index;
+            frame.sequence = sequence;
+            frame.timestampUs = ready.message.timestampUs;
+            frame.receivedUs = ready.receivedUs;
+            frame.image = std::move(ready.image);
+            frame.detections = std::move(ready.message.detections);
+
+            lock.unlock();
+            m_callback(frame);
+            lock.lock();
+        }
+    }
+
+    stream->delivering = false;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Statistics snapshot, resets the interval counters
+///////////////////////////////////////////////////////////////////////
+std::vector<ReceiverStreamStats> Receiver::Stats()
+{
+    uint64_t now = NowMicros();
+    double interval = static_cast<double>(now - m_lastStatsUs) / 1e6;
+    m_lastStatsUs = now;
+
+    std::vector<ReceiverStreamStats> stats;
+    stats.reserve(m_streams.size());
+    for (auto &stream : m_streams)
+    {
+        std::lock_guard<std::mutex> lock(stream->mutex);
+        ReceiverStreamStats s;
+        s.name = stream->source->Name();
+        s.frames = stream->frames;
+        s.bytes = stream->bytes;
+        s.gaps = stream->gaps;
+        s.errors = stream->errors;
+        s.fps = interval > 0.0
+            ? static_cast<double>(stream->frames - stream->framesAtLastStats) / interval : 0.0;
+        s.decodeMeanUs = stream->decode.Mean();
+        s.decodeP50Us = stream->decode.Percentile(50);
+        s.decodeP99Us = stream->decode.Percentile(99);
+        s.finished = stream->finished;
+        stats.push_back(s);
+
+        stream->framesAtLastStats = stream->frames;
+        stream->decode.Clear();
+    }
+    return stats;
+}
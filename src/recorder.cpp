@@ -0,0 +1,605 @@
+// Includes
+#include <algorithm>   // for std::lower_bound
+#include <fcntl.h>
+#include <filesystem>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "recorder.h"
+#include "trace.h"
+
+static const char kSegmentMagic[8] = {'M', 'J', 'R', 'E', 'C', 0, 0, 1};
+static const char kFooterMagic[8] = {'M', 'J', 'R', 'I', 'D', 'X', 0, 1};
+static const uint32_t kRecordMagic = 0x454D5246;    // "FRME"
+static const uint32_t kVersion = 1;
+static const size_t kRecordAlign = 8;
+static const size_t kWriteBuffer = 1 << 20;         // stdio buffer per segment
+
+static_assert(sizeof(SegmentHeader) == 32, "SegmentHeader layout changed");
+static_assert(sizeof(RecordHeader) == 40, "RecordHeader layout changed");
+static_assert(sizeof(DetectionRecord) == 32, "DetectionRecord layout changed");
+static_assert(sizeof(IndexEntry) == 32, "IndexEntry layout changed");
+static_assert(sizeof(SegmentFooter) == 32, "SegmentFooter layout changed");
+
+static size_t padding_for(uint64_t size)
+{
+    return (kRecordAlign - (size % kRecordAlign)) % kRecordAlign;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Recorder constructor
+///////////////////////////////////////////////////////////////////////
+Recorder::Recorder(uint64_t maxSegmentBytes, double maxSegmentSeconds)
+    : m_maxSegmentBytes(maxSegmentBytes),
+      m_maxSegmentUs(static_cast<uint64_t>(maxSegmentSeconds * 1e6)),
+      m_file(nullptr), m_segmentIndex(0), m_offset(0), m_segmentStartUs(0),
+      m_framesWritten(0), m_bytesWritten(0) {}
+
+Recorder::~Recorder()
+{
+    Close();
+}
+
+std::string Recorder::SegmentPath(const std::string &prefix, uint64_t index)
+{
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "-%06llu.mjr", (unsigned long long)index);
+    return prefix + suffix;
+}
+
+// <name>-NNNNNN.mjr, a segment of the recording called name
+static bool is_segment_of(const std::string &file, const std::string &name)
+{
+    if (file.size() < name.size() + 11 || file.compare(0, name.size(), name) != 0 ||
+        file[name.size()] != '-' || file.compare(file.size() - 4, 4, ".mjr") != 0)
+    {
+        return false;
+    }
+    return std::all_of(file.begin() + name.size() + 1, file.end() - 4,
+        [](char c) { return c >= '0' && c <= '9'; });
+}
+
+///////////////////////////////////////////////////////////////////////
+// Start a recording. The first segment is created on the first frame.
+// NOTE:
+//      Segments of an earlier recording under the same prefix are
+//      deleted: the player reads every consecutive segment, and would
+//      chain the old ones beyond the new recording's last onto it.
+///////////////////////////////////////////////////////////////////////
+bool Recorder::Open(const std::string &prefix)
+{
+    Close();
+    if (prefix.empty())
+    {
+        return false;
+    }
+
+    const std::filesystem::path base(prefix);
+    const std::string name = base.filename().string();
+    const std::filesystem::path dir = base.has_parent_path() ? base.parent_path() : ".";
+    std::vector<std::filesystem::path> old;
+    std::error_code error;
+    for (const auto &file : std::filesystem::directory_iterator(dir, error))
+    {
+        if (is_segment_of(file.path().filename().string(), name))
+        {
+            old.push_back(file.path());
+        }
+    }
+    for (const std::filesystem::path &path : old)
+    {
+        if (!std::filesystem::remove(path, error) && error)
+        {
+            fprintf(stderr, "can't remove old segment %s\n", path.c_str());
+            return false;
+        }
+    }
+
+    m_prefix = prefix;
+    m_segmentIndex = 0;
+    m_framesWritten = 0;
+    m_bytesWritten = 0;
+    return true;
+}
+
+bool Recorder::Close()
+{
+    bool ok = closeSegment();
+    m_prefix.clear();
+    return ok;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Create the next segment file and write its header
+///////////////////////////////////////////////////////////////////////
+bool Recorder::openSegment(uint64_t timestampUs)
+{
+    std::string path = SegmentPath(m_prefix, m_segmentIndex);
+    m_file = fopen(path.c_str(), "wb");
+    if (!m_file)
+    {
+        fprintf(stderr, "can't open %s\n", path.c_str());
+        return false;
+    }
+
+    m_fileBuffer.resize(kWriteBuffer);
+    setvbuf(m_file, m_fileBuffer.data(), _IOFBF, m_fileBuffer.size());
+
+    SegmentHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kSegmentMagic, sizeof(header.magic));
+    header.version = kVersion;
+    header.headerSize = sizeof(SegmentHeader);
+    header.segmentIndex = m_segmentIndex;
+
+    if (fwrite(&header, sizeof(header), 1, m_file) != 1)
+    {
+        fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+
+    m_offset = sizeof(header);
+    m_segmentStartUs = timestampUs;
+    m_index.clear();
+    m_segmentIndex++;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Append the index and footer, then close the segment
+///////////////////////////////////////////////////////////////////////
+bool Recorder::closeSegment()
+{
+    if (!m_file)
+    {
+        return true;
+    }
+
+    SegmentFooter footer;
+    memset(&footer, 0, sizeof(footer));
+    footer.indexOffset = m_offset;
+    footer.count = m_index.size();
+    memcpy(footer.magic, kFooterMagic, sizeof(footer.magic));
+
+    bool ok = true;
+    if (!m_index.empty() &&
+        fwrite(m_index.data(), sizeof(IndexEntry), m_index.size(), m_file) != m_index.size())
+    {
+        ok = false;
+    }
+    if (ok && fwrite(&footer, sizeof(footer), 1, m_file) != 1)
+    {
+        ok = false;
+    }
+    if (fclose(m_file) != 0)
+    {
+        ok = false;
+    }
+
+    m_file = nullptr;
+    m_index.clear();
+    return ok;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Append one encoded frame
+///////////////////////////////////////////////////////////////////////
+bool Recorder::Write(uint64_t sequence, uint64_t timestampUs, uint32_t width,
+    uint32_t height, const uint8_t *jpeg, size_t jpegSize,
+    const std::vector<Detection> &detections)
+{
+    TRACE_SCOPE_FRAME("record", sequence);
+    if (m_prefix.empty() || !jpeg || jpegSize == 0 || jpegSize > UINT32_MAX)
+    {
+        return false;
+    }
+
+    const uint64_t recordSize = sizeof(RecordHeader) + jpegSize +
+        detections.size() * sizeof(DetectionRecord);
+    const size_t padding = padding_for(recordSize);
+
+    // Roll over to a new segment when this one is full or old enough
+    if (m_file)
+    {
+        bool full = m_offset + recordSize + padding > m_maxSegmentBytes && !m_index.empty();
+        bool old = m_maxSegmentUs && timestampUs - m_segmentStartUs >= m_maxSegmentUs;
+        if ((full || old) && !closeSegment())
+        {
+            return false;
+        }
+    }
+    if (!m_file && !openSegment(timestampUs))
+    {
+        return false;
+    }
+
+    RecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kRecordMagic;
+    header.jpegSize = static_cast<uint32_t>(jpegSize);
+    header.sequence = sequence;
+    header.timestampUs = timestampUs;
+    header.width = width;
+    header.height = height;
+    header.detectionCount = static_cast<uint32_t>(detections.size());
+
+    m_detections.resize(detections.size());
+    for (size_t i = 0; i < detections.size(); i++)
+    {
+        const Detection &det = detections[i];
+        DetectionRecord &rec = m_detections[i];
+        rec = DetectionRecord{det.x, det.y, det.width, det.height, det.score,
+            det.classId, det.trackId, 0};
+    }
+
+    static const uint8_t zeros[kRecordAlign] = {0};
+    if (fwrite(&header, sizeof(header), 1, m_file) != 1 ||
+        fwrite(jpeg, 1, jpegSize, m_file) != jpegSize ||
+        (!m_detections.empty() && fwrite(m_detections.data(), sizeof(DetectionRecord),
+            m_detections.size(), m_file) != m_detections.size()) ||
+        (padding && fwrite(zeros, 1, padding, m_file) != padding))
+    {
+        dropPartialRecord();
+        return false;
+    }
+
+    IndexEntry entry;
+    entry.offset = m_offset;
+    entry.sequence = sequence;
+    entry.timestampUs = timestampUs;
+    entry.jpegSize = header.jpegSize;
+    entry.detectionCount = header.detectionCount;
+    m_index.push_back(entry);
+
+    m_offset += recordSize + padding;
+    m_framesWritten++;
+    m_bytesWritten += recordSize + padding;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// A record failed part way: cut the segment back to m_offset, where the
+// index and footer expect the next record. If that fails too the segment
+// is closed without a footer (the player recovers it by scanning) and
+// the next frame starts a new one.
+///////////////////////////////////////////////////////////////////////
+void Recorder::dropPartialRecord()
+{
+    if (fflush(m_file) == 0 && ftruncate(fileno(m_file), static_cast<off_t>(m_offset)) == 0 &&
+        fseeko(m_file, static_cast<off_t>(m_offset), SEEK_SET) == 0)
+    {
+        return;
+    }
+
+    // fclose() may still push out what stdio held, so cut again after it
+    const std::string path = SegmentPath(m_prefix, m_segmentIndex - 1);
+    fclose(m_file);
+    m_file = nullptr;
+    m_index.clear();
+    if (truncate(path.c_str(), static_cast<off_t>(m_offset)) != 0)
+    {
+        fprintf(stderr, "can't truncate %s\n", path.c_str());
+    }
+}
+
+bool Recorder::Write(const FrameMessage &frame)
+{
+    if (frame.encoding != FrameEncoding::JPEG)
+    {
+        return false;
+    }
+    return Write(frame.sequence, frame.timestampUs, frame.width, frame.height,
+        frame.payload.data(), frame.payload.size(), frame.detections);
+}
+
+bool Recorder::Flush()
+{
+    return !m_file || fflush(m_file) == 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Player
+///////////////////////////////////////////////////////////////////////
+Player::Player() {}
+
+Player::~Player()
+{
+    Close();
+}
+
+void Player::Close()
+{
+    for (Segment &segment : m_segments)
+    {
+        munmap(const_cast<uint8_t *>(segment.data), segment.size);
+    }
+    m_segments.clear();
+    m_entries.clear();
+}
+
+size_t Player::RecoveredSegments() const
+{
+    size_t recovered = 0;
+    for (const Segment &segment : m_segments)
+    {
+        if (segment.recovered) recovered++;
+    }
+    return recovered;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Open a recording: either a single segment file or every
+// <prefix>-NNNNNN.mjr segment, in order
+///////////////////////////////////////////////////////////////////////
+bool Player::Open(const std::string &prefixOrPath)
+{
+    Close();
+
+    std::vector<std::string> paths;
+    std::error_code error;
+    if (std::filesystem::is_regular_file(prefixOrPath, error))
+    {
+        paths.push_back(prefixOrPath);
+    }
+    else
+    {
+        for (uint64_t i = 0; ; i++)
+        {
+            std::string path = Recorder::SegmentPath(prefixOrPath, i);
+            if (!std::filesystem::is_regular_file(path, error))
+            {
+                break;
+            }
+            paths.push_back(path);
+        }
+    }
+
+    for (const std::string &path : paths)
+    {
+        if (!mapSegment(path))
+        {
+            Close();
+            return false;
+        }
+        uint32_t segment = static_cast<uint32_t>(m_segments.size() - 1);
+        if (!loadIndex(segment))
+        {
+            scanRecords(segment);
+        }
+    }
+    return !m_segments.empty();
+}
+
+///////////////////////////////////////////////////////////////////////
+// Map a segment read-only and check its header
+///////////////////////////////////////////////////////////////////////
+bool Player::mapSegment(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "can't open %s\n", path.c_str());
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(SegmentHeader)))
+    {
+        close(fd);
+        return false;
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void *data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);  // The mapping keeps the file alive
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    const SegmentHeader *header = static_cast<const SegmentHeader *>(data);
+    if (memcmp(header->magic, kSegmentMagic, sizeof(kSegmentMagic)) != 0 ||
+        header->headerSize < sizeof(SegmentHeader) || header->headerSize > size)
+    {
+        fprintf(stderr, "%s is not a recording segment\n", path.c_str());
+        munmap(data, size);
+        return false;
+    }
+
+    // Replay reads front to back
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    m_segments.push_back(Segment{static_cast<const uint8_t *>(data), size, false});
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Read the trailing index. Returns false if the segment has no valid
+// footer (it was not closed cleanly).
+///////////////////////////////////////////////////////////////////////
+bool Player::loadIndex(uint32_t segment)
+{
+    const Segment &seg = m_segments[segment];
+    if (seg.size < sizeof(SegmentHeader) + sizeof(SegmentFooter))
+    {
+        return false;
+    }
+
+    SegmentFooter footer;
+    memcpy(&footer, seg.data + seg.size - sizeof(footer), sizeof(footer));
+    if (memcmp(footer.magic, kFooterMagic, sizeof(kFooterMagic)) != 0 ||
+        footer.indexOffset > seg.size - sizeof(footer) ||
+        footer.count > (seg.size - sizeof(footer) - footer.indexOffset) / sizeof(IndexEntry))
+    {
+        return false;
+    }
+
+    // Every entry must point at a whole record that says the same sizes,
+    // or the index is corrupt (or stale) and the records are scanned
+    const uint64_t headerSize = reinterpret_cast<const SegmentHeader *>(seg.data)->headerSize;
+    const IndexEntry *index = reinterpret_cast<const IndexEntry *>(seg.data + footer.indexOffset);
+    std::vector<Entry> entries;
+    entries.reserve(footer.count);
+    for (uint64_t i = 0; i < footer.count; i++)
+    {
+        IndexEntry entry;
+        memcpy(&entry, index + i, sizeof(entry));
+        if (entry.offset < headerSize || entry.offset > footer.indexOffset ||
+            footer.indexOffset - entry.offset < sizeof(RecordHeader))
+        {
+            return false;
+        }
+        RecordHeader header;
+        memcpy(&header, seg.data + entry.offset, sizeof(header));
+        const uint64_t end = entry.offset + sizeof(RecordHeader) + entry.jpegSize +
+            static_cast<uint64_t>(entry.detectionCount) * sizeof(DetectionRecord);
+        if (header.magic != kRecordMagic || header.jpegSize != entry.jpegSize ||
+            header.detectionCount != entry.detectionCount || end > footer.indexOffset)
+        {
+            return false;
+        }
+        entries.push_back(Entry{segment, entry});
+    }
+
+    m_entries.insert(m_entries.end(), entries.begin(), entries.end());
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Rebuild the index of an unfinished segment by walking its records,
+// stopping at the first incomplete one
+///////////////////////////////////////////////////////////////////////
+void Player::scanRecords(uint32_t segment)
+{
+    Segment &seg = m_segments[segment];
+    seg.recovered = true;
+
+    uint64_t offset = reinterpret_cast<const SegmentHeader *>(seg.data)->headerSize;
+    while (offset + sizeof(RecordHeader) <= seg.size)
+    {
+        RecordHeader header;
+        memcpy(&header, seg.data + offset, sizeof(header));
+        if (header.magic != kRecordMagic)
+        {
+            break;
+        }
+
+        uint64_t recordSize = sizeof(RecordHeader) + header.jpegSize +
+            static_cast<uint64_t>(header.detectionCount) * sizeof(DetectionRecord);
+        if (offset + recordSize > seg.size)
+        {
+            break;  // Truncated by a crash
+        }
+
+        IndexEntry entry;
+        entry.offset = offset;
+        entry.sequence = header.sequence;
+        entry.timestampUs = header.timestampUs;
+        entry.jpegSize = header.jpegSize;
+        entry.detectionCount = header.detectionCount;
+        m_entries.push_back(Entry{segment, entry});
+
+        offset += recordSize + padding_for(recordSize);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Serve a frame straight out of the mapping
+///////////////////////////////////////////////////////////////////////
+bool Player::GetFrame(size_t index, RecordedFrame &frame) const
+{
+    if (index >= m_entries.size())
+    {
+        return false;
+    }
+
+    // Sizes come from the entry, which loadIndex() or scanRecords()
+    // checked against the segment; the mapping is checked once more
+    const Entry &entry = m_entries[index];
+    const Segment &segment = m_segments[entry.segment];
+    const uint64_t recordSize = sizeof(RecordHeader) + entry.index.jpegSize +
+        static_cast<uint64_t>(entry.index.detectionCount) * sizeof(DetectionRecord);
+    if (entry.index.offset > segment.size || segment.size - entry.index.offset < recordSize)
+    {
+        return false;
+    }
+    const uint8_t *record = segment.data + entry.index.offset;
+
+    RecordHeader header;
+    memcpy(&header, record, sizeof(header));
+
+    frame.sequence = header.sequence;
+    frame.timestampUs = header.timestampUs;
+    frame.width = header.width;
+    frame.height = header.height;
+    frame.jpeg = record + sizeof(RecordHeader);
+    frame.jpegSize = entry.index.jpegSize;
+    frame.detections = reinterpret_cast<const DetectionRecord *>(frame.jpeg + entry.index.jpegSize);
+    frame.detectionCount = entry.index.detectionCount;
+    return true;
+}
+
+size_t Player::FindByTimestamp(uint64_t timestampUs) const
+{
+    auto found = std::lower_bound(m_entries.begin(), m_entries.end(), timestampUs,
+        [](const Entry &entry, uint64_t t) { return entry.index.timestampUs < t; });
+    return static_cast<size_t>(found - m_entries.begin());
+}
+
+size_t Player::FindBySequence(uint64_t sequence) const
+{
+    // Sequences normally increase, so try a binary search first
+    auto found = std::lower_bound(m_entries.begin(), m_entries.end(), sequence,
+        [](const Entry &entry, uint64_t s) { return entry.index.sequence < s; });
+    if (found != m_entries.end() && found->index.sequence == sequence)
+    {
+        return static_cast<size_t>(found - m_entries.begin());
+    }
+
+    // Sequence restarted somewhere (e.g. publisher restart), search linearly
+    for (size_t i = 0; i < m_entries.size(); i++)
+    {
+        if (m_entries[i].index.sequence == sequence)
+        {
+            return i;
+        }
+    }
+    return m_entries.size();
+}
+
+///////////////////////////////////////////////////////////////////////
+// Convert a recorded frame back into a message for republishing
+///////////////////////////////////////////////////////////////////////
+bool Player::ToMessage(size_t index, FrameMessage &frame) const
+{
+    RecordedFrame recorded;
+    if (!GetFrame(index, recorded))
+    {
+        return false;
+    }
+
+    frame.sequence = recorded.sequence;
+    frame.timestampUs = recorded.timestampUs;
+    frame.width = recorded.width;
+    frame.height = recorded.height;
+    frame.encoding = FrameEncoding::JPEG;
+    frame.payload.assign(recorded.jpeg, recorded.jpeg + recorded.jpegSize);
+    frame.detections.resize(recorded.detectionCount);
+    for (uint32_t i = 0; i < recorded.detectionCount; i++)
+    {
+        DetectionRecord rec;
+        memcpy(&rec, recorded.detections + i, sizeof(rec));
+        Detection &det = frame.detections[i];
+        det.x = rec.x;
+        det.y = rec.y;
+        det.width = rec.width;
+        det.height = rec.height;
+        det.score = rec.score;
+        det.classId = rec.classId;
+        det.trackId = rec.trackId;
+    }
+    return true;
+}
@@ -0,0 +1,447 @@
+// Includes
+#include <algorithm>   // for std::max, std::min
+#include <cmath>       // for std::floor, std::lround
+#include <cstring>     // for memcpy, memset
+
+#include "remap.h"
+#include "trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Bilinear weights are 6 bit: 64 * 64 fits the 2^12 fixed point, and a
+// weight of 64 still fits maddubs' signed bytes
+static const int kFractionBits = 6;
+static const int kOne = 1 << kFractionBits;
+
+// Output tile: 32 full rows. Narrower tiles would keep fewer source rows
+// in cache, but break the hardware prefetcher's sequential streams.
+static const int kTileHeight = 32;
+
+// Rotation copy block, 32 x 32 pixels of source and destination in L1
+static const int kOrientBlock = 32;
+
+typedef void (*remap_row_fn)(const uint8_t *src, size_t stride, const int32_t *offsets,
+    const uint16_t *fractions, int count, uint8_t *out);
+
+///////////////////////////////////////////////////////////////////////
+// Scalar kernel
+///////////////////////////////////////////////////////////////////////
+static inline void remap_pixel(const uint8_t *src, size_t stride, int32_t offset, uint16_t fraction,
+    uint8_t *out)
+{
+    const int fx = fraction & 0xff;
+    const int fy = fraction >> 8;
+    const uint8_t *top = src + offset;
+    const uint8_t *bottom = top + stride;
+    for (int c = 0; c < 3; c++)
+    {
+        const int t = top[c] * (kOne - fx) + top[c + 3] * fx;
+        const int b = bottom[c] * (kOne - fx) + bottom[c + 3] * fx;
+        out[c] = static_cast<uint8_t>((t * (kOne - fy) + b * fy + (1 << (2 * kFractionBits - 1))) >>
+            (2 * kFractionBits));
+    }
+}
+
+static void remap_row_scalar(const uint8_t *src, size_t stride, const int32_t *offsets,
+    const uint16_t *fractions, int count, uint8_t *out)
+{
+    for (int i = 0; i < count; i++)
+    {
+        remap_pixel(src, stride, offsets[i], fractions[i], out + i * 3);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+///////////////////////////////////////////////////////////////////////
+// AVX2 kernel, 8 pixels at a time
+// NOTE:
+//      Per pixel two dwords are gathered from each of the two source
+//      rows: [R0 G0 B0 R1] at the pixel and [B0 R1 G1 B1] two bytes on,
+//      which never reads past the right hand pixel. Byte shuffles turn
+//      them into (R0 R1) (G0 G1) and (B0 B1) pairs, maddubs applies the
+//      x weights and madd the y weights.
+///////////////////////////////////////////////////////////////////////
+__attribute__((target("avx2")))
+static inline __m256i remap8_avx2(const int *base, __m256i rowStride, const int32_t *offsets,
+    const uint16_t *fractions)
+{
+    const __m256i takeG1 = _mm256_set1_epi32(0x00ff0000);      // Byte 2 from the second gather
+    const __m256i pairRG = _mm256_setr_epi8(0, 3, 1, 2, 4, 7, 5, 6, 8, 11, 9, 10, 12, 15, 13, 14,
+        0, 3, 1, 2, 4, 7, 5, 6, 8, 11, 9, 10, 12, 15, 13, 14);
+    const __m256i pairB = _mm256_setr_epi8(0, 3, -1, -1, 4, 7, -1, -1, 8, 11, -1, -1, 12, 15, -1, -1,
+        0, 3, -1, -1, 4, 7, -1, -1, 8, 11, -1, -1, 12, 15, -1, -1);
+    const __m256i spreadX = _mm256_setr_epi8(0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12,
+        0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12);
+    const __m256i packRGB = _mm256_setr_epi8(0, 1, 8, 2, 3, 9, 4, 5, 10, 6, 7, 11, -1, -1, -1, -1,
+        0, 1, 8, 2, 3, 9, 4, 5, 10, 6, 7, 11, -1, -1, -1, -1);
+    const __m256i oddBytes = _mm256_set1_epi16(static_cast<short>(0xff00));
+    const __m256i oneBytes = _mm256_set1_epi8(kOne);
+    const __m256i oneDwords = _mm256_set1_epi32(kOne);
+    const __m256i round = _mm256_set1_epi32(1 << (2 * kFractionBits - 1));
+    const __m256i two = _mm256_set1_epi32(2);
+
+    const __m256i offset = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(offsets));
+    const __m256i fraction = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(fractions)));
+
+    // x weights as bytes [64 - fx, fx, 64 - fx, fx], y weights as words [64 - fy, fy]
+    const __m256i fx = _mm256_shuffle_epi8(fraction, spreadX);
+    const __m256i wx = _mm256_blendv_epi8(_mm256_sub_epi8(oneBytes, fx), fx, oddBytes);
+    const __m256i fy = _mm256_srli_epi32(fraction, 8);
+    const __m256i wy = _mm256_or_si256(_mm256_slli_epi32(fy, 16), _mm256_sub_epi32(oneDwords, fy));
+
+    const __m256i offsetRight = _mm256_add_epi32(offset, two);
+    const __m256i tl = _mm256_i32gather_epi32(base, offset, 1);
+    const __m256i tr = _mm256_i32gather_epi32(base, offsetRight, 1);
+    const __m256i bl = _mm256_i32gather_epi32(base, _mm256_add_epi32(offset, rowStride), 1);
+    const __m256i br = _mm256_i32gather_epi32(base, _mm256_add_epi32(offsetRight, rowStride), 1);
+
+    // Horizontal: words [R, G] and [B, 0] per pixel and row
+    const __m256i topRG = _mm256_maddubs_epi16(
+        _mm256_shuffle_epi8(_mm256_blendv_epi8(tl, tr, takeG1), pairRG), wx);
+    const __m256i bottomRG = _mm256_maddubs_epi16(
+        _mm256_shuffle_epi8(_mm256_blendv_epi8(bl, br, takeG1), pairRG), wx);
+    const __m256i topB = _mm256_maddubs_epi16(_mm256_shuffle_epi8(tr, pairB), wx);
+    const __m256i bottomB = _mm256_maddubs_epi16(_mm256_shuffle_epi8(br, pairB), wx);
+
+    // Vertical: R G of pixels 0 1 (4 5) and 2 3 (6 7), B of all eight
+    const __m256i rgLow = _mm256_madd_epi16(_mm256_unpacklo_epi16(topRG, bottomRG),
+        _mm256_unpacklo_epi32(wy, wy));
+    const __m256i rgHigh = _mm256_madd_epi16(_mm256_unpackhi_epi16(topRG, bottomRG),
+        _mm256_unpackhi_epi32(wy, wy));
+    const __m256i b = _mm256_madd_epi16(_mm256_or_si256(topB, _mm256_slli_epi32(bottomB, 16)), wy);
+
+    const int shift = 2 * kFractionBits;
+    const __m256i rg = _mm256_packs_epi32(_mm256_srli_epi32(_mm256_add_epi32(rgLow, round), shift),
+        _mm256_srli_epi32(_mm256_add_epi32(rgHigh, round), shift));
+    const __m256i bb = _mm256_srli_epi32(_mm256_add_epi32(b, round), shift);
+    return _mm256_shuffle_epi8(_mm256_packus_epi16(rg, _mm256_packs_epi32(bb, bb)), packRGB);
+}
+
+__attribute__((target("avx2")))
+static void remap_row_avx2(const uint8_t *src, size_t stride, const int32_t *offsets,
+    const uint16_t *fractions, int count, uint8_t *out)
+{
+    if (count < 8)
+    {
+        remap_row_scalar(src, stride, offsets, fractions, count, out);
+        return;
+    }
+    const __m256i rowStride = _mm256_set1_epi32(static_cast<int>(stride));
+    const int *base = reinterpret_cast<const int *>(src);
+
+    int i = 0;
+    for (; i + 10 <= count; i += 8)     // Two more pixels: the 16 byte stores spill 4 bytes
+    {
+        const __m256i rgb = remap8_avx2(base, rowStride, offsets + i, fractions + i);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i * 3), _mm256_castsi256_si128(rgb));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i * 3 + 12), _mm256_extracti128_si256(rgb, 1));
+    }
+    for (; i < count; i += 8)
+    {
+        // Up to 9 left: the last blocks of 8, overlapping, through a buffer
+        const int at = std::min(i, count - 8);
+        alignas(32) uint8_t tail[32];
+        const __m256i rgb = remap8_avx2(base, rowStride, offsets + at, fractions + at);
+        _mm_store_si128(reinterpret_cast<__m128i *>(tail), _mm256_castsi256_si128(rgb));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(tail + 12), _mm256_extracti128_si256(rgb, 1));
+        memcpy(out + at * 3, tail, 24);
+    }
+}
+
+static bool has_avx2() { return __builtin_cpu_supports("avx2"); }
+
+#endif
+
+static remap_row_fn select_kernel(const char **name)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (has_avx2())
+    {
+        if (name) *name = "avx2";
+        return remap_row_avx2;
+    }
+#endif
+    if (name) *name = "scalar";
+    return remap_row_scalar;
+}
+
+static remap_row_fn remap_kernel()
+{
+    static const remap_row_fn kernel = select_kernel(nullptr);
+    return kernel;
+}
+
+const char *Remapper::KernelName()
+{
+    const char *name = nullptr;
+    select_kernel(&name);
+    return name;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Remapper constructor
+///////////////////////////////////////////////////////////////////////
+Remapper::Remapper(size_t threads)
+    : m_mode(Mode::None), m_orientation(Orientation::Rotate180),
+      m_sourceWidth(0), m_sourceHeight(0), m_width(0), m_height(0)
+{
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    m_threads = threads;
+    if (m_threads > 1)
+    {
+        m_pool.reset(new ThreadPool(m_threads));
+    }
+}
+
+size_t Remapper::MapBytes() const
+{
+    return m_offsets.size() * sizeof(int32_t) + m_fractions.size() * sizeof(uint16_t) +
+        m_runs.size() * sizeof(Run) + m_rowRuns.size() * sizeof(uint32_t);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Build the map from a warp
+// NOTE:
+//      Positions within half a pixel of the source are clamped onto it;
+//      the 2x2 neighbourhood always starts at most one pixel before the
+//      last column and row, with a fraction of up to 64 reaching them.
+///////////////////////////////////////////////////////////////////////
+bool Remapper::SetWarp(int sourceWidth, int sourceHeight, int width, int height, const Warp &warp)
+{
+    TRACE_SCOPE("Remapper build");
+    if (sourceWidth < 2 || sourceHeight < 2 || width <= 0 || height <= 0 || !warp)
+    {
+        return false;
+    }
+
+    m_mode = Mode::None;
+    const size_t pixels = static_cast<size_t>(width) * height;
+    m_offsets.assign(pixels, 0);
+    m_fractions.assign(pixels, 0);
+    m_runs.clear();
+    m_rowRuns.assign(static_cast<size_t>(height) + 1, 0);
+
+    for (int y = 0; y < height; y++)
+    {
+        m_rowRuns[y] = static_cast<uint32_t>(m_runs.size());
+        int runStart = -1;
+        for (int x = 0; x <= width; x++)
+        {
+            double sx = 0.0, sy = 0.0;
+            const bool inside = x < width && warp(x, y, sx, sy) &&
+                sx > -0.5 && sx < sourceWidth - 0.5 && sy > -0.5 && sy < sourceHeight - 0.5;
+            if (!inside)
+            {
+                if (runStart >= 0)
+                {
+                    m_runs.push_back(Run{runStart, x});
+                    runStart = -1;
+                }
+                continue;
+            }
+            if (runStart < 0)
+            {
+                runStart = x;
+            }
+
+            sx = std::min(std::max(sx, 0.0), sourceWidth - 1.0);
+            sy = std::min(std::max(sy, 0.0), sourceHeight - 1.0);
+            const int x0 = std::min(static_cast<int>(sx), sourceWidth - 2);
+            const int y0 = std::min(static_cast<int>(sy), sourceHeight - 2);
+            const long fx = std::lround((sx - x0) * kOne);
+            const long fy = std::lround((sy - y0) * kOne);
+            const size_t index = static_cast<size_t>(y) * width + x;
+            m_offsets[index] = (y0 * sourceWidth + x0) * 3;
+            m_fractions[index] = static_cast<uint16_t>(fx | (fy << 8));
+        }
+    }
+    m_rowRuns[height] = static_cast<uint32_t>(m_runs.size());
+
+    m_sourceWidth = sourceWidth;
+    m_sourceHeight = sourceHeight;
+    m_width = width;
+    m_height = height;
+    m_mode = Mode::Map;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Lens undistortion: for every pixel of the ideal (pinhole) image, where
+// the lens put it in the captured one
+///////////////////////////////////////////////////////////////////////
+bool Remapper::SetUndistort(const CameraCalibration &cal, int width, int height, double zoom)
+{
+    if (cal.fx <= 0.0 || cal.fy <= 0.0 || zoom <= 0.0)
+    {
+        return false;
+    }
+    const double fx = cal.fx * zoom;
+    const double fy = cal.fy * zoom;
+    return SetWarp(width, height, width, height, [&](double u, double v, double &sx, double &sy)
+    {
+        const double x = (u - cal.cx) / fx;
+        const double y = (v - cal.cy) / fy;
+        const double r2 = x * x + y * y;
+        const double radial = 1.0 + r2 * (cal.k1 + r2 * (cal.k2 + r2 * cal.k3));
+        const double xd = x * radial + 2.0 * cal.p1 * x * y + cal.p2 * (r2 + 2.0 * x * x);
+        const double yd = y * radial + cal.p1 * (r2 + 2.0 * y * y) + 2.0 * cal.p2 * x * y;
+        sx = cal.fx * xd + cal.cx;
+        sy = cal.fy * yd + cal.cy;
+        return true;
+    });
+}
+
+bool Remapper::SetOrientation(Orientation orientation, int sourceWidth, int sourceHeight)
+{
+    if (sourceWidth <= 0 || sourceHeight <= 0)
+    {
+        return false;
+    }
+    const bool turned = orientation == Orientation::Rotate90 || orientation == Orientation::Rotate270;
+    m_offsets.clear();
+    m_fractions.clear();
+    m_runs.clear();
+    m_rowRuns.clear();
+    m_orientation = orientation;
+    m_sourceWidth = sourceWidth;
+    m_sourceHeight = sourceHeight;
+    m_width = turned ? sourceHeight : sourceWidth;
+    m_height = turned ? sourceWidth : sourceHeight;
+    m_mode = Mode::Orient;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Remap output rows [y0, y1)
+///////////////////////////////////////////////////////////////////////
+void Remapper::remapBand(const Image &src, Image &dst, int y0, int y1) const
+{
+    const remap_row_fn kernel = remap_kernel();
+    const size_t stride = static_cast<size_t>(m_sourceWidth) * 3;
+    for (int y = y0; y < y1; y++)
+    {
+        const size_t row = static_cast<size_t>(y) * m_width;
+        uint8_t *out = dst.m_data + row * 3;
+        int x = 0;
+        for (uint32_t r = m_rowRuns[y]; r < m_rowRuns[y + 1]; r++)
+        {
+            const Run &run = m_runs[r];
+            memset(out + x * 3, 0, static_cast<size_t>(run.x0 - x) * 3);      // Outside the source
+            kernel(src.m_data, stride, m_offsets.data() + row + run.x0, m_fractions.data() + row + run.x0,
+                run.x1 - run.x0, out + run.x0 * 3);
+            x = run.x1;
+        }
+        memset(out + x * 3, 0, static_cast<size_t>(m_width - x) * 3);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Rotate or flip output rows [y0, y1)
+///////////////////////////////////////////////////////////////////////
+void Remapper::orientBand(const Image &src, Image &dst, int y0, int y1) const
+{
+    const int sw = m_sourceWidth;
+    const int sh = m_sourceHeight;
+    const size_t rowBytes = static_cast<size_t>(m_width) * 3;
+
+    if (m_orientation == Orientation::FlipVertical)
+    {
+        for (int y = y0; y < y1; y++)
+        {
+            memcpy(dst.m_data + y * rowBytes, src.m_data + static_cast<size_t>(sh - 1 - y) * rowBytes, rowBytes);
+        }
+        return;
+    }
+    if (m_orientation == Orientation::FlipHorizontal || m_orientation == Orientation::Rotate180)
+    {
+        for (int y = y0; y < y1; y++)
+        {
+            const int sy = m_orientation == Orientation::Rotate180 ? sh - 1 - y : y;
+            const uint8_t *in = src.m_data + static_cast<size_t>(sy) * rowBytes + rowBytes - 3;
+            uint8_t *out = dst.m_data + y * rowBytes;
+            for (int x = 0; x < m_width; x++, in -= 3, out += 3)
+            {
+                out[0] = in[0];
+                out[1] = in[1];
+                out[2] = in[2];
+            }
+        }
+        return;
+    }
+
+    // Quarter turns walk the source down a column: in blocks, so both
+    // sides of the copy stay in cache
+    const bool clockwise = m_orientation == Orientation::Rotate90;
+    const size_t srcStride = static_cast<size_t>(sw) * 3;
+    for (int by = y0; by < y1; by += kOrientBlock)
+    {
+        const int by1 = std::min(by + kOrientBlock, y1);
+        for (int bx = 0; bx < m_width; bx += kOrientBlock)
+        {
+            const int bx1 = std::min(bx + kOrientBlock, m_width);
+            for (int y = by; y < by1; y++)
+            {
+                // Rotate90: dst(x, y) = src(y, sh - 1 - x); Rotate270: src(sw - 1 - y, x)
+                const int sx = clockwise ? y : sw - 1 - y;
+                uint8_t *out = dst.m_data + y * rowBytes + bx * 3;
+                for (int x = bx; x < bx1; x++, out += 3)
+                {
+                    const int sy = clockwise ? sh - 1 - x : x;
+                    const uint8_t *in = src.m_data + sy * srcStride + sx * 3;
+                    out[0] = in[0];
+                    out[1] = in[1];
+                    out[2] = in[2];
+                }
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Remap one frame, bands of tile rows on every thread
+///////////////////////////////////////////////////////////////////////
+bool Remapper::Apply(const Image &src, Image &dst)
+{
+    TRACE_SCOPE("Remap");
+    if (m_mode == Mode::None || &src == &dst || !src.m_data ||
+        src.GetWidth() != m_sourceWidth || src.GetHeight() != m_sourceHeight)
+    {
+        return false;
+    }
+    if (!dst.Resize(m_width, m_height))
+    {
+        return false;
+    }
+
+    auto band = [this, &src, &dst](int y0, int y1)
+    {
+        if (m_mode == Mode::Map)
+            remapBand(src, dst, y0, y1);
+        else
+            orientBand(src, dst, y0, y1);
+    };
+
+    // A few bands per thread evens out tiles that cost more (rows with
+    // more of the source in view)
+    const int tileRows = (m_height + kTileHeight - 1) / kTileHeight;
+    const int bands = m_pool ? std::min(tileRows, static_cast<int>(m_threads) * 4) : 1;
+    if (bands <= 1)
+    {
+        band(0, m_height);
+        return true;
+    }
+    for (int b = 0; b < bands; b++)
+    {
+        const int y0 = tileRows * b / bands * kTileHeight;
+        const int y1 = std::min(tileRows * (b + 1) / bands * kTileHeight, m_height);
+        m_pool->Submit([&band, y0, y1] { band(y0, y1); });
+    }
+    m_pool->Wait();
+    return true;
+}
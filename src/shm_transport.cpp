@@ -0,0 +1,449 @@
+// Includes
+#include <algorithm>   // for std::min
+#include <atomic>
+#include <chrono>
+#include <climits>     // for INT_MAX
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shm_transport.h"
+#include "trace.h"
+
+static const uint32_t kShmMagic = 0x46524d53;  // "SMRF"
+static const uint32_t kShmVersion = 1;
+static const size_t kPageSize = 4096;
+
+static size_t round_up(size_t value, size_t to)
+{
+    return (value + to - 1) / to * to;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Shared layout
+// NOTE:
+//      Only lock-free atomics live in the mapping, they work between
+//      processes. magic is written last by the writer, so a reader never
+//      attaches to a half initialised ring.
+///////////////////////////////////////////////////////////////////////
+struct ShmHeader
+{
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t reserved;
+    uint64_t slotStride;
+    uint64_t maxPayload;
+    char streamId[64];
+
+    alignas(64) std::atomic<uint64_t> published;   // Frames committed so far
+    std::atomic<uint32_t> futex;                    // Bumped on every commit
+};
+
+struct ShmSlot
+{
+    std::atomic<uint64_t> version;  // Seqlock, odd while the writer is in the slot
+    uint64_t index;                 // Frame index this slot holds
+    uint64_t sequence;
+    uint64_t timestampUs;
+    uint32_t width;
+    uint32_t height;
+    uint32_t encoding;
+    uint32_t detectionCount;
+    uint64_t payloadSize;
+    Detection detections[kShmMaxDetections];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomics must be lock free");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared atomics must be lock free");
+
+static const size_t kHeaderBytes = round_up(sizeof(ShmHeader), kPageSize);
+static const size_t kSlotHeaderBytes = round_up(sizeof(ShmSlot), kPageSize);
+
+static ShmHeader *header_of(const uint8_t *base)
+{
+    return reinterpret_cast<ShmHeader *>(const_cast<uint8_t *>(base));
+}
+
+static ShmSlot *slot_of(const uint8_t *base, size_t stride, uint32_t slot)
+{
+    return reinterpret_cast<ShmSlot *>(const_cast<uint8_t *>(base) + kHeaderBytes + slot * stride);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Futex on the shared header (not FUTEX_PRIVATE: readers can be other
+// processes with their own mapping)
+///////////////////////////////////////////////////////////////////////
+static void futex_wake_all(std::atomic<uint32_t> *word)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+static void futex_wait(std::atomic<uint32_t> *word, uint32_t expected, int timeoutMs)
+{
+    struct timespec ts;
+    struct timespec *timeout = nullptr;
+    if (timeoutMs >= 0)
+    {
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = static_cast<long>(timeoutMs % 1000) * 1000000L;
+        timeout = &ts;
+    }
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT, expected, timeout, nullptr, 0);
+}
+
+///////////////////////////////////////////////////////////////////////
+// ShmFrameWriter constructor
+///////////////////////////////////////////////////////////////////////
+ShmFrameWriter::ShmFrameWriter()
+    : m_base(nullptr), m_size(0), m_slotCount(0), m_slotStride(0),
+      m_maxPayload(0), m_published(0) {}
+
+ShmFrameWriter::~ShmFrameWriter()
+{
+    Close();
+}
+
+///////////////////////////////////////////////////////////////////////
+// Create the ring
+///////////////////////////////////////////////////////////////////////
+bool ShmFrameWriter::Create(const std::string &name, uint32_t slotCount,
+    size_t maxPayloadBytes, const std::string &streamId)
+{
+    Close();
+    if (slotCount < 2 || maxPayloadBytes == 0)
+    {
+        return false;
+    }
+
+    // Replace a ring left behind by a crashed writer
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    const size_t stride = kSlotHeaderBytes + round_up(maxPayloadBytes, kPageSize);
+    const size_t size = kHeaderBytes + stride * slotCount;
+    void *base = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(size)) == 0)
+    {
+        base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);      // The mapping keeps the object alive
+    if (base == MAP_FAILED)
+    {
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    m_name = name;
+    m_base = static_cast<uint8_t *>(base);
+    m_size = size;
+    m_slotCount = slotCount;
+    m_slotStride = stride;
+    m_maxPayload = maxPayloadBytes;
+    m_published = 0;
+
+    // ftruncate zero fills: every slot starts at version 0, nothing published
+    ShmHeader *header = header_of(m_base);
+    header->version = kShmVersion;
+    header->slotCount = slotCount;
+    header->slotStride = stride;
+    header->maxPayload = maxPayloadBytes;
+    strncpy(header->streamId, streamId.c_str(), sizeof(header->streamId) - 1);
+    header->magic.store(kShmMagic, std::memory_order_release);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Unmap and unlink
+///////////////////////////////////////////////////////////////////////
+void ShmFrameWriter::Close()
+{
+    if (!m_base)
+    {
+        return;
+    }
+    munmap(m_base, m_size);
+    shm_unlink(m_name.c_str());
+    m_base = nullptr;
+    m_size = 0;
+    m_name.clear();
+}
+
+///////////////////////////////////////////////////////////////////////
+// Enter the slot for frame index: make its seqlock odd
+///////////////////////////////////////////////////////////////////////
+uint8_t *ShmFrameWriter::beginSlot(uint64_t index, size_t payloadSize)
+{
+    if (!m_base || payloadSize > m_maxPayload)
+    {
+        return nullptr;
+    }
+
+    ShmSlot *slot = slot_of(m_base, m_slotStride, static_cast<uint32_t>(index % m_slotCount));
+    uint64_t version = slot->version.load(std::memory_order_relaxed);
+    slot->version.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return reinterpret_cast<uint8_t *>(slot) + kSlotHeaderBytes;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Fill in the metadata, leave the slot and wake the readers
+///////////////////////////////////////////////////////////////////////
+void ShmFrameWriter::commitSlot(uint64_t index, const FrameMessage &meta, uint32_t width,
+    uint32_t height, FrameEncoding encoding, size_t payloadSize)
+{
+    ShmSlot *slot = slot_of(m_base, m_slotStride, static_cast<uint32_t>(index % m_slotCount));
+    slot->index = index;
+    slot->sequence = meta.sequence;
+    slot->timestampUs = meta.timestampUs;
+    slot->width = width;
+    slot->height = height;
+    slot->encoding = static_cast<uint32_t>(encoding);
+    slot->payloadSize = payloadSize;
+
+    // Extra detections are dropped rather than the frame
+    uint32_t count = static_cast<uint32_t>(std::min<size_t>(meta.detections.size(), kShmMaxDetections));
+    std::copy(meta.detections.begin(), meta.detections.begin() + count, slot->detections);
+    slot->detectionCount = count;
+
+    slot->version.store(slot->version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+
+    ShmHeader *header = header_of(m_base);
+    header->published.store(index + 1, std::memory_order_release);
+    header->futex.fetch_add(1, std::memory_order_release);
+    futex_wake_all(&header->futex);
+    m_published = index + 1;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Publish a frame
+///////////////////////////////////////////////////////////////////////
+bool ShmFrameWriter::Publish(const FrameMessage &frame)
+{
+    TRACE_SCOPE_FRAME("shm publish", frame.sequence);
+    uint8_t *payload = beginSlot(m_published, frame.payload.size());
+    if (!payload)
+    {
+        return false;
+    }
+    if (!frame.payload.empty())
+    {
+        memcpy(payload, frame.payload.data(), frame.payload.size());
+    }
+    commitSlot(m_published, frame, frame.width, frame.height, frame.encoding, frame.payload.size());
+    return true;
+}
+
+bool ShmFrameWriter::Publish(const FrameMessage &meta, const Image &image)
+{
+    TRACE_SCOPE_FRAME("shm publish", meta.sequence);
+    const size_t size = static_cast<size_t>(image.GetBufferSize());
+    uint8_t *payload = image.m_data ? beginSlot(m_published, size) : nullptr;
+    if (!payload)
+    {
+        return false;
+    }
+    memcpy(payload, image.m_data, size);
+    commitSlot(m_published, meta, static_cast<uint32_t>(image.GetWidth()),
+        static_cast<uint32_t>(image.GetHeight()), FrameEncoding::RawRGB, size);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// ShmFrameReader constructor
+///////////////////////////////////////////////////////////////////////
+ShmFrameReader::ShmFrameReader()
+    : m_base(nullptr), m_size(0), m_slotCount(0), m_slotStride(0),
+      m_next(0), m_missed(0) {}
+
+ShmFrameReader::~ShmFrameReader()
+{
+    Close();
+}
+
+///////////////////////////////////////////////////////////////////////
+// Attach to a ring
+// NOTE:
+//      The mapping is read only: a reader can never corrupt the ring for
+//      the writer or the other readers. FUTEX_WAIT works on it all the
+//      same.
+///////////////////////////////////////////////////////////////////////
+bool ShmFrameReader::Open(const std::string &name)
+{
+    Close();
+
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    void *base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= kHeaderBytes)
+    {
+        base = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        return false;
+    }
+
+    m_base = static_cast<const uint8_t *>(base);
+    m_size = static_cast<size_t>(st.st_size);
+
+    const ShmHeader *header = header_of(m_base);
+    if (header->magic.load(std::memory_order_acquire) != kShmMagic ||
+        header->version != kShmVersion || header->slotCount < 2 ||
+        header->slotStride < kSlotHeaderBytes + header->maxPayload ||
+        kHeaderBytes + header->slotStride * header->slotCount > m_size)
+    {
+        Close();
+        return false;
+    }
+
+    m_slotCount = header->slotCount;
+    m_slotStride = header->slotStride;
+    m_streamId.assign(header->streamId, strnlen(header->streamId, sizeof(header->streamId)));
+    uint64_t published = header->published.load(std::memory_order_acquire);
+    m_next = published > 0 ? published - 1 : 0;
+    m_missed = 0;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Detach
+///////////////////////////////////////////////////////////////////////
+void ShmFrameReader::Close()
+{
+    if (!m_base)
+    {
+        return;
+    }
+    munmap(const_cast<uint8_t *>(m_base), m_size);
+    m_base = nullptr;
+    m_size = 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Read the metadata of frame index under the slot's seqlock
+// NOTE:
+//      Only the metadata is copied. The payload stays in the slot and is
+//      handed out as a pointer and an Image view.
+///////////////////////////////////////////////////////////////////////
+bool ShmFrameReader::readSlot(uint64_t index, ShmFrame &frame)
+{
+    const uint32_t slotIndex = static_cast<uint32_t>(index % m_slotCount);
+    const ShmSlot *slot = slot_of(m_base, m_slotStride, slotIndex);
+    const size_t maxPayload = header_of(m_base)->maxPayload;
+
+    uint64_t before = slot->version.load(std::memory_order_acquire);
+    if ((before & 1) || slot->index != index)
+    {
+        return false;
+    }
+
+    frame.sequence = slot->sequence;
+    frame.timestampUs = slot->timestampUs;
+    frame.width = slot->width;
+    frame.height = slot->height;
+    frame.encoding = static_cast<FrameEncoding>(slot->encoding);
+    frame.payloadSize = std::min<size_t>(slot->payloadSize, maxPayload);
+    uint32_t count = std::min(slot->detectionCount, kShmMaxDetections);
+    frame.detections.assign(slot->detections, slot->detections + count);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot->version.load(std::memory_order_relaxed) != before)
+    {
+        return false;
+    }
+
+    uint8_t *payload = const_cast<uint8_t *>(reinterpret_cast<const uint8_t *>(slot)) + kSlotHeaderBytes;
+    frame.payload = payload;
+    frame.slot = slotIndex;
+    frame.version = before;
+
+    const size_t pixels = static_cast<size_t>(frame.width) * frame.height * 3;
+    if (frame.encoding == FrameEncoding::RawRGB && pixels > 0 && pixels <= frame.payloadSize)
+    {
+        frame.image = Image::View(payload, static_cast<int>(frame.width), static_cast<int>(frame.height));
+    }
+    else
+    {
+        frame.image = Image();
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Wait for and read the next frame
+///////////////////////////////////////////////////////////////////////
+bool ShmFrameReader::Receive(ShmFrame &frame, int timeoutMs)
+{
+    if (!m_base)
+    {
+        return false;
+    }
+
+    ShmHeader *header = header_of(m_base);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (;;)
+    {
+        // Load the futex word before checking, so a commit in between
+        // makes the wait return at once instead of being lost
+        uint32_t signal = header->futex.load(std::memory_order_acquire);
+        uint64_t published = header->published.load(std::memory_order_acquire);
+
+        if (published > m_next)
+        {
+            // Lapped: the oldest unread slots are being reused, jump to the newest
+            if (published - m_next >= m_slotCount)
+            {
+                m_missed += published - 1 - m_next;
+                m_next = published - 1;
+            }
+            if (readSlot(m_next, frame))
+            {
+                m_next++;
+                return true;
+            }
+            continue;   // Overwritten while we looked, retry from the head
+        }
+
+        int waitMs = -1;
+        if (timeoutMs >= 0)
+        {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            if (left <= 0)
+            {
+                return false;
+            }
+            waitMs = static_cast<int>(left);
+        }
+        futex_wait(&header->futex, signal, waitMs);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Is the frame's payload still the one that was read
+///////////////////////////////////////////////////////////////////////
+bool ShmFrameReader::Valid(const ShmFrame &frame) const
+{
+    if (!m_base || !frame.payload)
+    {
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const ShmSlot *slot = slot_of(m_base, m_slotStride, frame.slot);
+    return slot->version.load(std::memory_order_relaxed) == frame.version;
+}
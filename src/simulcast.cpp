@@ -0,0 +1,172 @@
+// Includes
+#include <algorithm>   // for std::max
+
+#include "simulcast.h"
+#include "trace.h"
+
+///////////////////////////////////////////////////////////////////////
+// SimulcastPublisher constructor
+///////////////////////////////////////////////////////////////////////
+SimulcastPublisher::SimulcastPublisher(FrameBus &bus, const std::string &topic, size_t threads)
+    : m_bus(bus), m_topic(topic), m_pool(threads), m_encodes(0) {}
+
+std::string SimulcastPublisher::LayerTopic(const std::string &topic, const std::string &layer)
+{
+    return topic + "/" + layer;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Add a layer
+///////////////////////////////////////////////////////////////////////
+bool SimulcastPublisher::AddLayer(const SimulcastLayer &config)
+{
+    if (config.name.empty() || config.width < 0 || config.height < 0 ||
+        (config.width == 0 && config.height == 0) ||
+        config.quality <= 0 || config.quality > 100)
+    {
+        return false;
+    }
+    for (const auto &layer : m_layers)
+    {
+        if (layer->config.name == config.name)
+        {
+            return false;
+        }
+    }
+
+    std::unique_ptr<Layer> layer(new Layer());
+    layer->config = config;
+    layer->publisher.reset(new Publisher(m_bus, LayerTopic(config.name)));
+    layer->active = false;
+    layer->ok = true;
+    m_layers.push_back(std::move(layer));
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Scale and encode one layer, runs on the pool
+///////////////////////////////////////////////////////////////////////
+bool SimulcastPublisher::encode(Layer &layer, const FrameMessage &meta, int width, int height)
+{
+    TRACE_SCOPE_FRAME("simulcast layer", meta.sequence);
+    const Image *pixels = m_pyramid.Scaled(width, height, layer.scratch);
+    FrameMessage &message = layer.message;
+    if (!pixels || !pixels->EncodeJPEG(message.payload, layer.config.quality))
+    {
+        return false;
+    }
+
+    message.sequence = meta.sequence;
+    message.timestampUs = meta.timestampUs;
+    message.streamId = meta.streamId;
+    message.width = static_cast<uint32_t>(width);
+    message.height = static_cast<uint32_t>(height);
+    message.encoding = FrameEncoding::JPEG;
+
+    // Boxes follow the pixels
+    const Image *full = m_pyramid.Level(0);
+    const float sx = static_cast<float>(width) / static_cast<float>(meta.width ? meta.width : full->GetWidth());
+    const float sy = static_cast<float>(height) / static_cast<float>(meta.height ? meta.height : full->GetHeight());
+    message.detections = meta.detections;
+    for (Detection &det : message.detections)
+    {
+        det.x *= sx;
+        det.width *= sx;
+        det.y *= sy;
+        det.height *= sy;
+    }
+    layer.publisher->Publish(message);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Layer size for a frame, 0 sides following the frame's aspect ratio
+///////////////////////////////////////////////////////////////////////
+void SimulcastPublisher::layerSize(const SimulcastLayer &layer, int frameWidth, int frameHeight,
+    int &width, int &height)
+{
+    width = layer.width;
+    height = layer.height;
+    if (width == 0)
+        width = std::max(1, static_cast<int>(static_cast<int64_t>(frameWidth) * height / frameHeight));
+    if (height == 0)
+        height = std::max(1, static_cast<int>(static_cast<int64_t>(frameHeight) * width / frameWidth));
+}
+
+void SimulcastPublisher::LargestLayer(int frameWidth, int frameHeight, int &width, int &height) const
+{
+    width = height = 0;
+    for (const auto &layer : m_layers)
+    {
+        int w, h;
+        layerSize(layer->config, frameWidth, frameHeight, w, h);
+        width = std::max(width, w);
+        height = std::max(height, h);
+    }
+}
+
+bool SimulcastPublisher::HasSubscribers()
+{
+    for (const auto &layer : m_layers)
+    {
+        if (m_bus.Subscribers(layer->publisher->Topic()) > 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Publish one capture on every layer
+///////////////////////////////////////////////////////////////////////
+bool SimulcastPublisher::Publish(const FrameMessage &meta, std::shared_ptr<const Image> image)
+{
+    if (!image || image->GetWidth() <= 0 || image->GetHeight() <= 0)
+    {
+        return false;
+    }
+    const int sw = meta.width ? static_cast<int>(meta.width) : image->GetWidth();
+    const int sh = meta.height ? static_cast<int>(meta.height) : image->GetHeight();
+
+    size_t active = 0;
+    for (auto &layer : m_layers)
+    {
+        layer->active = m_bus.Subscribers(layer->publisher->Topic()) > 0;
+        active += layer->active;
+    }
+    if (active == 0)
+    {
+        return true;    // Nobody watching, nothing to scale or encode
+    }
+
+    m_pyramid.Reset(std::move(image));
+    for (auto &layer : m_layers)
+    {
+        if (!layer->active)
+        {
+            continue;
+        }
+        int width, height;
+        layerSize(layer->config, sw, sh, width, height);
+
+        Layer *target = layer.get();
+        m_pool.Submit([this, target, &meta, width, height]
+        {
+            target->ok = encode(*target, meta, width, height);
+        });
+    }
+    m_pool.Wait();
+    m_pyramid.Reset(nullptr);   // Hand the frame back, keep the level buffers
+
+    bool ok = true;
+    for (auto &layer : m_layers)
+    {
+        if (layer->active)
+        {
+            m_encodes += layer->ok;
+            ok = ok && layer->ok;
+        }
+    }
+    return ok;
+}
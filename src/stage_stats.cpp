@@ -0,0 +1,74 @@
+// Includes
+#include <algorithm>   // for std::nth_element
+#include <stdio.h>     // for snprintf
+
+#include "stage_stats.h"
+
+///////////////////////////////////////////////////////////////////////
+// StageStats constructor
+///////////////////////////////////////////////////////////////////////
+StageStats::StageStats(const std::string &name, size_t expected)
+    : m_name(name), m_sum(0.0)
+{
+    m_samples.reserve(expected);
+}
+
+void StageStats::Add(double micros)
+{
+    m_samples.push_back(micros);
+    m_sum += micros;
+}
+
+void StageStats::Clear()
+{
+    m_samples.clear();
+    m_sum = 0.0;
+}
+
+double StageStats::Mean() const
+{
+    return m_samples.empty() ? 0.0 : m_sum / static_cast<double>(m_samples.size());
+}
+
+///////////////////////////////////////////////////////////////////////
+// Nearest-rank percentile
+///////////////////////////////////////////////////////////////////////
+double StageStats::Percentile(double p) const
+{
+    if (m_samples.empty())
+    {
+        return 0.0;
+    }
+
+    std::vector<double> sorted(m_samples);
+    size_t rank = static_cast<size_t>(p / 100.0 * static_cast<double>(sorted.size() - 1) + 0.5);
+    rank = std::min(rank, sorted.size() - 1);
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return sorted[rank];
+}
+
+double StageStats::Max() const
+{
+    return m_samples.empty() ? 0.0 : *std::max_element(m_samples.begin(), m_samples.end());
+}
+
+std::string StageStats::Summary() const
+{
+    char line[256];
+    snprintf(line, sizeof(line),
+        "%-12s n=%-7zu mean=%9.1fus p50=%9.1fus p90=%9.1fus p99=%9.1fus max=%9.1fus",
+        m_name.c_str(), Count(), Mean(), Percentile(50), Percentile(90),
+        Percentile(99), Max());
+    return line;
+}
+
+std::string StageStats::ToJSON() const
+{
+    char json[320];
+    snprintf(json, sizeof(json),
+        "{\"name\":\"%s\",\"count\":%zu,\"mean_us\":%.1f,\"p50_us\":%.1f,"
+        "\"p90_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f}",
+        m_name.c_str(), Count(), Mean(), Percentile(50), Percentile(90),
+        Percentile(99), Max());
+    return json;
+}
@@ -0,0 +1,466 @@
+// Includes
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "tcp_transport.h"
+#include "trace.h"
+
+// How long a peer may stall in the middle of a frame before we give up
+static const int kMidFrameTimeoutMs = 5000;
+
+///////////////////////////////////////////////////////////////////////
+// Send the whole buffer, returns false if the peer went away
+///////////////////////////////////////////////////////////////////////
+static bool send_all(int fd, const uint8_t *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Wait until fd is readable. Returns 1 ready, 0 timeout, -1 error.
+///////////////////////////////////////////////////////////////////////
+static int wait_readable(int fd, int timeoutMs)
+{
+    struct pollfd pfd = {fd, POLLIN, 0};
+    for (;;)
+    {
+        int n = poll(&pfd, 1, timeoutMs);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        return n > 0 ? 1 : 0;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// TcpFrameServer constructor
+///////////////////////////////////////////////////////////////////////
+TcpFrameServer::TcpFrameServer(FrameBus &bus, size_t depth)
+    : m_bus(bus), m_depth(depth), m_listenFd(-1), m_port(0), m_running(false) {}
+
+TcpFrameServer::~TcpFrameServer()
+{
+    Stop();
+}
+
+///////////////////////////////////////////////////////////////////////
+// Start listening
+///////////////////////////////////////////////////////////////////////
+bool TcpFrameServer::Start(uint16_t port, const std::string &bindAddress)
+{
+    if (m_running)
+    {
+        return false;
+    }
+
+    m_listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listenFd < 0)
+    {
+        return false;
+    }
+
+    int one = 1;
+    setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, bindAddress.c_str(), &addr.sin_addr) != 1 ||
+        bind(m_listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(m_listenFd, 64) < 0)
+    {
+        fprintf(stderr, "can't listen on %s:%u: %s\n", bindAddress.c_str(),
+            port, strerror(errno));
+        close(m_listenFd);
+        m_listenFd = -1;
+        return false;
+    }
+
+    // Find out which port we got when asked for port 0
+    socklen_t len = sizeof(addr);
+    getsockname(m_listenFd, (struct sockaddr *)&addr, &len);
+    m_port = ntohs(addr.sin_port);
+
+    m_running = true;
+    m_acceptThread = std::thread(&TcpFrameServer::acceptLoop, this);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Stop accepting, disconnect every client and join all threads
+///////////////////////////////////////////////////////////////////////
+void TcpFrameServer::Stop()
+{
+    if (!m_running.exchange(false))
+    {
+        return;
+    }
+
+    if (m_acceptThread.joinable())
+    {
+        m_acceptThread.join();
+    }
+    close(m_listenFd);
+    m_listenFd = -1;
+
+    reapClients(true);
+}
+
+size_t TcpFrameServer::Clients()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t connected = 0;
+    for (auto &client : m_clients)
+    {
+        if (!client->done && client->subscription) connected++;
+    }
+    return connected;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Join finished client threads (or all of them when stopping)
+///////////////////////////////////////////////////////////////////////
+void TcpFrameServer::reapClients(bool all)
+{
+    std::list<std::unique_ptr<Client>> finished;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto it = m_clients.begin(); it != m_clients.end();)
+        {
+            if (all || (*it)->done)
+            {
+                if (all)
+                {
+                    // Wake the client thread wherever it is blocked
+                    if ((*it)->subscription) (*it)->subscription->Close();
+                    shutdown((*it)->fd, SHUT_RDWR);
+                }
+                finished.push_back(std::move(*it));
+                it = m_clients.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    for (auto &client : finished)
+    {
+        client->thread.join();
+        close(client->fd);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Accept connections until stopped
+///////////////////////////////////////////////////////////////////////
+void TcpFrameServer::acceptLoop()
+{
+    while (m_running)
+    {
+        reapClients(false);
+
+        if (wait_readable(m_listenFd, 100) <= 0)
+        {
+            continue;
+        }
+
+        int fd = accept(m_listenFd, nullptr, nullptr);
+        if (fd < 0)
+        {
+            continue;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_clients.emplace_back(new Client());
+        Client *client = m_clients.back().get();
+        client->fd = fd;
+        client->thread = std::thread(&TcpFrameServer::clientLoop, this, client);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Topic of a "SUB <topic>" line, empty if it is something else
+///////////////////////////////////////////////////////////////////////
+static std::string sub_topic(const std::string &line)
+{
+    return line.compare(0, 4, "SUB ") == 0 ? line.substr(4) : std::string();
+}
+
+///////////////////////////////////////////////////////////////////////
+// Serve one client: read its SUB line, then forward frames
+// NOTE:
+//      Between frames the socket is checked for further SUB lines, which
+//      move the subscription to another topic (switching simulcast layer
+//      without reconnecting).
+///////////////////////////////////////////////////////////////////////
+void TcpFrameServer::clientLoop(Client *client)
+{
+    // Read "SUB <topic>\n"
+    std::string line;
+    char c;
+    while (m_running && line.size() < 1024)
+    {
+        if (wait_readable(client->fd, 100) <= 0) continue;
+        if (recv(client->fd, &c, 1, 0) != 1) break;
+        if (c == '\n') break;
+        line.push_back(c);
+    }
+
+    const std::string topic = sub_topic(line);
+    if (topic.empty())
+    {
+        client->done = true;
+        return;
+    }
+
+    std::shared_ptr<FrameBus::Subscription> subscription = m_bus.Subscribe(topic, m_depth);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        client->subscription = subscription;
+    }
+    if (!m_running)
+    {
+        subscription->Close();  // Stop() raced with the subscribe
+    }
+
+    FrameBus::Buffer message;
+    line.clear();
+    bool connected = true;
+    while (connected)
+    {
+        if (subscription->Receive(message, 100))
+        {
+            TRACE_SCOPE("tcp send");
+            uint32_t size = static_cast<uint32_t>(message->size());
+            uint8_t header[4] = {
+                static_cast<uint8_t>(size), static_cast<uint8_t>(size >> 8),
+                static_cast<uint8_t>(size >> 16), static_cast<uint8_t>(size >> 24)};
+
+            if (!send_all(client->fd, header, sizeof(header)) ||
+                !send_all(client->fd, message->data(), message->size()))
+            {
+                break;  // Client went away
+            }
+        }
+        else if (subscription->IsClosed())
+        {
+            break;
+        }
+
+        while (connected && wait_readable(client->fd, 0) > 0)
+        {
+            char buffer[256];
+            ssize_t n = recv(client->fd, buffer, sizeof(buffer), 0);
+            if (n < 0 && errno == EINTR) continue;
+            connected = n > 0;      // 0: the client closed its side
+            for (ssize_t i = 0; i < n && connected; i++)
+            {
+                if (buffer[i] != '\n')
+                {
+                    line.push_back(buffer[i]);
+                    connected = line.size() < 1024;
+                    continue;
+                }
+                const std::string next = sub_topic(line);
+                if (!next.empty())
+                {
+                    m_bus.Switch(subscription, next);
+                }
+                line.clear();
+            }
+        }
+    }
+
+    m_bus.Unsubscribe(subscription);
+    client->done = true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// TcpFrameClient
+///////////////////////////////////////////////////////////////////////
+TcpFrameClient::TcpFrameClient() : m_fd(-1) {}
+
+TcpFrameClient::~TcpFrameClient()
+{
+    Close();
+}
+
+void TcpFrameClient::Close()
+{
+    int fd = m_fd.exchange(-1);
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Shut the connection down without closing the descriptor
+// NOTE:
+//      Closing an fd another thread is polling does not wake it (and the
+//      number may be reused). shutdown() makes the blocked recv() return
+//      0, and the receiving thread then closes the socket itself.
+///////////////////////////////////////////////////////////////////////
+void TcpFrameClient::Shutdown()
+{
+    int fd = m_fd;
+    if (fd >= 0)
+    {
+        shutdown(fd, SHUT_RDWR);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Connect and subscribe to a topic
+///////////////////////////////////////////////////////////////////////
+bool TcpFrameClient::Connect(const std::string &host, uint16_t port, const std::string &topic)
+{
+    Close();
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *result = nullptr;
+    std::string service = std::to_string(port);
+    if (getaddrinfo(host.c_str(), service.c_str(), &hints, &result) != 0)
+    {
+        fprintf(stderr, "can't resolve %s\n", host.c_str());
+        return false;
+    }
+
+    for (struct addrinfo *ai = result; ai && m_fd < 0; ai = ai->ai_next)
+    {
+        m_fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (m_fd >= 0 && connect(m_fd, ai->ai_addr, ai->ai_addrlen) < 0)
+        {
+            close(m_fd);
+            m_fd = -1;
+        }
+    }
+    freeaddrinfo(result);
+
+    if (m_fd < 0)
+    {
+        fprintf(stderr, "can't connect to %s:%u\n", host.c_str(), port);
+        return false;
+    }
+
+    int one = 1;
+    setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    std::string request = "SUB " + topic + "\n";
+    if (!send_all(m_fd, reinterpret_cast<const uint8_t *>(request.data()), request.size()))
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Move to another topic on the same connection. Frames of the old topic
+// that are already on their way still arrive first.
+///////////////////////////////////////////////////////////////////////
+bool TcpFrameClient::Switch(const std::string &topic)
+{
+    int fd = m_fd;
+    std::string request = "SUB " + topic + "\n";
+    return fd >= 0 && !topic.empty() &&
+        send_all(fd, reinterpret_cast<const uint8_t *>(request.data()), request.size());
+}
+
+///////////////////////////////////////////////////////////////////////
+// Read exactly size bytes
+///////////////////////////////////////////////////////////////////////
+bool TcpFrameClient::readFully(uint8_t *data, size_t size, int timeoutMs)
+{
+    while (size > 0)
+    {
+        if (wait_readable(m_fd, timeoutMs) <= 0)
+        {
+            return false;
+        }
+        ssize_t n = recv(m_fd, data, size, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Receive one frame
+// NOTE:
+//      The timeout only applies while waiting for a frame to start. Once
+//      the header has arrived the rest must follow promptly, otherwise the
+//      stream is out of sync and the connection is closed.
+///////////////////////////////////////////////////////////////////////
+bool TcpFrameClient::Receive(std::vector<uint8_t> &out, int timeoutMs)
+{
+    if (m_fd < 0)
+    {
+        return false;
+    }
+
+    int ready = wait_readable(m_fd, timeoutMs);
+    if (ready == 0)
+    {
+        return false;   // Timed out, still connected
+    }
+
+    uint8_t header[4];
+    if (ready < 0 || !readFully(header, sizeof(header), kMidFrameTimeoutMs))
+    {
+        Close();
+        return false;
+    }
+
+    uint32_t size = static_cast<uint32_t>(header[0]) |
+        (static_cast<uint32_t>(header[1]) << 8) |
+        (static_cast<uint32_t>(header[2]) << 16) |
+        (static_cast<uint32_t>(header[3]) << 24);
+    if (size > kMaxTcpFrameBytes)
+    {
+        fprintf(stderr, "frame of %u bytes is too large\n", size);
+        Close();
+        return false;
+    }
+
+    out.resize(size);
+    if (!readFully(out.data(), size, kMidFrameTimeoutMs))
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
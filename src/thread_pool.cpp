@@ -0,0 +1,153 @@
+// Includes
+#include "thread_pool.h"
+#include "trace.h"
+
+// Pool and worker index of the calling thread, so tasks can push to
+// their own deque
+static thread_local const ThreadPool *t_pool = nullptr;
+static thread_local size_t t_worker = 0;
+
+///////////////////////////////////////////////////////////////////////
+// ThreadPool constructor
+///////////////////////////////////////////////////////////////////////
+ThreadPool::ThreadPool(size_t threads)
+    : m_queued(0), m_pending(0), m_nextQueue(0), m_steals(0), m_stop(false)
+{
+    if (threads == 0)
+    {
+        threads = std::thread::hardware_concurrency();
+        if (threads == 0) threads = 1;
+    }
+
+    m_queues.reserve(threads);
+    for (size_t i = 0; i < threads; i++)
+    {
+        m_queues.emplace_back(new WorkerQueue());
+    }
+
+    m_workers.reserve(threads);
+    for (size_t i = 0; i < threads; i++)
+    {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// ThreadPool destructor, drains the queues before joining
+///////////////////////////////////////////////////////////////////////
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stop = true;
+    }
+    m_taskReady.notify_all();
+
+    for (auto &worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Queue a task
+///////////////////////////////////////////////////////////////////////
+void ThreadPool::Submit(std::function<void()> task)
+{
+    size_t queue = (t_pool == this)
+        ? t_worker
+        : m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+
+    // Counted before the push so a worker popping it never sees the
+    // counters go below zero
+    m_pending.fetch_add(1);
+    m_queued.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(m_queues[queue]->mutex);
+        m_queues[queue]->tasks.push_back(std::move(task));
+    }
+
+    // Taking the sleep mutex orders this with a worker that just checked
+    // m_queued and is about to wait, so the wake-up cannot be lost
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_taskReady.notify_one();
+}
+
+///////////////////////////////////////////////////////////////////////
+// Wait for every submitted task to finish
+///////////////////////////////////////////////////////////////////////
+void ThreadPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(m_sleepMutex);
+    m_idle.wait(lock, [this] { return m_pending.load() == 0; });
+}
+
+///////////////////////////////////////////////////////////////////////
+// Take the newest task of our own deque, else steal the oldest task of
+// another worker
+///////////////////////////////////////////////////////////////////////
+bool ThreadPool::popTask(size_t worker, std::function<void()> &task)
+{
+    {
+        WorkerQueue &own = *m_queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    const size_t count = m_queues.size();
+    for (size_t i = 1; i < count; i++)
+    {
+        WorkerQueue &victim = *m_queues[(worker + i) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            m_steals.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Worker thread
+///////////////////////////////////////////////////////////////////////
+void ThreadPool::workerLoop(size_t worker)
+{
+    t_pool = this;
+    t_worker = worker;
+    TRACE_THREAD_NAME("pool worker");
+
+    for (;;)
+    {
+        std::function<void()> task;
+        if (popTask(worker, task))
+        {
+            m_queued.fetch_sub(1);
+            task();
+            task = nullptr;     // Release captures before reporting done
+
+            if (m_pending.fetch_sub(1) == 1)
+            {
+                std::lock_guard<std::mutex> lock(m_sleepMutex);
+                m_idle.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_taskReady.wait(lock, [this] { return m_stop || m_queued.load() > 0; });
+        if (m_stop && m_queued.load() == 0)
+        {
+            return;     // Stopping and nothing left to do
+        }
+    }
+}
@@ -0,0 +1,218 @@
+// Includes
+#include <algorithm>   // for std::sort
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <unordered_map>
+#include <vector>
+
+#include "trace.h"
+
+std::atomic<bool> Trace::s_enabled(false);
+
+///////////////////////////////////////////////////////////////////////
+// Per-thread event ring
+// NOTE:
+//      Only the owning thread writes. written is published with release
+//      after each event, so WriteJSON() on another thread sees complete
+//      events. Rings are never freed: a thread pool worker may be gone by
+//      the time the trace is written, its events are still wanted.
+///////////////////////////////////////////////////////////////////////
+struct ThreadRing
+{
+    std::vector<TraceEvent> events;
+    std::atomic<uint64_t> written{0};
+    uint32_t tid = 0;
+    std::string name;       // Guarded by the registry mutex
+};
+
+static std::mutex s_registryMutex;
+static std::vector<std::unique_ptr<ThreadRing>> s_rings;
+static size_t s_ringEvents = 32768;
+static thread_local ThreadRing *t_ring = nullptr;
+
+static ThreadRing *thread_ring()
+{
+    if (!t_ring)
+    {
+        std::lock_guard<std::mutex> lock(s_registryMutex);
+        std::unique_ptr<ThreadRing> ring(new ThreadRing());
+        ring->events.resize(s_ringEvents);
+        ring->tid = static_cast<uint32_t>(s_rings.size() + 1);
+        t_ring = ring.get();
+        s_rings.push_back(std::move(ring));
+    }
+    return t_ring;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Runtime switch
+///////////////////////////////////////////////////////////////////////
+void Trace::Enable(bool on)
+{
+    s_enabled.store(on, std::memory_order_relaxed);
+}
+
+bool Trace::Compiled()
+{
+#ifdef WITH_TRACING
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Trace::SetBufferEvents(size_t events)
+{
+    std::lock_guard<std::mutex> lock(s_registryMutex);
+    s_ringEvents = std::max<size_t>(events, 16);
+}
+
+void Trace::SetThreadName(const char *name)
+{
+    ThreadRing *ring = thread_ring();
+    std::lock_guard<std::mutex> lock(s_registryMutex);
+    ring->name = name;
+}
+
+uint64_t Trace::NowNs()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+///////////////////////////////////////////////////////////////////////
+// Append one event to the calling thread's ring
+///////////////////////////////////////////////////////////////////////
+void Trace::Record(const char *name, uint64_t startNs, uint64_t endNs,
+    bool hasFrame, uint64_t frame)
+{
+    ThreadRing *ring = thread_ring();
+    uint64_t index = ring->written.load(std::memory_order_relaxed);
+    TraceEvent &event = ring->events[index % ring->events.size()];
+    event.name = name;
+    event.startNs = startNs;
+    event.durationNs = endNs - startNs;
+    event.frame = frame;
+    event.hasFrame = hasFrame;
+    ring->written.store(index + 1, std::memory_order_release);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Forget all recorded events
+///////////////////////////////////////////////////////////////////////
+void Trace::Clear()
+{
+    std::lock_guard<std::mutex> lock(s_registryMutex);
+    for (auto &ring : s_rings)
+    {
+        ring->written.store(0, std::memory_order_release);
+    }
+}
+
+static void write_json_string(FILE *fp, const char *text)
+{
+    fputc('"', fp);
+    for (const char *p = text; *p; p++)
+    {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c == '"' || c == '\\')
+            fprintf(fp, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(fp, "\\u%04x", c);
+        else
+            fputc(c, fp);
+    }
+    fputc('"', fp);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Write the trace
+// NOTE:
+//      Events of the same frame are chained with flow v2 fields
+//      (bind_id, flow_in, flow_out) in time order: the viewer draws an
+//      arrow from each stage of a frame to the next, across threads.
+///////////////////////////////////////////////////////////////////////
+struct FlatEvent
+{
+    TraceEvent event;
+    uint32_t tid;
+};
+
+bool Trace::WriteJSON(const std::string &path)
+{
+    std::vector<FlatEvent> events;
+    std::vector<std::pair<uint32_t, std::string>> names;
+    {
+        std::lock_guard<std::mutex> lock(s_registryMutex);
+        for (auto &ring : s_rings)
+        {
+            const uint64_t written = ring->written.load(std::memory_order_acquire);
+            const uint64_t capacity = ring->events.size();
+            for (uint64_t i = written > capacity ? written - capacity : 0; i < written; i++)
+            {
+                events.push_back(FlatEvent{ring->events[i % capacity], ring->tid});
+            }
+            if (!ring->name.empty())
+            {
+                names.emplace_back(ring->tid, ring->name);
+            }
+        }
+    }
+
+    std::sort(events.begin(), events.end(), [](const FlatEvent &a, const FlatEvent &b)
+    {
+        return a.event.startNs < b.event.startNs;
+    });
+
+    // First and last event of every frame
+    std::unordered_map<uint64_t, std::pair<size_t, size_t>> flows;
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        if (events[i].event.hasFrame)
+        {
+            auto inserted = flows.emplace(events[i].event.frame, std::make_pair(i, i));
+            inserted.first->second.second = i;
+        }
+    }
+
+    FILE *fp = fopen(path.c_str(), "w");
+    if (!fp)
+    {
+        return false;
+    }
+
+    const uint64_t origin = events.empty() ? 0 : events.front().event.startNs;
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    bool first = true;
+    for (const auto &name : names)
+    {
+        fprintf(fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+            first ? "" : ",", name.first);
+        write_json_string(fp, name.second.c_str());
+        fprintf(fp, "}}");
+        first = false;
+    }
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        const TraceEvent &e = events[i].event;
+        fprintf(fp, "%s\n{\"name\":", first ? "" : ",");
+        write_json_string(fp, e.name);
+        fprintf(fp, ",\"cat\":\"pipeline\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u",
+            static_cast<double>(e.startNs - origin) / 1000.0,
+            static_cast<double>(e.durationNs) / 1000.0, events[i].tid);
+        if (e.hasFrame)
+        {
+            const auto &range = flows[e.frame];
+            fprintf(fp, ",\"args\":{\"frame\":%llu},\"bind_id\":\"0x%llx\"",
+                (unsigned long long)e.frame, (unsigned long long)e.frame);
+            if (i != range.first) fprintf(fp, ",\"flow_in\":true");
+            if (i != range.second) fprintf(fp, ",\"flow_out\":true");
+        }
+        fprintf(fp, "}");
+        first = false;
+    }
+    fprintf(fp, "\n]}\n");
+    return fclose(fp) == 0;
+}
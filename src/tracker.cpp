@@ -0,0 +1,332 @@
+// Includes
+#include <algorithm>   // for std::sort, std::min, std::max
+#include <cmath>       // for std::sqrt, std::pow
+
+#include "postprocess.h"   // for IoU
+#include "tracker.h"
+#include "trace.h"
+
+// Noise as a fraction of the box size, as in DeepSORT: the filter is
+// equally confident about a small far box and a large near one
+static const float kPositionWeight = 1.0f / 20.0f;
+static const float kVelocityWeight = 1.0f / 160.0f;
+
+///////////////////////////////////////////////////////////////////////
+// KalmanAxis
+// NOTE:
+//      State [x, v], F = [[1, 1], [0, 1]], H = [1, 0]. Written out by
+//      hand, the 2x2 covariance update is a handful of multiplies.
+///////////////////////////////////////////////////////////////////////
+void KalmanAxis::Init(float position, float positionVar, float velocityVar)
+{
+    x = position;
+    v = 0.0f;
+    p00 = positionVar;
+    p01 = 0.0f;
+    p11 = velocityVar;
+}
+
+void KalmanAxis::Predict(float positionNoise, float velocityNoise)
+{
+    x += v;
+    p00 += 2.0f * p01 + p11 + positionNoise;
+    p01 += p11;
+    p11 += velocityNoise;
+}
+
+void KalmanAxis::Correct(float measurement, float measurementVar)
+{
+    const float innovation = measurement - x;
+    const float s = p00 + measurementVar;
+    const float k0 = p00 / s;
+    const float k1 = p01 / s;
+
+    x += k0 * innovation;
+    v += k1 * innovation;
+    p11 -= k1 * p01;
+    p00 -= k0 * p00;
+    p01 -= k0 * p01;
+}
+
+// Size that scales the noise of a track
+static float track_scale(float width, float height)
+{
+    return std::max(std::max(width, height), 1.0f);
+}
+
+static void init_track(Track &track, const Detection &det, int32_t id)
+{
+    const float s = track_scale(det.width, det.height);
+    const float posVar = (2.0f * kPositionWeight * s) * (2.0f * kPositionWeight * s);
+    const float velVar = (10.0f * kVelocityWeight * s) * (10.0f * kVelocityWeight * s);
+
+    track.id = id;
+    track.classId = det.classId;
+    track.cx.Init(det.x + det.width * 0.5f, posVar, velVar);
+    track.cy.Init(det.y + det.height * 0.5f, posVar, velVar);
+    track.w.Init(det.width, posVar, velVar);
+    track.h.Init(det.height, posVar, velVar);
+    track.score = det.score;
+    track.hits = 1;
+    track.misses = 0;
+    track.sinceDetection = 0;
+}
+
+static void predict_track(Track &track)
+{
+    const float s = track_scale(track.w.x, track.h.x);
+    const float q = (kPositionWeight * s) * (kPositionWeight * s);
+    const float qv = (kVelocityWeight * s) * (kVelocityWeight * s);
+
+    track.cx.Predict(q, qv);
+    track.cy.Predict(q, qv);
+    track.w.Predict(q, qv);
+    track.h.Predict(q, qv);
+    track.sinceDetection++;
+}
+
+static void correct_track(Track &track, const Detection &det)
+{
+    const float s = track_scale(det.width, det.height);
+    const float r = (kPositionWeight * s) * (kPositionWeight * s);
+
+    track.cx.Correct(det.x + det.width * 0.5f, r);
+    track.cy.Correct(det.y + det.height * 0.5f, r);
+    track.w.Correct(det.width, r);
+    track.h.Correct(det.height, r);
+    track.score = det.score;
+    track.hits++;
+    track.misses = 0;
+    track.sinceDetection = 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Current box estimate of a track
+///////////////////////////////////////////////////////////////////////
+Detection Track::ToDetection(float confidence) const
+{
+    Detection det;
+    det.width = std::max(w.x, 1.0f);
+    det.height = std::max(h.x, 1.0f);
+    det.x = cx.x - det.width * 0.5f;
+    det.y = cy.x - det.height * 0.5f;
+    det.score = confidence;
+    det.classId = classId;
+    det.trackId = id;
+    return det;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Tracker constructor
+///////////////////////////////////////////////////////////////////////
+Tracker::Tracker()
+    : m_nextId(0), m_interval(1), m_sinceDetection(0), m_detected(false)
+{
+}
+
+///////////////////////////////////////////////////////////////////////
+// Drop all tracks, the next frame needs a detection
+///////////////////////////////////////////////////////////////////////
+void Tracker::Reset()
+{
+    m_tracks.clear();
+    m_interval = std::max(minInterval, 1);
+    m_sinceDetection = 0;
+    m_detected = false;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Should the detector run on the next frame
+///////////////////////////////////////////////////////////////////////
+bool Tracker::DetectionDue() const
+{
+    if (!m_detected || m_sinceDetection + 1 >= m_interval)
+    {
+        return true;
+    }
+
+    // A published track whose prediction has lost too much confidence
+    // needs a refresh, whatever the interval says
+    for (const Track &track : m_tracks)
+    {
+        if (track.hits >= minHits && track.misses == 0 &&
+            track.score * std::pow(confidenceDecay, track.sinceDetection + 1) < lowConfidence)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Tracker::predictTracks()
+{
+    for (Track &track : m_tracks)
+    {
+        predict_track(track);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Published boxes: confirmed tracks that matched at the last detection
+///////////////////////////////////////////////////////////////////////
+void Tracker::emit(std::vector<Detection> &tracked) const
+{
+    tracked.clear();
+    for (const Track &track : m_tracks)
+    {
+        if (track.hits >= minHits && track.misses == 0)
+        {
+            float confidence = track.score * std::pow(confidenceDecay, track.sinceDetection);
+            tracked.push_back(track.ToDetection(confidence));
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Pick the next detection interval
+// NOTE:
+//      The interval is how many frames the fastest confirmed track needs
+//      to drift driftBudget of its own size, so the prediction is still
+//      close when the detector next looks. Shrinking is immediate, growth
+//      is one frame per detection, so a burst of motion is not followed
+//      by an immediate jump back to maxInterval.
+///////////////////////////////////////////////////////////////////////
+void Tracker::adaptInterval(int births, int deaths)
+{
+    const int lo = std::max(minInterval, 1);
+    const int hi = std::max(maxInterval, lo);
+
+    float drift = 0.0f;         // Fraction of its size the fastest track moves per frame
+    float confidence = 1.0f;
+    for (const Track &track : m_tracks)
+    {
+        if (track.hits < minHits || track.misses != 0)
+        {
+            continue;
+        }
+        const float size = std::sqrt(std::max(track.w.x, 1.0f) * std::max(track.h.x, 1.0f));
+        const float speed = std::sqrt(track.cx.v * track.cx.v + track.cy.v * track.cy.v) +
+            0.5f * (std::fabs(track.w.v) + std::fabs(track.h.v));
+        drift = std::max(drift, speed / size);
+        confidence = std::min(confidence, track.score);
+    }
+
+    int target = hi;
+    if (drift > 0.0f)
+    {
+        target = static_cast<int>(std::min(driftBudget / drift, static_cast<float>(hi)));
+    }
+    if (confidence < lowConfidence)
+    {
+        target = lo;
+    }
+    if (births > 0 || deaths > 0)
+    {
+        // The scene changed: confirm new tracks quickly
+        target = std::min(target, std::max(lo, m_interval / 2));
+    }
+
+    m_interval = std::max(lo, std::min(target, m_interval + 1));
+}
+
+///////////////////////////////////////////////////////////////////////
+// Detection frame: predict, associate, correct
+///////////////////////////////////////////////////////////////////////
+void Tracker::Update(const std::vector<Detection> &detections, std::vector<Detection> &tracked)
+{
+    TRACE_SCOPE("tracker update");
+    predictTracks();
+
+    // Greedy association on IoU, best pairs first. Frame scenes have tens
+    // of objects at most, where this is as good as the Hungarian method.
+    m_candidates.clear();
+    for (uint32_t t = 0; t < m_tracks.size(); t++)
+    {
+        const Detection predicted = m_tracks[t].ToDetection(0.0f);
+        for (uint32_t d = 0; d < detections.size(); d++)
+        {
+            if (classAware && detections[d].classId != predicted.classId)
+            {
+                continue;
+            }
+            float iou = IoU(predicted, detections[d]);
+            if (iou >= iouThreshold)
+            {
+                m_candidates.push_back(Candidate{iou, t, d});
+            }
+        }
+    }
+    std::sort(m_candidates.begin(), m_candidates.end(),
+        [](const Candidate &a, const Candidate &b)
+        {
+            if (a.iou != b.iou)
+                return a.iou > b.iou;
+            return a.track != b.track ? a.track < b.track : a.detection < b.detection;
+        });
+
+    m_trackMatched.assign(m_tracks.size(), 0);
+    m_detectionMatched.assign(detections.size(), 0);
+    for (const Candidate &c : m_candidates)
+    {
+        if (m_trackMatched[c.track] || m_detectionMatched[c.detection])
+        {
+            continue;
+        }
+        m_trackMatched[c.track] = 1;
+        m_detectionMatched[c.detection] = 1;
+        correct_track(m_tracks[c.track], detections[c.detection]);
+    }
+
+    // Unmatched tracks: tentative ones die at once, confirmed ones after
+    // maxMisses detection rounds
+    int deaths = 0;
+    size_t kept = 0;
+    for (size_t t = 0; t < m_tracks.size(); t++)
+    {
+        Track &track = m_tracks[t];
+        if (!m_trackMatched[t])
+        {
+            track.misses++;
+            if (track.hits < minHits || track.misses > maxMisses)
+            {
+                deaths += track.hits >= minHits;
+                continue;
+            }
+        }
+        if (kept != t)
+        {
+            m_tracks[kept] = track;
+        }
+        kept++;
+    }
+    m_tracks.resize(kept);
+
+    // Unmatched detections start new tracks
+    int births = 0;
+    for (size_t d = 0; d < detections.size(); d++)
+    {
+        if (!m_detectionMatched[d])
+        {
+            Track track;
+            init_track(track, detections[d], m_nextId++);
+            m_tracks.push_back(track);
+            births++;
+        }
+    }
+
+    m_detected = true;
+    m_sinceDetection = 0;
+    adaptInterval(births, deaths);
+    emit(tracked);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Frame without detection: publish the predicted boxes
+///////////////////////////////////////////////////////////////////////
+void Tracker::Predict(std::vector<Detection> &tracked)
+{
+    TRACE_SCOPE("tracker predict");
+    predictTracks();
+    m_sinceDetection++;
+    emit(tracked);
+}
@@ -0,0 +1,513 @@
+// Includes
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "camera.h"
+#include "frame_message_util.h"
+#include "image.h"
+#include "motion_gate.h"
+#include "publisher.h"
+#include "recorder.h"
+#include "shm_transport.h"
+#include "stage_stats.h"
+#include "tcp_transport.h"
+#include "trace.h"
+
+///////////////////////////////////////////////////////////////////////
+// End-to-end streaming benchmark
+//
+// A SyntheticCamera feeds capture -> JPEG encode -> serialize/publish
+// on one thread; an in-process subscriber on another thread parses,
+// decodes and checks sequence numbers. Reports sustained fps, dropped
+// frames, bytes per frame and latency percentiles per stage.
+//
+// --record writes every published frame to an MJPEG recording and
+// --replay publishes a recording instead of synthetic frames (looping
+// it, with fresh sequence numbers and capture times), so captured
+// traffic can be pushed through the pipeline deterministically.
+//
+// With --tcp-port the same topic is also served over TCP, so
+// frame_receiver instances can subscribe to it from other processes.
+// --shm also writes every frame into a shared memory ring, raw RGB for
+// synthetic frames, for zero-copy readers on the same host.
+//
+// --trace writes a Chrome trace-event JSON of every stage, with the
+// stages of each frame linked, to find which stage stalled a frame.
+//
+// Exits with a non-zero status when --min-fps or --max-drop-pct are
+// violated, so it can gate merges on a headless box.
+///////////////////////////////////////////////////////////////////////
+
+struct BenchOptions
+{
+    int width = 1280;
+    int height = 720;
+    double fps = 30.0;          // 0 = unpaced, as fast as possible
+    double seconds = 5.0;
+    int quality = 80;
+    int depth = 4;              // Subscriber queue depth
+    int noise = 16;
+    double minFps = 0.0;        // Gate, 0 = disabled
+    double maxDropPct = 100.0;  // Gate
+    std::string jsonPath;
+    int tcpPort = -1;           // Also serve the stream over TCP, -1 = off
+    std::string recordPrefix;   // Record published frames
+    std::string replayPath;     // Publish a recording instead of synthetic frames
+    int motionMaxSkip = -1;     // Run the motion gate with this maxSkip, -1 = off
+    std::string shmName;        // Also publish into this shared memory ring
+    std::string tracePath;      // Write a trace of the run
+};
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --width N          frame width (1280)\n"
+        "  --height N         frame height (720)\n"
+        "  --fps F            source frame rate, 0 = unpaced (30)\n"
+        "  --seconds S        run time (5)\n"
+        "  --quality Q        JPEG quality (80)\n"
+        "  --depth N          subscriber queue depth (4)\n"
+        "  --noise N          synthetic noise amplitude (16)\n"
+        "  --json PATH        write results as JSON\n"
+        "  --tcp-port P       also serve topic synthetic/0 over TCP on port P\n"
+        "  --record PREFIX    record published frames to PREFIX-NNNNNN.mjr\n"
+        "  --replay PREFIX    publish a recording instead of synthetic frames\n"
+        "  --motion-gate N    run the inference motion gate on captured frames,\n"
+        "                     forcing a frame through after N skips (off)\n"
+        "  --shm NAME         also publish frames into shared memory ring NAME\n"
+        "  --trace PATH       write a Chrome/Perfetto trace of the run\n"
+        "  --min-fps F        fail if the received fps is below F\n"
+        "  --max-drop-pct P   fail if more than P%% of frames are dropped\n",
+        argv0);
+}
+
+static bool parse_options(int argc, char **argv, BenchOptions &opt)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (!strcmp(arg, "--help") || !strcmp(arg, "-h"))
+        {
+            return false;
+        }
+        if (!value)
+        {
+            fprintf(stderr, "Missing value for %s\n", arg);
+            return false;
+        }
+
+        if (!strcmp(arg, "--width")) opt.width = atoi(value);
+        else if (!strcmp(arg, "--height")) opt.height = atoi(value);
+        else if (!strcmp(arg, "--fps")) opt.fps = atof(value);
+        else if (!strcmp(arg, "--seconds")) opt.seconds = atof(value);
+        else if (!strcmp(arg, "--quality")) opt.quality = atoi(value);
+        else if (!strcmp(arg, "--depth")) opt.depth = atoi(value);
+        else if (!strcmp(arg, "--noise")) opt.noise = atoi(value);
+        else if (!strcmp(arg, "--json")) opt.jsonPath = value;
+        else if (!strcmp(arg, "--tcp-port")) opt.tcpPort = atoi(value);
+        else if (!strcmp(arg, "--record")) opt.recordPrefix = value;
+        else if (!strcmp(arg, "--replay")) opt.replayPath = value;
+        else if (!strcmp(arg, "--motion-gate")) opt.motionMaxSkip = atoi(value);
+        else if (!strcmp(arg, "--shm")) opt.shmName = value;
+        else if (!strcmp(arg, "--trace")) opt.tracePath = value;
+        else if (!strcmp(arg, "--min-fps")) opt.minFps = atof(value);
+        else if (!strcmp(arg, "--max-drop-pct")) opt.maxDropPct = atof(value);
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            return false;
+        }
+        i++;
+    }
+
+    if (opt.width <= 0 || opt.height <= 0 || opt.seconds <= 0.0 || opt.depth <= 0)
+    {
+        fprintf(stderr, "Invalid size, duration or depth\n");
+        return false;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Subscriber side results
+///////////////////////////////////////////////////////////////////////
+struct ReceiveResults
+{
+    StageStats transit{"transit"};      // Capture -> received (encode + publish + queue)
+    StageStats parse{"parse"};
+    StageStats decode{"decode"};
+    StageStats endToEnd{"end_to_end"};  // Capture -> decoded pixels
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t gaps = 0;                  // Frames missing from the sequence
+    uint64_t reordered = 0;             // Frames arriving with an old sequence
+    uint64_t decodeErrors = 0;
+    uint64_t sizeErrors = 0;
+    uint64_t firstUs = 0;
+    uint64_t lastUs = 0;
+};
+
+static void receive_loop(FrameBus::Subscription &sub, ReceiveResults &res)
+{
+    FrameBus::Buffer buffer;
+    FrameMessage frame;
+    Image decoded;
+    bool haveLast = false;
+    uint64_t lastSeq = 0;
+    TRACE_THREAD_NAME("subscriber");
+
+    while (sub.Receive(buffer))
+    {
+        uint64_t t0 = NowMicros();
+        if (!ParseFrame(buffer->data(), buffer->size(), frame))
+        {
+            res.decodeErrors++;
+            continue;
+        }
+        uint64_t t1 = NowMicros();
+        bool ok;
+        {
+            TRACE_SCOPE_FRAME("subscriber decode", frame.sequence);
+            ok = decoded.DecodeJPEG(frame.payload.data(), frame.payload.size());
+        }
+        uint64_t t2 = NowMicros();
+
+        if (!ok)
+        {
+            res.decodeErrors++;
+            continue;
+        }
+        if (decoded.GetWidth() != static_cast<int>(frame.width) ||
+            decoded.GetHeight() != static_cast<int>(frame.height))
+        {
+            res.sizeErrors++;
+        }
+
+        // Sequence check
+        if (haveLast)
+        {
+            if (frame.sequence > lastSeq + 1)
+                res.gaps += frame.sequence - lastSeq - 1;
+            else if (frame.sequence <= lastSeq)
+                res.reordered++;
+        }
+        if (!haveLast || frame.sequence > lastSeq)
+        {
+            lastSeq = frame.sequence;
+        }
+        haveLast = true;
+
+        res.transit.Add(static_cast<double>(t0 - frame.timestampUs));
+        res.parse.Add(static_cast<double>(t1 - t0));
+        res.decode.Add(static_cast<double>(t2 - t1));
+        res.endToEnd.Add(static_cast<double>(t2 - frame.timestampUs));
+        res.bytes += buffer->size();
+        if (res.frames++ == 0)
+        {
+            res.firstUs = t2;
+        }
+        res.lastUs = t2;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    BenchOptions opt;
+    if (!parse_options(argc, argv, opt))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    FrameBus bus;
+    const std::string topic = "synthetic/0";
+    auto subscription = bus.Subscribe(topic, static_cast<size_t>(opt.depth));
+    Publisher publisher(bus, topic);
+    SyntheticCamera camera(opt.width, opt.height, opt.fps, opt.noise);
+
+    TcpFrameServer server(bus, static_cast<size_t>(opt.depth));
+    if (opt.tcpPort >= 0)
+    {
+        if (!server.Start(static_cast<uint16_t>(opt.tcpPort)))
+        {
+            return 1;
+        }
+        printf("serving %s on tcp port %u\n", topic.c_str(), server.Port());
+    }
+
+    Player player;
+    const bool replay = !opt.replayPath.empty();
+    if (replay && (!player.Open(opt.replayPath) || player.FrameCount() == 0))
+    {
+        fprintf(stderr, "can't replay %s\n", opt.replayPath.c_str());
+        return 1;
+    }
+    RecordedFrame first;
+    if (replay && player.GetFrame(0, first))
+    {
+        opt.width = static_cast<int>(first.width);   // Report the recorded size
+        opt.height = static_cast<int>(first.height);
+    }
+
+    Recorder recorder;
+    const bool recording = !opt.recordPrefix.empty();
+    if (recording && !recorder.Open(opt.recordPrefix))
+    {
+        return 1;
+    }
+
+    // Raw frames for the synthetic source, the recording's JPEGs otherwise
+    ShmFrameWriter shmWriter;
+    const bool sharing = !opt.shmName.empty();
+    if (sharing)
+    {
+        size_t slotBytes = replay ? (8u << 20) : static_cast<size_t>(opt.width) * opt.height * 3;
+        if (!shmWriter.Create(opt.shmName, 8, slotBytes, topic))
+        {
+            fprintf(stderr, "can't create shared memory ring %s\n", opt.shmName.c_str());
+            return 1;
+        }
+        printf("sharing %s in shared memory ring %s\n", topic.c_str(), opt.shmName.c_str());
+    }
+
+    const bool tracing = !opt.tracePath.empty();
+    if (tracing)
+    {
+        if (!Trace::Compiled())
+        {
+            fprintf(stderr, "warning: built with TRACING=OFF, the trace will be empty\n");
+        }
+        TRACE_THREAD_NAME("producer");
+        Trace::Enable(true);
+    }
+
+    ReceiveResults received;
+    std::thread receiver(receive_loop, std::ref(*subscription), std::ref(received));
+
+    // Producer side
+    StageStats capture("capture");
+    StageStats encode("encode");
+    StageStats publish("publish");
+    StageStats record("record");
+    StageStats motion("motion");
+    StageStats shm("shm");
+    uint64_t shmErrors = 0;
+    MotionGate gate;
+    MotionResult motionResult;
+    gate.maxSkip = opt.motionMaxSkip;
+    Image image;
+    FrameMessage frame;
+    frame.streamId = topic;
+    frame.encoding = FrameEncoding::JPEG;
+    frame.width = static_cast<uint32_t>(opt.width);
+    frame.height = static_cast<uint32_t>(opt.height);
+
+    const uint64_t start = NowMicros();
+    const uint64_t end = start + static_cast<uint64_t>(opt.seconds * 1e6);
+    uint64_t sequence = 0;
+    uint64_t encodeErrors = 0;
+    uint64_t recordErrors = 0;
+    size_t replayIndex = 0;
+    auto nextFrame = std::chrono::steady_clock::now();
+
+    while (NowMicros() < end)
+    {
+        uint64_t t1, t2;
+        if (replay)
+        {
+            // Pace like the camera would; the recording is already JPEG
+            if (opt.fps > 0.0)
+            {
+                std::this_thread::sleep_until(nextFrame);
+                nextFrame += std::chrono::microseconds(static_cast<int64_t>(1e6 / opt.fps));
+            }
+            uint64_t t0 = NowMicros();
+            player.ToMessage(replayIndex++ % player.FrameCount(), frame);
+            frame.timestampUs = t0;
+            t1 = t2 = NowMicros();
+        }
+        else
+        {
+            camera.Capture(image, frame.timestampUs);
+            t1 = NowMicros();
+            bool encoded;
+            {
+                TRACE_SCOPE_FRAME("encode", sequence + 1);
+                encoded = image.EncodeJPEG(frame.payload, opt.quality);
+            }
+            if (!encoded)
+            {
+                encodeErrors++;
+                continue;
+            }
+            t2 = NowMicros();
+
+            // The stream itself is not gated, only what would go to inference
+            if (opt.motionMaxSkip >= 0)
+            {
+                gate.Process(image, motionResult);
+                motion.Add(static_cast<double>(NowMicros() - t2));
+            }
+        }
+        frame.sequence = ++sequence;
+        const uint64_t publishStart = NowMicros();
+        publisher.Publish(frame);
+        uint64_t t3 = NowMicros();
+
+        // Capture time excludes waiting for the frame to be due
+        capture.Add(static_cast<double>(t1 - frame.timestampUs));
+        if (!replay) encode.Add(static_cast<double>(t2 - t1));
+        publish.Add(static_cast<double>(t3 - publishStart));
+
+        if (recording)
+        {
+            if (!recorder.Write(frame)) recordErrors++;
+            record.Add(static_cast<double>(NowMicros() - t3));
+        }
+
+        if (sharing)
+        {
+            uint64_t t4 = NowMicros();
+            bool ok = replay ? shmWriter.Publish(frame) : shmWriter.Publish(frame, image);
+            if (!ok) shmErrors++;
+            shm.Add(static_cast<double>(NowMicros() - t4));
+        }
+    }
+    const uint64_t producerEnd = NowMicros();
+    if (recording && !recorder.Close())
+    {
+        recordErrors++;
+    }
+
+    subscription->Close();      // Drains whatever is still queued, then stops
+    receiver.join();
+    server.Stop();
+
+    if (tracing)
+    {
+        Trace::Enable(false);
+        if (!Trace::WriteJSON(opt.tracePath))
+        {
+            fprintf(stderr, "can't write %s\n", opt.tracePath.c_str());
+            return 1;
+        }
+        printf("trace written to %s\n", opt.tracePath.c_str());
+    }
+
+    // Results
+    const uint64_t sent = publisher.Published();
+    const uint64_t busDrops = subscription->Dropped();
+    const uint64_t lost = (sent > received.frames) ? sent - received.frames : 0;
+    const double elapsed = static_cast<double>(producerEnd - start) / 1e6;
+    const double window = (received.frames > 1)
+        ? static_cast<double>(received.lastUs - received.firstUs) / 1e6 : elapsed;
+    const double sendFps = static_cast<double>(sent) / elapsed;
+    const double recvFps = (received.frames > 1 && window > 0.0)
+        ? static_cast<double>(received.frames - 1) / window : 0.0;
+    const double dropPct = sent ? 100.0 * static_cast<double>(lost) / static_cast<double>(sent) : 0.0;
+    const double bytesPerFrame = received.frames
+        ? static_cast<double>(received.bytes) / static_cast<double>(received.frames) : 0.0;
+
+    if (replay)
+    {
+        printf("replaying %s: %zu frames in %zu segments\n", opt.replayPath.c_str(),
+            player.FrameCount(), player.SegmentCount());
+    }
+    if (recording)
+    {
+        printf("recorded %llu frames, %llu bytes in %llu segments (%llu errors)\n",
+            (unsigned long long)recorder.FramesWritten(),
+            (unsigned long long)recorder.BytesWritten(),
+            (unsigned long long)recorder.Segments(), (unsigned long long)recordErrors);
+    }
+    if (sharing)
+    {
+        printf("shared %llu frames in %s (%llu errors)\n",
+            (unsigned long long)shmWriter.Published(), opt.shmName.c_str(),
+            (unsigned long long)shmErrors);
+    }
+    printf("stream_bench %dx%d target %.1f fps, quality %d, depth %d, %.1f s\n",
+        opt.width, opt.height, opt.fps, opt.quality, opt.depth, elapsed);
+    printf("  sent %llu frames (%.1f fps), received %llu (%.1f fps)\n",
+        (unsigned long long)sent, sendFps, (unsigned long long)received.frames, recvFps);
+    printf("  dropped %llu (%.2f%%): queue %llu, sequence gaps %llu, reordered %llu\n",
+        (unsigned long long)lost, dropPct, (unsigned long long)busDrops,
+        (unsigned long long)received.gaps, (unsigned long long)received.reordered);
+    printf("  errors: encode %llu, decode %llu, size %llu\n",
+        (unsigned long long)encodeErrors, (unsigned long long)received.decodeErrors,
+        (unsigned long long)received.sizeErrors);
+    printf("  bytes/frame %.0f (%.2f MB/s)\n", bytesPerFrame,
+        bytesPerFrame * recvFps / 1e6);
+    if (gate.Frames())
+    {
+        printf("  motion gate: %llu of %llu frames to inference (%.1f%%), thumbnail %dx%d\n",
+            (unsigned long long)gate.Forwarded(), (unsigned long long)gate.Frames(),
+            100.0 * static_cast<double>(gate.Forwarded()) / static_cast<double>(gate.Frames()),
+            gate.ThumbnailWidth(), gate.ThumbnailHeight());
+    }
+
+    std::vector<const StageStats *> stages = {&capture, &encode, &motion, &publish, &record, &shm,
+        &received.transit, &received.parse, &received.decode, &received.endToEnd};
+    for (const StageStats *stage : stages)
+    {
+        if (stage->Count())
+        {
+            printf("  %s\n", stage->Summary().c_str());
+        }
+    }
+
+    if (!opt.jsonPath.empty())
+    {
+        FILE *fp = fopen(opt.jsonPath.c_str(), "w");
+        if (!fp)
+        {
+            fprintf(stderr, "can't open %s\n", opt.jsonPath.c_str());
+            return 1;
+        }
+        fprintf(fp, "{\"width\":%d,\"height\":%d,\"target_fps\":%.2f,\"quality\":%d,"
+            "\"depth\":%d,\"seconds\":%.3f,\"sent\":%llu,\"received\":%llu,"
+            "\"send_fps\":%.2f,\"recv_fps\":%.2f,\"dropped\":%llu,\"drop_pct\":%.3f,"
+            "\"sequence_gaps\":%llu,\"reordered\":%llu,\"bytes_per_frame\":%.1f,"
+            "\"stages\":[",
+            opt.width, opt.height, opt.fps, opt.quality, opt.depth, elapsed,
+            (unsigned long long)sent, (unsigned long long)received.frames,
+            sendFps, recvFps, (unsigned long long)lost, dropPct,
+            (unsigned long long)received.gaps, (unsigned long long)received.reordered,
+            bytesPerFrame);
+        for (size_t i = 0; i < stages.size(); i++)
+        {
+            fprintf(fp, "%s%s", i ? "," : "", stages[i]->ToJSON().c_str());
+        }
+        fprintf(fp, "]}\n");
+        fclose(fp);
+    }
+
+    // Gates
+    int status = 0;
+    if (encodeErrors || recordErrors || shmErrors || received.decodeErrors || received.sizeErrors ||
+        received.reordered)
+    {
+        fprintf(stderr, "FAIL: codec or ordering errors\n");
+        status = 1;
+    }
+    if (opt.minFps > 0.0 && recvFps < opt.minFps)
+    {
+        fprintf(stderr, "FAIL: received %.1f fps < %.1f\n", recvFps, opt.minFps);
+        status = 1;
+    }
+    if (dropPct > opt.maxDropPct)
+    {
+        fprintf(stderr, "FAIL: dropped %.2f%% > %.2f%%\n", dropPct, opt.maxDropPct);
+        status = 1;
+    }
+    return status;
+}
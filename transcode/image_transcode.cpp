@@ -0,0 +1,368 @@
+// Includes
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>     // for strcasecmp
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "image.h"
+#include "image_proc.h"
+#include "stage_stats.h"
+#include "thread_pool.h"
+
+///////////////////////////////////////////////////////////////////////
+// Parallel batch transcoder
+//
+// Converts every JPEG/PNG/QOI file under --input into --output, keeping
+// the directory layout, optionally resizing, on a work-stealing thread
+// pool. Files are decoded by content, so misnamed files are handled.
+// Prints files/s, input/output MB/s and per-file latency at the end.
+///////////////////////////////////////////////////////////////////////
+
+namespace fs = std::filesystem;
+
+struct TranscodeOptions
+{
+    std::string input;
+    std::string output;
+    ImageFormat format = ImageFormat::JPEG;
+    bool keepFormat = false;    // --format same
+    int quality = 90;
+    int width = 0;              // 0 = keep aspect from the other side
+    int height = 0;
+    int threads = 0;            // 0 = all cores
+    bool recursive = true;
+    bool overwrite = true;
+};
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+        "Usage: %s --input DIR --output DIR [options]\n"
+        "  --format F         jpeg, png, qoi or same (jpeg)\n"
+        "  --quality Q        JPEG quality (90)\n"
+        "  --width W          output width, 0 = from height keeping aspect (0)\n"
+        "  --height H         output height, 0 = from width keeping aspect (0)\n"
+        "  --threads N        worker threads, 0 = all cores (0)\n"
+        "  --no-recursive     only the top level of --input\n"
+        "  --skip-existing    leave outputs that already exist alone\n",
+        argv0);
+}
+
+static bool parse_format(const char *text, TranscodeOptions &opt)
+{
+    if (!strcasecmp(text, "same"))
+    {
+        opt.keepFormat = true;
+        return true;
+    }
+    // Reuse the registry's extension table
+    opt.format = Image::FormatFromPath(std::string(".") + text);
+    return opt.format != ImageFormat::Unknown;
+}
+
+static bool parse_options(int argc, char **argv, TranscodeOptions &opt)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+
+        if (!strcmp(arg, "--help") || !strcmp(arg, "-h"))
+        {
+            return false;
+        }
+        if (!strcmp(arg, "--no-recursive"))
+        {
+            opt.recursive = false;
+            continue;
+        }
+        if (!strcmp(arg, "--skip-existing"))
+        {
+            opt.overwrite = false;
+            continue;
+        }
+
+        const char *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (!value)
+        {
+            fprintf(stderr, "Missing value for %s\n", arg);
+            return false;
+        }
+
+        if (!strcmp(arg, "--input")) opt.input = value;
+        else if (!strcmp(arg, "--output")) opt.output = value;
+        else if (!strcmp(arg, "--format"))
+        {
+            if (!parse_format(value, opt))
+            {
+                fprintf(stderr, "Unknown format %s\n", value);
+                return false;
+            }
+        }
+        else if (!strcmp(arg, "--quality")) opt.quality = atoi(value);
+        else if (!strcmp(arg, "--width")) opt.width = atoi(value);
+        else if (!strcmp(arg, "--height")) opt.height = atoi(value);
+        else if (!strcmp(arg, "--threads")) opt.threads = atoi(value);
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            return false;
+        }
+        i++;
+    }
+
+    return !opt.input.empty() && !opt.output.empty() && opt.quality > 0 &&
+        opt.quality <= 100 && opt.width >= 0 && opt.height >= 0 && opt.threads >= 0;
+}
+
+// Output size for a source image, keeping the aspect ratio when only one
+// side is given
+static void target_size(const TranscodeOptions &opt, int srcWidth, int srcHeight,
+    int &width, int &height)
+{
+    width = opt.width;
+    height = opt.height;
+    if (width == 0 && height == 0)
+    {
+        width = srcWidth;
+        height = srcHeight;
+    }
+    else if (width == 0)
+    {
+        width = std::max(1, static_cast<int>(static_cast<int64_t>(srcWidth) * height / srcHeight));
+    }
+    else if (height == 0)
+    {
+        height = std::max(1, static_cast<int>(static_cast<int64_t>(srcHeight) * width / srcWidth));
+    }
+}
+
+static bool read_file(const fs::path &path, std::vector<uint8_t> &bytes)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp)
+    {
+        return false;
+    }
+    bool ok = fseek(fp, 0, SEEK_END) == 0;
+    long size = ok ? ftell(fp) : -1;
+    ok = size >= 0 && fseek(fp, 0, SEEK_SET) == 0;
+    if (ok)
+    {
+        bytes.resize(static_cast<size_t>(size));
+        ok = fread(bytes.data(), 1, bytes.size(), fp) == bytes.size();
+    }
+    fclose(fp);
+    return ok;
+}
+
+static bool write_file(const fs::path &path, const std::vector<uint8_t> &bytes)
+{
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (!fp)
+    {
+        return false;
+    }
+    bool ok = fwrite(bytes.data(), 1, bytes.size(), fp) == bytes.size();
+    return (fclose(fp) == 0) && ok;
+}
+
+// Lower case extension for a format
+static const char *format_extension(ImageFormat format)
+{
+    switch (format)
+    {
+        case ImageFormat::PNG:  return ".png";
+        case ImageFormat::JPEG: return ".jpg";
+        case ImageFormat::QOI:  return ".qoi";
+        default:                return "";
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Per-thread scratch, so steady state transcoding reuses its buffers
+///////////////////////////////////////////////////////////////////////
+struct Scratch
+{
+    std::vector<uint8_t> input;
+    std::vector<uint8_t> output;
+    Image decoded;
+    Image resized;
+};
+
+struct Totals
+{
+    std::atomic<uint64_t> files{0};
+    std::atomic<uint64_t> failed{0};
+    std::atomic<uint64_t> skipped{0};
+    std::atomic<uint64_t> bytesIn{0};
+    std::atomic<uint64_t> bytesOut{0};
+    std::atomic<uint64_t> pixels{0};
+
+    std::mutex latencyMutex;
+    StageStats latency{"transcode", 4096};
+};
+
+static void transcode_file(const TranscodeOptions &opt, const fs::path &source,
+    const fs::path &target, Totals &totals)
+{
+    static thread_local Scratch scratch;
+    const uint64_t start = NowMicros();
+
+    if (!opt.overwrite && fs::exists(target))
+    {
+        totals.skipped++;
+        return;
+    }
+
+    if (!read_file(source, scratch.input))
+    {
+        fprintf(stderr, "%s: can't read\n", source.c_str());
+        totals.failed++;
+        return;
+    }
+
+    const ImageFormat sourceFormat = Image::DetectFormat(scratch.input.data(), scratch.input.size());
+    if (!scratch.decoded.Decode(scratch.input.data(), scratch.input.size()))
+    {
+        fprintf(stderr, "%s: %s\n", source.c_str(), Image::LastError());
+        totals.failed++;
+        return;
+    }
+
+    int width, height;
+    target_size(opt, scratch.decoded.GetWidth(), scratch.decoded.GetHeight(), width, height);
+    const Image *image = &scratch.decoded;
+    if (width != scratch.decoded.GetWidth() || height != scratch.decoded.GetHeight())
+    {
+        if (!ResizeImage(scratch.decoded, scratch.resized, width, height))
+        {
+            fprintf(stderr, "%s: resize to %dx%d failed\n", source.c_str(), width, height);
+            totals.failed++;
+            return;
+        }
+        image = &scratch.resized;
+    }
+
+    const ImageFormat format = opt.keepFormat ? sourceFormat : opt.format;
+    if (!image->Encode(scratch.output, format, opt.quality) || !write_file(target, scratch.output))
+    {
+        fprintf(stderr, "%s: %s\n", target.c_str(), Image::LastError());
+        totals.failed++;
+        return;
+    }
+
+    totals.files++;
+    totals.bytesIn += scratch.input.size();
+    totals.bytesOut += scratch.output.size();
+    totals.pixels += static_cast<uint64_t>(scratch.decoded.GetWidth()) * scratch.decoded.GetHeight();
+
+    std::lock_guard<std::mutex> lock(totals.latencyMutex);
+    totals.latency.Add(static_cast<double>(NowMicros() - start));
+}
+
+int main(int argc, char **argv)
+{
+    TranscodeOptions opt;
+    if (!parse_options(argc, argv, opt))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // Collect the work list and create the output tree up front, so the
+    // workers never race on directory creation
+    std::error_code error;
+    std::vector<std::pair<fs::path, fs::path>> jobs;
+    const fs::path inputRoot(opt.input);
+    const fs::path outputRoot(opt.output);
+
+    auto addFile = [&](const fs::directory_entry &entry)
+    {
+        if (!entry.is_regular_file() || Image::FormatFromPath(entry.path().string()) == ImageFormat::Unknown)
+        {
+            return;
+        }
+        fs::path target = outputRoot / fs::relative(entry.path(), inputRoot);
+        if (!opt.keepFormat)
+        {
+            target.replace_extension(format_extension(opt.format));
+        }
+        fs::create_directories(target.parent_path(), error);
+        jobs.emplace_back(entry.path(), target);
+    };
+
+    if (opt.recursive)
+    {
+        for (const auto &entry : fs::recursive_directory_iterator(inputRoot, error))
+            addFile(entry);
+    }
+    else
+    {
+        for (const auto &entry : fs::directory_iterator(inputRoot, error))
+            addFile(entry);
+    }
+    if (error)
+    {
+        fprintf(stderr, "%s: %s\n", opt.input.c_str(), error.message().c_str());
+        return 1;
+    }
+
+    // Largest files first: with stealing, the long jobs start early and
+    // the small ones fill the gaps at the end
+    std::vector<uintmax_t> sizes(jobs.size());
+    std::vector<size_t> order(jobs.size());
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        sizes[i] = fs::file_size(jobs[i].first, error);
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+    Totals totals;
+    const auto start = std::chrono::steady_clock::now();
+    size_t threads;
+    uint64_t steals;
+    {
+        ThreadPool pool(static_cast<size_t>(opt.threads));
+        threads = pool.Size();
+        for (size_t i : order)
+        {
+            pool.Submit([&opt, &jobs, &totals, i]
+            {
+                transcode_file(opt, jobs[i].first, jobs[i].second, totals);
+            });
+        }
+        pool.Wait();
+        steals = pool.Steals();
+    }
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    const double mb = 1024.0 * 1024.0;
+    printf("transcoded %llu files (%llu failed, %llu skipped) in %.2fs on %zu threads, %llu steals\n",
+        (unsigned long long)totals.files.load(), (unsigned long long)totals.failed.load(),
+        (unsigned long long)totals.skipped.load(), seconds, threads,
+        (unsigned long long)steals);
+    if (seconds > 0.0)
+    {
+        printf("  %.1f files/s  in %.1f MB/s  out %.1f MB/s  %.1f Mpix/s\n",
+            totals.files / seconds, totals.bytesIn / mb / seconds,
+            totals.bytesOut / mb / seconds, totals.pixels / 1e6 / seconds);
+    }
+    if (totals.latency.Count() > 0)
+    {
+        printf("  %s\n", totals.latency.Summary().c_str());
+    }
+
+    return totals.failed ? 1 : 0;
+}